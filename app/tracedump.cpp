@@ -0,0 +1,156 @@
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <udt.h>
+
+using namespace std;
+
+const char* eventName(int type)
+{
+   switch (type)
+   {
+   case UDT_TRACE_DATA_SENT:
+      return "DATA_SENT";
+   case UDT_TRACE_DATA_RECV:
+      return "DATA_RECV";
+   case UDT_TRACE_ACK_RECV:
+      return "ACK_RECV";
+   case UDT_TRACE_ACK2_RECV:
+      return "ACK2_RECV";
+   case UDT_TRACE_NAK_RECV:
+      return "NAK_RECV";
+   case UDT_TRACE_RATE:
+      return "RATE";
+   default:
+      return "UNKNOWN";
+   }
+}
+
+void printRecord(const UDT::TRACERECORD& r)
+{
+   cout << setw(12) << r.usTimeStamp << " " << setw(10) << left << eventName(r.iType) << right;
+
+   switch (r.iType)
+   {
+   case UDT_TRACE_DATA_SENT:
+   case UDT_TRACE_DATA_RECV:
+      // strip the message boundary and order bits
+      cout << " seq=" << r.iSeqNo << " len=" << r.iValue1 << " msg=" << (r.iValue2 & 0x1FFFFFFF);
+      if (0 != r.iFlags)
+         cout << ((UDT_TRACE_DATA_SENT == r.iType) ? " retrans" : " gapfill");
+      break;
+
+   case UDT_TRACE_ACK_RECV:
+      cout << " ack=" << r.iSeqNo << " rtt_us=" << r.iValue1 << " ackno=" << r.iValue2;
+      break;
+
+   case UDT_TRACE_ACK2_RECV:
+      cout << " ack=" << r.iSeqNo << " rtt_us=" << r.iValue1 << " ackno=" << r.iValue2;
+      break;
+
+   case UDT_TRACE_NAK_RECV:
+      cout << " first=" << r.iSeqNo << " lost=" << r.iValue1;
+      break;
+
+   case UDT_TRACE_RATE:
+      cout << " seq=" << r.iSeqNo << " period_us=" << r.iValue1 / 1000.0 << " cwnd=" << r.iValue2;
+      break;
+
+   default:
+      cout << " type=" << int(r.iType) << " seq=" << r.iSeqNo << " v1=" << r.iValue1 << " v2=" << r.iValue2;
+      break;
+   }
+
+   cout << endl;
+}
+
+int main(int argc, char* argv[])
+{
+   bool summary = (argc == 3) && (0 == strcmp(argv[1], "-s"));
+   if ((argc != 2) && !summary)
+   {
+      cout << "usage: tracedump [-s] trace_file" << endl;
+      cout << "   decode a packet trace written by UDT::dumptrace(); -s prints a summary only" << endl;
+      return -1;
+   }
+
+   ifstream ifs(argv[argc - 1], ios::in | ios::binary);
+   if (ifs.fail())
+   {
+      cout << "cannot open " << argv[argc - 1] << endl;
+      return -1;
+   }
+
+   UDT::TRACEHEADER header;
+   ifs.read((char*)&header, sizeof(header));
+   if (ifs.fail() || (0 != memcmp(header.acMagic, "UDTTRACE", 8)))
+   {
+      cout << "not a UDT packet trace" << endl;
+      return -1;
+   }
+   if ((1 != header.iVersion) || (sizeof(UDT::TRACERECORD) != (size_t)header.iRecordSize))
+   {
+      cout << "unsupported trace version " << header.iVersion << " or record size " << header.iRecordSize << " (written on a different platform?)" << endl;
+      return -1;
+   }
+
+   cout << "# socket " << header.iSocketID << " peer " << header.iPeerID << ", started at " << header.usStartTime << " us, "
+        << header.llRecords << " records, " << header.llOverwritten << " overwritten" << endl;
+
+   int64_t count[UDT_TRACE_RATE + 1] = {};
+   int64_t sentbytes = 0, retrans = 0, recvbytes = 0, gapfill = 0, nakloss = 0;
+   uint64_t first = 0, last = 0;
+
+   UDT::TRACERECORD r;
+   for (int64_t i = 0; i < header.llRecords; ++ i)
+   {
+      ifs.read((char*)&r, sizeof(r));
+      if (ifs.fail())
+      {
+         cout << "# truncated after " << i << " records" << endl;
+         break;
+      }
+
+      if (0 == i)
+         first = r.usTimeStamp;
+      last = r.usTimeStamp;
+
+      if (r.iType <= UDT_TRACE_RATE)
+         ++ count[r.iType];
+      if (UDT_TRACE_DATA_SENT == r.iType)
+      {
+         sentbytes += r.iValue1;
+         retrans += r.iFlags;
+      }
+      else if (UDT_TRACE_DATA_RECV == r.iType)
+      {
+         recvbytes += r.iValue1;
+         gapfill += r.iFlags;
+      }
+      else if (UDT_TRACE_NAK_RECV == r.iType)
+         nakloss += r.iValue1;
+
+      if (!summary)
+         printRecord(r);
+   }
+
+   if (summary)
+   {
+      double sec = (last - first) / 1000000.0;
+      cout << "duration_s    " << sec << endl;
+      for (int t = UDT_TRACE_DATA_SENT; t <= UDT_TRACE_RATE; ++ t)
+         cout << setw(14) << left << eventName(t) << right << count[t] << endl;
+      cout << "retransmitted " << retrans << endl;
+      cout << "gap_filled    " << gapfill << endl;
+      cout << "nak_lost      " << nakloss << endl;
+      if (sec > 0)
+      {
+         cout << "send_mbps     " << sentbytes * 8.0 / sec / 1000000.0 << endl;
+         cout << "recv_mbps     " << recvbytes * 8.0 / sec / 1000000.0 << endl;
+      }
+   }
+
+   return 0;
+}
@@ -0,0 +1,643 @@
+#ifndef WIN32
+   #include <sys/time.h>
+   #include <sys/resource.h>
+   #include <time.h>
+   #include <signal.h>
+   #include <cstdlib>
+   #include <cstring>
+   #include <cstdio>
+   #include <unistd.h>
+#else
+   #include <psapi.h>
+#endif
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <udt.h>
+#include "../app/cc.h"
+#include "bench.h"
+
+using namespace std;
+
+struct CScenarioEntry
+{
+   const char* m_pcName;
+   BenchScenario m_pFunc;
+   const char* m_pcDesc;
+};
+
+static const CScenarioEntry g_Scenarios[] =
+{
+   {"bulk", scenarioBulk, "single-stream bulk throughput (send/recv)"},
+   {"streams", scenarioStreams, "aggregate throughput of parallel streams"},
+   {"repeat", scenarioRepeat, "short transfers to one peer over new connections, warm started from cached history"},
+   {"rtt", scenarioRTT, "small-message round trip time (sendmsg/recvmsg)"},
+   {"msgread", scenarioMsgRead, "out-of-order message delivery rate and receiver CPU per message under loss (sendmsg/recvmsg)"},
+   {"msgrate", scenarioMsgRate, "small-message rate with --batch messages per sendmsg_batch/recvmsg_batch call"},
+   {"recvmiss", scenarioRecvMiss, "non-blocking recv and zero-timeout epoll_wait calls per second on an idle connection"},
+   {"connect", scenarioConnect, "connection setup rate (connect/accept)"},
+   {"accept", scenarioAccept, "accept rate of a listener under a burst of concurrent connects (accept_batch)"},
+   {"aconnect", scenarioAsyncConnect, "concurrent non-blocking connects from one thread, completed through epoll"},
+   {"resume", scenarioResume, "request/reply over a new connection, without and with a resumption ticket (connect_data)"},
+   {"idle", scenarioIdle, "resident memory per idle connection"},
+   {"gc", scenarioGC, "API call stalls caused by garbage collection with many open sockets, and reclamation delay"},
+   {"handshake", scenarioHandshake, "handshake validation rate of a listener under a raw handshake flood"},
+   {"file", scenarioFile, "file transfer throughput (sendfile/recvfile)"}
+};
+
+static const int g_ScenarioNum = sizeof(g_Scenarios) / sizeof(CScenarioEntry);
+
+
+void usage()
+{
+   cout << "usage: udtbench [--scenario=NAME|all] [options]" << endl << endl;
+   cout << "scenarios:" << endl;
+   for (int i = 0; i < g_ScenarioNum; ++ i)
+      cout << "   " << g_Scenarios[i].m_pcName << "\t" << g_Scenarios[i].m_pcDesc << endl;
+   cout << endl;
+   cout << "options:" << endl;
+   cout << "   --bytes=N        bytes per stream (bulk, streams, file), per transfer (repeat)" << endl;
+   cout << "   --streams=N      parallel streams (streams)" << endl;
+   cout << "   --messages=N     measured messages (rtt, msgread, msgrate), handshake packets (handshake)" << endl;
+   cout << "   --msgsize=N      message size in bytes (rtt, msgread, msgrate, resume)" << endl;
+   cout << "   --conns=N        connections (connect, accept, aconnect, resume, repeat, idle, gc)" << endl;
+   cout << "   --batch=N        connections per accept_batch call, 1 = accept() (accept); messages per call, 1 = sendmsg/recvmsg (msgrate)" << endl;
+   cout << "   --warmup=N       samples discarded before measuring" << endl;
+   cout << "   --cc=udt|bbr|cubic|ledbat|tcp|blast, --blast-mbps=R, --mss=N" << endl;
+   cout << "   --pkttrace=N     keep N packet trace records per direction on every socket" << endl;
+   cout << "   --muxrate=BPS    senders share one multiplexer limited to BPS bytes/s (bulk, streams, rtt; no link emulation)" << endl;
+   cout << "   --weights=W,...  UDT_SNDWEIGHT of the senders, cycled over the streams" << endl;
+   cout << "   --bulk=N         bulk senders sharing the multiplexer of the rtt client (rtt; no link emulation)" << endl;
+   cout << "   --priority=high|normal|low  UDT_PRIORITY of the rtt client" << endl;
+   cout << "   --delay=US --jitter=US --loss=P --ge-good-bad=P --ge-bad-good=P --ge-loss-bad=P" << endl;
+   cout << "   --reorder=P --reorder-delay=US --rate=BYTES_PER_SEC --queue=BYTES --seed=N" << endl;
+   cout << "                    loopback link emulation (UDT_NETEM), applied to both ends" << endl;
+   cout << endl << "Each scenario prints one JSON object per line on stdout." << endl;
+}
+
+int parse(int argc, char* argv[], CBenchOptions& opt)
+{
+   opt.m_strScenario = "all";
+   opt.m_llBytes = 100000000;
+   opt.m_iStreams = 8;
+   opt.m_iMessages = 10000;
+   opt.m_iMsgSize = 64;
+   opt.m_iConns = 1000;
+   opt.m_iBatch = 64;
+   opt.m_iWarmup = 100;
+   opt.m_strCC = "udt";
+   opt.m_dBlastMbps = 500;
+   opt.m_iMSS = 1500;
+   opt.m_iPktTrace = 0;
+   opt.m_llMuxRate = 0;
+   opt.m_iBulk = 0;
+   opt.m_iPriority = UDT_PRIORITY_NORMAL;
+   memset(&opt.m_NetEmu, 0, sizeof(CNetEmuConfig));
+
+   for (int i = 1; i < argc; ++ i)
+   {
+      string arg = argv[i];
+      if ((arg.size() < 3) || (arg.compare(0, 2, "--") != 0))
+         return -1;
+
+      string key = arg.substr(2);
+      string val;
+      string::size_type eq = key.find('=');
+      if (eq != string::npos)
+      {
+         val = key.substr(eq + 1);
+         key = key.substr(0, eq);
+      }
+
+      const char* v = val.c_str();
+      if (key == "scenario")
+         opt.m_strScenario = val;
+      else if (key == "bytes")
+         opt.m_llBytes = atoll(v);
+      else if (key == "streams")
+         opt.m_iStreams = atoi(v);
+      else if (key == "messages")
+         opt.m_iMessages = atoi(v);
+      else if (key == "msgsize")
+         opt.m_iMsgSize = atoi(v);
+      else if (key == "conns")
+         opt.m_iConns = atoi(v);
+      else if (key == "batch")
+         opt.m_iBatch = atoi(v);
+      else if (key == "warmup")
+         opt.m_iWarmup = atoi(v);
+      else if (key == "cc")
+         opt.m_strCC = val;
+      else if (key == "blast-mbps")
+         opt.m_dBlastMbps = atof(v);
+      else if (key == "mss")
+         opt.m_iMSS = atoi(v);
+      else if (key == "pkttrace")
+         opt.m_iPktTrace = atoi(v);
+      else if (key == "muxrate")
+         opt.m_llMuxRate = atoll(v);
+      else if (key == "weights")
+      {
+         for (string::size_type p = 0; p < val.size(); p = val.find(',', p) + 1)
+         {
+            opt.m_viWeights.push_back(atoi(v + p));
+            if (val.find(',', p) == string::npos)
+               break;
+         }
+      }
+      else if (key == "bulk")
+         opt.m_iBulk = atoi(v);
+      else if (key == "priority")
+      {
+         if (val == "high")
+            opt.m_iPriority = UDT_PRIORITY_HIGH;
+         else if (val == "normal")
+            opt.m_iPriority = UDT_PRIORITY_NORMAL;
+         else if (val == "low")
+            opt.m_iPriority = UDT_PRIORITY_LOW;
+         else
+            return -1;
+      }
+      else if (key == "delay")
+         opt.m_NetEmu.usDelay = atoi(v);
+      else if (key == "jitter")
+         opt.m_NetEmu.usJitter = atoi(v);
+      else if (key == "loss")
+         opt.m_NetEmu.dLossRate = atof(v);
+      else if (key == "ge-good-bad")
+         opt.m_NetEmu.dGEGoodToBad = atof(v);
+      else if (key == "ge-bad-good")
+         opt.m_NetEmu.dGEBadToGood = atof(v);
+      else if (key == "ge-loss-bad")
+         opt.m_NetEmu.dGELossBad = atof(v);
+      else if (key == "reorder")
+         opt.m_NetEmu.dReorderRate = atof(v);
+      else if (key == "reorder-delay")
+         opt.m_NetEmu.usReorderDelay = atoi(v);
+      else if (key == "rate")
+         opt.m_NetEmu.byteRate = atoll(v);
+      else if (key == "queue")
+         opt.m_NetEmu.byteQueueLimit = atoi(v);
+      else if (key == "seed")
+         opt.m_NetEmu.uiSeed = (unsigned int)strtoul(v, NULL, 10);
+      else
+         return -1;
+   }
+
+   if ((opt.m_strCC != "udt") && (opt.m_strCC != "bbr") && (opt.m_strCC != "cubic") && (opt.m_strCC != "ledbat") && (opt.m_strCC != "tcp") && (opt.m_strCC != "blast"))
+      return -1;
+
+   if ((opt.m_llBytes <= 0) || (opt.m_iStreams <= 0) || (opt.m_iMessages <= 0) || (opt.m_iMsgSize <= 0) || (opt.m_iConns <= 0) || (opt.m_iBatch <= 0) || (opt.m_iWarmup < 0))
+      return -1;
+
+   // emulated channels are never shared, so the senders could not share a multiplexer
+   CNetEmuConfig noemu;
+   memset(&noemu, 0, sizeof(CNetEmuConfig));
+   if ((opt.m_llMuxRate < 0) || ((opt.m_llMuxRate > 0) && (0 != memcmp(&noemu, &opt.m_NetEmu, sizeof(CNetEmuConfig)))))
+      return -1;
+   if ((opt.m_iBulk < 0) || ((opt.m_iBulk > 0) && (0 != memcmp(&noemu, &opt.m_NetEmu, sizeof(CNetEmuConfig)))))
+      return -1;
+   for (vector<int>::const_iterator i = opt.m_viWeights.begin(); i != opt.m_viWeights.end(); ++ i)
+   {
+      if ((*i < 1) || (*i > 10000))
+         return -1;
+   }
+
+   return 0;
+}
+
+CJson common(const CBenchOptions& opt)
+{
+   CJson netem;
+   netem.add("delay_us", opt.m_NetEmu.usDelay)
+        .add("jitter_us", opt.m_NetEmu.usJitter)
+        .add("loss", opt.m_NetEmu.dLossRate)
+        .add("ge_good_bad", opt.m_NetEmu.dGEGoodToBad)
+        .add("ge_bad_good", opt.m_NetEmu.dGEBadToGood)
+        .add("ge_loss_bad", opt.m_NetEmu.dGELossBad)
+        .add("reorder", opt.m_NetEmu.dReorderRate)
+        .add("reorder_delay_us", opt.m_NetEmu.usReorderDelay)
+        .add("rate_Bps", opt.m_NetEmu.byteRate)
+        .add("queue_bytes", opt.m_NetEmu.byteQueueLimit)
+        .add("seed", int64_t(opt.m_NetEmu.uiSeed));
+
+   CJson json;
+   json.add("cc", opt.m_strCC);
+   if (opt.m_strCC == "blast")
+      json.add("blast_mbps", opt.m_dBlastMbps);
+   json.add("mss", opt.m_iMSS).add("pkttrace", opt.m_iPktTrace);
+   if (opt.m_llMuxRate > 0)
+      json.add("muxrate_Bps", opt.m_llMuxRate);
+   if (!opt.m_viWeights.empty())
+   {
+      vector<double> weights(opt.m_viWeights.begin(), opt.m_viWeights.end());
+      json.add("weights", weights);
+   }
+   json.add("netem", netem);
+   return json;
+}
+
+int main(int argc, char* argv[])
+{
+   CBenchOptions opt;
+   if (0 != parse(argc, argv, opt))
+   {
+      usage();
+      return 1;
+   }
+
+   #ifndef WIN32
+      // a peer closing early must not kill the benchmark
+      signal(SIGPIPE, SIG_IGN);
+   #endif
+
+   bool found = false;
+   int failed = 0;
+
+   UDT::startup();
+
+   for (int i = 0; i < g_ScenarioNum; ++ i)
+   {
+      if ((opt.m_strScenario != "all") && (opt.m_strScenario != g_Scenarios[i].m_pcName))
+         continue;
+      found = true;
+
+      CJson config = common(opt);
+      CJson result;
+      int res = g_Scenarios[i].m_pFunc(opt, config, result);
+      if (res < 0)
+         ++ failed;
+
+      CJson out;
+      out.add("scenario", g_Scenarios[i].m_pcName)
+         .add("status", (res < 0) ? "error" : "ok")
+         .add("config", config)
+         .add("result", result);
+      cout << out.str() << endl;
+   }
+
+   UDT::cleanup();
+
+   if (!found)
+   {
+      usage();
+      return 1;
+   }
+
+   return (failed > 0) ? 2 : 0;
+}
+
+
+// JSON writer
+
+void CJson::key(const char* key)
+{
+   if (!m_strBody.empty())
+      m_strBody += ",";
+   m_strBody += "\"";
+   m_strBody += key;
+   m_strBody += "\":";
+}
+
+CJson& CJson::add(const char* k, int value)
+{
+   return add(k, int64_t(value));
+}
+
+CJson& CJson::add(const char* k, int64_t value)
+{
+   key(k);
+   char buf[32];
+   sprintf(buf, "%lld", (long long)value);
+   m_strBody += buf;
+   return *this;
+}
+
+CJson& CJson::add(const char* k, double value)
+{
+   key(k);
+   char buf[64];
+   sprintf(buf, "%.10g", value);
+   m_strBody += buf;
+   return *this;
+}
+
+CJson& CJson::add(const char* k, const char* value)
+{
+   return add(k, string(value));
+}
+
+CJson& CJson::add(const char* k, const string& value)
+{
+   key(k);
+   m_strBody += "\"";
+   for (string::const_iterator i = value.begin(); i != value.end(); ++ i)
+   {
+      if ((*i == '"') || (*i == '\\'))
+         m_strBody += '\\';
+      if ((unsigned char)*i >= 0x20)
+         m_strBody += *i;
+   }
+   m_strBody += "\"";
+   return *this;
+}
+
+CJson& CJson::add(const char* k, const CJson& value)
+{
+   key(k);
+   m_strBody += value.str();
+   return *this;
+}
+
+CJson& CJson::add(const char* k, const vector<double>& values)
+{
+   key(k);
+   m_strBody += "[";
+   for (vector<double>::const_iterator i = values.begin(); i != values.end(); ++ i)
+   {
+      char buf[64];
+      sprintf(buf, "%s%.10g", (i == values.begin()) ? "" : ",", *i);
+      m_strBody += buf;
+   }
+   m_strBody += "]";
+   return *this;
+}
+
+string CJson::str() const
+{
+   return "{" + m_strBody + "}";
+}
+
+
+// helpers
+
+uint64_t benchTime()
+{
+   #ifndef WIN32
+      timeval t;
+      gettimeofday(&t, 0);
+      return t.tv_sec * 1000000ULL + t.tv_usec;
+   #else
+      LARGE_INTEGER ccf, cc;
+      QueryPerformanceFrequency(&ccf);
+      QueryPerformanceCounter(&cc);
+      return cc.QuadPart * 1000000ULL / ccf.QuadPart;
+   #endif
+}
+
+uint64_t benchUserTime()
+{
+   #ifndef WIN32
+      rusage ru;
+      getrusage(RUSAGE_SELF, &ru);
+      return ru.ru_utime.tv_sec * 1000000ULL + ru.ru_utime.tv_usec;
+   #else
+      FILETIME create, exit, kernel, user;
+      GetProcessTimes(GetCurrentProcess(), &create, &exit, &kernel, &user);
+      return ((uint64_t(user.dwHighDateTime) << 32) + user.dwLowDateTime) / 10;
+   #endif
+}
+
+uint64_t benchThreadTime()
+{
+   #ifndef WIN32
+      #ifdef CLOCK_THREAD_CPUTIME_ID
+         timespec t;
+         if (0 == clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t))
+            return t.tv_sec * 1000000000ULL + t.tv_nsec;
+      #endif
+      return benchUserTime() * 1000;
+   #else
+      FILETIME create, exit, kernel, user;
+      GetThreadTimes(GetCurrentThread(), &create, &exit, &kernel, &user);
+      return ((uint64_t(user.dwHighDateTime) << 32) + user.dwLowDateTime + (uint64_t(kernel.dwHighDateTime) << 32) + kernel.dwLowDateTime) * 100;
+   #endif
+}
+
+int64_t benchRSS()
+{
+   #ifndef WIN32
+      FILE* f = fopen("/proc/self/statm", "r");
+      if (NULL == f)
+         return 0;
+      long size = 0;
+      long resident = 0;
+      int n = fscanf(f, "%ld %ld", &size, &resident);
+      fclose(f);
+      return (2 == n) ? int64_t(resident) * sysconf(_SC_PAGESIZE) : 0;
+   #else
+      PROCESS_MEMORY_COUNTERS pmc;
+      if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+         return 0;
+      return pmc.WorkingSetSize;
+   #endif
+}
+
+UDTSOCKET benchSocket(const CBenchOptions& opt, int type)
+{
+   UDTSOCKET u = UDT::socket(AF_INET, type, 0);
+   if (UDT::INVALID_SOCK == u)
+      return u;
+
+   UDT::setsockopt(u, 0, UDT_MSS, &opt.m_iMSS, sizeof(int));
+   UDT::setsockopt(u, 0, UDT_PKTTRACE, &opt.m_iPktTrace, sizeof(int));
+
+   if (opt.m_strCC == "tcp")
+   {
+      CCCFactory<CTCP> factory;
+      UDT::setsockopt(u, 0, UDT_CC, &factory, sizeof(CCCFactory<CTCP>));
+   }
+   else if (opt.m_strCC == "blast")
+   {
+      CCCFactory<CUDPBlast> factory;
+      UDT::setsockopt(u, 0, UDT_CC, &factory, sizeof(CCCFactory<CUDPBlast>));
+   }
+   else
+      UDT::setsockopt(u, 0, UDT_CCNAME, opt.m_strCC.c_str(), opt.m_strCC.size());
+
+   if (UDT::ERROR == UDT::setsockopt(u, 0, UDT_NETEM, &opt.m_NetEmu, sizeof(CNetEmuConfig)))
+   {
+      UDT::close(u);
+      return UDT::INVALID_SOCK;
+   }
+
+   return u;
+}
+
+UDTSOCKET benchListen(const CBenchOptions& opt, int type, sockaddr_in& addr, int backlog)
+{
+   UDTSOCKET u = benchSocket(opt, type);
+   if (UDT::INVALID_SOCK == u)
+      return u;
+
+   memset(&addr, 0, sizeof(sockaddr_in));
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   addr.sin_port = 0;
+
+   int namelen = sizeof(sockaddr_in);
+   if ((UDT::ERROR == UDT::bind(u, (sockaddr*)&addr, sizeof(sockaddr_in))) ||
+       (UDT::ERROR == UDT::getsockname(u, (sockaddr*)&addr, &namelen)) ||
+       (UDT::ERROR == UDT::listen(u, backlog)))
+   {
+      UDT::close(u);
+      return UDT::INVALID_SOCK;
+   }
+
+   return u;
+}
+
+int benchConnect(const CBenchOptions& opt, UDTSOCKET u, const sockaddr_in& addr)
+{
+   if (UDT::ERROR == UDT::connect(u, (const sockaddr*)&addr, sizeof(sockaddr_in)))
+      return -1;
+
+   if (opt.m_strCC == "blast")
+   {
+      CUDPBlast* cchandle = NULL;
+      int len;
+      UDT::getsockopt(u, 0, UDT_CC, &cchandle, &len);
+      if (NULL != cchandle)
+         cchandle->setRate(opt.m_dBlastMbps);
+   }
+
+   return 0;
+}
+
+int benchSendAll(UDTSOCKET u, const char* buf, int64_t len)
+{
+   while (len > 0)
+   {
+      int ss = UDT::send(u, buf, int(min(len, int64_t(1000000000))), 0);
+      if (UDT::ERROR == ss)
+         return -1;
+      buf += ss;
+      len -= ss;
+   }
+   return 0;
+}
+
+int benchRecvAll(UDTSOCKET u, char* buf, int64_t len)
+{
+   while (len > 0)
+   {
+      int rs = UDT::recv(u, buf, int(min(len, int64_t(1000000000))), 0);
+      if (UDT::ERROR == rs)
+         return -1;
+      buf += rs;
+      len -= rs;
+   }
+   return 0;
+}
+
+double benchPercentile(vector<double>& samples, double p)
+{
+   if (samples.empty())
+      return 0;
+
+   sort(samples.begin(), samples.end());
+
+   // nearest-rank
+   int rank = int(p / 100.0 * samples.size() + 0.999999);
+   if (rank < 1)
+      rank = 1;
+   if (rank > int(samples.size()))
+      rank = int(samples.size());
+   return samples[rank - 1];
+}
+
+void benchSummary(vector<double>& samples, CJson& json)
+{
+   double sum = 0;
+   for (vector<double>::iterator i = samples.begin(); i != samples.end(); ++ i)
+      sum += *i;
+
+   json.add("count", int(samples.size()))
+       .add("min", benchPercentile(samples, 0))
+       .add("mean", samples.empty() ? 0 : sum / samples.size())
+       .add("p50", benchPercentile(samples, 50))
+       .add("p90", benchPercentile(samples, 90))
+       .add("p99", benchPercentile(samples, 99))
+       .add("p999", benchPercentile(samples, 99.9))
+       .add("max", benchPercentile(samples, 100));
+}
+
+void benchPerf(UDTSOCKET u, CJson& json)
+{
+   UDT::TRACEINFO perf;
+   if (UDT::ERROR == UDT::perfmon(u, &perf, false))
+      return;
+
+   json.add("pkt_sent", perf.pktSentTotal)
+       .add("pkt_retrans", perf.pktRetransTotal)
+       .add("pkt_snd_loss", perf.pktSndLossTotal)
+       .add("pkt_recv_nak", perf.pktRecvNAKTotal)
+       .add("rtt_ms", perf.msRTT)
+       .add("bandwidth_mbps", perf.mbpsBandwidth);
+}
+
+void benchHist(const CPerfHist& hist, CJson& json)
+{
+   json.add("count", hist.count)
+       .add("min", hist.usMin)
+       .add("mean", hist.usMean)
+       .add("p50", hist.usP50)
+       .add("p90", hist.usP90)
+       .add("p99", hist.usP99)
+       .add("p999", hist.usP999)
+       .add("max", hist.usMax);
+}
+
+void benchMux(UDTSOCKET u, CJson& json)
+{
+   sockaddr_in addr;
+   int len = sizeof(addr);
+   UDT::MUXSTATS mux;
+   if ((UDT::ERROR == UDT::getsockname(u, (sockaddr*)&addr, &len)) || (UDT::ERROR == UDT::getmuxstats(ntohs(addr.sin_port), &mux)))
+      return;
+
+   json.add("sockets", mux.iSockets)
+       .add("pkt_sent", mux.pktSent)
+       .add("pkt_sent_direct", mux.pktSentDirect)
+       .add("pkt_send_failed", mux.pktSendFailed)
+       .add("snd_idle_waits", mux.sndIdleWaits)
+       .add("snd_timer_sleeps", mux.sndTimerSleeps)
+       .add("snd_oversleep_us_total", mux.usSndOversleepTotal)
+       .add("snd_oversleep_us_max", mux.usSndOversleepMax)
+       .add("recv_calls", mux.sysRecvCalls)
+       .add("pkt_recv", mux.pktRecv)
+       .add("pkt_recv_dropped", mux.pktRecvDropped)
+       .add("pkt_recv_nosocket", mux.pktRecvNoSocket)
+       .add("unit_queue_size", mux.unitQueueSize)
+       .add("unit_queue_used", mux.unitQueueUsed)
+       .add("snd_throttled", mux.sndThrottled)
+       .add("rcv_timer_checks", mux.rcvTimerChecks)
+       .add("conn_slab_used", mux.connSlabUsed)
+       .add("conn_slab_total", mux.connSlabTotal);
+}
+
+string benchError(const char* api)
+{
+   return string(api) + ": " + UDT::getlasterror_desc();
+}
+
+BenchThread benchStartThread(BenchThreadFunc func, void* param)
+{
+   #ifndef WIN32
+      pthread_t t;
+      pthread_create(&t, NULL, func, param);
+      return t;
+   #else
+      return CreateThread(NULL, 0, func, param, 0, NULL);
+   #endif
+}
+
+void benchJoinThread(BenchThread t)
+{
+   #ifndef WIN32
+      pthread_join(t, NULL);
+   #else
+      WaitForSingleObject(t, INFINITE);
+      CloseHandle(t);
+   #endif
+}
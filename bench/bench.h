@@ -0,0 +1,139 @@
+#ifndef _UDT_BENCH_H_
+#define _UDT_BENCH_H_
+
+#ifndef WIN32
+   #include <pthread.h>
+   #include <arpa/inet.h>
+#else
+   #include <winsock2.h>
+   #include <ws2tcpip.h>
+#endif
+#include <string>
+#include <vector>
+#include <udt.h>
+
+
+// Options shared by all scenarios, given on the command line as --key=value.
+struct CBenchOptions
+{
+   std::string m_strScenario;           // scenario to run, or "all"
+   int64_t m_llBytes;                   // bytes per stream for bulk/streams/file
+   int m_iStreams;                      // number of parallel streams
+   int m_iMessages;                     // number of messages for latency scenarios
+   int m_iMsgSize;                      // message size in bytes
+   int m_iConns;                        // number of connections for connection scenarios
+   int m_iBatch;                        // connections taken per accept_batch call, 1 = accept()
+   int m_iWarmup;                       // samples discarded before measuring
+   std::string m_strCC;                 // congestion control: udt, bbr, cubic, ledbat, tcp or blast
+   double m_dBlastMbps;                 // sending rate of the blast controller
+   int m_iMSS;                          // UDT_MSS
+   int m_iPktTrace;                     // UDT_PKTTRACE, packet trace records per direction
+   int64_t m_llMuxRate;                 // aggregate rate limit of the senders' shared multiplexer, bytes/s, 0 = off
+   std::vector<int> m_viWeights;        // UDT_SNDWEIGHT of the senders, stream i uses entry i % size
+   int m_iBulk;                         // bulk senders competing with the rtt client on its multiplexer
+   int m_iPriority;                     // UDT_PRIORITY of the rtt client
+   CNetEmuConfig m_NetEmu;              // link emulation applied to both ends
+};
+
+// Minimal JSON object writer; values are appended in order.
+class CJson
+{
+public:
+   CJson& add(const char* key, int value);
+   CJson& add(const char* key, int64_t value);
+   CJson& add(const char* key, double value);
+   CJson& add(const char* key, const char* value);
+   CJson& add(const char* key, const std::string& value);
+   CJson& add(const char* key, const CJson& value);
+   CJson& add(const char* key, const std::vector<double>& values);
+
+   std::string str() const;
+
+private:
+   void key(const char* key);
+
+private:
+   std::string m_strBody;
+};
+
+// A scenario fills "config" with its own parameters and "result" with its measurements.
+// It returns 0 on success, or -1 after putting the reason into result as "error".
+typedef int (*BenchScenario)(const CBenchOptions& opt, CJson& config, CJson& result);
+
+int scenarioBulk(const CBenchOptions& opt, CJson& config, CJson& result);
+int scenarioStreams(const CBenchOptions& opt, CJson& config, CJson& result);
+int scenarioRepeat(const CBenchOptions& opt, CJson& config, CJson& result);
+int scenarioRTT(const CBenchOptions& opt, CJson& config, CJson& result);
+int scenarioRecvMiss(const CBenchOptions& opt, CJson& config, CJson& result);
+int scenarioMsgRead(const CBenchOptions& opt, CJson& config, CJson& result);
+int scenarioMsgRate(const CBenchOptions& opt, CJson& config, CJson& result);
+int scenarioConnect(const CBenchOptions& opt, CJson& config, CJson& result);
+int scenarioAccept(const CBenchOptions& opt, CJson& config, CJson& result);
+int scenarioAsyncConnect(const CBenchOptions& opt, CJson& config, CJson& result);
+int scenarioResume(const CBenchOptions& opt, CJson& config, CJson& result);
+int scenarioIdle(const CBenchOptions& opt, CJson& config, CJson& result);
+int scenarioGC(const CBenchOptions& opt, CJson& config, CJson& result);
+int scenarioHandshake(const CBenchOptions& opt, CJson& config, CJson& result);
+int scenarioFile(const CBenchOptions& opt, CJson& config, CJson& result);
+
+// Helpers shared by the scenarios.
+
+// current time in microseconds
+uint64_t benchTime();
+
+// user CPU time of the process, all threads, in microseconds
+uint64_t benchUserTime();
+
+// CPU time of the calling thread in nanoseconds (process user time where not available)
+uint64_t benchThreadTime();
+
+// resident memory of the process in bytes, 0 if unknown
+int64_t benchRSS();
+
+// create a UDT socket configured with the common options (CC, MSS, emulation)
+UDTSOCKET benchSocket(const CBenchOptions& opt, int type);
+
+// create a socket listening on an ephemeral loopback port; addr receives the bound address
+UDTSOCKET benchListen(const CBenchOptions& opt, int type, sockaddr_in& addr, int backlog = 1024);
+
+// connect u to addr and apply the post-connection CC settings
+int benchConnect(const CBenchOptions& opt, UDTSOCKET u, const sockaddr_in& addr);
+
+// send or receive exactly len bytes; return 0 on success, -1 on error
+int benchSendAll(UDTSOCKET u, const char* buf, int64_t len);
+int benchRecvAll(UDTSOCKET u, char* buf, int64_t len);
+
+// p-th percentile (0 - 100) of samples, which are sorted in place
+double benchPercentile(std::vector<double>& samples, double p);
+
+// add count/min/mean/percentiles/max of samples to json
+void benchSummary(std::vector<double>& samples, CJson& json);
+
+// add the retransmission/loss/RTT counters of a connected socket to json
+void benchPerf(UDTSOCKET u, CJson& json);
+
+// add the summary of a histogram returned by perfmon2 to json
+void benchHist(const CPerfHist& hist, CJson& json);
+
+// add the statistics of the multiplexer a socket is bound to to json
+void benchMux(UDTSOCKET u, CJson& json);
+
+// last UDT error as text
+std::string benchError(const char* api);
+
+#ifndef WIN32
+   typedef pthread_t BenchThread;
+   typedef void* (*BenchThreadFunc)(void*);
+   #define BENCH_THREAD(name) void* name(void* param)
+   #define BENCH_THREAD_RETURN return NULL
+#else
+   typedef HANDLE BenchThread;
+   typedef LPTHREAD_START_ROUTINE BenchThreadFunc;
+   #define BENCH_THREAD(name) DWORD WINAPI name(LPVOID param)
+   #define BENCH_THREAD_RETURN return 0
+#endif
+
+BenchThread benchStartThread(BenchThreadFunc func, void* param);
+void benchJoinThread(BenchThread t);
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef WIN32
+   #include <unistd.h>
+   #include <arpa/inet.h>
+   #include <netinet/in.h>
+   #include <sys/socket.h>
+   #include <sys/time.h>
+#else
+   #include <winsock2.h>
+   #include <ws2tcpip.h>
+#endif
+#include <cstdio>
+#include <cstring>
+#include <udt.h>
+
+// Check that a connection the listener fails to set up is released: a raw
+// handshake announces a flow window so large that the new socket cannot
+// allocate its loss list, so newConnection() rolls back after the socket has
+// joined the listener's multiplexer. Once the garbage collector has run, the
+// multiplexer must be back to the listener alone, with no connection state
+// block in use. Prints one JSON line like the udtbench scenarios.
+
+static const int g_iRollbacks = 8;
+static const int g_iWaitMs = 5000;
+
+static void packHandshake(char* buf, int reqtype, int32_t cookie, int32_t id, int32_t window)
+{
+   // UDT control header (handshake, destination socket 0) followed by the handshake, in network order
+   uint32_t* p = (uint32_t*)buf;
+   p[0] = htonl(0x80000000);
+   p[1] = p[2] = p[3] = 0;
+   p[4] = htonl(4);                // UDT version
+   p[5] = htonl(1);                // UDT_STREAM
+   p[6] = htonl(12345);            // ISN
+   p[7] = htonl(1500);             // MSS
+   p[8] = htonl(window);           // flow window
+   p[9] = htonl(reqtype);
+   p[10] = htonl(id);              // socket ID
+   p[11] = htonl(cookie);
+   p[12] = p[13] = p[14] = p[15] = 0;
+}
+
+static int muxStats(int port, UDT::MUXSTATS& stats)
+{
+   return UDT::getmuxstats(port, &stats);
+}
+
+int main()
+{
+   UDT::startup();
+
+   UDTSOCKET serv = UDT::socket(AF_INET, SOCK_STREAM, 0);
+   sockaddr_in addr;
+   memset(&addr, 0, sizeof(sockaddr_in));
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   addr.sin_port = 0;
+   int namelen = sizeof(sockaddr_in);
+   if ((UDT::ERROR == UDT::bind(serv, (sockaddr*)&addr, sizeof(sockaddr_in)))
+      || (UDT::ERROR == UDT::listen(serv, 16))
+      || (UDT::ERROR == UDT::getsockname(serv, (sockaddr*)&addr, &namelen)))
+   {
+      printf("{\"scenario\":\"conncheck\",\"status\":\"error\",\"result\":{\"error\":\"listen: %s\"}}\n", UDT::getlasterror().getErrorMessage());
+      return 1;
+   }
+   int port = ntohs(addr.sin_port);
+
+   UDT::MUXSTATS before;
+   muxStats(port, before);
+
+   int sock = socket(AF_INET, SOCK_DGRAM, 0);
+   #ifndef WIN32
+      timeval tv;
+      tv.tv_sec = 1;
+      tv.tv_usec = 0;
+   #else
+      DWORD tv = 1000;
+   #endif
+   setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
+
+   // get a cookie, then echo it with a flow window whose loss list cannot be allocated
+   char buf[64];
+   char res[1500];
+   int32_t cookie = 0;
+   packHandshake(buf, 1, 0, 54321, 25600);
+   sendto(sock, buf, 64, 0, (const sockaddr*)&addr, sizeof(sockaddr_in));
+   if (recv(sock, res, sizeof(res), 0) >= 64)
+      cookie = int32_t(ntohl(((uint32_t*)res)[11]));
+
+   for (int i = 0; i < g_iRollbacks; ++ i)
+   {
+      packHandshake(buf, -1, cookie, 54321 + i, 0x40000000);
+      sendto(sock, buf, 64, 0, (const sockaddr*)&addr, sizeof(sockaddr_in));
+   }
+
+   // the rolled back sockets are released by the garbage collector about one second after they are closed
+   UDT::MUXSTATS after;
+   int waited = 0;
+   for (; waited < g_iWaitMs; waited += 100)
+   {
+      muxStats(port, after);
+      if ((after.iSockets == before.iSockets) && (after.connSlabUsed == before.connSlabUsed) && (waited >= 1000))
+         break;
+      #ifndef WIN32
+         usleep(100000);
+      #else
+         Sleep(100);
+      #endif
+   }
+
+   #ifndef WIN32
+      close(sock);
+   #else
+      closesocket(sock);
+   #endif
+
+   bool ok = (0 != cookie) && (after.iSockets == before.iSockets) && (after.connSlabUsed == before.connSlabUsed);
+   printf("{\"scenario\":\"conncheck\",\"status\":\"%s\",\"result\":{\"rollbacks\":%d,\"cookie\":%s,\"sockets_before\":%d,\"sockets_after\":%d,\"conn_slab_used_before\":%d,\"conn_slab_used_after\":%d,\"wait_ms\":%d}}\n",
+          ok ? "ok" : "error", g_iRollbacks, (0 != cookie) ? "true" : "false", before.iSockets, after.iSockets, before.connSlabUsed, after.connSlabUsed, waited);
+
+   UDT::close(serv);
+   UDT::cleanup();
+
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,752 @@
+#ifndef WIN32
+   #include <unistd.h>
+#endif
+#include <cstring>
+#include <map>
+#include <vector>
+#include "bench.h"
+
+using namespace std;
+
+// Connection setup rate: the client opens m_iConns connections one after the
+// other, each on its own UDP port, and closes them right away; the server
+// accepts and closes. Samples are connect() latencies in microseconds.
+
+struct CAcceptLoop
+{
+   UDTSOCKET m_Listener;
+   int m_iCount;
+   int m_iAccepted;
+};
+
+static BENCH_THREAD(acceptLoop)
+{
+   CAcceptLoop* a = (CAcceptLoop*)param;
+
+   for (a->m_iAccepted = 0; a->m_iAccepted < a->m_iCount; ++ a->m_iAccepted)
+   {
+      sockaddr_in addr;
+      int addrlen = sizeof(sockaddr_in);
+      UDTSOCKET u = UDT::accept(a->m_Listener, (sockaddr*)&addr, &addrlen);
+      if (UDT::INVALID_SOCK == u)
+         break;
+      UDT::close(u);
+   }
+
+   BENCH_THREAD_RETURN;
+}
+
+int scenarioConnect(const CBenchOptions& opt, CJson& config, CJson& result)
+{
+   config.add("conns", opt.m_iConns);
+
+   sockaddr_in addr;
+   UDTSOCKET serv = benchListen(opt, SOCK_STREAM, addr);
+   if (UDT::INVALID_SOCK == serv)
+   {
+      result.add("error", benchError("listen"));
+      return -1;
+   }
+
+   CAcceptLoop loop;
+   loop.m_Listener = serv;
+   loop.m_iCount = opt.m_iConns;
+   loop.m_iAccepted = 0;
+   BenchThread t = benchStartThread(acceptLoop, &loop);
+
+   vector<double> samples;
+   samples.reserve(opt.m_iConns);
+   int res = 0;
+
+   uint64_t start = benchTime();
+   for (int i = 0; i < opt.m_iConns; ++ i)
+   {
+      UDTSOCKET u = benchSocket(opt, SOCK_STREAM);
+      uint64_t t0 = benchTime();
+      if ((UDT::INVALID_SOCK == u) || (0 != benchConnect(opt, u, addr)))
+      {
+         result.add("error", benchError("connect"));
+         UDT::close(u);
+         res = -1;
+         break;
+      }
+      samples.push_back(double(benchTime() - t0));
+      UDT::close(u);
+   }
+   double sec = (benchTime() - start) / 1000000.0;
+
+   // wake up the acceptor if the client gave up early
+   UDT::close(serv);
+   benchJoinThread(t);
+
+   result.add("connected", int(samples.size()))
+         .add("accepted", loop.m_iAccepted)
+         .add("seconds", sec)
+         .add("conns_per_sec", samples.size() / sec);
+
+   CJson latency;
+   benchSummary(samples, latency);
+   result.add("connect_us", latency);
+
+   return res;
+}
+
+// Accept rate under a connection burst: the client starts m_iConns
+// non-blocking connects at once and the server drains the listener with
+// accept_batch, m_iBatch connections per call (accept() when m_iBatch is 1).
+// The time runs from the first connect to the last accepted connection.
+
+struct CBatchAcceptLoop
+{
+   UDTSOCKET m_Listener;
+   int m_iCount;
+   int m_iBatch;
+   int m_iAccepted;
+   int m_iCalls;
+   uint64_t m_ullDone;
+   vector<UDTSOCKET> m_vAccepted;
+};
+
+static BENCH_THREAD(batchAcceptLoop)
+{
+   CBatchAcceptLoop* a = (CBatchAcceptLoop*)param;
+   vector<UDTSOCKET> batch(a->m_iBatch);
+
+   while (a->m_iAccepted < a->m_iCount)
+   {
+      int n;
+      if (1 == a->m_iBatch)
+      {
+         batch[0] = UDT::accept(a->m_Listener, NULL, NULL);
+         n = (UDT::INVALID_SOCK == batch[0]) ? UDT::ERROR : 1;
+      }
+      else
+         n = UDT::accept_batch(a->m_Listener, &batch[0], a->m_iBatch);
+      if (UDT::ERROR == n)
+         break;
+
+      ++ a->m_iCalls;
+      a->m_iAccepted += n;
+      a->m_vAccepted.insert(a->m_vAccepted.end(), batch.begin(), batch.begin() + n);
+   }
+   a->m_ullDone = benchTime();
+
+   BENCH_THREAD_RETURN;
+}
+
+int scenarioAccept(const CBenchOptions& opt, CJson& config, CJson& result)
+{
+   config.add("conns", opt.m_iConns)
+         .add("batch", opt.m_iBatch);
+
+   sockaddr_in addr;
+   UDTSOCKET serv = benchListen(opt, SOCK_STREAM, addr, opt.m_iConns);
+   if (UDT::INVALID_SOCK == serv)
+   {
+      result.add("error", benchError("listen"));
+      return -1;
+   }
+
+   CBatchAcceptLoop loop;
+   loop.m_Listener = serv;
+   loop.m_iCount = opt.m_iConns;
+   loop.m_iBatch = opt.m_iBatch;
+   loop.m_iAccepted = 0;
+   loop.m_iCalls = 0;
+   loop.m_ullDone = 0;
+   loop.m_vAccepted.reserve(opt.m_iConns);
+
+   vector<UDTSOCKET> clients;
+   clients.reserve(opt.m_iConns);
+   for (int i = 0; i < opt.m_iConns; ++ i)
+   {
+      UDTSOCKET u = benchSocket(opt, SOCK_STREAM);
+      if (UDT::INVALID_SOCK == u)
+         break;
+      bool block = false;
+      UDT::setsockopt(u, 0, UDT_RCVSYN, &block, sizeof(bool));
+      clients.push_back(u);
+   }
+
+   BenchThread t = benchStartThread(batchAcceptLoop, &loop);
+
+   int res = 0;
+   uint64_t start = benchTime();
+   for (vector<UDTSOCKET>::iterator i = clients.begin(); i != clients.end(); ++ i)
+   {
+      if (0 != benchConnect(opt, *i, addr))
+      {
+         result.add("error", benchError("connect"));
+         res = -1;
+         break;
+      }
+   }
+   if ((0 == res) && (int(clients.size()) < opt.m_iConns))
+   {
+      result.add("error", benchError("socket"));
+      res = -1;
+   }
+
+   // wait for the acceptor, or wake it up if the client gave up early
+   if (0 != res)
+      UDT::close(serv);
+   benchJoinThread(t);
+   double sec = (loop.m_ullDone - start) / 1000000.0;
+
+   result.add("accepted", loop.m_iAccepted)
+         .add("accept_calls", loop.m_iCalls)
+         .add("seconds", sec)
+         .add("accepts_per_sec", loop.m_iAccepted / sec);
+
+   for (vector<UDTSOCKET>::iterator i = loop.m_vAccepted.begin(); i != loop.m_vAccepted.end(); ++ i)
+      UDT::close(*i);
+   for (vector<UDTSOCKET>::iterator i = clients.begin(); i != clients.end(); ++ i)
+      UDT::close(*i);
+   UDT::close(serv);
+
+   return res;
+}
+
+// Concurrent non-blocking connects: the client starts m_iConns connects at
+// once from one thread, all on one UDP port, and waits for them with epoll
+// (UDT_EPOLL_OUT on success, UDT_EPOLL_ERR on failure). The handshakes and
+// their retransmissions run in the multiplexer's receiving worker. Samples
+// are the times from connect() to the completion event, in microseconds.
+
+int scenarioAsyncConnect(const CBenchOptions& opt, CJson& config, CJson& result)
+{
+   config.add("conns", opt.m_iConns);
+
+   sockaddr_in addr;
+   UDTSOCKET serv = benchListen(opt, SOCK_STREAM, addr, opt.m_iConns);
+   if (UDT::INVALID_SOCK == serv)
+   {
+      result.add("error", benchError("listen"));
+      return -1;
+   }
+
+   CBatchAcceptLoop loop;
+   loop.m_Listener = serv;
+   loop.m_iCount = opt.m_iConns;
+   loop.m_iBatch = 64;
+   loop.m_iAccepted = 0;
+   loop.m_iCalls = 0;
+   loop.m_ullDone = 0;
+   loop.m_vAccepted.reserve(opt.m_iConns);
+
+   sockaddr_in local;
+   memset(&local, 0, sizeof(sockaddr_in));
+   local.sin_family = AF_INET;
+   local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   int eid = UDT::epoll_create();
+   vector<UDTSOCKET> clients;
+   clients.reserve(opt.m_iConns);
+   int res = 0;
+   for (int i = 0; i < opt.m_iConns; ++ i)
+   {
+      UDTSOCKET u = benchSocket(opt, SOCK_STREAM);
+      bool block = false;
+      int len = sizeof(sockaddr_in);
+      if ((UDT::INVALID_SOCK == u)
+          || (UDT::ERROR == UDT::setsockopt(u, 0, UDT_RCVSYN, &block, sizeof(bool)))
+          || (UDT::ERROR == UDT::bind(u, (sockaddr*)&local, sizeof(sockaddr_in)))
+          || ((0 == i) && (UDT::ERROR == UDT::getsockname(u, (sockaddr*)&local, &len))))
+      {
+         result.add("error", benchError("bind"));
+         UDT::close(u);
+         res = -1;
+         break;
+      }
+      clients.push_back(u);
+   }
+
+   BenchThread t = benchStartThread(batchAcceptLoop, &loop);
+
+   map<UDTSOCKET, uint64_t> pending;
+   uint64_t start = benchTime();
+   for (vector<UDTSOCKET>::iterator i = clients.begin(); (0 == res) && (i != clients.end()); ++ i)
+   {
+      int events = UDT_EPOLL_OUT | UDT_EPOLL_ERR;
+      pending[*i] = benchTime();
+      if ((UDT::ERROR == UDT::epoll_add_usock(eid, *i, &events)) || (0 != benchConnect(opt, *i, addr)))
+      {
+         result.add("error", benchError("connect"));
+         res = -1;
+      }
+   }
+
+   vector<double> samples;
+   samples.reserve(opt.m_iConns);
+   int failed = 0;
+   while ((0 == res) && !pending.empty())
+   {
+      // a failed connect is reported in the write set too, its state tells it apart
+      set<UDTSOCKET> writefds;
+      if (UDT::ERROR == UDT::epoll_wait(eid, NULL, &writefds, 10000))
+      {
+         result.add("error", benchError("epoll_wait"));
+         res = -1;
+         break;
+      }
+
+      uint64_t now = benchTime();
+      for (set<UDTSOCKET>::iterator i = writefds.begin(); i != writefds.end(); ++ i)
+      {
+         map<UDTSOCKET, uint64_t>::iterator p = pending.find(*i);
+         if (p == pending.end())
+            continue;
+         if (CONNECTED == UDT::getsockstate(*i))
+            samples.push_back(double(now - p->second));
+         else
+            ++ failed;
+         pending.erase(p);
+         UDT::epoll_remove_usock(eid, *i);
+      }
+   }
+   double sec = (benchTime() - start) / 1000000.0;
+
+   // wait for the acceptor, or wake it up if some connections failed
+   if ((0 != res) || (failed > 0))
+      UDT::close(serv);
+   benchJoinThread(t);
+
+   result.add("connected", int(samples.size()))
+         .add("failed", failed)
+         .add("accepted", loop.m_iAccepted)
+         .add("seconds", sec)
+         .add("conns_per_sec", samples.size() / sec);
+
+   CJson latency;
+   benchSummary(samples, latency);
+   result.add("connect_us", latency);
+
+   UDT::epoll_release(eid);
+   for (vector<UDTSOCKET>::iterator i = loop.m_vAccepted.begin(); i != loop.m_vAccepted.end(); ++ i)
+      UDT::close(*i);
+   for (vector<UDTSOCKET>::iterator i = clients.begin(); i != clients.end(); ++ i)
+      UDT::close(*i);
+   UDT::close(serv);
+
+   return res;
+}
+
+// Memory of idle connections: m_iConns connections are opened, the clients
+// sharing one multiplexer and the accepted sockets the listener's, and left
+// idle. The growth of the resident memory is reported per connection, each
+// connection counting both of its ends.
+
+int scenarioIdle(const CBenchOptions& opt, CJson& config, CJson& result)
+{
+   config.add("conns", opt.m_iConns);
+
+   sockaddr_in addr;
+   UDTSOCKET serv = benchListen(opt, SOCK_STREAM, addr, opt.m_iConns);
+   if (UDT::INVALID_SOCK == serv)
+   {
+      result.add("error", benchError("listen"));
+      return -1;
+   }
+
+   CBatchAcceptLoop loop;
+   loop.m_Listener = serv;
+   loop.m_iCount = opt.m_iConns;
+   loop.m_iBatch = 64;
+   loop.m_iAccepted = 0;
+   loop.m_iCalls = 0;
+   loop.m_ullDone = 0;
+   loop.m_vAccepted.reserve(opt.m_iConns);
+
+   // open the client multiplexer first, so that only the connections are counted
+   sockaddr_in local;
+   memset(&local, 0, sizeof(sockaddr_in));
+   local.sin_family = AF_INET;
+   local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   int len = sizeof(sockaddr_in);
+
+   vector<UDTSOCKET> clients;
+   clients.reserve(opt.m_iConns);
+   UDTSOCKET u = benchSocket(opt, SOCK_STREAM);
+   if ((UDT::INVALID_SOCK == u)
+       || (UDT::ERROR == UDT::bind(u, (sockaddr*)&local, sizeof(sockaddr_in)))
+       || (UDT::ERROR == UDT::getsockname(u, (sockaddr*)&local, &len)))
+   {
+      result.add("error", benchError("bind"));
+      UDT::close(u);
+      UDT::close(serv);
+      return -1;
+   }
+   clients.push_back(u);
+
+   BenchThread t = benchStartThread(batchAcceptLoop, &loop);
+
+   int res = 0;
+   int64_t before = benchRSS();
+   for (int i = 0; i < opt.m_iConns; ++ i)
+   {
+      if (i > 0)
+      {
+         u = benchSocket(opt, SOCK_STREAM);
+         if ((UDT::INVALID_SOCK == u) || (UDT::ERROR == UDT::bind(u, (sockaddr*)&local, sizeof(sockaddr_in))))
+         {
+            result.add("error", benchError("bind"));
+            UDT::close(u);
+            res = -1;
+            break;
+         }
+         clients.push_back(u);
+      }
+      if (0 != benchConnect(opt, u, addr))
+      {
+         result.add("error", benchError("connect"));
+         res = -1;
+         break;
+      }
+   }
+
+   // wait for the acceptor, or wake it up if the client gave up early
+   if (0 != res)
+      UDT::close(serv);
+   benchJoinThread(t);
+
+   // let the connections settle into their idle state
+   #ifndef WIN32
+      usleep(200000);
+   #else
+      Sleep(200);
+   #endif
+   int64_t after = benchRSS();
+
+   result.add("connected", int(clients.size()))
+         .add("accepted", loop.m_iAccepted)
+         .add("rss_before_bytes", before)
+         .add("rss_after_bytes", after)
+         .add("bytes_per_conn", (loop.m_iAccepted > 0) ? double(after - before) / loop.m_iAccepted : 0.0);
+
+   for (vector<UDTSOCKET>::iterator i = loop.m_vAccepted.begin(); i != loop.m_vAccepted.end(); ++ i)
+      UDT::close(*i);
+   for (vector<UDTSOCKET>::iterator i = clients.begin(); i != clients.end(); ++ i)
+      UDT::close(*i);
+   UDT::close(serv);
+
+   return res;
+}
+
+// Garbage collection pauses: m_iConns idle (unbound) sockets are kept open while
+// one thread calls getsockstate(), which takes the same global lock as the
+// garbage collector, for g_GCRunUs; every g_GCChurn calls it closes one socket
+// and opens another. Samples are the longest call in each 10 ms window, in
+// microseconds. Then g_GCReclaim sockets are closed at once, and the time until
+// all of them are released (state NONEXIST) is reported.
+
+static const uint64_t g_GCRunUs = 3000000;     // three periods of a once-per-second collector
+static const int g_GCChurn = 1000;
+static const int g_GCReclaim = 100;
+
+int scenarioGC(const CBenchOptions& opt, CJson& config, CJson& result)
+{
+   config.add("conns", opt.m_iConns);
+
+   vector<UDTSOCKET> socks;
+   socks.reserve(opt.m_iConns);
+   for (int i = 0; i < opt.m_iConns; ++ i)
+   {
+      UDTSOCKET u = UDT::socket(AF_INET, SOCK_STREAM, 0);
+      if (UDT::INVALID_SOCK == u)
+      {
+         result.add("error", benchError("socket"));
+         for (vector<UDTSOCKET>::iterator j = socks.begin(); j != socks.end(); ++ j)
+            UDT::close(*j);
+         return -1;
+      }
+      socks.push_back(u);
+   }
+
+   vector<double> samples;
+   samples.reserve(g_GCRunUs / 10000 + 1);
+   int64_t calls = 0;
+   int churn = 0;
+   uint64_t start = benchTime();
+   uint64_t window = start;
+   double longest = 0;
+   for (uint64_t t = start; t - start < g_GCRunUs; ++ calls)
+   {
+      UDT::getsockstate(socks[calls % socks.size()]);
+      uint64_t t1 = benchTime();
+      if (double(t1 - t) > longest)
+         longest = double(t1 - t);
+      t = t1;
+
+      if (t - window >= 10000)
+      {
+         samples.push_back(longest);
+         longest = 0;
+         window = t;
+      }
+
+      if (calls % g_GCChurn == g_GCChurn - 1)
+      {
+         int k = churn ++ % socks.size();
+         UDT::close(socks[k]);
+         socks[k] = UDT::socket(AF_INET, SOCK_STREAM, 0);
+         t = benchTime();
+      }
+   }
+
+   result.add("calls", calls).add("churned", churn);
+   CJson pause;
+   benchSummary(samples, pause);
+   result.add("window_max_us", pause);
+
+   // reclamation delay of a burst of closes
+   int n = (g_GCReclaim < int(socks.size())) ? g_GCReclaim : int(socks.size());
+   for (int i = 0; i < n; ++ i)
+      UDT::close(socks[i]);
+   uint64_t closed = benchTime();
+   int left = n;
+   while ((left > 0) && (benchTime() - closed < 10000000))
+   {
+      left = 0;
+      for (int i = 0; i < n; ++ i)
+         left += (NONEXIST != UDT::getsockstate(socks[i])) ? 1 : 0;
+
+      #ifndef WIN32
+         usleep(1000);
+      #else
+         Sleep(1);
+      #endif
+   }
+   result.add("reclaim_us", int64_t(benchTime() - closed)).add("unreclaimed", left);
+
+   for (int i = n; i < int(socks.size()); ++ i)
+      UDT::close(socks[i]);
+
+   return 0;
+}
+
+// Handshake validation rate: a plain UDP socket floods the listener with raw
+// handshake packets in bursts. "request" bursts are cookie requests, each
+// answered with a cookie; "reject" bursts echo forged cookies, which the
+// listener checks against the current and the previous secret and drops, and
+// end with one request whose response marks the end of the burst. No
+// connection is created. Syscalls dominate the wall time, so the user CPU per
+// packet is reported as well.
+
+static const int g_iHSBurst = 32;
+
+static void packHandshake(char* buf, int reqtype, int32_t cookie)
+{
+   // UDT control header (handshake, destination socket 0) followed by the handshake, in network order
+   uint32_t* p = (uint32_t*)buf;
+   p[0] = htonl(0x80000000);
+   p[1] = p[2] = p[3] = 0;
+   p[4] = htonl(4);                // UDT version
+   p[5] = htonl(1);                // UDT_STREAM
+   p[6] = htonl(12345);            // ISN
+   p[7] = htonl(1500);             // MSS
+   p[8] = htonl(25600);            // flow window
+   p[9] = htonl(reqtype);
+   p[10] = htonl(54321);           // socket ID
+   p[11] = htonl(cookie);
+   p[12] = p[13] = p[14] = p[15] = 0;
+}
+
+// send forged cookie echoes, then cookie requests, and read the responses to the requests;
+// return the number of responses, cookie receives the last cookie
+static int handshakeBurst(int sock, const sockaddr_in& addr, int forged, int requests, int32_t& cookie)
+{
+   char buf[64];
+   for (int i = 0; i < forged; ++ i)
+   {
+      packHandshake(buf, -1, cookie ^ (i + 1));
+      sendto(sock, buf, 64, 0, (const sockaddr*)&addr, sizeof(sockaddr_in));
+   }
+   packHandshake(buf, 1, 0);
+   for (int i = 0; i < requests; ++ i)
+      sendto(sock, buf, 64, 0, (const sockaddr*)&addr, sizeof(sockaddr_in));
+
+   char res[1500];
+   int n = 0;
+   for (; n < requests; ++ n)
+   {
+      if (recv(sock, res, sizeof(res), 0) < 64)
+         break;
+      cookie = int32_t(ntohl(((uint32_t*)res)[11]));
+   }
+   return n;
+}
+
+int scenarioHandshake(const CBenchOptions& opt, CJson& config, CJson& result)
+{
+   config.add("handshakes", opt.m_iMessages).add("burst", g_iHSBurst);
+
+   sockaddr_in addr;
+   UDTSOCKET serv = benchListen(opt, SOCK_STREAM, addr);
+   if (UDT::INVALID_SOCK == serv)
+   {
+      result.add("error", benchError("listen"));
+      return -1;
+   }
+
+   int sock = socket(AF_INET, SOCK_DGRAM, 0);
+   #ifndef WIN32
+      timeval tv;
+      tv.tv_sec = 1;
+      tv.tv_usec = 0;
+   #else
+      DWORD tv = 1000;
+   #endif
+   setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
+
+   int32_t cookie = 0;
+   int lost = 1 - handshakeBurst(sock, addr, 0, 1, cookie);
+   int bursts = opt.m_iMessages / (g_iHSBurst + 1);
+
+   // cookie requests only
+   uint64_t start = benchTime();
+   uint64_t cpu = benchUserTime();
+   for (int i = 0; i < bursts; ++ i)
+      lost += (g_iHSBurst + 1) - handshakeBurst(sock, addr, 0, g_iHSBurst + 1, cookie);
+   double reqsec = (benchTime() - start) / 1000000.0;
+   double reqcpu = double(benchUserTime() - cpu);
+
+   // forged cookie echoes, each burst closed by a request
+   start = benchTime();
+   cpu = benchUserTime();
+   for (int i = 0; i < bursts; ++ i)
+      lost += 1 - handshakeBurst(sock, addr, g_iHSBurst, 1, cookie);
+   double rejsec = (benchTime() - start) / 1000000.0;
+   double rejcpu = double(benchUserTime() - cpu);
+
+   #ifndef WIN32
+      close(sock);
+   #else
+      closesocket(sock);
+   #endif
+
+   // user CPU covers both ends, but the client side only packs and sends fixed packets
+   int packets = bursts * (g_iHSBurst + 1);
+   result.add("request_seconds", reqsec)
+         .add("requests_per_sec", packets / reqsec)
+         .add("request_user_us", reqcpu / packets)
+         .add("reject_seconds", rejsec)
+         .add("rejects_per_sec", bursts * g_iHSBurst / rejsec)
+         .add("reject_user_us", rejcpu / packets)
+         .add("lost", lost);
+
+   CJson mux;
+   benchMux(serv, mux);
+   result.add("server_mux", mux);
+
+   UDT::close(serv);
+
+   return (lost > 0) ? -1 : 0;
+}
+
+// Resumed connections: short transactions, each a new connection that
+// carries a request of m_iMsgSize bytes and waits for a one-byte reply. The
+// listener issues resumption tickets (UDT_RESUME). The same client runs
+// m_iConns transactions without a ticket, then m_iConns more that present
+// the ticket of the previous connection and send the request with the
+// handshake. Samples are the times from connect_data() to the reply, in
+// microseconds; use --delay to see the round trip saved.
+
+struct CRequestLoop
+{
+   UDTSOCKET m_Listener;
+   int m_iCount;
+   int m_iMsgSize;
+   int m_iServed;
+};
+
+static BENCH_THREAD(requestLoop)
+{
+   CRequestLoop* a = (CRequestLoop*)param;
+   vector<char> buf(a->m_iMsgSize);
+
+   for (a->m_iServed = 0; a->m_iServed < a->m_iCount; ++ a->m_iServed)
+   {
+      UDTSOCKET u = UDT::accept(a->m_Listener, NULL, NULL);
+      if (UDT::INVALID_SOCK == u)
+         break;
+      if (0 == benchRecvAll(u, &buf[0], a->m_iMsgSize))
+         UDT::send(u, &buf[0], 1, 0);
+      UDT::close(u);
+   }
+
+   BENCH_THREAD_RETURN;
+}
+
+static int resumeRun(const CBenchOptions& opt, const sockaddr_in& addr, bool resume, int count, vector<double>& samples)
+{
+   vector<char> buf(opt.m_iMsgSize, 'r');
+
+   for (int i = 0; i < count; ++ i)
+   {
+      UDTSOCKET u = benchSocket(opt, SOCK_STREAM);
+      if (UDT::INVALID_SOCK == u)
+         return -1;
+      UDT::setsockopt(u, 0, UDT_RESUME, &resume, sizeof(bool));
+
+      char reply;
+      uint64_t t0 = benchTime();
+      if ((UDT::ERROR == UDT::connect_data(u, (const sockaddr*)&addr, sizeof(sockaddr_in), &buf[0], opt.m_iMsgSize))
+          || (0 != benchRecvAll(u, &reply, 1)))
+      {
+         UDT::close(u);
+         return -1;
+      }
+      samples.push_back(double(benchTime() - t0));
+      UDT::close(u);
+   }
+
+   return 0;
+}
+
+int scenarioResume(const CBenchOptions& opt, CJson& config, CJson& result)
+{
+   config.add("conns", opt.m_iConns)
+         .add("msgsize", opt.m_iMsgSize);
+
+   sockaddr_in addr;
+   UDTSOCKET serv = benchListen(opt, SOCK_STREAM, addr);
+   bool resume = true;
+   if ((UDT::INVALID_SOCK == serv) || (UDT::ERROR == UDT::setsockopt(serv, 0, UDT_RESUME, &resume, sizeof(bool))))
+   {
+      result.add("error", benchError("listen"));
+      UDT::close(serv);
+      return -1;
+   }
+
+   // one extra connection fetches the first ticket
+   CRequestLoop loop;
+   loop.m_Listener = serv;
+   loop.m_iCount = opt.m_iConns * 2 + 1;
+   loop.m_iMsgSize = opt.m_iMsgSize;
+   loop.m_iServed = 0;
+   BenchThread t = benchStartThread(requestLoop, &loop);
+
+   vector<double> cold, resumed, prime;
+   int res = 0;
+   if ((0 != resumeRun(opt, addr, false, opt.m_iConns, cold))
+       || (0 != resumeRun(opt, addr, true, 1, prime))
+       || (0 != resumeRun(opt, addr, true, opt.m_iConns, resumed)))
+   {
+      result.add("error", benchError("connect_data"));
+      res = -1;
+   }
+
+   // wake up the server if the client gave up early
+   UDT::close(serv);
+   benchJoinThread(t);
+
+   result.add("served", loop.m_iServed);
+
+   CJson c, r;
+   benchSummary(cold, c);
+   benchSummary(resumed, r);
+   result.add("cold_us", c)
+         .add("resumed_us", r);
+
+   return res;
+}
@@ -0,0 +1,125 @@
+#ifndef WIN32
+   #include <unistd.h>
+#else
+   #include <process.h>
+   #define getpid _getpid
+#endif
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include "bench.h"
+
+using namespace std;
+
+// File transfer with sendfile2()/recvfile2() between two scratch files in the
+// current directory; the clock covers the transfer only, not file creation.
+
+struct CFileReceiver
+{
+   UDTSOCKET m_Listener;
+   string m_strPath;
+   int64_t m_llSize;
+   int64_t m_llReceived;
+   uint64_t m_ullEnd;
+};
+
+static BENCH_THREAD(recvFile)
+{
+   CFileReceiver* r = (CFileReceiver*)param;
+
+   sockaddr_in addr;
+   int addrlen = sizeof(sockaddr_in);
+   UDTSOCKET u = UDT::accept(r->m_Listener, (sockaddr*)&addr, &addrlen);
+   if (UDT::INVALID_SOCK == u)
+      BENCH_THREAD_RETURN;
+
+   int64_t offset = 0;
+   r->m_llReceived = UDT::recvfile2(u, r->m_strPath.c_str(), &offset, r->m_llSize);
+   r->m_ullEnd = benchTime();
+
+   UDT::close(u);
+   BENCH_THREAD_RETURN;
+}
+
+int scenarioFile(const CBenchOptions& opt, CJson& config, CJson& result)
+{
+   config.add("bytes", opt.m_llBytes);
+
+   stringstream prefix;
+   prefix << "udtbench." << getpid();
+   string src = prefix.str() + ".src";
+   string dst = prefix.str() + ".dst";
+
+   {
+      fstream ofs(src.c_str(), ios::out | ios::binary | ios::trunc);
+      char block[65536];
+      for (int i = 0; i < 65536; ++ i)
+         block[i] = char(i * 7);
+      for (int64_t left = opt.m_llBytes; left > 0; left -= 65536)
+         ofs.write(block, left < 65536 ? left : 65536);
+      if (ofs.fail())
+      {
+         result.add("error", "cannot create " + src);
+         remove(src.c_str());
+         return -1;
+      }
+   }
+
+   sockaddr_in addr;
+   UDTSOCKET serv = benchListen(opt, SOCK_STREAM, addr);
+   if (UDT::INVALID_SOCK == serv)
+   {
+      result.add("error", benchError("listen"));
+      remove(src.c_str());
+      return -1;
+   }
+
+   CFileReceiver receiver;
+   receiver.m_Listener = serv;
+   receiver.m_strPath = dst;
+   receiver.m_llSize = opt.m_llBytes;
+   receiver.m_llReceived = -1;
+   receiver.m_ullEnd = 0;
+   BenchThread t = benchStartThread(recvFile, &receiver);
+
+   int res = 0;
+   UDTSOCKET u = benchSocket(opt, SOCK_STREAM);
+   if ((UDT::INVALID_SOCK == u) || (0 != benchConnect(opt, u, addr)))
+   {
+      result.add("error", benchError("connect"));
+      UDT::close(serv);
+      res = -1;
+   }
+   else
+   {
+      int64_t offset = 0;
+      uint64_t start = benchTime();
+      int64_t sent = UDT::sendfile2(u, src.c_str(), &offset, opt.m_llBytes);
+      benchJoinThread(t);
+
+      double sec = (receiver.m_ullEnd - start) / 1000000.0;
+      result.add("sent", sent)
+            .add("received", receiver.m_llReceived)
+            .add("seconds", sec)
+            .add("mbps", receiver.m_llReceived * 8.0 / 1000000.0 / sec);
+
+      CJson perf;
+      benchPerf(u, perf);
+      result.add("sender", perf);
+
+      if ((sent != opt.m_llBytes) || (receiver.m_llReceived != opt.m_llBytes))
+      {
+         result.add("error", benchError("sendfile/recvfile"));
+         res = -1;
+      }
+   }
+
+   UDT::close(u);
+   UDT::close(serv);
+   if (res < 0)
+      benchJoinThread(t);
+
+   remove(src.c_str());
+   remove(dst.c_str());
+   return res;
+}
@@ -0,0 +1,566 @@
+#ifndef WIN32
+   #include <unistd.h>
+#endif
+#include <cstring>
+#include <set>
+#include <vector>
+#include "bench.h"
+
+using namespace std;
+
+// Ping-pong of small messages over a UDT_DGRAM connection; each sample is the
+// time from sendmsg() to the matching recvmsg() of the echo, in microseconds.
+// With --bulk, that many UDT_STREAM senders bound to the client's port keep
+// its multiplexer busy for the whole run, so the samples show how long a small
+// message waits behind bulk data on a shared sending list.
+
+static const int g_BulkChunk = 1000000;
+static const uint64_t g_BulkRampUs = 1000000;  // time given to the bulk senders to leave slow start
+
+struct CEchoServer
+{
+   UDTSOCKET m_Listener;
+   int m_iMsgSize;
+   int m_iCount;
+};
+
+static BENCH_THREAD(echo)
+{
+   CEchoServer* e = (CEchoServer*)param;
+
+   sockaddr_in addr;
+   int addrlen = sizeof(sockaddr_in);
+   UDTSOCKET u = UDT::accept(e->m_Listener, (sockaddr*)&addr, &addrlen);
+   if (UDT::INVALID_SOCK == u)
+      BENCH_THREAD_RETURN;
+
+   char* buf = new char[e->m_iMsgSize];
+   for (int i = 0; i < e->m_iCount; ++ i)
+   {
+      int rs = UDT::recvmsg(u, buf, e->m_iMsgSize);
+      if ((UDT::ERROR == rs) || (UDT::ERROR == UDT::sendmsg(u, buf, rs, -1, true)))
+         break;
+   }
+
+   delete [] buf;
+   UDT::close(u);
+   BENCH_THREAD_RETURN;
+}
+
+struct CBulkLoad
+{
+   UDTSOCKET m_Socket;
+   volatile int64_t m_llBytes;          // bytes sent (sender) or received (sink)
+   volatile bool* m_pbStop;
+};
+
+static BENCH_THREAD(bulkSend)
+{
+   CBulkLoad* b = (CBulkLoad*)param;
+   char* buf = new char[g_BulkChunk];
+   memset(buf, 0, g_BulkChunk);
+
+   while (!*b->m_pbStop && (UDT::ERROR != benchSendAll(b->m_Socket, buf, g_BulkChunk)))
+      b->m_llBytes += g_BulkChunk;
+
+   delete [] buf;
+   BENCH_THREAD_RETURN;
+}
+
+static BENCH_THREAD(bulkSink)
+{
+   CBulkLoad* b = (CBulkLoad*)param;
+
+   sockaddr_in addr;
+   int addrlen = sizeof(sockaddr_in);
+   b->m_Socket = UDT::accept(b->m_Socket, (sockaddr*)&addr, &addrlen);
+   if (UDT::INVALID_SOCK == b->m_Socket)
+      BENCH_THREAD_RETURN;
+
+   char* buf = new char[g_BulkChunk];
+   int rs;
+   while (UDT::ERROR != (rs = UDT::recv(b->m_Socket, buf, g_BulkChunk, 0)))
+      b->m_llBytes += rs;
+
+   delete [] buf;
+   UDT::close(b->m_Socket);
+   BENCH_THREAD_RETURN;
+}
+
+int scenarioRTT(const CBenchOptions& opt, CJson& config, CJson& result)
+{
+   config.add("messages", opt.m_iMessages)
+         .add("msgsize", opt.m_iMsgSize)
+         .add("warmup", opt.m_iWarmup)
+         .add("bulk", opt.m_iBulk)
+         .add("priority", opt.m_iPriority);
+
+   sockaddr_in addr;
+   UDTSOCKET serv = benchListen(opt, SOCK_DGRAM, addr);
+   if (UDT::INVALID_SOCK == serv)
+   {
+      result.add("error", benchError("listen"));
+      return -1;
+   }
+
+   CEchoServer server;
+   server.m_Listener = serv;
+   server.m_iMsgSize = opt.m_iMsgSize;
+   server.m_iCount = opt.m_iWarmup + opt.m_iMessages;
+   BenchThread t = benchStartThread(echo, &server);
+
+   UDTSOCKET u = benchSocket(opt, SOCK_DGRAM);
+   if (UDT::INVALID_SOCK != u)
+      UDT::setsockopt(u, 0, UDT_PRIORITY, &opt.m_iPriority, sizeof(int));
+
+   // the bulk senders bind to the client's port, so they share its multiplexer and rate limit
+   sockaddr_in local;
+   memset(&local, 0, sizeof(sockaddr_in));
+   local.sin_family = AF_INET;
+   local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   int len = sizeof(sockaddr_in);
+   bool failed = (UDT::INVALID_SOCK == u);
+   if (!failed && ((opt.m_iBulk > 0) || (opt.m_llMuxRate > 0)))
+   {
+      failed = (UDT::ERROR == UDT::bind(u, (sockaddr*)&local, sizeof(sockaddr_in)))
+               || (UDT::ERROR == UDT::getsockname(u, (sockaddr*)&local, &len))
+               || ((opt.m_llMuxRate > 0) && (UDT::ERROR == UDT::setmuxrate(ntohs(local.sin_port), UDT_RATECLASS_ALL, opt.m_llMuxRate)));
+      if (failed)
+         result.add("error", benchError("bind"));
+   }
+   if (!failed && (0 != benchConnect(opt, u, addr)))
+   {
+      result.add("error", benchError("connect"));
+      failed = true;
+   }
+   if (failed)
+   {
+      UDT::close(u);
+      UDT::close(serv);
+      benchJoinThread(t);
+      return -1;
+   }
+
+   volatile bool stop = false;
+   vector<CBulkLoad> bulk(opt.m_iBulk), sink(opt.m_iBulk);
+   vector<BenchThread> senders, sinks;
+   sockaddr_in bulkaddr;
+   UDTSOCKET bulkserv = (opt.m_iBulk > 0) ? benchListen(opt, SOCK_STREAM, bulkaddr) : UDT::INVALID_SOCK;
+   for (int i = 0; i < opt.m_iBulk; ++ i)
+   {
+      sink[i].m_Socket = bulkserv;
+      bulk[i].m_Socket = UDT::INVALID_SOCK;
+      sink[i].m_llBytes = bulk[i].m_llBytes = 0;
+      sink[i].m_pbStop = bulk[i].m_pbStop = &stop;
+   }
+   for (int i = 0; i < opt.m_iBulk; ++ i)
+   {
+      bulk[i].m_Socket = benchSocket(opt, SOCK_STREAM);
+      if ((UDT::INVALID_SOCK == bulkserv) || (UDT::INVALID_SOCK == bulk[i].m_Socket)
+          || (UDT::ERROR == UDT::bind(bulk[i].m_Socket, (sockaddr*)&local, sizeof(sockaddr_in))))
+      {
+         result.add("error", benchError("bulk bind"));
+         failed = true;
+         break;
+      }
+
+      sinks.push_back(benchStartThread(bulkSink, &sink[i]));
+      if (0 != benchConnect(opt, bulk[i].m_Socket, bulkaddr))
+      {
+         result.add("error", benchError("bulk connect"));
+         failed = true;
+         break;
+      }
+      senders.push_back(benchStartThread(bulkSend, &bulk[i]));
+   }
+
+   char* buf = new char[opt.m_iMsgSize];
+   for (int i = 0; i < opt.m_iMsgSize; ++ i)
+      buf[i] = char(i);
+
+   vector<double> samples;
+   samples.reserve(opt.m_iMessages);
+   int res = failed ? -1 : 0;
+
+   for (uint64_t t0 = benchTime(); !failed && (opt.m_iBulk > 0) && (benchTime() - t0 < g_BulkRampUs); )
+   {
+      #ifndef WIN32
+         usleep(10000);
+      #else
+         Sleep(10);
+      #endif
+   }
+
+   int64_t startbytes = 0;
+   for (int i = 0; i < opt.m_iBulk; ++ i)
+      startbytes += sink[i].m_llBytes;
+   uint64_t start = benchTime();
+   for (int i = 0, n = failed ? 0 : opt.m_iWarmup + opt.m_iMessages; i < n; ++ i)
+   {
+      uint64_t t0 = benchTime();
+      if ((UDT::ERROR == UDT::sendmsg(u, buf, opt.m_iMsgSize, -1, true)) || (UDT::ERROR == UDT::recvmsg(u, buf, opt.m_iMsgSize)))
+      {
+         result.add("error", benchError("sendmsg/recvmsg"));
+         res = -1;
+         break;
+      }
+      uint64_t t1 = benchTime();
+
+      if (i >= opt.m_iWarmup)
+         samples.push_back(double(t1 - t0));
+   }
+   uint64_t end = benchTime();
+   int64_t bytes = -startbytes;
+   for (int i = 0; i < opt.m_iBulk; ++ i)
+      bytes += sink[i].m_llBytes;
+
+   CJson rtt;
+   benchSummary(samples, rtt);
+   result.add("rtt_us", rtt);
+
+   // the library's own view of the same exchange
+   UDT::TRACEINFO2 perf;
+   if (UDT::ERROR != UDT::perfmon2(u, &perf, false))
+   {
+      CJson udtrtt, latency, queue;
+      benchHist(perf.histRTT, udtrtt);
+      benchHist(perf.histMsgLatency, latency);
+      benchHist(perf.histSndQueueDelay, queue);
+      result.add("udt_rtt_us", udtrtt)
+            .add("udt_msg_latency_us", latency)
+            .add("udt_snd_queue_us", queue);
+   }
+
+   if (opt.m_iBulk > 0)
+   {
+      // stop the senders first; closing them and the listener ends the sinks
+      stop = true;
+      for (vector<BenchThread>::iterator i = senders.begin(); i != senders.end(); ++ i)
+         benchJoinThread(*i);
+
+      if (end > start)
+         result.add("bulk_mbps", bytes * 8.0 / (end - start));
+
+      // the echo server may have closed the client already; the bulk senders share its multiplexer
+      CJson mux;
+      benchMux(bulk[0].m_Socket, mux);
+      result.add("client_mux", mux);
+
+      for (int i = 0; i < opt.m_iBulk; ++ i)
+         UDT::close(bulk[i].m_Socket);
+      UDT::close(bulkserv);
+      for (vector<BenchThread>::iterator i = sinks.begin(); i != sinks.end(); ++ i)
+         benchJoinThread(*i);
+   }
+
+   delete [] buf;
+   UDT::close(u);
+   benchJoinThread(t);
+   UDT::close(serv);
+
+   return res;
+}
+
+// Cost of polling an idle connection: a non-blocking recv() on a connected
+// UDT_STREAM socket with no data, and epoll_wait() with a zero timeout on the
+// same socket, each repeated for g_MissRunUs. Both fail with a would-block or
+// timeout error every time; the result is calls per second.
+
+static const uint64_t g_MissRunUs = 1000000;
+
+static BENCH_THREAD(acceptIdle)
+{
+   UDTSOCKET* u = (UDTSOCKET*)param;
+
+   sockaddr_in addr;
+   int addrlen = sizeof(sockaddr_in);
+   *u = UDT::accept(*u, (sockaddr*)&addr, &addrlen);
+
+   BENCH_THREAD_RETURN;
+}
+
+int scenarioRecvMiss(const CBenchOptions& opt, CJson& config, CJson& result)
+{
+   config.add("run_us", int64_t(g_MissRunUs));
+
+   sockaddr_in addr;
+   UDTSOCKET serv = benchListen(opt, SOCK_STREAM, addr);
+   if (UDT::INVALID_SOCK == serv)
+   {
+      result.add("error", benchError("listen"));
+      return -1;
+   }
+
+   UDTSOCKET peer = serv;
+   BenchThread t = benchStartThread(acceptIdle, &peer);
+
+   UDTSOCKET u = benchSocket(opt, SOCK_STREAM);
+   if ((UDT::INVALID_SOCK == u) || (0 != benchConnect(opt, u, addr)))
+   {
+      result.add("error", benchError("connect"));
+      UDT::close(u);
+      UDT::close(serv);
+      benchJoinThread(t);
+      return -1;
+   }
+   benchJoinThread(t);
+
+   bool block = false;
+   UDT::setsockopt(u, 0, UDT_RCVSYN, &block, sizeof(bool));
+
+   char buf[64];
+   int64_t calls = 0;
+   int other = 0;
+   uint64_t start = benchTime();
+   uint64_t end = start;
+   while (end - start < g_MissRunUs)
+   {
+      // check the clock every 1024 calls, the call itself is what is measured
+      for (int i = 0; i < 1024; ++ i)
+      {
+         if ((UDT::ERROR != UDT::recv(u, buf, sizeof(buf), 0)) || (CUDTException::EASYNCRCV != UDT::getlasterror_code()))
+            ++ other;
+      }
+      calls += 1024;
+      end = benchTime();
+   }
+   result.add("recv_calls_per_sec", calls * 1000000.0 / (end - start));
+
+   int eid = UDT::epoll_create();
+   int events = UDT_EPOLL_IN;
+   UDT::epoll_add_usock(eid, u, &events);
+   set<UDTSOCKET> readfds;
+   calls = 0;
+   start = end = benchTime();
+   while (end - start < g_MissRunUs)
+   {
+      for (int i = 0; i < 1024; ++ i)
+      {
+         if ((UDT::ERROR != UDT::epoll_wait(eid, &readfds, NULL, 0)) || (CUDTException::ETIMEOUT != UDT::getlasterror_code()))
+            ++ other;
+      }
+      calls += 1024;
+      end = benchTime();
+   }
+   result.add("epoll_calls_per_sec", calls * 1000000.0 / (end - start))
+         .add("unexpected", other);
+   UDT::epoll_release(eid);
+
+   UDT::close(u);
+   UDT::close(peer);
+   UDT::close(serv);
+
+   return 0;
+}
+
+// Message reassembly on the receiver: the client sends m_iMessages messages
+// of m_iMsgSize bytes with the in-order flag off, and the server reads them
+// with recvmsg(). With loss emulated, complete messages queue up behind the
+// holes and are read out of order, so the receiver's cost per recvmsg() shows
+// how it finds the next readable message in a full buffer. Each message
+// carries its index, so lost, duplicated or corrupted messages are counted.
+//
+// The same transfer with m_iBatch messages per sendmsg_batch/recvmsg_batch
+// call (sendmsg/recvmsg when m_iBatch is 1) measures the message rate of the
+// batch API.
+
+struct CMsgSink
+{
+   UDTSOCKET m_Listener;
+   int m_iMsgSize;
+   int m_iCount;
+   int m_iBatch;                        // buffers per recvmsg_batch call, 1 = recvmsg()
+   int m_iReceived;                     // distinct messages received
+   int m_iDuplicate;
+   int m_iCorrupt;
+   int m_iOutOfOrder;                   // messages received after a later one
+   int64_t m_llCalls;                   // successful receiving calls
+   uint64_t m_ullCPU;                   // CPU time of the receiving thread, in nanoseconds
+   uint64_t m_ullEnd;                   // time the last message arrived
+};
+
+static BENCH_THREAD(msgSink)
+{
+   CMsgSink* s = (CMsgSink*)param;
+
+   UDTSOCKET u = UDT::accept(s->m_Listener, NULL, NULL);
+   if (UDT::INVALID_SOCK == u)
+      BENCH_THREAD_RETURN;
+
+   vector<bool> seen(s->m_iCount, false);
+   vector<char> buf(s->m_iMsgSize * s->m_iBatch);
+   vector<UDT::MSGVEC> msgs(s->m_iBatch);
+   for (int i = 0; i < s->m_iBatch; ++ i)
+   {
+      msgs[i].pcData = &buf[i * s->m_iMsgSize];
+      msgs[i].iLength = s->m_iMsgSize;
+   }
+
+   int last = -1;
+   uint64_t cpu = benchThreadTime();
+   while (s->m_iReceived < s->m_iCount)
+   {
+      int n;
+      if (1 == s->m_iBatch)
+      {
+         msgs[0].iReceived = UDT::recvmsg(u, msgs[0].pcData, s->m_iMsgSize);
+         n = (UDT::ERROR == msgs[0].iReceived) ? UDT::ERROR : 1;
+      }
+      else
+         n = UDT::recvmsg_batch(u, &msgs[0], s->m_iBatch);
+      if (UDT::ERROR == n)
+         break;
+      ++ s->m_llCalls;
+
+      for (int k = 0; k < n; ++ k)
+      {
+         const char* data = msgs[k].pcData;
+         int rs = msgs[k].iReceived;
+
+         int32_t id;
+         memcpy(&id, data, sizeof(int32_t));
+         bool good = (rs == s->m_iMsgSize) && (id >= 0) && (id < s->m_iCount);
+         for (int i = sizeof(int32_t); good && (i < rs); ++ i)
+            good = (data[i] == char(id + i));
+         if (!good)
+            ++ s->m_iCorrupt;
+         else if (seen[id])
+            ++ s->m_iDuplicate;
+         else
+         {
+            seen[id] = true;
+            ++ s->m_iReceived;
+            if (id < last)
+               ++ s->m_iOutOfOrder;
+            else
+               last = id;
+         }
+      }
+   }
+   s->m_ullEnd = benchTime();
+   s->m_ullCPU = benchThreadTime() - cpu;
+
+   UDT::close(u);
+   BENCH_THREAD_RETURN;
+}
+
+static int runMsgs(const CBenchOptions& opt, int batch, CJson& config, CJson& result)
+{
+   int size = (opt.m_iMsgSize < int(sizeof(int32_t))) ? int(sizeof(int32_t)) : opt.m_iMsgSize;
+   config.add("messages", opt.m_iMessages)
+         .add("msgsize", size)
+         .add("batch", batch);
+
+   sockaddr_in addr;
+   UDTSOCKET serv = benchListen(opt, SOCK_DGRAM, addr);
+   if (UDT::INVALID_SOCK == serv)
+   {
+      result.add("error", benchError("listen"));
+      return -1;
+   }
+
+   CMsgSink sink;
+   sink.m_Listener = serv;
+   sink.m_iMsgSize = size;
+   sink.m_iCount = opt.m_iMessages;
+   sink.m_iBatch = batch;
+   sink.m_iReceived = sink.m_iDuplicate = sink.m_iCorrupt = sink.m_iOutOfOrder = 0;
+   sink.m_llCalls = 0;
+   sink.m_ullCPU = 0;
+   sink.m_ullEnd = 0;
+   BenchThread t = benchStartThread(msgSink, &sink);
+
+   UDTSOCKET u = benchSocket(opt, SOCK_DGRAM);
+   if ((UDT::INVALID_SOCK == u) || (0 != benchConnect(opt, u, addr)))
+   {
+      result.add("error", benchError("connect"));
+      UDT::close(u);
+      UDT::close(serv);
+      benchJoinThread(t);
+      return -1;
+   }
+
+   // all messages are built before the clock starts
+   vector<char> buf(int64_t(size) * opt.m_iMessages);
+   vector<UDT::MSGVEC> msgs(opt.m_iMessages);
+   for (int i = 0; i < opt.m_iMessages; ++ i)
+   {
+      char* data = &buf[int64_t(i) * size];
+      int32_t id = i;
+      memcpy(data, &id, sizeof(int32_t));
+      for (int j = sizeof(int32_t); j < size; ++ j)
+         data[j] = char(i + j);
+
+      msgs[i].pcData = data;
+      msgs[i].iLength = size;
+   }
+
+   int res = 0;
+   int64_t calls = 0;
+   uint64_t cpu = benchUserTime();
+   uint64_t sendcpu = benchThreadTime();
+   uint64_t start = benchTime();
+   for (int i = 0; i < opt.m_iMessages; )
+   {
+      int n;
+      if (1 == batch)
+         n = (UDT::ERROR == UDT::sendmsg(u, msgs[i].pcData, size, -1, false)) ? UDT::ERROR : 1;
+      else
+         n = UDT::sendmsg_batch(u, &msgs[i], (opt.m_iMessages - i < batch) ? opt.m_iMessages - i : batch, -1, false);
+
+      if (n <= 0)
+      {
+         result.add("error", benchError("sendmsg"));
+         res = -1;
+         break;
+      }
+      i += n;
+      ++ calls;
+   }
+   uint64_t sent = benchTime();
+   sendcpu = benchThreadTime() - sendcpu;
+
+   // the sink returns once it has every message; closing the listener ends it early on failure
+   if (0 != res)
+      UDT::close(serv);
+   benchJoinThread(t);
+   cpu = benchUserTime() - cpu;
+
+   if (sink.m_iReceived < opt.m_iMessages)
+   {
+      if (0 == res)
+         result.add("error", benchError("recvmsg"));
+      res = -1;
+   }
+
+   result.add("received", sink.m_iReceived)
+         .add("duplicate", sink.m_iDuplicate)
+         .add("corrupt", sink.m_iCorrupt)
+         .add("out_of_order", sink.m_iOutOfOrder)
+         .add("send_calls", calls)
+         .add("recv_calls", sink.m_llCalls);
+   if (sent > start)
+      result.add("send_msgs_per_sec", opt.m_iMessages * 1000000.0 / (sent - start));
+   if (sink.m_ullEnd > start)
+      result.add("msgs_per_sec", sink.m_iReceived * 1000000.0 / (sink.m_ullEnd - start));
+   if (sink.m_iReceived > 0)
+      result.add("cpu_us_per_msg", double(cpu) / sink.m_iReceived)
+            .add("send_cpu_ns_per_msg", double(sendcpu) / opt.m_iMessages)
+            .add("recv_cpu_ns_per_msg", double(sink.m_ullCPU) / sink.m_iReceived);
+   benchPerf(u, result);
+
+   UDT::close(u);
+   UDT::close(serv);
+
+   return res;
+}
+
+int scenarioMsgRead(const CBenchOptions& opt, CJson& config, CJson& result)
+{
+   return runMsgs(opt, 1, config, result);
+}
+
+int scenarioMsgRate(const CBenchOptions& opt, CJson& config, CJson& result)
+{
+   return runMsgs(opt, opt.m_iBatch, config, result);
+}
@@ -0,0 +1,366 @@
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "bench.h"
+
+using namespace std;
+
+// Bulk transfer over one or more parallel connections: every stream sends
+// m_llBytes, the clock starts once all connections are up and stops when the
+// last receiver has all its data.
+
+static const int g_ChunkSize = 1000000;
+
+struct CStream
+{
+   UDTSOCKET m_Socket;
+   int64_t m_llBytes;
+   uint64_t m_ullEnd;                   // time the last byte arrived (receiver) or was queued (sender)
+   bool m_bFailed;
+};
+
+struct CAcceptor
+{
+   UDTSOCKET m_Listener;
+   vector<CStream>* m_pStreams;
+   int64_t m_llBytes;
+   bool m_bFailed;
+};
+
+static BENCH_THREAD(recvStream)
+{
+   CStream* s = (CStream*)param;
+   char* buf = new char[g_ChunkSize];
+
+   int64_t left = s->m_llBytes;
+   while (left > 0)
+   {
+      int rs = UDT::recv(s->m_Socket, buf, int(left < g_ChunkSize ? left : g_ChunkSize), 0);
+      if (UDT::ERROR == rs)
+      {
+         s->m_bFailed = true;
+         break;
+      }
+      left -= rs;
+   }
+
+   s->m_ullEnd = benchTime();
+   delete [] buf;
+   BENCH_THREAD_RETURN;
+}
+
+static BENCH_THREAD(sendStream)
+{
+   CStream* s = (CStream*)param;
+   char* buf = new char[g_ChunkSize];
+   for (int i = 0; i < g_ChunkSize; ++ i)
+      buf[i] = char(i);
+
+   int64_t left = s->m_llBytes;
+   while (left > 0)
+   {
+      int len = int(left < g_ChunkSize ? left : g_ChunkSize);
+      if (0 != benchSendAll(s->m_Socket, buf, len))
+      {
+         s->m_bFailed = true;
+         break;
+      }
+      left -= len;
+   }
+
+   s->m_ullEnd = benchTime();
+   delete [] buf;
+   BENCH_THREAD_RETURN;
+}
+
+static BENCH_THREAD(acceptStreams)
+{
+   CAcceptor* a = (CAcceptor*)param;
+
+   for (vector<CStream>::iterator i = a->m_pStreams->begin(); i != a->m_pStreams->end(); ++ i)
+   {
+      sockaddr_in addr;
+      int addrlen = sizeof(sockaddr_in);
+      i->m_Socket = UDT::accept(a->m_Listener, (sockaddr*)&addr, &addrlen);
+      i->m_llBytes = a->m_llBytes;
+      i->m_ullEnd = 0;
+      i->m_bFailed = (UDT::INVALID_SOCK == i->m_Socket);
+      if (i->m_bFailed)
+      {
+         a->m_bFailed = true;
+         break;
+      }
+   }
+
+   BENCH_THREAD_RETURN;
+}
+
+static int runStreams(const CBenchOptions& opt, int num, CJson& config, CJson& result)
+{
+   config.add("streams", num).add("bytes_per_stream", opt.m_llBytes);
+
+   sockaddr_in addr;
+   UDTSOCKET serv = benchListen(opt, SOCK_STREAM, addr);
+   if (UDT::INVALID_SOCK == serv)
+   {
+      result.add("error", benchError("listen"));
+      return -1;
+   }
+
+   vector<CStream> rcv(num);
+   vector<CStream> snd(num);
+
+   CAcceptor acceptor;
+   acceptor.m_Listener = serv;
+   acceptor.m_pStreams = &rcv;
+   acceptor.m_llBytes = opt.m_llBytes;
+   acceptor.m_bFailed = false;
+   BenchThread at = benchStartThread(acceptStreams, &acceptor);
+
+   // with --muxrate all senders bind to the port of the first one, so they share its multiplexer and rate limit
+   sockaddr_in local;
+   memset(&local, 0, sizeof(sockaddr_in));
+   local.sin_family = AF_INET;
+   local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   bool failed = false;
+   for (int i = 0; i < num; ++ i)
+   {
+      snd[i].m_llBytes = opt.m_llBytes;
+      snd[i].m_ullEnd = 0;
+      snd[i].m_bFailed = false;
+      snd[i].m_Socket = benchSocket(opt, SOCK_STREAM);
+      if (!opt.m_viWeights.empty())
+         UDT::setsockopt(snd[i].m_Socket, 0, UDT_SNDWEIGHT, &opt.m_viWeights[i % opt.m_viWeights.size()], sizeof(int));
+      if ((opt.m_llMuxRate > 0) && (UDT::INVALID_SOCK != snd[i].m_Socket))
+      {
+         int len = sizeof(sockaddr_in);
+         if ((UDT::ERROR == UDT::bind(snd[i].m_Socket, (sockaddr*)&local, sizeof(sockaddr_in)))
+             || (UDT::ERROR == UDT::getsockname(snd[i].m_Socket, (sockaddr*)&local, &len))
+             || ((0 == i) && (UDT::ERROR == UDT::setmuxrate(ntohs(local.sin_port), UDT_RATECLASS_ALL, opt.m_llMuxRate))))
+         {
+            result.add("error", benchError("bind"));
+            failed = true;
+            break;
+         }
+      }
+      if ((UDT::INVALID_SOCK == snd[i].m_Socket) || (0 != benchConnect(opt, snd[i].m_Socket, addr)))
+      {
+         result.add("error", benchError("connect"));
+         failed = true;
+         break;
+      }
+   }
+
+   if (failed)
+   {
+      // unblock the acceptor
+      UDT::close(serv);
+      benchJoinThread(at);
+      for (int i = 0; i < num; ++ i)
+         UDT::close(snd[i].m_Socket);
+      return -1;
+   }
+
+   benchJoinThread(at);
+   if (acceptor.m_bFailed)
+   {
+      result.add("error", benchError("accept"));
+      UDT::close(serv);
+      return -1;
+   }
+
+   vector<BenchThread> threads;
+   uint64_t start = benchTime();
+   for (int i = 0; i < num; ++ i)
+   {
+      threads.push_back(benchStartThread(recvStream, &rcv[i]));
+      threads.push_back(benchStartThread(sendStream, &snd[i]));
+   }
+   for (vector<BenchThread>::iterator i = threads.begin(); i != threads.end(); ++ i)
+      benchJoinThread(*i);
+
+   uint64_t end = start;
+   double sum = 0, sumsq = 0, minmbps = -1, maxmbps = 0;
+   vector<double> streammbps;
+   for (int i = 0; i < num; ++ i)
+   {
+      failed = failed || rcv[i].m_bFailed || snd[i].m_bFailed;
+      if (rcv[i].m_ullEnd > end)
+         end = rcv[i].m_ullEnd;
+
+      double mbps = opt.m_llBytes * 8.0 / double(rcv[i].m_ullEnd - start + 1);
+      streammbps.push_back(mbps);
+      sum += mbps;
+      sumsq += mbps * mbps;
+      if ((minmbps < 0) || (mbps < minmbps))
+         minmbps = mbps;
+      if (mbps > maxmbps)
+         maxmbps = mbps;
+   }
+
+   double sec = (end - start) / 1000000.0;
+   result.add("seconds", sec)
+         .add("mbps", opt.m_llBytes * 8.0 * num / 1000000.0 / sec);
+   if (num > 1)
+   {
+      // Jain's fairness index over the per-stream rates
+      result.add("stream_mbps_min", minmbps)
+            .add("stream_mbps_max", maxmbps)
+            .add("fairness", sum * sum / (num * sumsq));
+      if (!opt.m_viWeights.empty())
+         result.add("stream_mbps", streammbps);
+   }
+
+   CJson perf;
+   benchPerf(snd[0].m_Socket, perf);
+   result.add("sender", perf);
+
+   CJson sndmux, rcvmux;
+   benchMux(snd[0].m_Socket, sndmux);
+   benchMux(rcv[0].m_Socket, rcvmux);
+   result.add("sender_mux", sndmux)
+         .add("receiver_mux", rcvmux);
+
+   if (failed)
+      result.add("error", benchError("transfer"));
+
+   for (int i = 0; i < num; ++ i)
+   {
+      UDT::close(snd[i].m_Socket);
+      UDT::close(rcv[i].m_Socket);
+   }
+   UDT::close(serv);
+
+   return failed ? -1 : 0;
+}
+
+int scenarioBulk(const CBenchOptions& opt, CJson& config, CJson& result)
+{
+   return runStreams(opt, 1, config, result);
+}
+
+int scenarioStreams(const CBenchOptions& opt, CJson& config, CJson& result)
+{
+   return runStreams(opt, opt.m_iStreams, config, result);
+}
+
+// Repeated short transfers: m_iConns transfers of m_llBytes to the same
+// listener, each over a new connection that is closed when the receiver has
+// confirmed all data. Congestion state cached when a connection closes warm
+// starts the next one, so only the first transfer runs slow start (unless
+// an earlier scenario in the same process already talked to the loopback
+// peer). Samples are the times from connect() to the confirmation, in
+// microseconds.
+
+struct CRepeatServer
+{
+   UDTSOCKET m_Listener;
+   int m_iCount;
+   int64_t m_llBytes;
+   int m_iServed;
+};
+
+static BENCH_THREAD(repeatServer)
+{
+   CRepeatServer* a = (CRepeatServer*)param;
+   char* buf = new char[g_ChunkSize];
+
+   for (a->m_iServed = 0; a->m_iServed < a->m_iCount; ++ a->m_iServed)
+   {
+      UDTSOCKET u = UDT::accept(a->m_Listener, NULL, NULL);
+      if (UDT::INVALID_SOCK == u)
+         break;
+
+      int64_t left = a->m_llBytes;
+      while (left > 0)
+      {
+         int rs = UDT::recv(u, buf, int(left < g_ChunkSize ? left : g_ChunkSize), 0);
+         if (UDT::ERROR == rs)
+            break;
+         left -= rs;
+      }
+      if (0 == left)
+         UDT::send(u, buf, 1, 0);
+      UDT::close(u);
+   }
+
+   delete [] buf;
+   BENCH_THREAD_RETURN;
+}
+
+int scenarioRepeat(const CBenchOptions& opt, CJson& config, CJson& result)
+{
+   config.add("conns", opt.m_iConns)
+         .add("bytes", opt.m_llBytes);
+
+   sockaddr_in addr;
+   UDTSOCKET serv = benchListen(opt, SOCK_STREAM, addr);
+   if (UDT::INVALID_SOCK == serv)
+   {
+      result.add("error", benchError("listen"));
+      return -1;
+   }
+
+   CRepeatServer server;
+   server.m_Listener = serv;
+   server.m_iCount = opt.m_iConns;
+   server.m_llBytes = opt.m_llBytes;
+   server.m_iServed = 0;
+   BenchThread t = benchStartThread(repeatServer, &server);
+
+   char* buf = new char[g_ChunkSize];
+   memset(buf, 0, g_ChunkSize);
+
+   vector<double> samples;
+   int res = 0;
+   for (int i = 0; i < opt.m_iConns; ++ i)
+   {
+      UDTSOCKET u = benchSocket(opt, SOCK_STREAM);
+      uint64_t t0 = benchTime();
+      if ((UDT::INVALID_SOCK == u) || (0 != benchConnect(opt, u, addr)))
+      {
+         result.add("error", benchError("connect"));
+         UDT::close(u);
+         res = -1;
+         break;
+      }
+
+      int64_t left = opt.m_llBytes;
+      while ((0 == res) && (left > 0))
+      {
+         int len = int(left < g_ChunkSize ? left : g_ChunkSize);
+         if (0 != benchSendAll(u, buf, len))
+            res = -1;
+         left -= len;
+      }
+      char ack;
+      if ((0 != res) || (0 != benchRecvAll(u, &ack, 1)))
+      {
+         result.add("error", benchError("transfer"));
+         UDT::close(u);
+         res = -1;
+         break;
+      }
+      samples.push_back(double(benchTime() - t0));
+      UDT::close(u);
+   }
+   delete [] buf;
+
+   // wake up the server if the client gave up early
+   UDT::close(serv);
+   benchJoinThread(t);
+
+   result.add("transfers", int(samples.size()))
+         .add("first_us", samples.empty() ? 0.0 : samples[0]);
+
+   if (samples.size() > 1)
+   {
+      vector<double> rest(samples.begin() + 1, samples.end());
+      CJson c;
+      benchSummary(rest, c);
+      result.add("rest_us", c);
+   }
+
+   return res;
+}
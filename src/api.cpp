@@ -48,11 +48,131 @@ written by
    #include <unistd.h>
 #endif
 #include <cstring>
+#include <new>
 #include "api.h"
 #include "core.h"
+#include "netem.h"
 
 using namespace std;
 
+CAcceptQueue::CAcceptQueue():
+m_pHead(NULL),
+m_pTail(NULL),
+m_iSize(0),
+m_iLive(0),
+m_iWaiting(0)
+{
+   // the queue always holds one consumed node, so producers never see it empty
+   m_pHead = m_pTail = new CNode;
+   m_pHead->m_Socket = CUDT::INVALID_SOCK;
+   m_pHead->m_pNext = NULL;
+}
+
+CAcceptQueue::~CAcceptQueue()
+{
+   while (NULL != m_pHead)
+   {
+      CNode* n = m_pHead->m_pNext;
+      delete m_pHead;
+      m_pHead = n;
+   }
+}
+
+int CAcceptQueue::push(UDTSOCKET u)
+{
+   CNode* n = new CNode;
+   n->m_Socket = u;
+   n->m_pNext = NULL;
+
+   // count first: a consumer may pop the node as soon as it is linked
+   // 先计数再链接，链接后消费者可能立即取走
+   #ifndef WIN32
+      int size = __sync_fetch_and_add(&m_iSize, 1);
+      CNode* prev = __sync_lock_test_and_set(&m_pTail, n);
+      __sync_synchronize();
+   #else
+      int size = InterlockedIncrement((LONG volatile*)&m_iSize) - 1;
+      CNode* prev = (CNode*)InterlockedExchangePointer((PVOID volatile*)&m_pTail, n);
+      MemoryBarrier();
+   #endif
+
+   // until this store the consumer sees the queue ending at prev
+   prev->m_pNext = n;
+
+   return size;
+}
+
+bool CAcceptQueue::pop(UDTSOCKET& u)
+{
+   CNode* head = m_pHead;
+   CNode* next = head->m_pNext;
+   if (NULL == next)
+      return false;
+
+   #ifndef WIN32
+      __sync_synchronize();
+   #else
+      MemoryBarrier();
+   #endif
+
+   // the popped node becomes the consumed one
+   u = next->m_Socket;
+   m_pHead = next;
+   delete head;
+
+   #ifndef WIN32
+      __sync_fetch_and_sub(&m_iSize, 1);
+   #else
+      InterlockedDecrement((LONG volatile*)&m_iSize);
+   #endif
+
+   return true;
+}
+
+void CAcceptQueue::addWaiter(int delta)
+{
+   // full barrier: either the waiter sees the new node, or the producer sees the waiter
+   // 全屏障：要么等待者看到新节点，要么生产者看到等待者
+   #ifndef WIN32
+      __sync_fetch_and_add(&m_iWaiting, delta);
+   #else
+      InterlockedExchangeAdd((LONG volatile*)&m_iWaiting, delta);
+   #endif
+}
+
+bool CAcceptQueue::waiting() const
+{
+   #ifndef WIN32
+      __sync_synchronize();
+   #else
+      MemoryBarrier();
+   #endif
+
+   return m_iWaiting > 0;
+}
+
+// 套接字控制块：CUDTSocket、它的CUDT实例以及本地/对端地址位于slab的同一个对象中
+// Control block of a socket: the socket, its UDT entity and its addresses
+// share one object of the socket slab, so creating a socket is one allocation.
+struct CSocketBlock: public CUDTSocket
+{
+   CSocketBlock(): m_UDT() {init();}
+   CSocketBlock(const CUDT& ancestor): m_UDT(ancestor) {init();}
+
+   void init()
+   {
+      memset(&m_SelfAddr, 0, sizeof(sockaddr_in6));
+      memset(&m_PeerAddr, 0, sizeof(sockaddr_in6));
+      m_pUDT = &m_UDT;
+      m_pSelfAddr = (sockaddr*)&m_SelfAddr;
+      m_pPeerAddr = (sockaddr*)&m_PeerAddr;
+   }
+
+   CUDT m_UDT;
+   sockaddr_in6 m_SelfAddr;                  // large enough for both IP versions
+   sockaddr_in6 m_PeerAddr;
+};
+
 CUDTSocket::CUDTSocket():
 m_Status(INIT),
 m_TimeStamp(0),
@@ -65,10 +185,10 @@ m_PeerID(0),
 m_iISN(0),
 m_pUDT(NULL),
 m_pQueuedSockets(NULL),
-m_pAcceptSockets(NULL),
 m_AcceptCond(),
 m_AcceptLock(),
 m_uiBackLog(0),
+m_bQueued(false),
 m_iMuxID(-1)
 {
    #ifndef WIN32
@@ -84,22 +204,7 @@ m_iMuxID(-1)
 
 CUDTSocket::~CUDTSocket()
 {
-   if (AF_INET == m_iIPversion)
-   {
-      delete (sockaddr_in*)m_pSelfAddr;
-      delete (sockaddr_in*)m_pPeerAddr;
-   }
-   else
-   {
-      delete (sockaddr_in6*)m_pSelfAddr;
-      delete (sockaddr_in6*)m_pPeerAddr;
-   }
-
-   delete m_pUDT;
-   m_pUDT = NULL;
-
    delete m_pQueuedSockets;
-   delete m_pAcceptSockets;
 
    #ifndef WIN32
       pthread_mutex_destroy(&m_AcceptLock);
@@ -123,6 +228,7 @@ m_TLSError(),
 m_mMultiplexer(),
 m_MultiplexerLock(),
 m_pCache(NULL),
+m_pTicketCache(NULL),
 m_bClosing(false),
 m_GCStopLock(),
 m_GCStopCond(),
@@ -155,7 +261,10 @@ m_ClosedSockets()
       m_TLSLock = CreateMutex(NULL, false, NULL);
    #endif
 
-   m_pCache = new CCache<CInfoBlock>;
+   // 过期的网络信息和票据由缓存自行淘汰
+   m_pCache = new CCache<CInfoBlock>(1024, CUDT::m_iInfoLifetime * 1000000ULL);
+   m_pTicketCache = new CCache<CTicketBlock>(1024, CUDT::m_iTicketLifetime * 1000000ULL);
+   m_pSocketSlab = new CSlab(sizeof(CSocketBlock));
 }
 
 CUDTUnited::~CUDTUnited()
@@ -178,6 +287,8 @@ CUDTUnited::~CUDTUnited()
    #endif
 
    delete m_pCache;
+   delete m_pTicketCache;
+   delete m_pSocketSlab;
 }
 
 int CUDTUnited::startup()
@@ -238,14 +349,21 @@ int CUDTUnited::cleanup()
    if (!m_bGCStatus)
       return 0;
 
+   // set under the lock, so that the GC thread cannot miss the signal before it waits
+   CGuard::enterCS(m_GCStopLock);
    m_bClosing = true;
    #ifndef WIN32
       pthread_cond_signal(&m_GCStopCond);
+   #else
+      SetEvent(m_GCStopCond);
+   #endif
+   CGuard::leaveCS(m_GCStopLock);
+
+   #ifndef WIN32
       pthread_join(m_GCThread, NULL);
       pthread_mutex_destroy(&m_GCStopLock);
       pthread_cond_destroy(&m_GCStopCond);
    #else
-      SetEvent(m_GCStopCond);
       WaitForSingleObject(m_GCThread, INFINITE);
       CloseHandle(m_GCThread);
       CloseHandle(m_GCStopLock);
@@ -262,38 +380,46 @@ int CUDTUnited::cleanup()
    return 0;
 }
 
-UDTSOCKET CUDTUnited::newSocket(int af, int type)
+CUDTSocket* CUDTUnited::newSocketBlock(int af, const CUDT* ancestor)
 {
-   if ((type != SOCK_STREAM) && (type != SOCK_DGRAM))
-      throw CUDTException(5, 3, 0);
-
-   CUDTSocket* ns = NULL;
+   void* p = NULL;
+   CSocketBlock* b = NULL;
 
    try
    {
-      // UDT套接字
-      ns = new CUDTSocket;
-      // UDT句柄，注意：此时才创建了一个CUDT实例
-      ns->m_pUDT = new CUDT;
-      if (AF_INET == af)
-      {
-         // IPv4 地址
-         ns->m_pSelfAddr = (sockaddr*)(new sockaddr_in);
-         ((sockaddr_in*)(ns->m_pSelfAddr))->sin_port = 0;
-      }
-      else
-      {  
-         // IPv6 地址
-         ns->m_pSelfAddr = (sockaddr*)(new sockaddr_in6);
-         ((sockaddr_in6*)(ns->m_pSelfAddr))->sin6_port = 0;
-      }
+      p = m_pSocketSlab->alloc();
+      b = (NULL == ancestor) ? new (p) CSocketBlock : new (p) CSocketBlock(*ancestor);
    }
    catch (...)
    {
-      delete ns;
-      throw CUDTException(3, 2, 0);
+      m_pSocketSlab->free(p);
+      return NULL;
    }
 
+   b->m_iIPversion = af;
+
+   return b;
+}
+
+void CUDTUnited::freeSocketBlock(CUDTSocket* s)
+{
+   CSocketBlock* b = static_cast<CSocketBlock*>(s);
+   b->~CSocketBlock();
+   m_pSocketSlab->free(b);
+}
+
+UDTSOCKET CUDTUnited::newSocket(int af, int type)
+{
+   if ((type != SOCK_STREAM) && (type != SOCK_DGRAM))
+      throw CUDTException(5, 3, 0);
+
+   CUDTSocket* ns = NULL;
+
+   // UDT套接字及其CUDT实例，注意：此时才创建了一个CUDT实例
+   ns = newSocketBlock(af, NULL);
+   if (NULL == ns)
+      throw CUDTException(3, 2, 0);
+
    // 保存UDT套接字m_SocketID,是一个随机值
    CGuard::enterCS(m_IDLock);
    ns->m_SocketID = -- m_SocketID;
@@ -308,6 +434,7 @@ UDTSOCKET CUDTUnited::newSocket(int af, int type)
    ns->m_pUDT->m_iSockType = (SOCK_STREAM == type) ? UDT_STREAM : UDT_DGRAM;
    ns->m_pUDT->m_iIPversion = ns->m_iIPversion = af;
    ns->m_pUDT->m_pCache = m_pCache;
+   ns->m_pUDT->m_pTicketCache = m_pTicketCache;
 
    // protect the m_Sockets structure.
    // 使用一个map来保存UDT套接字
@@ -320,7 +447,7 @@ UDTSOCKET CUDTUnited::newSocket(int af, int type)
    {
       //failure and rollback
       CGuard::leaveCS(m_ControlLock);
-      delete ns;
+      freeSocketBlock(ns);
       ns = NULL;
    }
    CGuard::leaveCS(m_ControlLock);
@@ -360,11 +487,11 @@ int CUDTUnited::newConnection(const UDTSOCKET listen, const sockaddr* peer, CHan
          ns->m_Status = CLOSED;
          ns->m_TimeStamp = CTimer::getTime();
 
-         // 从监听套接字的待处理连接队列和已连接队列中移除
-         CGuard::enterCS(ls->m_AcceptLock);
-         ls->m_pQueuedSockets->erase(ns->m_SocketID);
-         ls->m_pAcceptSockets->erase(ns->m_SocketID);
-         CGuard::leaveCS(ls->m_AcceptLock);
+         // a closed socket still in the listener's queue is skipped by accept, and no longer counts against the backlog
+         // 仍在监听套接字队列中的已关闭连接会被accept跳过，也不再占用backlog
+         CGuard::enterCS(m_ControlLock);
+         unqueue(ns);
+         CGuard::leaveCS(m_ControlLock);
       }
       // 旧的连接正常，说明是一个重复的连接请求，封装一个错误报文，后续返回给对端
       else
@@ -384,36 +511,16 @@ int CUDTUnited::newConnection(const UDTSOCKET listen, const sockaddr* peer, CHan
       }
    }
 
-   // exceeding backlog, refuse the connection request
-   // 待处理连接队列已满，拒绝连接请求
-   if (ls->m_pQueuedSockets->size() >= ls->m_uiBackLog)
+   // exceeding backlog, refuse the connection request; closed connections still queued do not count
+   // 待处理连接队列已满，拒绝连接请求；队列中已关闭的连接不计入
+   if ((unsigned int)ls->m_pQueuedSockets->live() >= ls->m_uiBackLog)
       return -1;
 
    // 创建新的连接
-   try
-   {
-      ns = new CUDTSocket;
-      ns->m_pUDT = new CUDT(*(ls->m_pUDT));
-      if (AF_INET == ls->m_iIPversion)
-      {
-         ns->m_pSelfAddr = (sockaddr*)(new sockaddr_in);
-         ((sockaddr_in*)(ns->m_pSelfAddr))->sin_port = 0;
-         ns->m_pPeerAddr = (sockaddr*)(new sockaddr_in);
-         memcpy(ns->m_pPeerAddr, peer, sizeof(sockaddr_in));
-      }
-      else
-      {
-         ns->m_pSelfAddr = (sockaddr*)(new sockaddr_in6);
-         ((sockaddr_in6*)(ns->m_pSelfAddr))->sin6_port = 0;
-         ns->m_pPeerAddr = (sockaddr*)(new sockaddr_in6);
-         memcpy(ns->m_pPeerAddr, peer, sizeof(sockaddr_in6));
-      }
-   }
-   catch (...)
-   {
-      delete ns;
+   ns = newSocketBlock(ls->m_iIPversion, ls->m_pUDT);
+   if (NULL == ns)
       return -1;
-   }
+   memcpy(ns->m_pPeerAddr, peer, (AF_INET == ls->m_iIPversion) ? sizeof(sockaddr_in) : sizeof(sockaddr_in6));
 
    CGuard::enterCS(m_IDLock);
    ns->m_SocketID = -- m_SocketID;
@@ -426,6 +533,7 @@ int CUDTUnited::newConnection(const UDTSOCKET listen, const sockaddr* peer, CHan
    ns->m_iISN = hs->m_iISN;
 
    int error = 0;
+   bool first = false;
 
    // 绑定到一个UDP通道
    try
@@ -458,6 +566,11 @@ int CUDTUnited::newConnection(const UDTSOCKET listen, const sockaddr* peer, CHan
       m_Sockets[ns->m_SocketID] = ns;
       // 记录来自同一个对方所有的连接请求，避免重复连接
       m_PeerRec[(ns->m_PeerID << 30) + ns->m_iISN].insert(ns->m_SocketID);
+
+      // count the connection as open in the listener's queue until it is accepted or closed
+      // 在被accept或关闭之前，计入监听套接字队列的打开连接数
+      ns->m_bQueued = true;
+      first = (1 == ls->m_pQueuedSockets->addLive(1));
    }
    catch (...)
    {
@@ -465,43 +578,60 @@ int CUDTUnited::newConnection(const UDTSOCKET listen, const sockaddr* peer, CHan
    }
    CGuard::leaveCS(m_ControlLock);
 
-   // 将新连接添加到待处理连接队列中
-   CGuard::enterCS(ls->m_AcceptLock);
-   try
+   // 将新连接添加到待处理连接队列中，无锁
+   if (0 == error)
    {
-      ls->m_pQueuedSockets->insert(ns->m_SocketID);
+      try
+      {
+         ls->m_pQueuedSockets->push(ns->m_SocketID);
+      }
+      catch (...)
+      {
+         error = 3;
+      }
    }
-   catch (...)
+
+   // acknowledge users waiting for new connections on the listening socket, when the first open connection is queued
+   // 队列中出现第一个打开的连接时，更新监听套接字的epoll事件为UDT_EPOLL_IN，并唤醒select
+   if (first && (0 == error))
    {
-      error = 3;
+      m_EPoll.update_events(listen, ls->m_pUDT->m_sPollID, UDT_EPOLL_IN, true);
+      CTimer::triggerEvent();
    }
-   CGuard::leaveCS(ls->m_AcceptLock);
-
-   // acknowledge users waiting for new connections on the listening socket
-   // 更新监听套接字的epoll事件为UDT_EPOLL_IN，等待新连接
-   m_EPoll.update_events(listen, ls->m_pUDT->m_sPollID, UDT_EPOLL_IN, true);
-
-   // 唤醒一个等待的accept()调用
-   CTimer::triggerEvent();
 
    ERR_ROLLBACK:
    if (error > 0)
    {
       ns->m_pUDT->close();
+
+      // the garbage collector only finds sockets in m_Sockets or m_ClosedSockets, and a socket that failed
+      // before it was added to m_Sockets would never be released (nor its multiplexer reference)
+      // 垃圾回收只处理m_Sockets或m_ClosedSockets中的套接字，在加入m_Sockets之前失败的套接字必须放入m_ClosedSockets
+      CGuard::enterCS(m_ControlLock);
+      unqueue(ns);
       ns->m_Status = CLOSED;
       ns->m_TimeStamp = CTimer::getTime();
+      m_Sockets.erase(ns->m_SocketID);
+      m_ClosedSockets[ns->m_SocketID] = ns;
+      CGuard::leaveCS(m_ControlLock);
+
+      scheduleGC(ns->m_SocketID);
 
       return -1;
    }
 
-   // wake up a waiting accept() call
-   #ifndef WIN32
-      pthread_mutex_lock(&(ls->m_AcceptLock));
-      pthread_cond_signal(&(ls->m_AcceptCond));
-      pthread_mutex_unlock(&(ls->m_AcceptLock));
-   #else
-      SetEvent(ls->m_AcceptCond);
-   #endif
+   // wake up a waiting accept() call, if any
+   // 只有存在阻塞的accept()调用时才加锁唤醒
+   if (ls->m_pQueuedSockets->waiting())
+   {
+      #ifndef WIN32
+         pthread_mutex_lock(&(ls->m_AcceptLock));
+         pthread_cond_signal(&(ls->m_AcceptCond));
+         pthread_mutex_unlock(&(ls->m_AcceptLock));
+      #else
+         SetEvent(ls->m_AcceptCond);
+      #endif
+   }
 
    return 1;
 }
@@ -636,8 +766,6 @@ int CUDTUnited::bind(UDTSOCKET u, UDPSOCKET udpsock)
 // 创建了两个队列：待处理的连接队列和已连接队列
 int CUDTUnited::listen(const UDTSOCKET u, int backlog)
 {
-   std::cout << "CUDTUnited::listen..." << std::endl;
-
    // 根据socket id查找CUDTSocket实例
    CUDTSocket* s = locate(u);
    if (NULL == s)
@@ -669,15 +797,11 @@ int CUDTUnited::listen(const UDTSOCKET u, int backlog)
 
    try
    {
-      // 正在建立连接的sockfd列表
-      s->m_pQueuedSockets = new set<UDTSOCKET>;
-      // 已经建立连接的sockfd列表
-      s->m_pAcceptSockets = new set<UDTSOCKET>;
+      // 等待accept的新连接队列
+      s->m_pQueuedSockets = new CAcceptQueue;
    }
    catch (...)
    {
-      delete s->m_pQueuedSockets;
-      delete s->m_pAcceptSockets;
       throw CUDTException(3, 2, 0);
    }
 
@@ -711,119 +835,166 @@ UDTSOCKET CUDTUnited::accept(const UDTSOCKET listen, sockaddr* addr, int* addrle
    if (ls->m_pUDT->m_bRendezvous)
       throw CUDTException(5, 7, 0);
 
-   // 套接字初始化
    UDTSOCKET u = CUDT::INVALID_SOCK;
-   bool accepted = false;
+   if (CUDT::ERROR == popAccepted(ls, &u, 1))
+      return CUDT::INVALID_SOCK;
 
-   // !!only one conection can be set up each time!!
-   // 每次只能建立一个连接
-#ifndef WIN32
-      // 阻塞，直到获得一个连接请求
-      while (!accepted)
-      {
-         // 临界区保护，确保一次只处理一个连接请求
-         pthread_mutex_lock(&(ls->m_AcceptLock));
+   // 获取对端地址
+   if ((addr != NULL) && (addrlen != NULL))
+   {
+      // IPv4/IPv6 地址长度不同
+      if (AF_INET == locate(u)->m_iIPversion)
+         *addrlen = sizeof(sockaddr_in);
+      else
+         *addrlen = sizeof(sockaddr_in6);
 
-         // 套接字不可用时，将accepted设置为true,通过这种方式退出循环
+      // copy address information of peer node
+      // 对端地址信息
+      memcpy(addr, locate(u)->m_pPeerAddr, *addrlen);
+   }
+
+   return u;
+}
+
+int CUDTUnited::acceptBatch(const UDTSOCKET listen, UDTSOCKET* sockets, int max)
+{
+   if ((NULL == sockets) || (max <= 0))
+      throw CUDTException(5, 3, 0);
+
+   CUDTSocket* ls = locate(listen);
+
+   if (ls == NULL)
+      throw CUDTException(5, 4, 0);
+
+   if (LISTENING != ls->m_Status)
+      throw CUDTException(5, 6, 0);
+
+   if (ls->m_pUDT->m_bRendezvous)
+      throw CUDTException(5, 7, 0);
+
+   return popAccepted(ls, sockets, max);
+}
+
+int CUDTUnited::popAccepted(CUDTSocket* ls, UDTSOCKET* sockets, int max)
+{
+   int n = 0;
+
+   while (0 == n)
+   {
+      // pop under the accept lock, which serializes the consumers of the queue
+      // 在m_AcceptLock保护下出队，保证同一时刻只有一个消费者
+      CGuard::enterCS(ls->m_AcceptLock);
+
+      bool closed = false;
+      while (n < max)
+      {
          if ((LISTENING != ls->m_Status) || ls->m_pUDT->m_bBroken)
          {
-            // This socket has been closed.
-            accepted = true;
-         }
-         // 有待处理的连接请求
-         else if (ls->m_pQueuedSockets->size() > 0)
-         {
-            // 将sockfd从m_pQueuedSockets转移到m_pAcceptSockets
-            
-            // 获取待连接队列中的第一个元素
-            u = *(ls->m_pQueuedSockets->begin());
-            // 将sockfd添加到已连接队列的队尾
-            ls->m_pAcceptSockets->insert(ls->m_pAcceptSockets->end(), u);
-            // 从待连接队列中删除该元素
-            ls->m_pQueuedSockets->erase(ls->m_pQueuedSockets->begin());
-            // 更新标志位
-            accepted = true;
-         }
-         // 同步接收模式　？？？
-         else if (!ls->m_pUDT->m_bSynRecving)
-         {
-            accepted = true;
+            closed = true;
+            break;
          }
 
-         // 没有待处理连接时，通过条件变量休眠
-         if (!accepted && (LISTENING == ls->m_Status)){
-            pthread_cond_wait(&(ls->m_AcceptCond), &(ls->m_AcceptLock));
+         if (ls->m_pQueuedSockets->pop(sockets[n]))
+         {
+            ++ n;
+            continue;
          }
 
-         // 待处理的套接字队列为空，将监听套接字从epoll中移除，减少资源占用
-         if (ls->m_pQueuedSockets->empty())
-            m_EPoll.update_events(listen, ls->m_pUDT->m_sPollID, UDT_EPOLL_IN, false);
+         // non-blocking, or some connections have been taken already
+         if (!ls->m_pUDT->m_bSynRecving || (n > 0))
+            break;
 
-         pthread_mutex_unlock(&(ls->m_AcceptLock));
-      }
-#else
-      while (!accepted)
-      {
-         WaitForSingleObject(ls->m_AcceptLock, INFINITE);
-
-         if (ls->m_pQueuedSockets->size() > 0)
+         // register before the last check, so that a producer either sees this waiter or its push is seen here
+         // 先登记为等待者再检查队列，避免丢失唤醒
+         ls->m_pQueuedSockets->addWaiter(1);
+         if (0 == ls->m_pQueuedSockets->size())
          {
-            u = *(ls->m_pQueuedSockets->begin());
-            ls->m_pAcceptSockets->insert(ls->m_pAcceptSockets->end(), u);
-            ls->m_pQueuedSockets->erase(ls->m_pQueuedSockets->begin());
-
-            accepted = true;
+            #ifndef WIN32
+               pthread_cond_wait(&(ls->m_AcceptCond), &(ls->m_AcceptLock));
+            #else
+               CGuard::leaveCS(ls->m_AcceptLock);
+               WaitForSingleObject(ls->m_AcceptCond, INFINITE);
+               CGuard::enterCS(ls->m_AcceptLock);
+            #endif
          }
-         else if (!ls->m_pUDT->m_bSynRecving)
-            accepted = true;
+         ls->m_pQueuedSockets->addWaiter(-1);
+      }
+
+      #ifdef WIN32
+         // pass the close on to other threads waiting to accept
+         if (closed)
+            SetEvent(ls->m_AcceptCond);
+      #endif
 
-         ReleaseMutex(ls->m_AcceptLock);
+      CGuard::leaveCS(ls->m_AcceptLock);
 
-         if  (!accepted & (LISTENING == ls->m_Status))
-            WaitForSingleObject(ls->m_AcceptCond, INFINITE);
+      if (closed && (0 == n))
+      {
+         // listening socket is closed
+         throw CUDTException(5, 6, 0);
+      }
 
-         if ((LISTENING != ls->m_Status) || ls->m_pUDT->m_bBroken)
+      // drop the connections closed while they were queued, with one lookup of the socket map for the batch;
+      // the closed ones have been uncounted already when they were closed
+      // 丢弃排队期间已关闭的连接，整批只加锁查找一次；已关闭的连接在关闭时已扣除计数
+      CGuard::enterCS(m_ControlLock);
+      int k = 0;
+      for (int i = 0; i < n; ++ i)
+      {
+         map<UDTSOCKET, CUDTSocket*>::iterator j = m_Sockets.find(sockets[i]);
+         if (j == m_Sockets.end())
+            continue;
+         if (j->second->m_bQueued)
          {
-            // Send signal to other threads that are waiting to accept.
-            SetEvent(ls->m_AcceptCond);
-            accepted = true;
+            j->second->m_bQueued = false;
+            ls->m_pQueuedSockets->addLive(-1);
          }
+         if (CONNECTED == j->second->m_Status)
+            sockets[k ++] = sockets[i];
+      }
+      CGuard::leaveCS(m_ControlLock);
+      n = k;
 
-         if (ls->m_pQueuedSockets->empty())
-            m_EPoll.update_events(listen, ls->m_pUDT->m_sPollID, UDT_EPOLL_IN, false);
+      // no more open connection to accept: clear the read event of the listener, unless a new one has just arrived
+      // 队列中没有打开的连接时清除监听套接字的读事件，再次检查以免覆盖刚到达的新连接
+      if (0 == ls->m_pQueuedSockets->live())
+      {
+         m_EPoll.update_events(ls->m_SocketID, ls->m_pUDT->m_sPollID, UDT_EPOLL_IN, false);
+         if (ls->m_pQueuedSockets->live() > 0)
+            m_EPoll.update_events(ls->m_SocketID, ls->m_pUDT->m_sPollID, UDT_EPOLL_IN, true);
       }
-#endif
 
-   // 没有待处理的连接
-   if (u == CUDT::INVALID_SOCK)
-   {
-      // non-blocking receiving, no connection available
-      // 非阻塞接收，没有可用的连接
-      if (!ls->m_pUDT->m_bSynRecving)
-         throw CUDTException(6, 2, 0);
+      if ((0 == n) && (closed || !ls->m_pUDT->m_bSynRecving))
+      {
+         if (closed)
+            throw CUDTException(5, 6, 0);
 
-      // listening socket is closed
-      throw CUDTException(5, 6, 0);
+         // non-blocking receiving, no connection available
+         return CUDT::wouldBlock(2);
+      }
    }
 
-   // 获取对端地址
-   if ((addr != NULL) && (addrlen != NULL))
-   {
-      // IPv4/IPv6 地址长度不同
-      if (AF_INET == locate(u)->m_iIPversion)
-         *addrlen = sizeof(sockaddr_in);
-      else
-         *addrlen = sizeof(sockaddr_in6);
+   return n;
+}
 
-      // copy address information of peer node
-      // 对端地址信息
-      memcpy(addr, locate(u)->m_pPeerAddr, *addrlen);
-   }
+void CUDTUnited::unqueue(CUDTSocket* s)
+{
+   if (!s->m_bQueued)
+      return;
+   s->m_bQueued = false;
 
-   return u;
+   // the listener may be gone already, together with its queue
+   map<UDTSOCKET, CUDTSocket*>::iterator i = m_Sockets.find(s->m_ListenSocket);
+   if ((i == m_Sockets.end()) || (NULL == i->second->m_pQueuedSockets))
+      return;
+
+   // the last open connection is gone: the listener is no longer readable
+   // 最后一个打开的连接已关闭，监听套接字不再可读
+   if (0 == i->second->m_pQueuedSockets->addLive(-1))
+      m_EPoll.update_events(i->first, i->second->m_pUDT->m_sPollID, UDT_EPOLL_IN, false);
 }
 
-int CUDTUnited::connect(const UDTSOCKET u, const sockaddr* name, int namelen)
+int CUDTUnited::connect(const UDTSOCKET u, const sockaddr* name, int namelen, const char* data, int len)
 {
    // 从map中查找UDT套接字
    CUDTSocket* s = locate(u);
@@ -871,7 +1042,7 @@ int CUDTUnited::connect(const UDTSOCKET u, const sockaddr* name, int namelen)
    try
    {
       // 核心逻辑，开始建立连接
-      s->m_pUDT->connect(name);
+      s->m_pUDT->connect(name, data, len);
    }
    catch (CUDTException e)
    {
@@ -880,17 +1051,7 @@ int CUDTUnited::connect(const UDTSOCKET u, const sockaddr* name, int namelen)
    }
 
    // 记录对端IP地址
-   delete s->m_pPeerAddr;
-   if (AF_INET == s->m_iIPversion)
-   {
-      s->m_pPeerAddr = (sockaddr*)(new sockaddr_in);
-      memcpy(s->m_pPeerAddr, name, sizeof(sockaddr_in));
-   }
-   else
-   {
-      s->m_pPeerAddr = (sockaddr*)(new sockaddr_in6);
-      memcpy(s->m_pPeerAddr, name, sizeof(sockaddr_in6));
-   }
+   memcpy(s->m_pPeerAddr, name, (AF_INET == s->m_iIPversion) ? sizeof(sockaddr_in) : sizeof(sockaddr_in6));
 
    return 0;
 }
@@ -925,6 +1086,7 @@ int CUDTUnited::close(const UDTSOCKET u)
 
       s->m_TimeStamp = CTimer::getTime();
       s->m_pUDT->m_bBroken = true;
+      scheduleGC(u);
 
       // broadcast all "accept" waiting
       #ifndef WIN32
@@ -950,6 +1112,7 @@ int CUDTUnited::close(const UDTSOCKET u)
    s = i->second;
 
    s->m_Status = CLOSED;
+   unqueue(s);
 
    // a socket will not be immediated removed when it is closed
    // in order to prevent other methods from accessing invalid address
@@ -958,6 +1121,7 @@ int CUDTUnited::close(const UDTSOCKET u)
 
    m_Sockets.erase(s->m_SocketID);
    m_ClosedSockets.insert(pair<UDTSOCKET, CUDTSocket*>(s->m_SocketID, s));
+   scheduleGC(u);
 
    CTimer::triggerEvent();
 
@@ -1078,7 +1242,7 @@ int CUDTUnited::select(ud_set* readfds, ud_set* writefds, ud_set* exceptfds, con
 
          if ((s->m_pUDT->m_bConnected && (s->m_pUDT->m_pRcvBuffer->getRcvDataSize() > 0) && ((s->m_pUDT->m_iSockType == UDT_STREAM) || (s->m_pUDT->m_pRcvBuffer->getRcvMsgNum() > 0)))
             || (!s->m_pUDT->m_bListening && (s->m_pUDT->m_bBroken || !s->m_pUDT->m_bConnected))
-            || (s->m_pUDT->m_bListening && (s->m_pQueuedSockets->size() > 0))
+            || (s->m_pUDT->m_bListening && (s->m_pQueuedSockets->live() > 0))
             || (s->m_Status == CLOSED))
          {
             rs.insert(s->m_SocketID);
@@ -1161,7 +1325,7 @@ int CUDTUnited::selectEx(const vector<UDTSOCKET>& fds, vector<UDTSOCKET>* readfd
          if (NULL != readfds)
          {
             if ((s->m_pUDT->m_bConnected && (s->m_pUDT->m_pRcvBuffer->getRcvDataSize() > 0) && ((s->m_pUDT->m_iSockType == UDT_STREAM) || (s->m_pUDT->m_pRcvBuffer->getRcvMsgNum() > 0)))
-               || (s->m_pUDT->m_bListening && (s->m_pQueuedSockets->size() > 0)))
+               || (s->m_pUDT->m_bListening && (s->m_pQueuedSockets->live() > 0)))
             {
                readfds->push_back(s->m_SocketID);
                ++ count;
@@ -1238,7 +1402,11 @@ int CUDTUnited::epoll_remove_ssock(const int eid, const SYSSOCKET s)
 
 int CUDTUnited::epoll_wait(const int eid, set<UDTSOCKET>* readfds, set<UDTSOCKET>* writefds, int64_t msTimeOut, set<SYSSOCKET>* lrfds, set<SYSSOCKET>* lwfds)
 {
-   return m_EPoll.wait(eid, readfds, writefds, msTimeOut, lrfds, lwfds);
+   int n = m_EPoll.wait(eid, readfds, writefds, msTimeOut, lrfds, lwfds);
+   if (n < 0)
+      return CUDT::wouldBlock(3);
+
+   return n;
 }
 
 int CUDTUnited::epoll_release(const int eid)
@@ -1246,6 +1414,90 @@ int CUDTUnited::epoll_release(const int eid)
    return m_EPoll.release(eid);
 }
 
+int CUDTUnited::getMuxStats(int port, CMuxStats* stats)
+{
+   if (NULL == stats)
+      throw CUDTException(5, 3, 0);
+
+   CGuard cg(m_ControlLock);
+
+   CMultiplexer* m = locateMux(port);
+   if (NULL == m)
+      throw CUDTException(5, 3, 0);
+
+   memset(stats, 0, sizeof(CMuxStats));
+   stats->iPort = m->m_iPort;
+   stats->iIPversion = m->m_iIPversion;
+   stats->iSockets = m->m_iRefCount;
+   m->m_pSndQueue->getStats(*stats);
+   m->m_pRcvQueue->getStats(*stats);
+   m->m_pConnSlab->getStats(stats->connSlabUsed, stats->connSlabTotal);
+
+   return 0;
+}
+
+int CUDTUnited::setMuxTrace(int port, int size)
+{
+   if (size < 0)
+      throw CUDTException(5, 3, 0);
+
+   CGuard cg(m_ControlLock);
+
+   CMultiplexer* m = locateMux(port);
+   if (NULL == m)
+      throw CUDTException(5, 3, 0);
+
+   m->m_pTrace->setSize(size);
+
+   return 0;
+}
+
+int CUDTUnited::getMuxTrace(int port, CMuxEvent* events, int len)
+{
+   if ((NULL == events) || (len < 0))
+      throw CUDTException(5, 3, 0);
+
+   CGuard cg(m_ControlLock);
+
+   CMultiplexer* m = locateMux(port);
+   if (NULL == m)
+      throw CUDTException(5, 3, 0);
+
+   return m->m_pTrace->read(events, len);
+}
+
+int CUDTUnited::setMuxRate(int port, int cls, int64_t bandwidth)
+{
+   if ((cls < UDT_RATECLASS_ALL) || (cls >= UDT_RATECLASS_NUM))
+      throw CUDTException(5, 3, 0);
+
+   CGuard cg(m_ControlLock);
+
+   CMultiplexer* m = locateMux(port);
+   if (NULL == m)
+      throw CUDTException(5, 3, 0);
+
+   m->m_pSndQueue->m_pSndUList->setRate(cls, bandwidth);
+
+   return 0;
+}
+
+int CUDTUnited::getMuxRate(int port, int cls, int64_t* bandwidth)
+{
+   if ((NULL == bandwidth) || (cls < UDT_RATECLASS_ALL) || (cls >= UDT_RATECLASS_NUM))
+      throw CUDTException(5, 3, 0);
+
+   CGuard cg(m_ControlLock);
+
+   CMultiplexer* m = locateMux(port);
+   if (NULL == m)
+      throw CUDTException(5, 3, 0);
+
+   *bandwidth = m->m_pSndQueue->m_pSndUList->getRate(cls);
+
+   return 0;
+}
+
 // 根据socket id从m_Sockets中查找对应的CUDTSocket实例
 CUDTSocket* CUDTUnited::locate(const UDTSOCKET u)
 {
@@ -1281,91 +1533,112 @@ CUDTSocket* CUDTUnited::locate(const sockaddr* peer, const UDTSOCKET id, int32_t
    return NULL;
 }
 
-void CUDTUnited::checkBrokenSockets()
+void CUDTUnited::scheduleGC(const UDTSOCKET u, const uint64_t delay)
+{
+   uint64_t due = CTimer::getTime() + delay;
+
+   CGuard::enterCS(m_GCStopLock);
+
+   // wake up the GC thread only if it sleeps past the new due time
+   // 只有新的检查时间早于GC线程当前的唤醒时间时才唤醒它
+   bool wake = m_GCQueue.empty() || (due < m_GCQueue.begin()->first);
+   m_GCQueue.insert(pair<uint64_t, UDTSOCKET>(due, u));
+
+   if (wake)
+   {
+      #ifndef WIN32
+         pthread_cond_signal(&m_GCStopCond);
+      #else
+         SetEvent(m_GCStopCond);
+      #endif
+   }
+
+   CGuard::leaveCS(m_GCStopLock);
+}
+
+void CUDTUnited::checkSocket(const UDTSOCKET u)
 {
    CGuard cg(m_ControlLock);
 
-   // set of sockets To Be Closed and To Be Removed
-   vector<UDTSOCKET> tbc;     // 将要被关闭的socket
-   vector<UDTSOCKET> tbr;     // 将要被删除的socket
+   uint64_t now = CTimer::getTime();
 
-   // 检查socket状态
-   for (map<UDTSOCKET, CUDTSocket*>::iterator i = m_Sockets.begin(); i != m_Sockets.end(); ++ i)
+   map<UDTSOCKET, CUDTSocket*>::iterator i = m_Sockets.find(u);
+   if (i != m_Sockets.end())
    {
+      CUDTSocket* s = i->second;
+
       // check broken connection
-      if (i->second->m_pUDT->m_bBroken)
+      if (!s->m_pUDT->m_bBroken && (s->m_Status != CLOSED))
+         return;
+
+      if (s->m_pUDT->m_bBroken)
       {
-         if (i->second->m_Status == LISTENING)
+         if (s->m_Status == LISTENING)
          {
             // for a listening socket, it should wait an extra 3 seconds in case a client is connecting
-            // listening 的socket,需要额外等待3秒，防止有客户端正在尝试连接，这么做有什么好处?
-            if (CTimer::getTime() - i->second->m_TimeStamp < 3000000)
-               continue;
+            // listening 的socket,需要额外等待3秒，防止有客户端正在尝试连接
+            if (now - s->m_TimeStamp < 3000000)
+            {
+               scheduleGC(u, s->m_TimeStamp + 3000000 - now);
+               return;
+            }
          }
-         // 如果接受有缓冲区中有数据，continue
-         else if ((i->second->m_pUDT->m_pRcvBuffer != NULL) && (i->second->m_pUDT->m_pRcvBuffer->getRcvDataSize() > 0) && (i->second->m_pUDT->m_iBrokenCounter -- > 0))
+         // 如果接收缓冲区中有数据，每秒再检查一次，直到计数用完
+         else if ((s->m_pUDT->m_pRcvBuffer != NULL) && (s->m_pUDT->m_pRcvBuffer->getRcvDataSize() > 0) && (s->m_pUDT->m_iBrokenCounter -- > 0))
          {
             // if there is still data in the receiver buffer, wait longer
-            continue;
-         }
-
-         //close broken connections and start removal timer
-         // 将socket设置为CLOSED状态，将其放入待关闭列表tbc中，更新m_ClosedSockets中对应的信息
-         i->second->m_Status = CLOSED;
-         i->second->m_TimeStamp = CTimer::getTime();
-         tbc.push_back(i->first);
-         m_ClosedSockets[i->first] = i->second;
-
-         // remove from listener's queue
-         // 从m_Sockets和m_ClosedSockets中查找listen sockfd
-         map<UDTSOCKET, CUDTSocket*>::iterator ls = m_Sockets.find(i->second->m_ListenSocket);
-         if (ls == m_Sockets.end())
-         {
-            ls = m_ClosedSockets.find(i->second->m_ListenSocket);
-            if (ls == m_ClosedSockets.end())
-               continue;
+            scheduleGC(u, 1000000);
+            return;
          }
-
-         // 清除待连接列表和已连接列表中的sockfd
-         CGuard::enterCS(ls->second->m_AcceptLock);
-         ls->second->m_pQueuedSockets->erase(i->second->m_SocketID);
-         ls->second->m_pAcceptSockets->erase(i->second->m_SocketID);
-         CGuard::leaveCS(ls->second->m_AcceptLock);
       }
+
+      //close broken connections and start removal timer
+      // 将socket设置为CLOSED状态，移入m_ClosedSockets，1秒后删除
+      s->m_Status = CLOSED;
+      s->m_TimeStamp = now;
+      m_ClosedSockets[u] = s;
+      m_Sockets.erase(i);
+
+      // a closed socket still in its listener's queue is skipped by accept(), and no longer counts against the backlog
+      // 仍在监听队列中的已关闭连接由accept()跳过，也不再占用backlog
+      unqueue(s);
+      scheduleGC(u, 1000000);
+      return;
    }
 
-   // 检查处于closed状态的sockfd
-   for (map<UDTSOCKET, CUDTSocket*>::iterator j = m_ClosedSockets.begin(); j != m_ClosedSockets.end(); ++ j)
+   i = m_ClosedSockets.find(u);
+   if (i == m_ClosedSockets.end())
+      return;
+
+   CUDTSocket* s = i->second;
+
+   // sockfd对应的发送缓冲区中仍有数据，并且尚未超时
+   if (s->m_pUDT->m_ullLingerExpiration > 0)
    {
-      // sockfd对应的发送缓冲区中仍有数据，并且尚未超时
-      if (j->second->m_pUDT->m_ullLingerExpiration > 0)
+      // asynchronous close: 
+      // 异步关闭：如果发送缓冲区为空或超时，则关闭；否则每秒检查一次
+      if ((NULL == s->m_pUDT->m_pSndBuffer) || (0 == s->m_pUDT->m_pSndBuffer->getCurrBufSize()) || (s->m_pUDT->m_ullLingerExpiration <= now))
       {
-         // asynchronous close: 
-         // 异步关闭：如果发送缓冲区为空或超时，则关闭
-         if ((NULL == j->second->m_pUDT->m_pSndBuffer) || (0 == j->second->m_pUDT->m_pSndBuffer->getCurrBufSize()) || (j->second->m_pUDT->m_ullLingerExpiration <= CTimer::getTime()))
-         {
-            j->second->m_pUDT->m_ullLingerExpiration = 0;   // 清空超时时间
-            j->second->m_pUDT->m_bClosing = true;           // 更新sockfd状态 - closing
-            j->second->m_TimeStamp = CTimer::getTime();     // 更新时间戳
-         }
+         s->m_pUDT->m_ullLingerExpiration = 0;   // 清空超时时间
+         s->m_pUDT->m_bClosing = true;           // 更新sockfd状态 - closing
+         s->m_TimeStamp = now;                   // 更新时间戳
       }
-
-      // timeout 1 second to destroy a socket AND it has been removed from RcvUList
-      // 等待１秒，等待sockfd销毁和从RcvUList中删除，这个操作有必要吗？使用延时的方式合理吗？
-      if ((CTimer::getTime() - j->second->m_TimeStamp > 1000000) && ((NULL == j->second->m_pUDT->m_pRNode) || !j->second->m_pUDT->m_pRNode->m_bOnList))
+      else
       {
-         // 将其放到待删除列表中
-         tbr.push_back(j->first);
+         uint64_t left = s->m_pUDT->m_ullLingerExpiration - now;
+         scheduleGC(u, (left < 1000000) ? left : 1000000);
+         return;
       }
    }
 
-   // move closed sockets to the ClosedSockets structure
-   for (vector<UDTSOCKET>::iterator k = tbc.begin(); k != tbc.end(); ++ k)
-      m_Sockets.erase(*k);
-
-   // remove those timeout sockets
-   for (vector<UDTSOCKET>::iterator l = tbr.begin(); l != tbr.end(); ++ l)
-      removeSocket(*l);
+   // timeout 1 second to destroy a socket AND it has been removed from the receiving queue
+   // 关闭1秒后，且已从接收队列中移除，才删除套接字
+   if ((now - s->m_TimeStamp > 1000000) && ((NULL == s->m_pUDT->m_pRNode) || !s->m_pUDT->m_pRNode->m_bOnList))
+      removeSocket(u);
+   else if (now - s->m_TimeStamp > 1000000)
+      scheduleGC(u, 1000000);
+   else
+      scheduleGC(u, s->m_TimeStamp + 1000001 - now);
 }
 
 void CUDTUnited::removeSocket(const UDTSOCKET u)
@@ -1384,14 +1657,20 @@ void CUDTUnited::removeSocket(const UDTSOCKET u)
       CGuard::enterCS(i->second->m_AcceptLock);
 
       // if it is a listener, close all un-accepted sockets in its queue and remove them later
-      for (set<UDTSOCKET>::iterator q = i->second->m_pQueuedSockets->begin(); q != i->second->m_pQueuedSockets->end(); ++ q)
+      UDTSOCKET q;
+      while (i->second->m_pQueuedSockets->pop(q))
       {
-         m_Sockets[*q]->m_pUDT->m_bBroken = true;
-         m_Sockets[*q]->m_pUDT->close();
-         m_Sockets[*q]->m_TimeStamp = CTimer::getTime();
-         m_Sockets[*q]->m_Status = CLOSED;
-         m_ClosedSockets[*q] = m_Sockets[*q];
-         m_Sockets.erase(*q);
+         map<UDTSOCKET, CUDTSocket*>::iterator k = m_Sockets.find(q);
+         if (k == m_Sockets.end())
+            continue;
+
+         k->second->m_pUDT->m_bBroken = true;
+         k->second->m_pUDT->close();
+         k->second->m_TimeStamp = CTimer::getTime();
+         k->second->m_Status = CLOSED;
+         m_ClosedSockets[q] = k->second;
+         m_Sockets.erase(k);
+         scheduleGC(q);
       }
 
       CGuard::leaveCS(i->second->m_AcceptLock);
@@ -1408,7 +1687,7 @@ void CUDTUnited::removeSocket(const UDTSOCKET u)
 
    // delete this one
    i->second->m_pUDT->close();
-   delete i->second;
+   freeSocketBlock(i->second);
    m_ClosedSockets.erase(i);
 
    map<int, CMultiplexer>::iterator m;
@@ -1427,38 +1706,39 @@ void CUDTUnited::removeSocket(const UDTSOCKET u)
       delete m->second.m_pRcvQueue;
       delete m->second.m_pTimer;
       delete m->second.m_pChannel;
+      delete m->second.m_pTrace;
+      delete m->second.m_pConnSlab;
       m_mMultiplexer.erase(m);
    }
 }
 
-void CUDTUnited::setError(CUDTException* e)
+void CUDTUnited::setError(const CUDTException& e)
 {
-   #ifndef WIN32
-      delete (CUDTException*)pthread_getspecific(m_TLSError);
-      pthread_setspecific(m_TLSError, e);
-   #else
-      CGuard tg(m_TLSLock);
-      delete (CUDTException*)TlsGetValue(m_TLSError);
-      TlsSetValue(m_TLSError, e);
-      m_mTLSRecord[GetCurrentThreadId()] = e;
-   #endif
+   // the error object of a thread is allocated once and overwritten in place afterwards
+   // 每个线程的错误对象只分配一次，之后原地覆盖，出错时不再分配内存
+   *getError() = e;
 }
 
 CUDTException* CUDTUnited::getError()
 {
    #ifndef WIN32
-      if(NULL == pthread_getspecific(m_TLSError))
-         pthread_setspecific(m_TLSError, new CUDTException);
-      return (CUDTException*)pthread_getspecific(m_TLSError);
+      CUDTException* e = (CUDTException*)pthread_getspecific(m_TLSError);
+      if (NULL == e)
+      {
+         e = new CUDTException;
+         pthread_setspecific(m_TLSError, e);
+      }
+      return e;
    #else
-      CGuard tg(m_TLSLock);
-      if(NULL == TlsGetValue(m_TLSError))
+      CUDTException* e = (CUDTException*)TlsGetValue(m_TLSError);
+      if (NULL == e)
       {
-         CUDTException* e = new CUDTException;
+         e = new CUDTException;
          TlsSetValue(m_TLSError, e);
+         CGuard tg(m_TLSLock);
          m_mTLSRecord[GetCurrentThreadId()] = e;
       }
-      return (CUDTException*)TlsGetValue(m_TLSError);
+      return e;
    #endif
 }
 
@@ -1501,7 +1781,7 @@ void CUDTUnited::updateMux(CUDTSocket* s, const sockaddr* addr, const UDPSOCKET*
    CGuard cg(m_ControlLock);
 
    // 地址复用
-   if ((s->m_pUDT->m_bReuseAddr) && (NULL != addr))
+   if ((s->m_pUDT->m_bReuseAddr) && (NULL != addr) && !CEmuChannel::isEnabled(s->m_pUDT->m_NetEmu))
    {
       // 从IPv4/IPv6地址中获取端口号
       int port = (AF_INET == s->m_pUDT->m_iIPversion) ? ntohs(((sockaddr_in*)addr)->sin_port) : ntohs(((sockaddr_in6*)addr)->sin6_port);
@@ -1519,6 +1799,7 @@ void CUDTUnited::updateMux(CUDTSocket* s, const sockaddr* addr, const UDPSOCKET*
                ++ i->second.m_iRefCount;
                s->m_pUDT->m_pSndQueue = i->second.m_pSndQueue;
                s->m_pUDT->m_pRcvQueue = i->second.m_pRcvQueue;
+               s->m_pUDT->m_pConnSlab = i->second.m_pConnSlab;
                s->m_iMuxID = i->second.m_iID;
                return;
             }
@@ -1532,11 +1813,15 @@ void CUDTUnited::updateMux(CUDTSocket* s, const sockaddr* addr, const UDPSOCKET*
    m.m_iMSS = s->m_pUDT->m_iMSS;
    m.m_iIPversion = s->m_pUDT->m_iIPversion;
    m.m_iRefCount = 1;
-   m.m_bReusable = s->m_pUDT->m_bReuseAddr;
    m.m_iID = s->m_SocketID;
 
-   // 创建UDP通道
-   m.m_pChannel = new CChannel(s->m_pUDT->m_iIPversion);
+   // 创建UDP通道，如果设置了网络仿真参数，则使用仿真通道；仿真通道不与其他套接字共享
+   CEmuChannel* emu = NULL;
+   if (CEmuChannel::isEnabled(s->m_pUDT->m_NetEmu))
+      m.m_pChannel = emu = new CEmuChannel(s->m_pUDT->m_iIPversion, s->m_pUDT->m_NetEmu);
+   else
+      m.m_pChannel = new CChannel(s->m_pUDT->m_iIPversion);
+   m.m_bReusable = s->m_pUDT->m_bReuseAddr && (NULL == emu);
    m.m_pChannel->setSndBufSize(s->m_pUDT->m_iUDPSndBufSize);
    m.m_pChannel->setRcvBufSize(s->m_pUDT->m_iUDPRcvBufSize);
 
@@ -1548,6 +1833,9 @@ void CUDTUnited::updateMux(CUDTSocket* s, const sockaddr* addr, const UDPSOCKET*
          m.m_pChannel->open(*udpsock);
       else
          m.m_pChannel->open(addr);
+
+      if (NULL != emu)
+         emu->start();
    }
    catch (CUDTException& e)
    {
@@ -1565,12 +1853,17 @@ void CUDTUnited::updateMux(CUDTSocket* s, const sockaddr* addr, const UDPSOCKET*
 
    // 创建一个定时器
    m.m_pTimer = new CTimer;
+   // 工作线程事件跟踪，默认关闭
+   m.m_pTrace = new CMuxTrace;
 
    // 创建发送/接收队列
    m.m_pSndQueue = new CSndQueue;
-   m.m_pSndQueue->init(m.m_pChannel, m.m_pTimer);
+   m.m_pSndQueue->init(m.m_pChannel, m.m_pTimer, m.m_pTrace);
    m.m_pRcvQueue = new CRcvQueue;
-   m.m_pRcvQueue->init(32, s->m_pUDT->m_iPayloadSize, m.m_iIPversion, 1024, m.m_pChannel, m.m_pTimer);
+   m.m_pRcvQueue->init(32, s->m_pUDT->m_iPayloadSize, m.m_iIPversion, 1024, m.m_pChannel, m.m_pTimer, m.m_pTrace);
+
+   // 连接状态（收发缓冲、丢失列表、窗口）从复用器的slab中分配
+   m.m_pConnSlab = new CSlab(sizeof(CConnState));
 
    // 保存CMultiplexer到map中
    m_mMultiplexer[m.m_iID] = m;
@@ -1578,6 +1871,7 @@ void CUDTUnited::updateMux(CUDTSocket* s, const sockaddr* addr, const UDPSOCKET*
    // 更新UDT套接字发送/接收队列
    s->m_pUDT->m_pSndQueue = m.m_pSndQueue;
    s->m_pUDT->m_pRcvQueue = m.m_pRcvQueue;
+   s->m_pUDT->m_pConnSlab = m.m_pConnSlab;
    s->m_iMuxID = m.m_iID;
 }
 
@@ -1601,12 +1895,24 @@ void CUDTUnited::updateMux(CUDTSocket* s, const CUDTSocket* ls)
          ++ i->second.m_iRefCount;   // 引用计数+1
          s->m_pUDT->m_pSndQueue = i->second.m_pSndQueue;
          s->m_pUDT->m_pRcvQueue = i->second.m_pRcvQueue;
+         s->m_pUDT->m_pConnSlab = i->second.m_pConnSlab;
          s->m_iMuxID = i->second.m_iID;
          return;
       }
    }
 }
 
+CMultiplexer* CUDTUnited::locateMux(int port)
+{
+   for (map<int, CMultiplexer>::iterator i = m_mMultiplexer.begin(); i != m_mMultiplexer.end(); ++ i)
+   {
+      if (i->second.m_iPort == port)
+         return &(i->second);
+   }
+
+   return NULL;
+}
+
 #ifndef WIN32
    void* CUDTUnited::garbageCollect(void* p)
 #else
@@ -1615,30 +1921,57 @@ void CUDTUnited::updateMux(CUDTSocket* s, const CUDTSocket* ls)
 {
    CUDTUnited* self = (CUDTUnited*)p;
 
-   CGuard gcguard(self->m_GCStopLock);
+   // sockets are queued when they are broken or closed, so no scan of all sockets is needed
+   // 套接字在断开或关闭时排队，GC线程只检查到期的套接字，不再扫描全部套接字
+   vector<UDTSOCKET> due;
 
+   CGuard::enterCS(self->m_GCStopLock);
    while (!self->m_bClosing)
    {
-      // 检查sockfd状态，将不同状态的sockfd转移到不同的列表中
-      self->checkBrokenSockets();
+      // 取出所有到期的套接字
+      uint64_t now = CTimer::getTime();
+      multimap<uint64_t, UDTSOCKET>::iterator i = self->m_GCQueue.begin();
+      for (; (i != self->m_GCQueue.end()) && (i->first <= now); ++ i)
+         due.push_back(i->second);
+      self->m_GCQueue.erase(self->m_GCQueue.begin(), i);
+
+      if (!due.empty())
+      {
+         // checkSocket() takes m_ControlLock, which must not be acquired under m_GCStopLock
+         CGuard::leaveCS(self->m_GCStopLock);
+         for (vector<UDTSOCKET>::iterator j = due.begin(); j != due.end(); ++ j)
+            self->checkSocket(*j);
+         due.clear();
+         CGuard::enterCS(self->m_GCStopLock);
+         continue;
+      }
 
       #ifdef WIN32
          self->checkTLSValue();
       #endif
 
+      // sleep until the next due time, at most 1 second
+      // 睡眠到下一个到期时间，最多1秒
+      uint64_t wait = 1000000;
+      if (!self->m_GCQueue.empty() && (self->m_GCQueue.begin()->first - now < wait))
+         wait = self->m_GCQueue.begin()->first - now;
+
       #ifndef WIN32
-         timeval now;
+         timeval tv;
          timespec timeout;
-         gettimeofday(&now, 0);
-         timeout.tv_sec = now.tv_sec + 1;          // 1秒的超时时间
-         timeout.tv_nsec = now.tv_usec * 1000;
+         gettimeofday(&tv, 0);
+         uint64_t t = tv.tv_sec * 1000000ULL + tv.tv_usec + wait;
+         timeout.tv_sec = t / 1000000;
+         timeout.tv_nsec = (t % 1000000) * 1000;
 
-         // 等待　m_GCStopCond　这个条件变量，超时时间为1秒
          pthread_cond_timedwait(&self->m_GCStopCond, &self->m_GCStopLock, &timeout);
       #else
-         WaitForSingleObject(self->m_GCStopCond, 1000);
+         CGuard::leaveCS(self->m_GCStopLock);
+         WaitForSingleObject(self->m_GCStopCond, DWORD(wait / 1000));
+         CGuard::enterCS(self->m_GCStopLock);
       #endif
    }
+   CGuard::leaveCS(self->m_GCStopLock);
 
    // remove all sockets and multiplexers
    // 回收所有资源
@@ -1651,22 +1984,6 @@ void CUDTUnited::updateMux(CUDTSocket* s, const CUDTSocket* ls)
       i->second->m_Status = CLOSED;
       i->second->m_TimeStamp = CTimer::getTime();
       self->m_ClosedSockets[i->first] = i->second;
-
-      // remove from listener's queue
-      // 回收listen sockfd
-      map<UDTSOCKET, CUDTSocket*>::iterator ls = self->m_Sockets.find(i->second->m_ListenSocket);
-      if (ls == self->m_Sockets.end())
-      {
-         ls = self->m_ClosedSockets.find(i->second->m_ListenSocket);
-         if (ls == self->m_ClosedSockets.end())
-            continue;
-      }
-
-      // 回收正在连接或已建立连接的sockfd
-      CGuard::enterCS(ls->second->m_AcceptLock);
-      ls->second->m_pQueuedSockets->erase(i->second->m_SocketID);
-      ls->second->m_pAcceptSockets->erase(i->second->m_SocketID);
-      CGuard::leaveCS(ls->second->m_AcceptLock);
    }
    self->m_Sockets.clear();
 
@@ -1679,19 +1996,26 @@ void CUDTUnited::updateMux(CUDTSocket* s, const CUDTSocket* ls)
 
    while (true)
    {
-      // 检查sockfd状态，将不同状态的sockfd转移到不同的列表中
-      self->checkBrokenSockets();
-
+      // 检查所有已关闭的套接字，直到全部回收；此时不再需要排队
       CGuard::enterCS(self->m_ControlLock);
-      bool empty = self->m_ClosedSockets.empty();
+      for (map<UDTSOCKET, CUDTSocket*>::iterator j = self->m_ClosedSockets.begin(); j != self->m_ClosedSockets.end(); ++ j)
+         due.push_back(j->first);
       CGuard::leaveCS(self->m_ControlLock);
 
-      if (empty)
+      if (due.empty())
          break;
 
+      for (vector<UDTSOCKET>::iterator j = due.begin(); j != due.end(); ++ j)
+         self->checkSocket(*j);
+      due.clear();
+
       CTimer::sleep();
    }
 
+   CGuard::enterCS(self->m_GCStopLock);
+   self->m_GCQueue.clear();
+   CGuard::leaveCS(self->m_GCStopLock);
+
    #ifndef WIN32
       return NULL;
    #else
@@ -1725,17 +2049,17 @@ UDTSOCKET CUDT::socket(int af, int type, int)
    }
    catch (CUDTException& e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return INVALID_SOCK;
    }
    catch (bad_alloc&)
    {
-      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      s_UDTUnited.setError(CUDTException(3, 2, 0));
       return INVALID_SOCK;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return INVALID_SOCK;
    }
 }
@@ -1749,17 +2073,17 @@ int CUDT::bind(UDTSOCKET u, const sockaddr* name, int namelen)
    }
    catch (CUDTException& e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (bad_alloc&)
    {
-      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      s_UDTUnited.setError(CUDTException(3, 2, 0));
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -1772,17 +2096,17 @@ int CUDT::bind(UDTSOCKET u, UDPSOCKET udpsock)
    }
    catch (CUDTException& e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (bad_alloc&)
    {
-      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      s_UDTUnited.setError(CUDTException(3, 2, 0));
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -1795,17 +2119,17 @@ int CUDT::listen(UDTSOCKET u, int backlog)
    }
    catch (CUDTException& e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (bad_alloc&)
    {
-      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      s_UDTUnited.setError(CUDTException(3, 2, 0));
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -1818,16 +2142,34 @@ UDTSOCKET CUDT::accept(UDTSOCKET u, sockaddr* addr, int* addrlen)
    }
    catch (CUDTException& e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return INVALID_SOCK;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return INVALID_SOCK;
    }
 }
 
+int CUDT::accept_batch(UDTSOCKET u, UDTSOCKET* sockets, int max)
+{
+   try
+   {
+      return s_UDTUnited.acceptBatch(u, sockets, max);
+   }
+   catch (CUDTException& e)
+   {
+      s_UDTUnited.setError(e);
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
 int CUDT::connect(UDTSOCKET u, const sockaddr* name, int namelen)
 {
    try
@@ -1836,17 +2178,40 @@ int CUDT::connect(UDTSOCKET u, const sockaddr* name, int namelen)
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
+      return ERROR;
+   }
+   catch (bad_alloc&)
+   {
+      s_UDTUnited.setError(CUDTException(3, 2, 0));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::connect_data(UDTSOCKET u, const sockaddr* name, int namelen, const char* buf, int len)
+{
+   try
+   {
+      return s_UDTUnited.connect(u, name, namelen, buf, len);
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (bad_alloc&)
    {
-      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      s_UDTUnited.setError(CUDTException(3, 2, 0));
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -1859,12 +2224,12 @@ int CUDT::close(UDTSOCKET u)
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -1877,12 +2242,12 @@ int CUDT::getpeername(UDTSOCKET u, sockaddr* name, int* namelen)
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -1895,12 +2260,12 @@ int CUDT::getsockname(UDTSOCKET u, sockaddr* name, int* namelen)
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -1915,12 +2280,12 @@ int CUDT::getsockopt(UDTSOCKET u, int, UDTOpt optname, void* optval, int* optlen
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -1935,12 +2300,12 @@ int CUDT::setsockopt(UDTSOCKET u, int, UDTOpt optname, const void* optval, int o
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -1955,17 +2320,17 @@ int CUDT::send(UDTSOCKET u, const char* buf, int len, int)
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (bad_alloc&)
    {
-      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      s_UDTUnited.setError(CUDTException(3, 2, 0));
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -1981,12 +2346,12 @@ int CUDT::recv(UDTSOCKET u, char* buf, int len, int)
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -2001,17 +2366,17 @@ int CUDT::sendmsg(UDTSOCKET u, const char* buf, int len, int ttl, bool inorder)
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (bad_alloc&)
    {
-      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      s_UDTUnited.setError(CUDTException(3, 2, 0));
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -2025,12 +2390,61 @@ int CUDT::recvmsg(UDTSOCKET u, char* buf, int len)
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::sendmsg_batch(UDTSOCKET u, const CMsgVec* msgs, int num, int ttl, bool inorder)
+{
+   try
+   {
+      if ((num < 0) || ((NULL == msgs) && (num > 0)))
+         throw CUDTException(5, 3, 0);
+
+      CUDT* udt = s_UDTUnited.lookup(u);
+      return udt->sendmsgBatch(msgs, num, ttl, inorder);
+   }
+   catch (CUDTException& e)
+   {
+      s_UDTUnited.setError(e);
+      return ERROR;
+   }
+   catch (bad_alloc&)
+   {
+      s_UDTUnited.setError(CUDTException(3, 2, 0));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::recvmsg_batch(UDTSOCKET u, CMsgVec* msgs, int num)
+{
+   try
+   {
+      if ((num < 0) || ((NULL == msgs) && (num > 0)))
+         throw CUDTException(5, 3, 0);
+
+      CUDT* udt = s_UDTUnited.lookup(u);
+      return udt->recvmsgBatch(msgs, num);
+   }
+   catch (CUDTException& e)
+   {
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -2045,17 +2459,17 @@ int64_t CUDT::sendfile(UDTSOCKET u, fstream& ifs, int64_t& offset, int64_t size,
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (bad_alloc&)
    {
-      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      s_UDTUnited.setError(CUDTException(3, 2, 0));
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -2069,12 +2483,12 @@ int64_t CUDT::recvfile(UDTSOCKET u, fstream& ofs, int64_t& offset, int64_t size,
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -2083,7 +2497,7 @@ int CUDT::select(int, ud_set* readfds, ud_set* writefds, ud_set* exceptfds, cons
 {
    if ((NULL == readfds) && (NULL == writefds) && (NULL == exceptfds))
    {
-      s_UDTUnited.setError(new CUDTException(5, 3, 0));
+      s_UDTUnited.setError(CUDTException(5, 3, 0));
       return ERROR;
    }
 
@@ -2093,17 +2507,17 @@ int CUDT::select(int, ud_set* readfds, ud_set* writefds, ud_set* exceptfds, cons
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (bad_alloc&)
    {
-      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      s_UDTUnited.setError(CUDTException(3, 2, 0));
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -2112,7 +2526,7 @@ int CUDT::selectEx(const vector<UDTSOCKET>& fds, vector<UDTSOCKET>* readfds, vec
 {
    if ((NULL == readfds) && (NULL == writefds) && (NULL == exceptfds))
    {
-      s_UDTUnited.setError(new CUDTException(5, 3, 0));
+      s_UDTUnited.setError(CUDTException(5, 3, 0));
       return ERROR;
    }
 
@@ -2122,17 +2536,17 @@ int CUDT::selectEx(const vector<UDTSOCKET>& fds, vector<UDTSOCKET>* readfds, vec
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (bad_alloc&)
    {
-      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      s_UDTUnited.setError(CUDTException(3, 2, 0));
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -2145,12 +2559,12 @@ int CUDT::epoll_create()
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -2163,12 +2577,12 @@ int CUDT::epoll_add_usock(const int eid, const UDTSOCKET u, const int* events)
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -2181,12 +2595,12 @@ int CUDT::epoll_add_ssock(const int eid, const SYSSOCKET s, const int* events)
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -2199,12 +2613,12 @@ int CUDT::epoll_remove_usock(const int eid, const UDTSOCKET u)
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -2217,12 +2631,12 @@ int CUDT::epoll_remove_ssock(const int eid, const SYSSOCKET s)
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -2235,12 +2649,12 @@ int CUDT::epoll_wait(const int eid, set<UDTSOCKET>* readfds, set<UDTSOCKET>* wri
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -2253,12 +2667,12 @@ int CUDT::epoll_release(const int eid)
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -2278,12 +2692,142 @@ int CUDT::perfmon(UDTSOCKET u, CPerfMon* perf, bool clear)
    }
    catch (CUDTException e)
    {
-      s_UDTUnited.setError(new CUDTException(e));
+      s_UDTUnited.setError(e);
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::perfmon2(UDTSOCKET u, CPerfMon2* perf, bool clear)
+{
+   try
+   {
+      CUDT* udt = s_UDTUnited.lookup(u);
+      udt->sample(perf, clear);
+      return 0;
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(e);
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::dumptrace(UDTSOCKET u, const char* path)
+{
+   try
+   {
+      CUDT* udt = s_UDTUnited.lookup(u);
+      udt->dumpTrace(path);
+      return 0;
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(e);
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::getmuxstats(int port, CMuxStats* stats)
+{
+   try
+   {
+      return s_UDTUnited.getMuxStats(port, stats);
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(e);
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::setmuxtrace(int port, int size)
+{
+   try
+   {
+      return s_UDTUnited.setMuxTrace(port, size);
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(e);
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::getmuxtrace(int port, CMuxEvent* events, int len)
+{
+   try
+   {
+      return s_UDTUnited.getMuxTrace(port, events, len);
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(e);
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::setmuxrate(int port, int cls, int64_t bandwidth)
+{
+   try
+   {
+      return s_UDTUnited.setMuxRate(port, cls, bandwidth);
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(e);
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::getmuxrate(int port, int cls, int64_t* bandwidth)
+{
+   try
+   {
+      return s_UDTUnited.getMuxRate(port, cls, bandwidth);
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(e);
       return ERROR;
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return ERROR;
    }
 }
@@ -2308,7 +2852,7 @@ UDTSTATUS CUDT::getsockstate(UDTSOCKET u)
    }
    catch (...)
    {
-      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      s_UDTUnited.setError(CUDTException(-1, 0, 0));
       return NONEXIST;
    }
 }
@@ -2354,11 +2898,21 @@ UDTSOCKET accept(UDTSOCKET u, struct sockaddr* addr, int* addrlen)
    return CUDT::accept(u, addr, addrlen);
 }
 
+int accept_batch(UDTSOCKET u, UDTSOCKET* sockets, int max)
+{
+   return CUDT::accept_batch(u, sockets, max);
+}
+
 int connect(UDTSOCKET u, const struct sockaddr* name, int namelen)
 {
    return CUDT::connect(u, name, namelen);
 }
 
+int connect_data(UDTSOCKET u, const struct sockaddr* name, int namelen, const char* buf, int len)
+{
+   return CUDT::connect_data(u, name, namelen, buf, len);
+}
+
 int close(UDTSOCKET u)
 {
    return CUDT::close(u);
@@ -2404,6 +2958,16 @@ int recvmsg(UDTSOCKET u, char* buf, int len)
    return CUDT::recvmsg(u, buf, len);
 }
 
+int sendmsg_batch(UDTSOCKET u, const MSGVEC* msgs, int num, int ttl, bool inorder)
+{
+   return CUDT::sendmsg_batch(u, msgs, num, ttl, inorder);
+}
+
+int recvmsg_batch(UDTSOCKET u, MSGVEC* msgs, int num)
+{
+   return CUDT::recvmsg_batch(u, msgs, num);
+}
+
 int64_t sendfile(UDTSOCKET u, fstream& ifs, int64_t& offset, int64_t size, int block)
 {
    return CUDT::sendfile(u, ifs, offset, size, block);
@@ -2545,9 +3109,44 @@ int perfmon(UDTSOCKET u, TRACEINFO* perf, bool clear)
    return CUDT::perfmon(u, perf, clear);
 }
 
+int perfmon2(UDTSOCKET u, TRACEINFO2* perf, bool clear)
+{
+   return CUDT::perfmon2(u, perf, clear);
+}
+
+int dumptrace(UDTSOCKET u, const char* path)
+{
+   return CUDT::dumptrace(u, path);
+}
+
 UDTSTATUS getsockstate(UDTSOCKET u)
 {
    return CUDT::getsockstate(u);
 }
 
+int getmuxstats(int port, MUXSTATS* stats)
+{
+   return CUDT::getmuxstats(port, stats);
+}
+
+int setmuxtrace(int port, int size)
+{
+   return CUDT::setmuxtrace(port, size);
+}
+
+int getmuxtrace(int port, MUXEVENT* events, int len)
+{
+   return CUDT::getmuxtrace(port, events, len);
+}
+
+int setmuxrate(int port, int cls, int64_t bandwidth)
+{
+   return CUDT::setmuxrate(port, cls, bandwidth);
+}
+
+int getmuxrate(int port, int cls, int64_t* bandwidth)
+{
+   return CUDT::getmuxrate(port, cls, bandwidth);
+}
+
 }  // namespace UDT
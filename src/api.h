@@ -54,6 +54,83 @@ written by
 class CUDT;
 
 
+// 监听套接字的新连接队列：接收线程无锁入队，accept在m_AcceptLock保护下批量出队
+// Queue of the new connections of a listener (Dmitry Vyukov's intrusive MPSC
+// queue). The receiving threads of the multiplexers push with a single atomic
+// exchange, without any lock; accept calls pop under the listener's
+// m_AcceptLock. It also counts the accept calls waiting on it, so that a
+// producer only takes the lock to wake them up when there is one.
+
+class CAcceptQueue
+{
+public:
+   CAcceptQueue();
+   ~CAcceptQueue();
+
+      // Functionality:
+      //    Append a new connection; may be called by several threads at once.
+      // Parameters:
+      //    0) [in] u: the new socket.
+      // Returned value:
+      //    number of queued connections before this one.
+
+   // 入队，可以被多个线程同时调用
+   int push(UDTSOCKET u);
+
+      // Functionality:
+      //    Remove the oldest connection; callers must be serialized.
+      // Parameters:
+      //    0) [out] u: the socket removed.
+      // Returned value:
+      //    true if a connection was removed, false if the queue is empty.
+
+   // 出队，调用者必须互斥
+   bool pop(UDTSOCKET& u);
+
+   // 排队的连接数，入队过程中可能暂时多计一个
+   int size() const {return m_iSize;}
+
+   // 排队的连接中仍然打开的个数，由调用者在CUDTUnited::m_ControlLock保护下维护
+   int live() const {return m_iLive;}
+   int addLive(int delta) {return m_iLive += delta;}
+
+      // Functionality:
+      //    Register or unregister an accept call about to wait for a connection.
+      //    Registration is ordered before the caller's next check of the queue.
+      // Parameters:
+      //    0) [in] delta: 1 to register, -1 to unregister.
+      // Returned value:
+      //    None.
+
+   void addWaiter(int delta);
+
+      // Functionality:
+      //    Check if an accept call may be waiting; ordered after a preceding push.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    true if a waiting accept call has to be woken up.
+
+   bool waiting() const;
+
+private:
+   struct CNode
+   {
+      UDTSOCKET m_Socket;
+      CNode* volatile m_pNext;
+   };
+
+   CNode* m_pHead;                           // consumed node, the queue starts after it
+   CNode* volatile m_pTail;                  // last node, target of the producers' exchange
+   volatile int m_iSize;                     // number of queued connections
+   volatile int m_iLive;                     // number of queued connections still open, updated under CUDTUnited::m_ControlLock
+   volatile int m_iWaiting;                  // number of accept calls waiting for a connection
+
+private:
+   CAcceptQueue(const CAcceptQueue&);
+   CAcceptQueue& operator=(const CAcceptQueue&);
+};
+
 class CUDTSocket
 {
 public:
@@ -71,7 +148,7 @@ public:
    // local地址
    sockaddr* m_pSelfAddr;                    // pointer to the local address of the socket
    // 对端地址
-   sockaddr* m_pPeerAddr;                    // pointer to the peer address of the socket
+   sockaddr* m_pPeerAddr;                    // pointer to the peer address of the socket, valid once connected
 
    // 一个随机值，在CUDTUnited构造函数中生成,用来标识不同的套接字，为啥不直接作用sockfd的值作为标识呢？sockfd不也是唯一的吗？
    UDTSOCKET m_SocketID;                     // socket ID
@@ -86,10 +163,8 @@ public:
    // CUDT句柄
    CUDT* m_pUDT;                             // pointer to the UDT entity
 
-   // 正在建立连接的sockfd队列
-   std::set<UDTSOCKET>* m_pQueuedSockets;    // set of connections waiting for accept()
-   // 已建立连接的sockfd队列
-   std::set<UDTSOCKET>* m_pAcceptSockets;    // set of accept()ed connections
+   // 等待accept的新连接队列
+   CAcceptQueue* m_pQueuedSockets;           // connections waiting for accept(), in arrival order
 
    // accept阶段使用的条件变量和锁
    pthread_cond_t m_AcceptCond;              // used to block "accept" call
@@ -98,6 +173,8 @@ public:
 
    // 套接字上可以排队的最大连接请求数量，listen函数的第二个参数
    unsigned int m_uiBackLog;                 // maximum number of connections in queue
+   // 是否计入监听套接字队列中的打开连接数
+   bool m_bQueued;                           // if counted in the live entries of its listener's queue, under m_ControlLock
 
    int m_iMuxID;                             // multiplexer ID
 
@@ -192,7 +269,8 @@ public:
    int bind(const UDTSOCKET u, UDPSOCKET udpsock);
    int listen(const UDTSOCKET u, int backlog);
    UDTSOCKET accept(const UDTSOCKET listen, sockaddr* addr, int* addrlen);
-   int connect(const UDTSOCKET u, const sockaddr* name, int namelen);
+   int acceptBatch(const UDTSOCKET listen, UDTSOCKET* sockets, int max);
+   int connect(const UDTSOCKET u, const sockaddr* name, int namelen, const char* data = NULL, int len = 0);
    int close(const UDTSOCKET u);
    int getpeername(const UDTSOCKET u, sockaddr* name, int* namelen);
    int getsockname(const UDTSOCKET u, sockaddr* name, int* namelen);
@@ -207,14 +285,61 @@ public:
    int epoll_release(const int eid);
 
       // Functionality:
-      //    record the UDT exception.
+      //    read the statistics of the multiplexer bound to a UDP port.
+      // Parameters:
+      //    0) [in] port: the local UDP port.
+      //    1) [out] stats: the statistics.
+      // Returned value:
+      //    0 if success, otherwise an exception is thrown.
+
+   // 多路复用器统计
+   int getMuxStats(int port, CMuxStats* stats);
+
+      // Functionality:
+      //    enable, resize or disable the worker event trace of a multiplexer.
       // Parameters:
-      //    0) [in] e: pointer to a UDT exception instance.
+      //    0) [in] port: the local UDP port.
+      //    1) [in] size: capacity of the trace in events, 0 to disable.
+      // Returned value:
+      //    0 if success, otherwise an exception is thrown.
+
+   // 设置多路复用器事件跟踪
+   int setMuxTrace(int port, int size);
+
+      // Functionality:
+      //    move the recorded worker events of a multiplexer, oldest first, into an array.
+      // Parameters:
+      //    0) [in] port: the local UDP port.
+      //    1) [out] events: array to receive the events.
+      //    2) [in] len: length of the array.
+      // Returned value:
+      //    number of events read, otherwise an exception is thrown.
+
+   // 读取多路复用器事件跟踪
+   int getMuxTrace(int port, CMuxEvent* events, int len);
+
+      // Functionality:
+      //    set or read the rate limit shared by all sockets of a multiplexer.
+      // Parameters:
+      //    0) [in] port: the local UDP port.
+      //    1) [in] cls: rate class, or UDT_RATECLASS_ALL for the aggregate.
+      //    2) [in, out] bandwidth: bytes per second, <= 0 for unlimited.
+      // Returned value:
+      //    0 if success, otherwise an exception is thrown.
+
+   // 多路复用器限速
+   int setMuxRate(int port, int cls, int64_t bandwidth);
+   int getMuxRate(int port, int cls, int64_t* bandwidth);
+
+      // Functionality:
+      //    record the UDT exception in the error slot of the calling thread.
+      // Parameters:
+      //    0) [in] e: the UDT exception, copied.
       // Returned value:
       //    None.
 
-   // 记录异常
-   void setError(CUDTException* e);
+   // 记录异常，拷贝到当前线程的错误对象中
+   void setError(const CUDTException& e);
 
       // Functionality:
       //    look up the most recent UDT exception.
@@ -257,10 +382,20 @@ private:
    // 根据socket id从m_Sockets中查找对应的CUDTSocket实例
    CUDTSocket* locate(const UDTSOCKET u);
    CUDTSocket* locate(const sockaddr* peer, const UDTSOCKET id, int32_t isn);
+   // 从监听套接字的队列中取出最多max个新连接，必要时阻塞等待；非阻塞且无连接时返回ERROR
+   int popAccepted(CUDTSocket* ls, UDTSOCKET* sockets, int max);
+   // 将排队中的连接从监听套接字的打开连接数中扣除，调用者需持有m_ControlLock
+   void unqueue(CUDTSocket* s);
    // 更新UDP多路复用器，每一个CMultiplexer都是一个已建立的UDP连接
    void updateMux(CUDTSocket* s, const sockaddr* addr = NULL, const UDPSOCKET* = NULL);
    // 更新UDP多路复用器，处理监听套接字
    void updateMux(CUDTSocket* s, const CUDTSocket* ls);
+   // 根据端口号查找UDP多路复用器，调用者需持有m_ControlLock
+   CMultiplexer* locateMux(int port);
+   // 从slab中创建套接字控制块，CUDTSocket、CUDT实例和地址位于同一块内存中
+   CUDTSocket* newSocketBlock(int af, const CUDT* ancestor);
+   // 销毁套接字控制块并归还slab
+   void freeSocketBlock(CUDTSocket* s);
 
 private:
    // 多路复用器map
@@ -269,11 +404,15 @@ private:
 
 private:
    CCache<CInfoBlock>* m_pCache;			// UDT network information cache
+   // 会话恢复票据缓存
+   CCache<CTicketBlock>* m_pTicketCache;		// resumption tickets received from listeners
+   // 所有套接字控制块的slab
+   CSlab* m_pSocketSlab;                                // control blocks of all sockets, see newSocketBlock()
 
 private:
    // 资源释放线程运行控制
    volatile bool m_bClosing;
-   // 在资源释放阶段使用的互斥锁
+   // 在资源释放阶段使用的互斥锁，同时保护m_GCQueue；持有它时不再获取其它锁
    pthread_mutex_t m_GCStopLock;
    // 在资源释放阶段使用的条件变量
    pthread_cond_t m_GCStopCond;
@@ -295,8 +434,22 @@ private:
    // 处于closed状态的sockfd
    std::map<UDTSOCKET, CUDTSocket*> m_ClosedSockets;   // temporarily store closed sockets
 
-   // 检查套接字状态
-   void checkBrokenSockets();
+   // 等待GC线程检查的套接字，按检查时间排序，由m_GCStopLock保护
+   std::multimap<uint64_t, UDTSOCKET> m_GCQueue;       // sockets to be checked by the GC thread, by due time, protected by m_GCStopLock
+
+      // Functionality:
+      //    ask the GC thread to check a socket that has been broken or closed.
+      // Parameters:
+      //    0) [in] u: the socket ID.
+      //    1) [in] delay: time to wait before the check, in microseconds.
+      // Returned value:
+      //    None.
+
+   // 通知GC线程在delay微秒后检查一个已断开或已关闭的套接字
+   void scheduleGC(const UDTSOCKET u, const uint64_t delay = 0);
+
+   // 检查一个套接字：断开的移入m_ClosedSockets，到期的删除，其余的重新排队
+   void checkSocket(const UDTSOCKET u);
    // 删除套接字
    void removeSocket(const UDTSOCKET u);
 
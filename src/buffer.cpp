@@ -139,11 +139,58 @@ void CSndBuffer::addBuffer(const char* data, int len, int ttl, bool order)
    while (size + m_iCount >= m_iSize)
       increase();
 
-   uint64_t time = CTimer::getTime();
    // 是否需要按序发送
    int32_t inorder = order;
    inorder <<= 29;
 
+   copyMsg(data, len, ttl, inorder, CTimer::getTime());
+
+   // 更新发送缓冲区中已被占用的数据块数量
+   CGuard::enterCS(m_BufLock);
+   m_iCount += size;
+   CGuard::leaveCS(m_BufLock);
+}
+
+void CSndBuffer::addBuffer(const CMsgVec* msgs, int num, int ttl, bool order)
+{
+   // 所有消息需要占用的数据块数
+   int size = 0;
+   for (int i = 0; i < num; ++ i)
+   {
+      if (msgs[i].iLength > 0)
+         size += (msgs[i].iLength + m_iMSS - 1) / m_iMSS;
+   }
+
+   // dynamically increase sender buffer
+   // 动态增大发送缓冲区
+   while (size + m_iCount >= m_iSize)
+      increase();
+
+   int32_t inorder = order;
+   inorder <<= 29;
+
+   // 同一批消息使用同一个时间戳
+   uint64_t time = CTimer::getTime();
+   for (int i = 0; i < num; ++ i)
+   {
+      if (msgs[i].iLength > 0)
+         copyMsg(msgs[i].pcData, msgs[i].iLength, ttl, inorder, time);
+   }
+
+   // m_iCount is updated once for the whole batch
+   // 整批消息只更新一次m_iCount
+   CGuard::enterCS(m_BufLock);
+   m_iCount += size;
+   CGuard::leaveCS(m_BufLock);
+}
+
+void CSndBuffer::copyMsg(const char* data, int len, int ttl, int32_t inorder, uint64_t time)
+{
+   // 计算要插入的数据需要占用多少数据块
+   int size = len / m_iMSS;
+   if ((len % m_iMSS) != 0)
+      size ++;
+
    // 指向最后一个数据块
    Block* s = m_pLastBlock;
    // 将数据插入到数据块中
@@ -179,11 +226,6 @@ void CSndBuffer::addBuffer(const char* data, int len, int ttl, bool order)
    // 更新最后一个数据块指针
    m_pLastBlock = s;
 
-   // 更新发送缓冲区中已被占用的数据块数量
-   CGuard::enterCS(m_BufLock);
-   m_iCount += size;
-   CGuard::leaveCS(m_BufLock);
-
    // 更新消息编号，超出后回绕至1
    m_iNextMsgNo ++;
    if (m_iNextMsgNo == CMsgNo::m_iMaxMsgNo)
@@ -241,7 +283,7 @@ int CSndBuffer::addBufferFromFile(fstream& ifs, int len)
    return total;
 }
 
-int CSndBuffer::readData(char** data, int32_t& msgno)
+int CSndBuffer::readData(char** data, int32_t& msgno, uint64_t& origintime)
 {
    // No data to read
    if (m_pCurrBlock == m_pLastBlock)
@@ -250,6 +292,7 @@ int CSndBuffer::readData(char** data, int32_t& msgno)
    *data = m_pCurrBlock->m_pcData;
    int readlen = m_pCurrBlock->m_iLength;
    msgno = m_pCurrBlock->m_iMsgNo;
+   origintime = m_pCurrBlock->m_OriginTime;
 
    m_pCurrBlock = m_pCurrBlock->m_pNext;
 
@@ -382,20 +425,37 @@ void CSndBuffer::increase()
 
 ////////////////////////////////////////////////////////////////////////////////
 
-CRcvBuffer::CRcvBuffer(CUnitQueue* queue, int bufsize):
+CRcvBuffer::CRcvBuffer(CUnitQueue* queue, int bufsize, bool msgmode):
 m_pUnit(NULL),
 m_iSize(bufsize),
 m_pUnitQueue(queue),
 m_iStartPos(0),
 m_iLastAckPos(0),
 m_iMaxPos(0),
-m_iNotch(0)
+m_iNotch(0),
+m_pMsgInfo(NULL),
+m_iMsgInfoMask(0),
+m_ReadyMsgs()
 {
    // 数据单元指针数组
    m_pUnit = new CUnit* [m_iSize];
    // 数据单元指针数组初始化
    for (int i = 0; i < m_iSize; ++ i)
       m_pUnit[i] = NULL;
+
+   // the message numbers of the packets in the buffer span less than the buffer size,
+   // so an index of at least that size addressed by message number never collides
+   if (msgmode)
+   {
+      int n = 1;
+      while (n < m_iSize)
+         n <<= 1;
+
+      m_pMsgInfo = new CMsgInfo[n];
+      m_iMsgInfoMask = n - 1;
+      for (int i = 0; i < n; ++ i)
+         m_pMsgInfo[i].m_iMsgNo = -1;
+   }
 }
 
 CRcvBuffer::~CRcvBuffer()
@@ -410,6 +470,7 @@ CRcvBuffer::~CRcvBuffer()
    }
 
    delete [] m_pUnit;
+   delete [] m_pMsgInfo;
 }
 
 int CRcvBuffer::addData(CUnit* unit, int offset)
@@ -432,6 +493,43 @@ int CRcvBuffer::addData(CUnit* unit, int offset)
    // 被占用的数据单元统计
    ++ m_pUnitQueue->m_iCount;
 
+   if (NULL == m_pMsgInfo)
+      return 0;
+
+   // 更新数据单元所属消息的索引项
+   int32_t msgno = unit->m_Packet.getMsgSeq();
+   CMsgInfo& m = msgInfo(msgno);
+   if (m.m_iMsgNo != msgno)
+   {
+      m.m_iMsgNo = msgno;
+      m.m_iCount = 0;
+      m.m_bHead = m.m_bTail = false;
+      m.m_iState = 0;
+   }
+
+   // 消息已被发送方丢弃，数据单元不再交付
+   if (2 == m.m_iState)
+      unit->m_iFlag = 3;
+
+   if (0 == m.m_iCount)
+      m.m_iLoPos = m.m_iHiPos = pos;
+   else if (distance(pos) < distance(m.m_iLoPos))
+      m.m_iLoPos = pos;
+   else if (distance(pos) > distance(m.m_iHiPos))
+      m.m_iHiPos = pos;
+
+   int boundary = unit->m_Packet.getMsgBoundary();
+   if (boundary & 2)
+      m.m_bHead = true;
+   if (boundary & 1)
+      m.m_bTail = true;
+   ++ m.m_iCount;
+
+   // a message that may be read out of order becomes readable as soon as its last missing packet arrives
+   // 允许乱序读取的消息在收齐时加入就绪队列
+   if ((0 == m.m_iState) && !unit->m_Packet.getMsgOrderFlag() && isComplete(m))
+      m_ReadyMsgs.push_back(msgno);
+
    return 0;
 }
 
@@ -571,9 +669,30 @@ int CRcvBuffer::getRcvDataSize() const
 
 void CRcvBuffer::dropMsg(int32_t msgno)
 {
-   for (int i = m_iStartPos, n = (m_iLastAckPos + m_iMaxPos) % m_iSize; i != n; i = (i + 1) % m_iSize)
-      if ((NULL != m_pUnit[i]) && (msgno == m_pUnit[i]->m_Packet.m_iMsgNo))
-         m_pUnit[i]->m_iFlag = 3;
+   if (NULL == m_pMsgInfo)
+      return;
+
+   CMsgInfo& m = msgInfo(msgno);
+   if (m.m_iMsgNo != msgno)
+   {
+      // nothing of the message has arrived yet: remember the drop for late packets, unless the entry is in use
+      // 消息的数据尚未到达：若索引项空闲，记录丢弃状态，之后到达的数据单元直接标记为丢弃
+      if ((-1 != m.m_iMsgNo) && (m.m_iCount > 0))
+         return;
+
+      m.m_iMsgNo = msgno;
+      m.m_iCount = 0;
+      m.m_bHead = m.m_bTail = false;
+   }
+   else
+   {
+      // 消息的数据单元都在lo和hi之间
+      for (int i = m.m_iLoPos, n = (m.m_iHiPos + 1) % m_iSize; i != n; i = (i + 1) % m_iSize)
+         if ((NULL != m_pUnit[i]) && (msgno == m_pUnit[i]->m_Packet.getMsgSeq()))
+            m_pUnit[i]->m_iFlag = 3;
+   }
+
+   m.m_iState = 2;
 }
 
 int CRcvBuffer::readMsg(char* data, int len)
@@ -583,6 +702,10 @@ int CRcvBuffer::readMsg(char* data, int len)
    if (!scanMsg(p, q, passack))
       return 0;
 
+   // 越过确认点读取的消息，数据单元留在缓冲区中，等确认点越过后再释放
+   if (passack)
+      msgInfo(m_pUnit[p]->m_Packet.getMsgSeq()).m_iState = 1;
+
    int rs = len;
    while (p != (q + 1) % m_iSize)
    {
@@ -598,12 +721,7 @@ int CRcvBuffer::readMsg(char* data, int len)
       }
 
       if (!passack)
-      {
-         CUnit* tmp = m_pUnit[p];
-         m_pUnit[p] = NULL;
-         tmp->m_iFlag = 0;
-         -- m_pUnitQueue->m_iCount;
-      }
+         releaseUnit(p);
       else
          m_pUnit[p]->m_iFlag = 2;
 
@@ -624,6 +742,38 @@ int CRcvBuffer::getRcvMsgNum()
    return scanMsg(p, q, passack) ? 1 : 0;
 }
 
+bool CRcvBuffer::isComplete(const CMsgInfo& m) const
+{
+   // 收到了首尾两个数据单元，且两者之间没有空洞
+   return m.m_bHead && m.m_bTail && (m.m_iCount == (m.m_iHiPos - m.m_iLoPos + m_iSize) % m_iSize + 1);
+}
+
+void CRcvBuffer::releaseUnit(int pos)
+{
+   CUnit* tmp = m_pUnit[pos];
+
+   if (NULL != m_pMsgInfo)
+   {
+      int32_t msgno = tmp->m_Packet.getMsgSeq();
+      CMsgInfo& m = msgInfo(msgno);
+      if (m.m_iMsgNo == msgno)
+      {
+         // 消息头已离开缓冲区，剩余部分不能再作为完整消息交付
+         if (tmp->m_Packet.getMsgBoundary() & 2)
+            m.m_bHead = false;
+
+         // a dropped entry is kept so that late packets of the message are still discarded
+         // 丢弃状态的索引项保留，使该消息迟到的数据单元仍被丢弃
+         if ((0 == -- m.m_iCount) && (2 != m.m_iState))
+            m.m_iMsgNo = -1;
+      }
+   }
+
+   m_pUnit[pos] = NULL;
+   tmp->m_iFlag = 0;
+   -- m_pUnitQueue->m_iCount;
+}
+
 bool CRcvBuffer::scanMsg(int& p, int& q, bool& passack)
 {
    // empty buffer
@@ -631,8 +781,11 @@ bool CRcvBuffer::scanMsg(int& p, int& q, bool& passack)
    if ((m_iStartPos == m_iLastAckPos) && (m_iMaxPos <= 0))
       return false;
 
+   // 读起始位置到确认点之间的数据量
+   int acked = getRcvDataSize();
+
    //skip all bad msgs at the beginning
-   // 跳过缓冲区开头的坏数据单元
+   // 跳过缓冲区开头的坏数据单元；每个数据单元只会被跳过一次
    while (m_iStartPos != m_iLastAckPos)
    {
       // 跳过空数据单元，直到找到一个有效的消息或到达缓冲区的最后位置
@@ -640,118 +793,74 @@ bool CRcvBuffer::scanMsg(int& p, int& q, bool& passack)
       {
          if (++ m_iStartPos == m_iSize)
             m_iStartPos = 0;
+         -- acked;
          continue;
       }
 
-      // 数据单元中有数据并且存在消息边界，则尝试获取一个完整的消息
+      // 数据单元是一条未读消息的第一个数据单元，由索引判断消息在确认点之前是否完整
       if ((1 == m_pUnit[m_iStartPos]->m_iFlag) && (m_pUnit[m_iStartPos]->m_Packet.getMsgBoundary() > 1))
       {
-         // 用于判断消息的完整性
-         bool good = true;
-
-         // look ahead for the whole message
-         // 从当前位置开始，向后查找消息边界，以获取一个完整的消息
-         for (int i = m_iStartPos; i != m_iLastAckPos;)
-         {
-            // 获取UDP消息边界失败，说明不是一个完整的包
-            if ((NULL == m_pUnit[i]) || (1 != m_pUnit[i]->m_iFlag))
-            {
-               // 消息不完整
-               good = false;
-               break;
-            }
-
-            // 找到了消息的边界，退出循环
-            if ((m_pUnit[i]->m_Packet.getMsgBoundary() == 1) || (m_pUnit[i]->m_Packet.getMsgBoundary() == 3))
-               break;
-
-            // 更新循环索引，到达缓冲区末尾时回绕
-            if (++ i == m_iSize)
-               i = 0;
-         }
-         
-         // 消息完整，退出循环
-         if (good)
+         const CMsgInfo& m = msgInfo(m_pUnit[m_iStartPos]->m_Packet.getMsgSeq());
+
+         // the message starts here; if all its packets received so far lie before the ACK point,
+         // they must be contiguous and either end the message or reach the ACK point
+         // 消息从这里开始；若已收到的数据单元都在确认点之前，它们必须连续，并且以消息尾结束或一直延伸到确认点
+         int span = distance(m.m_iHiPos) + 1;
+         if ((span > acked) || ((m.m_iCount == span) && (m.m_bTail || (span == acked))))
             break;
       }
 
       // 无论消息是否完整，都要释放数据单元；如果消息完整，向用户返回消息；如果消息不完整，直接丢弃
-      CUnit* tmp = m_pUnit[m_iStartPos];
-      m_pUnit[m_iStartPos] = NULL;
-      tmp->m_iFlag = 0;
-      -- m_pUnitQueue->m_iCount;
+      releaseUnit(m_iStartPos);
 
       // 更新起始指针，到达缓冲区末尾时回绕
       if (++ m_iStartPos == m_iSize)
          m_iStartPos = 0;
+      -- acked;
    }
 
-   // 消息头索引
-   p = -1;                  // message head
-   // 消息尾索引
-   q = m_iStartPos;         // message tail
-   // passack表示是否越过确认点
-   passack = m_iStartPos == m_iLastAckPos;
-   // 是否找到完整消息
-   bool found = false;
-
-   // looking for the first message
-   for (int i = 0, n = m_iMaxPos + getRcvDataSize(); i <= n; ++ i)
+   // the first message in the buffer, if it has been fully acknowledged
+   // 缓冲区开头的消息已完整收到并且已被确认，按顺序读取
+   if (m_iStartPos != m_iLastAckPos)
    {
-      // 检查数据单元是否有效
-      if ((NULL != m_pUnit[q]) && (1 == m_pUnit[q]->m_iFlag))
-      {
-         // 是否找到完整消息
-         switch (m_pUnit[q]->m_Packet.getMsgBoundary())
-         {
-         case 3: // 11
-            p = q;
-            found = true;
-            break;
-
-         case 2: // 10
-            p = q;
-            break;
+      const CMsgInfo& m = msgInfo(m_pUnit[m_iStartPos]->m_Packet.getMsgSeq());
 
-         case 1: // 01
-            if (p != -1)
-               found = true;
-         }
-      }
-      else
+      if (isComplete(m) && (distance(m.m_iHiPos) < acked))
       {
-         // a hole in this message, not valid, restart search
-         p = -1;
+         p = m_iStartPos;
+         q = m.m_iHiPos;
+         passack = false;
+         return true;
       }
 
-      if (found)
+      // if the message is larger than the receiver buffer, return part of the message
+      // 消息比缓冲区大，返回部分消息
+      if (acked == m_iSize - 1)
       {
-         // the msg has to be ack'ed or it is allowed to read out of order, and was not read before
-         // 如果找到完整消息，检查是否已确认或允许乱序读取。如果是，则退出循环；否则，重置 found
-         if (!passack || !m_pUnit[q]->m_Packet.getMsgOrderFlag())
-            break;
-
-         found = false;
+         p = m_iStartPos;
+         q = (m_iLastAckPos - 1 + m_iSize) % m_iSize;
+         passack = false;
+         return true;
       }
+   }
 
-      // 更新环形缓冲区索引
-      if (++ q == m_iSize)
-         q = 0;
+   // otherwise the oldest complete message that is allowed to be read out of order
+   // 否则读取最早收齐的允许乱序读取的消息；已读取或已丢弃的项直接出队
+   while (!m_ReadyMsgs.empty())
+   {
+      int32_t msgno = m_ReadyMsgs.front();
+      const CMsgInfo& m = msgInfo(msgno);
 
-      // 找到了ack位置
-      if (q == m_iLastAckPos)
+      if ((m.m_iMsgNo == msgno) && (0 == m.m_iState) && isComplete(m))
+      {
+         p = m.m_iLoPos;
+         q = m.m_iHiPos;
          passack = true;
-   }
+         return true;
+      }
 
-   // no msg found
-   // 如果没有找到消息，但消息大于缓冲区，返回部分消息
-   if (!found)
-   {
-      // if the message is larger than the receiver buffer, return part of the message
-      // 消息比缓冲区大，返回部分消息
-      if ((p != -1) && ((q + 1) % m_iSize == p))
-         found = true;
+      m_ReadyMsgs.pop_front();
    }
 
-   return found;
+   return false;
 }
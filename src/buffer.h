@@ -45,6 +45,7 @@ written by
 #include "udt.h"
 #include "list.h"
 #include "queue.h"
+#include <deque>
 #include <fstream>
 
 class CSndBuffer
@@ -66,6 +67,19 @@ public:
    // 向发送列表中插入一个用户数据块
    void addBuffer(const char* data, int len, int ttl = -1, bool order = false);
 
+      // Functionality:
+      //    Insert an array of messages into the sending list; the sender sees all of them at once.
+      // Parameters:
+      //    0) [in] msgs: the messages, empty ones are skipped.
+      //    1) [in] num: number of messages.
+      //    2) [in] ttl: time to live in milliseconds, for every message
+      //    3) [in] order: if the messages should be delivered in order
+      // Returned value:
+      //    None.
+
+   // 向发送列表中插入多条消息，只加锁一次
+   void addBuffer(const CMsgVec* msgs, int num, int ttl = -1, bool order = false);
+
       // Functionality:
       //    Read a block of data from file and insert it into the sending list.
       // Parameters:
@@ -82,11 +96,12 @@ public:
       // Parameters:
       //    0) [out] data: the pointer to the data position.
       //    1) [out] msgno: message number of the packet.
+      //    2) [out] origintime: the time when the message was added into the buffer.
       // Returned value:
       //    Actual length of data read.
 
    // 从发送列表中读取数据块，按块读取，每次不一定会读取一个完整的消息
-   int readData(char** data, int32_t& msgno);
+   int readData(char** data, int32_t& msgno, uint64_t& origintime);
 
       // Functionality:
       //    Find data position to pack a DATA packet for a retransmission.
@@ -125,6 +140,9 @@ private:
    // 动态增大发送缓冲区
    void increase();
 
+   // 将一条消息拷贝到m_pLastBlock开始的数据块中，不更新m_iCount
+   void copyMsg(const char* data, int len, int ttl, int32_t inorder, uint64_t time);
+
 private:
    // 用于同步操作
    pthread_mutex_t m_BufLock;           // used to synchronize buffer operation
@@ -182,8 +200,8 @@ private:
 class CRcvBuffer
 {
 public:
-   // 初始化缓冲区大小和队列指针，并分配内存
-   CRcvBuffer(CUnitQueue* queue, int bufsize = 65536);
+   // 初始化缓冲区大小和队列指针，并分配内存；消息模式下同时建立消息索引
+   CRcvBuffer(CUnitQueue* queue, int bufsize = 65536, bool msgmode = false);
    // 释放缓冲区中所有数据单元，清空指针数组
    ~CRcvBuffer();
 
@@ -282,9 +300,31 @@ public:
    int getRcvMsgNum();
 
 private:
-   // 扫描缓冲区，查找完整的消息
+   // 查找下一条可读的消息，借助消息索引，不扫描整个缓冲区
    bool scanMsg(int& start, int& end, bool& passack);
 
+   // Boundaries and progress of one message in the buffer, kept up to date by addData().
+   // 消息索引项：记录一条消息在缓冲区中的边界和已收到的数据单元数，由addData()增量维护
+   struct CMsgInfo
+   {
+      int32_t m_iMsgNo;                 // message number, -1 if the entry is unused
+      int m_iCount;                     // units of the message in the buffer
+      int m_iLoPos;                     // position of the lowest packet received
+      int m_iHiPos;                     // position of the highest packet received
+      bool m_bHead;                     // the first packet of the message has been received
+      bool m_bTail;                     // the last packet of the message has been received
+      char m_iState;                    // 0: unread, 1: read ahead of the ACK point, 2: dropped
+   };
+
+   // 按消息号直接寻址的索引项；缓冲区中的消息号相差不超过缓冲区大小，所以不会冲突
+   CMsgInfo& msgInfo(int32_t msgno) {return m_pMsgInfo[msgno & m_iMsgInfoMask];}
+   // 消息的数据单元是否已全部收到
+   bool isComplete(const CMsgInfo& m) const;
+   // 位置pos相对读起始位置的距离
+   int distance(int pos) const {return (pos - m_iStartPos + m_iSize) % m_iSize;}
+   // 释放一个数据单元并更新它所属消息的索引项
+   void releaseUnit(int pos);
+
 private:
    // 指向缓冲区的指针数组，数组中的每个元素都指向一个数据单元
    CUnit** m_pUnit;                     // pointer to the protocol buffer
@@ -303,6 +343,12 @@ private:
    // 在处理当前单元时，m_iNotch 用于记录已经读取了多少数据。这样，如果一次读取没有读取完整个单元的数据，下次可以从这个偏移量继
    int m_iNotch;			// the starting read point of the first unit
 
+   // 消息索引，只在消息模式下分配；大小为不小于缓冲区大小的2的幂，使消息号回绕时仍不冲突
+   CMsgInfo* m_pMsgInfo;                // message index, by message number, NULL in stream mode
+   int m_iMsgInfoMask;                  // size of the message index - 1
+   // 已完整收到、允许乱序读取且尚未读取的消息，按完成顺序排列；可能含有已失效的项
+   std::deque<int32_t> m_ReadyMsgs;     // complete out-of-order messages not read yet, oldest first; may hold stale entries
+
 private:
    // 构造函数私有化，用于单例模式
    CRcvBuffer();
@@ -52,12 +52,27 @@ written by
 
 using namespace std;
 
+CInfoBlock::CInfoBlock():
+m_iIPversion(0),
+m_ullTimeStamp(0),
+m_iRTT(0),
+m_iRTTVar(0),
+m_iBandwidth(0),
+m_iLossRate(0),
+m_iReorderDistance(0),
+m_dInterval(0),
+m_dCWnd(0)
+{
+   m_piIP[0] = m_piIP[1] = m_piIP[2] = m_piIP[3] = 0;
+}
+
 CInfoBlock& CInfoBlock::operator=(const CInfoBlock& obj)
 {
-   std::copy(obj.m_piIP, obj.m_piIP + 3, m_piIP);
+   std::copy(obj.m_piIP, obj.m_piIP + 4, m_piIP);
    m_iIPversion = obj.m_iIPversion;
    m_ullTimeStamp = obj.m_ullTimeStamp;
    m_iRTT = obj.m_iRTT;
+   m_iRTTVar = obj.m_iRTTVar;
    m_iBandwidth = obj.m_iBandwidth;
    m_iLossRate = obj.m_iLossRate;
    m_iReorderDistance = obj.m_iReorderDistance;
@@ -67,7 +82,7 @@ CInfoBlock& CInfoBlock::operator=(const CInfoBlock& obj)
    return *this;
 }
 
-bool CInfoBlock::operator==(const CInfoBlock& obj)
+bool CInfoBlock::operator==(const CInfoBlock& obj) const
 {
    if (m_iIPversion != obj.m_iIPversion)
       return false;
@@ -84,24 +99,7 @@ bool CInfoBlock::operator==(const CInfoBlock& obj)
    return true;
 }
 
-CInfoBlock* CInfoBlock::clone()
-{
-   CInfoBlock* obj = new CInfoBlock;
-
-   std::copy(m_piIP, m_piIP + 3, obj->m_piIP);
-   obj->m_iIPversion = m_iIPversion;
-   obj->m_ullTimeStamp = m_ullTimeStamp;
-   obj->m_iRTT = m_iRTT;
-   obj->m_iBandwidth = m_iBandwidth;
-   obj->m_iLossRate = m_iLossRate;
-   obj->m_iReorderDistance = m_iReorderDistance;
-   obj->m_dInterval = m_dInterval;
-   obj->m_dCWnd = m_dCWnd;
-
-   return obj;
-}
-
-int CInfoBlock::getKey()
+uint32_t CInfoBlock::getKey() const
 {
    if (m_iIPversion == AF_INET)
       return m_piIP[0];
@@ -121,3 +119,71 @@ void CInfoBlock::convert(const sockaddr* addr, int ver, uint32_t ip[])
       memcpy((char*)ip, (char*)((sockaddr_in6*)addr)->sin6_addr.s6_addr, 16);
    }
 }
+
+void CInfoBlock::merge(const CInfoBlock& obj)
+{
+   // each connection weighs 1/4, as the RTT samples of one connection are smoothed with 1/8
+   // 每个连接的权重为1/4
+   m_iRTT = (m_iRTT * 3 + obj.m_iRTT) >> 2;
+   m_iRTTVar = (m_iRTTVar * 3 + obj.m_iRTTVar) >> 2;
+   m_iBandwidth = int((m_iBandwidth * 3LL + obj.m_iBandwidth) >> 2);
+   m_iLossRate = (m_iLossRate * 3 + obj.m_iLossRate) >> 2;
+   m_iReorderDistance = (m_iReorderDistance * 3 + obj.m_iReorderDistance) >> 2;
+
+   // a connection that sent too little to leave the initial window says nothing about the path
+   if (obj.m_dCWnd > 0)
+   {
+      if (m_dCWnd > 0)
+      {
+         m_dInterval = (m_dInterval * 3 + obj.m_dInterval) / 4;
+         m_dCWnd = (m_dCWnd * 3 + obj.m_dCWnd) / 4;
+      }
+      else
+      {
+         m_dInterval = obj.m_dInterval;
+         m_dCWnd = obj.m_dCWnd;
+      }
+   }
+
+   m_ullTimeStamp = obj.m_ullTimeStamp;
+}
+
+CTicketBlock& CTicketBlock::operator=(const CTicketBlock& obj)
+{
+   std::copy(obj.m_piIP, obj.m_piIP + 4, m_piIP);
+   m_iIPversion = obj.m_iIPversion;
+   m_iPort = obj.m_iPort;
+   m_ullTimeStamp = obj.m_ullTimeStamp;
+   m_iTicketTime = obj.m_iTicketTime;
+   m_iTicketSerial = obj.m_iTicketSerial;
+   m_piTicketMAC[0] = obj.m_piTicketMAC[0];
+   m_piTicketMAC[1] = obj.m_piTicketMAC[1];
+
+   return *this;
+}
+
+bool CTicketBlock::operator==(const CTicketBlock& obj) const
+{
+   if ((m_iIPversion != obj.m_iIPversion) || (m_iPort != obj.m_iPort))
+      return false;
+
+   else if (m_iIPversion == AF_INET)
+      return (m_piIP[0] == obj.m_piIP[0]);
+
+   for (int i = 0; i < 4; ++ i)
+   {
+      if (m_piIP[i] != obj.m_piIP[i])
+         return false;
+   }
+
+   return true;
+}
+
+uint32_t CTicketBlock::getKey() const
+{
+   uint32_t key = m_piIP[0] + m_iPort;
+   if (m_iIPversion != AF_INET)
+      key += m_piIP[1] + m_piIP[2] + m_piIP[3];
+
+   return key;
+}
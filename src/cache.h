@@ -41,76 +41,54 @@ written by
 #ifndef __UDT_CACHE_H__
 #define __UDT_CACHE_H__
 
-#include <list>
-#include <vector>
+#include <algorithm>
 
 #include "common.h"
 #include "udt.h"
 
-// 抽象类，用来表示缓存项
-class CCacheItem
+// Key policy of the cache: how an item is hashed and which items share a key.
+// The default one uses the item's own getKey() and "==", resolved at compile time.
+// 缓存的键策略：默认使用缓存项自身的getKey()和"=="，在编译期绑定，没有虚函数调用
+template<typename T> struct CCacheKey
 {
-public:
-   // 虚析构
-   virtual ~CCacheItem() {}
-
-public:
-   // 纯虚函数，用来实现赋值操作
-   virtual CCacheItem& operator=(const CCacheItem&) = 0;
-
-   // The "==" operator SHOULD only compare key values.
-   // 重载 "==" 运算符
-   virtual bool operator==(const CCacheItem&) = 0;
-
-      // Functionality:
-      //    get a deep copy clone of the current item
-      // Parameters:
-      //    None.
-      // Returned value:
-      //    Pointer to the new item, or NULL if failed.
-
-   // 深拷贝克隆数据
-   virtual CCacheItem* clone() = 0;
-
-      // Functionality:
-      //    get a random key value between 0 and MAX_INT to be used for the hash in cache
-      // Parameters:
-      //    None.
-      // Returned value:
-      //    A random hash key.
-
-   // 缓存hash数据结构中的key
-   virtual int getKey() = 0;
-
-   // If there is any shared resources between the cache item and its clone,
-   // the shared resource should be released by this function.
-   // 如果缓存项与其克隆之间存在任何共享资源，则共享的资源应该被这个函数释放
-   virtual void release() {}
+   static uint32_t hash(const T& item) {return item.getKey();}
+   static bool equal(const T& a, const T& b) {return a == b;}
 };
 
 // 缓存模板类，用于存储和管理缓存项
+// 缓存分为若干分片，每个分片有自己的锁、哈希表和LRU双向链表，不同对端的查找和更新互不阻塞。
 // 使用了LRU策略,即最近最少使用:主要用于管理缓存中的数据。
 // LRU基本思想是：如果一个数据在最近被使用过，那么它在将来被使用的概率也较高；反之，如果一个数据在很长时间内没有被使用过，那么它在将来被使用的概率较低
-template<typename T> class CCache
+// 缓存项超过存活时间(TTL)后视为过期，查找时不再返回，并被逐步回收。
+// The cache is split into shards, each with its own lock, hash table and LRU list, so that
+// connections to different peers do not contend. Items are stored by value.
+// Items older than the TTL are never returned and are reclaimed lazily.
+template<typename T, typename K = CCacheKey<T> > class CCache
 {
 public:
-   CCache(int size = 1024):
-   m_iMaxSize(size),
-   m_iHashSize(size * 3),
-   m_iCurrSize(0)
+   CCache(int size = 1024, uint64_t ttl = 0):
+   m_ullTTL(ttl)
    {
-      // 哈希表的大小为缓存项个数的三倍，以减少hash冲突
-      m_vHashPtr.resize(m_iHashSize);
-      // 初始化锁
-      CGuard::createMutex(m_Lock);
+      for (int i = 0; i < m_iShards; ++ i)
+      {
+         CGuard::createMutex(m_Shards[i].m_Lock);
+         m_Shards[i].init();
+      }
+
+      setSizeLimit(size);
    }
 
    ~CCache()
    {
       // 释放所有缓存项及哈希表
       clear();
-      // 销毁锁
-      CGuard::releaseMutex(m_Lock);
+
+      for (int i = 0; i < m_iShards; ++ i)
+      {
+         delete [] m_Shards[i].m_pBuckets;
+         // 销毁锁
+         CGuard::releaseMutex(m_Shards[i].m_Lock);
+      }
    }
 
 public:
@@ -121,35 +99,27 @@ public:
       // Returned value:
       //    0 if found a match, otherwise -1.
 
-   // 从缓存中查找匹配项，拷贝数据到data中
+   // 从缓存中查找匹配项，拷贝数据到data中；命中的项移到LRU链表头部
    int lookup(T* data)
    {
-      // lock_guard
-      CGuard cacheguard(m_Lock);
+      uint32_t hash = mix(K::hash(*data));
+      CShard& s = m_Shards[hash % m_iShards];
 
-      // 获取key值,要求模板参数T必须实现getKey()函数
-      int key = data->getKey();
-      if (key < 0)
+      CGuard cacheguard(s.m_Lock);
+
+      CNode* n = s.find(hash, *data);
+      if (NULL == n)
          return -1;
-      // 避免key值超出哈希表的大小
-      if (key >= m_iMaxSize)
-         key %= m_iHashSize;
 
-      // 哈希查找，找到匹配的list
-      const ItemPtrList& item_list = m_vHashPtr[key];
-      for (typename ItemPtrList::const_iterator i = item_list.begin(); i != item_list.end(); ++ i)
+      if ((0 != m_ullTTL) && expired(n, now()))
       {
-         // 虽然*data == ***i，但是并不意味者这两个对象完全相同，要看==运算符重载是如何实现的
-         if (*data == ***i)
-         {
-            // copy the cached info
-            // 将整个对象进行拷贝
-            *data = ***i;
-            return 0;
-         }
+         s.remove(n);
+         return -1;
       }
 
-      return -1;
+      s.touch(n);
+      *data = n->m_Data;
+      return 0;
    }
 
       // Functionality:
@@ -159,86 +129,41 @@ public:
       // Returned value:
       //    0 if success, otherwise -1.
 
-   // 更新缓存中的项，或者插入一个不存在的项；最旧的项目可能会被删除
+   // 更新缓存中的项，或者插入一个不存在的项；分片满时删除最久未使用的项
    int update(T* data)
    {
-      // RAII方式加锁，函数结束时自动解锁
-      CGuard cacheguard(m_Lock);
-
-      // 获取key值，要求模板参数中必须实现了getKey()函数
-      int key = data->getKey();
-      if (key < 0)
-         return -1;
-      // 避免key值超出哈希表的大小
-      if (key >= m_iMaxSize)
-         key %= m_iHashSize;
+      uint32_t hash = mix(K::hash(*data));
+      CShard& s = m_Shards[hash % m_iShards];
+      uint64_t currtime = now();
 
-      // 用于临时存储当前正在处理的项
-      T* curr = NULL;
+      CGuard cacheguard(s.m_Lock);
 
-      // 查找现有项，获取key对应的list
-      ItemPtrList& item_list = m_vHashPtr[key];
-      for (typename ItemPtrList::iterator i = item_list.begin(); i != item_list.end(); ++ i)
+      CNode* n = s.find(hash, *data);
+      if (NULL != n)
       {
-         // 如果key对应的数据已存在，则删除之，并将新数据插入到最前面，LRU策略
-         if (*data == ***i)
-         {
-            // update the existing entry with the new value
-            // 更新数据内容
-            ***i = *data;
-            // 保存数据
-            curr = **i;
-
-            // remove the current entry
-            // 从原位置删除数据
-            m_StorageList.erase(*i);
-            // 从哈希表中删除数据
-            item_list.erase(i);
-
-            // re-insert to the front
-            // 将数据重新插入到链表的最前面(LRU策略)
-            m_StorageList.push_front(curr);
-            // 更新哈希表中的引用
-            item_list.push_front(m_StorageList.begin());
-
-            return 0;
-         }
+         // update the existing entry with the new value and move it to the front
+         // 更新数据内容，并移到LRU链表头部
+         n->m_Data = *data;
+         n->m_ullTimeStamp = currtime;
+         s.touch(n);
+         return 0;
       }
 
-      // create new entry and insert to front
-      // 如果是新的缓存项，创建并插入到链表的最前面
-      curr = data->clone();
-      m_StorageList.push_front(curr);
-      // 更新哈希表中的引用
-      item_list.push_front(m_StorageList.begin());
-
-      // 更新缓存项个数
-      ++ m_iCurrSize;
-      // 缓冲容量超出限制，则删除最旧的数据
-      if (m_iCurrSize >= m_iMaxSize)
-      {
-         // Cache overflow, remove oldest entry.
-         // 缓存溢出，删除最旧的数据
-         T* last_data = m_StorageList.back();
-         int last_key = last_data->getKey() % m_iHashSize;
-         // 从哈希表中删除
-         item_list = m_vHashPtr[last_key];
-         for (typename ItemPtrList::iterator i = item_list.begin(); i != item_list.end(); ++ i)
-         {
-            if (*last_data == ***i)
-            {
-               item_list.erase(i);
-               break;
-            }
-         }
-         // 删除数据，释放内存
-         last_data->release();
-         delete last_data;
-         // 删除链表中的数据
-         m_StorageList.pop_back();
-         // 更新缓存项个数
-         -- m_iCurrSize;
-      }
+      // expired items gather at the tail of the LRU list, reclaim a few of them
+      // 过期项集中在LRU链表尾部，顺便回收
+      for (int i = 0; (i < 4) && (NULL != s.m_pTail) && expired(s.m_pTail, currtime); ++ i)
+         s.remove(s.m_pTail);
+
+      // cache overflow, remove the least recently used entry
+      // 分片已满，删除最久未使用的项
+      if (s.m_iCurrSize >= s.m_iMaxSize)
+         s.remove(s.m_pTail);
+
+      n = new CNode;
+      n->m_Data = *data;
+      n->m_uiHash = hash;
+      n->m_ullTimeStamp = currtime;
+      s.insert(n);
 
       return 0;
    }
@@ -250,15 +175,31 @@ public:
       // Returned value:
       //    None.
 
-   // 指定缓存大小
+   // 指定缓存大小，平均分配到各个分片；多出的项按LRU删除
    void setSizeLimit(int size)
    {
-      // 缓存项个数
-      m_iMaxSize = size;
-      // 哈希表的大小为缓存项个数的三倍，以减少hash冲突
-      m_iHashSize = size * 3;
-      // 重新调整哈希表的大小
-      m_vHashPtr.resize(m_iHashSize);
+      int shard_size = (size + m_iShards - 1) / m_iShards;
+      if (shard_size < 1)
+         shard_size = 1;
+
+      for (int i = 0; i < m_iShards; ++ i)
+      {
+         CGuard cacheguard(m_Shards[i].m_Lock);
+         m_Shards[i].resize(shard_size);
+      }
+   }
+
+      // Functionality:
+      //    Specify how long an item stays valid after its last update.
+      // Parameters:
+      //    0) [in] ttl: time to live, in microseconds; 0 means never expire.
+      // Returned value:
+      //    None.
+
+   // 指定缓存项的存活时间，单位微秒，0表示永不过期
+   void setTTL(uint64_t ttl)
+   {
+      m_ullTTL = ttl;
    }
 
       // Functionality:
@@ -271,38 +212,172 @@ public:
    // 清除缓存中的所有条目，恢复到初始化状态
    void clear()
    {
-      // 释放所有缓存项
-      for (typename std::list<T*>::iterator i = m_StorageList.begin(); i != m_StorageList.end(); ++ i)
+      for (int i = 0; i < m_iShards; ++ i)
+      {
+         CGuard cacheguard(m_Shards[i].m_Lock);
+         while (NULL != m_Shards[i].m_pTail)
+            m_Shards[i].remove(m_Shards[i].m_pTail);
+      }
+   }
+
+private:
+   // 缓存节点：同时挂在哈希桶的单向链表和LRU双向链表上
+   struct CNode
+   {
+      T m_Data;
+      uint32_t m_uiHash;		// mixed hash of the key
+      uint64_t m_ullTimeStamp;	// last update time, in CPU clock cycles
+      CNode* m_pHashNext;		// next node in the same bucket
+      CNode* m_pPrev;		// LRU list, towards the most recently used
+      CNode* m_pNext;		// LRU list, towards the least recently used
+   };
+
+   struct CShard
+   {
+      pthread_mutex_t m_Lock;
+      CNode** m_pBuckets;		// hash table, power-of-2 size
+      uint32_t m_uiMask;		// number of buckets - 1
+      CNode* m_pHead;		// most recently used
+      CNode* m_pTail;		// least recently used
+      int m_iCurrSize;
+      int m_iMaxSize;
+
+      void init()
+      {
+         m_pBuckets = NULL;
+         m_uiMask = 0;
+         m_pHead = m_pTail = NULL;
+         m_iCurrSize = m_iMaxSize = 0;
+      }
+
+      CNode* find(uint32_t hash, const T& data)
+      {
+         for (CNode* n = m_pBuckets[(hash / m_iShards) & m_uiMask]; NULL != n; n = n->m_pHashNext)
+         {
+            if ((n->m_uiHash == hash) && K::equal(n->m_Data, data))
+               return n;
+         }
+         return NULL;
+      }
+
+      // 插入到哈希桶和LRU链表头部
+      void insert(CNode* n)
+      {
+         CNode** b = m_pBuckets + ((n->m_uiHash / m_iShards) & m_uiMask);
+         n->m_pHashNext = *b;
+         *b = n;
+
+         n->m_pPrev = NULL;
+         n->m_pNext = m_pHead;
+         if (NULL != m_pHead)
+            m_pHead->m_pPrev = n;
+         else
+            m_pTail = n;
+         m_pHead = n;
+
+         ++ m_iCurrSize;
+      }
+
+      void unlinkLRU(CNode* n)
+      {
+         if (NULL != n->m_pPrev)
+            n->m_pPrev->m_pNext = n->m_pNext;
+         else
+            m_pHead = n->m_pNext;
+         if (NULL != n->m_pNext)
+            n->m_pNext->m_pPrev = n->m_pPrev;
+         else
+            m_pTail = n->m_pPrev;
+      }
+
+      // 移到LRU链表头部
+      void touch(CNode* n)
+      {
+         if (m_pHead == n)
+            return;
+
+         unlinkLRU(n);
+         n->m_pPrev = NULL;
+         n->m_pNext = m_pHead;
+         m_pHead->m_pPrev = n;
+         m_pHead = n;
+      }
+
+      // 从哈希桶和LRU链表中删除并释放
+      void remove(CNode* n)
+      {
+         CNode** p = m_pBuckets + ((n->m_uiHash / m_iShards) & m_uiMask);
+         while (*p != n)
+            p = &(*p)->m_pHashNext;
+         *p = n->m_pHashNext;
+
+         unlinkLRU(n);
+         delete n;
+         -- m_iCurrSize;
+      }
+
+      // 调整容量：删除多出的项，哈希表按2倍容量重建
+      void resize(int size)
       {
-         (*i)->release();
-         delete *i;
+         m_iMaxSize = size;
+         while (m_iCurrSize > m_iMaxSize)
+            remove(m_pTail);
+
+         uint32_t buckets = 1;
+         while (buckets < uint32_t(size) * 2)
+            buckets <<= 1;
+
+         delete [] m_pBuckets;
+         m_pBuckets = new CNode*[buckets];
+         std::fill(m_pBuckets, m_pBuckets + buckets, (CNode*)NULL);
+         m_uiMask = buckets - 1;
+
+         // re-insert from the tail so that the LRU order is kept
+         CNode* n = m_pTail;
+         m_pHead = m_pTail = NULL;
+         m_iCurrSize = 0;
+         while (NULL != n)
+         {
+            CNode* prev = n->m_pPrev;
+            insert(n);
+            n = prev;
+         }
       }
-      // 清除真正存储缓存项的链表
-      m_StorageList.clear();
-      // 清除哈希表
-      for (typename std::vector<ItemPtrList>::iterator i = m_vHashPtr.begin(); i != m_vHashPtr.end(); ++ i)
-         i->clear();
-
-      // 更新缓存项个数
-      m_iCurrSize = 0;
+   };
+
+private:
+   // Keys such as IPv4 addresses differ mostly in a few bits; spread them over the shards and buckets.
+   // 打散key值，使相近的key分布到不同的分片和哈希桶
+   static uint32_t mix(uint32_t key)
+   {
+      key ^= key >> 16;
+      key *= 0x85EBCA6BU;
+      key ^= key >> 13;
+      key *= 0xC2B2AE35U;
+      key ^= key >> 16;
+      return key;
+   }
+
+   // the TTL check runs on every lookup, so the time is read from the CPU clock
+   // 每次查找都要检查TTL，直接读取CPU时钟周期
+   static uint64_t now()
+   {
+      uint64_t t;
+      CTimer::rdtsc(t);
+      return t;
+   }
+
+   bool expired(const CNode* n, uint64_t currtime) const
+   {
+      // the CPU frequency is read here, as the cache may be built before the timer is initialized
+      return (0 != m_ullTTL) && (currtime - n->m_ullTimeStamp > m_ullTTL * CTimer::getCPUFrequency());
    }
 
 private:
-   // 真正存储缓存项的链表
-   std::list<T*> m_StorageList;
-   typedef typename std::list<T*>::iterator ItemPtr;
-   typedef std::list<ItemPtr> ItemPtrList;
-   // 哈希表中存放的是每个list的入口地址，用于快速找到对应的list
-   std::vector<ItemPtrList> m_vHashPtr;
-
-   // 缓存最大大小
-   int m_iMaxSize;
-   // 哈希表，是m_iMaxSize的三倍，以减少哈希冲突的概率
-   int m_iHashSize;
-   // 缓存的最大大小
-   int m_iCurrSize;
-
-   pthread_mutex_t m_Lock;
+   static const int m_iShards = 16;	// number of shards, each locked independently
+   CShard m_Shards[m_iShards];
+
+   uint64_t m_ullTTL;			// time to live of an item, in microseconds, 0 = forever
 
 private:
    // 仅声明未实现，表示禁用拷贝构造函数
@@ -323,10 +398,12 @@ public:
    uint64_t m_ullTimeStamp;	// last update time
    // rtt
    int m_iRTT;			// RTT
+   // rtt变化幅度
+   int m_iRTTVar;		// RTT variance
    // 估算的带宽
    int m_iBandwidth;		// estimated bandwidth
-   // 平均丢包率
-   int m_iLossRate;		// average loss rate
+   // 平均丢包率，单位万分之一
+   int m_iLossRate;		// average loss rate, in 1/10000
    // 重排序距离，数据包到达顺序与发送顺序的差异，可以用来识别网络中的重排序现象
    int m_iReorderDistance;	// packet reordering distance
    // 包间时间，数据包之间的时间间隔，用于拥塞控制
@@ -335,17 +412,13 @@ public:
    double m_dCWnd;		// congestion window size, congestion control
 
 public:
-   virtual ~CInfoBlock() {}
+   CInfoBlock();
    // 重载赋值运算符
-   virtual CInfoBlock& operator=(const CInfoBlock& obj);
-   // 重载==运算符
-   virtual bool operator==(const CInfoBlock& obj);
-   // 深拷贝克隆
-   virtual CInfoBlock* clone();
+   CInfoBlock& operator=(const CInfoBlock& obj);
+   // 重载==运算符，只比较IP地址
+   bool operator==(const CInfoBlock& obj) const;
    // 获取key值，以IP地址作为key值
-   virtual int getKey();
-   // 释放资源，未实现
-   virtual void release() {}
+   uint32_t getKey() const;
 
 public:
 
@@ -360,6 +433,38 @@ public:
 
    // 将sockaddr类型转换为机器可读的IP地址格式
    static void convert(const sockaddr* addr, int ver, uint32_t ip[]);
+
+      // Functionality:
+      //    fold the values of a finished connection into this entry by exponential smoothing
+      // Parameters:
+      //    0) [in] obj: values measured by the connection; m_dCWnd <= 0 if it has no congestion control history
+      // Returned value:
+      //    None.
+
+   // 按指数平滑把一个结束的连接的测量值合并到缓存项中
+   void merge(const CInfoBlock& obj);
+};
+
+// 会话恢复票据，由监听端签发，客户端按监听端的地址和端口缓存
+class CTicketBlock
+{
+public:
+   // 监听端IP地址和端口，作为key值
+   uint32_t m_piIP[4];		// IP address of the listener, machine read only
+   int m_iIPversion;		// IP version
+   int m_iPort;			// UDP port of the listener
+   // 收到票据的时间
+   uint64_t m_ullTimeStamp;	// local time when the ticket was received
+   // 票据内容，原样交还给监听端
+   int32_t m_iTicketTime;	// issue time, in seconds on the listener's clock
+   int32_t m_iTicketSerial;	// serial number on the listener
+   uint32_t m_piTicketMAC[2];	// authenticator
+
+public:
+   CTicketBlock& operator=(const CTicketBlock& obj);
+   // 比较IP地址和端口
+   bool operator==(const CTicketBlock& obj) const;
+   uint32_t getKey() const;
 };
 
 
@@ -54,6 +54,11 @@ m_iMSS(),
 m_iSndCurrSeqNo(),
 m_iRcvRate(),
 m_iRTT(),
+m_iLastRTT(),
+m_iRTTVar(),
+m_iMinRTT(),
+m_dWarmPktSndPeriod(0),
+m_dWarmCWndSize(0),
 m_pcParam(NULL),
 m_iPSize(0),
 m_UDT(),
@@ -149,6 +154,19 @@ void CCC::setRTT(int rtt)
    m_iRTT = rtt;
 }
 
+void CCC::setRTTSample(int sample, int rttvar, int minrtt)
+{
+   m_iLastRTT = sample;
+   m_iRTTVar = rttvar;
+   m_iMinRTT = minrtt;
+}
+
+void CCC::setWarmStart(double period, double cwnd)
+{
+   m_dWarmPktSndPeriod = period;
+   m_dWarmCWndSize = cwnd;
+}
+
 void CCC::setUserParam(const char* param, int size)
 {
    delete [] m_pcParam;
@@ -190,6 +208,15 @@ void CUDTCC::init()
 
    m_dCWndSize = 16;
    m_dPktSndPeriod = 1;
+
+   // history of the peer: start in congestion avoidance at the rate the recent connections ended with
+   // 有对端的历史信息时跳过慢启动，从最近连接结束时的速率开始
+   if (m_dWarmCWndSize > 0)
+   {
+      m_bSlowStart = false;
+      m_dCWndSize = m_dWarmCWndSize;
+      m_dPktSndPeriod = m_dWarmPktSndPeriod;
+   }
 }
 /*
    1. 通过ACK包来调整发送速率
@@ -372,3 +399,553 @@ void CUDTCC::onTimeout()
       */
    }
 }
+
+////////////////////////////////////////////////////////////////////////////////
+
+const double CBBRCC::m_dHighGain = 2.885;
+const double CBBRCC::m_adPacingGain[CBBRCC::m_iGainCycle] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+
+CBBRCC::CBBRCC():
+m_Mode(STARTUP),
+m_dPacingGain(),
+m_dCWndGain(),
+m_iBWIndex(),
+m_iLastAck(),
+m_LastAckTime(),
+m_llRound(),
+m_iRoundEndSeq(),
+m_iRTProp(),
+m_RTPropStamp(),
+m_bFullPipe(),
+m_dFullBW(),
+m_iFullBWCount(),
+m_iCycleIndex(),
+m_CycleStamp(),
+m_ProbeRTTDone(),
+m_llProbeRTTRound()
+{
+   memset(m_adBWSample, 0, sizeof(m_adBWSample));
+}
+
+void CBBRCC::init()
+{
+   m_Mode = STARTUP;
+   m_dPacingGain = m_dHighGain;
+   m_dCWndGain = m_dHighGain;
+
+   memset(m_adBWSample, 0, sizeof(m_adBWSample));
+   m_iBWIndex = 0;
+   m_iLastAck = m_iSndCurrSeqNo;
+   m_LastAckTime = CTimer::getTime();
+
+   m_llRound = 0;
+   m_iRoundEndSeq = m_iSndCurrSeqNo;
+
+   // no RTT sample yet: m_iRTT is still the initial guess
+   m_iRTProp = 0;
+   m_RTPropStamp = m_LastAckTime;
+
+   m_bFullPipe = false;
+   m_dFullBW = 0;
+   m_iFullBWCount = 0;
+
+   m_iCycleIndex = 0;
+   m_CycleStamp = m_LastAckTime;
+   m_ProbeRTTDone = 0;
+   m_llProbeRTTRound = 0;
+
+   m_dCWndSize = 16;
+   m_dPktSndPeriod = 1;
+
+   // history of the peer: the model starts from the rate the recent connections ended with, startup is skipped
+   // 有对端的历史信息时，以最近连接结束时的速率作为瓶颈带宽的初始估计，跳过STARTUP
+   if (m_dWarmCWndSize > 0)
+   {
+      m_adBWSample[0] = 1000000.0 / m_dWarmPktSndPeriod;
+      m_iRTProp = m_iRTT;
+      m_bFullPipe = true;
+      m_dFullBW = m_adBWSample[0];
+      enterProbeBW(m_LastAckTime);
+      m_dCWndSize = m_dWarmCWndSize;
+      m_dPktSndPeriod = 1000000.0 / (m_dPacingGain * m_adBWSample[0]);
+   }
+}
+
+/*
+   1. 由两次ACK之间新确认的包数计算交付速率，取最近10轮的最大值作为瓶颈带宽
+   2. 取10秒内的最小RTT作为传播时延
+   3. 按阶段(STARTUP/DRAIN/PROBE_BW/PROBE_RTT)选择增益，发送间隔 = 1 / (增益 * 瓶颈带宽)
+   4. 拥塞窗口 = 增益 * BDP，丢包不降速
+*/
+void CBBRCC::onACK(int32_t ack)
+{
+   uint64_t currtime = CTimer::getTime();
+
+   int acked = CSeqNo::seqoff(m_iLastAck, ack);
+   if (acked <= 0)
+      return;
+
+   updateModel(ack, currtime);
+   updateMode(currtime);
+
+   if (PROBE_RTT == m_Mode)
+   {
+      // hold the window at the minimum for at least 200ms and one round trip
+      if ((0 == m_ProbeRTTDone) && (getInflight(ack) <= 4))
+      {
+         m_ProbeRTTDone = currtime + m_ullProbeRTTTime;
+         m_llProbeRTTRound = m_llRound;
+      }
+      else if ((0 != m_ProbeRTTDone) && (currtime > m_ProbeRTTDone) && (m_llRound > m_llProbeRTTRound))
+      {
+         m_RTPropStamp = currtime;
+         m_ProbeRTTDone = 0;
+         if (m_bFullPipe)
+            enterProbeBW(currtime);
+         else
+         {
+            m_Mode = STARTUP;
+            m_dPacingGain = m_dCWndGain = m_dHighGain;
+         }
+      }
+   }
+
+   setOutput(acked);
+}
+
+void CBBRCC::onTimeout()
+{
+   // no feedback at all: keep the model, restart from a small window
+   m_dCWndSize = 4;
+}
+
+void CBBRCC::updateModel(int32_t ack, uint64_t currtime)
+{
+   // a new round starts when the data sent at the beginning of the last round is acknowledged
+   bool roundstart = false;
+   if (CSeqNo::seqcmp(ack, m_iRoundEndSeq) > 0)
+   {
+      ++ m_llRound;
+      m_iRoundEndSeq = m_iSndCurrSeqNo;
+      m_iBWIndex = (m_iBWIndex + 1) % m_iBWWindow;
+      m_adBWSample[m_iBWIndex] = 0;
+      roundstart = true;
+   }
+
+   // delivery rate sample, bounded by the packet-pair link capacity when it is known
+   if (currtime > m_LastAckTime)
+   {
+      double rate = CSeqNo::seqoff(m_iLastAck, ack) * 1000000.0 / (currtime - m_LastAckTime);
+      if ((m_iBandwidth > 0) && (rate > m_iBandwidth))
+         rate = m_iBandwidth;
+      if (rate > m_adBWSample[m_iBWIndex])
+         m_adBWSample[m_iBWIndex] = rate;
+   }
+   m_iLastAck = ack;
+   m_LastAckTime = currtime;
+
+   // m_iRTT is refreshed from the RTT reported in every ACK
+   bool expired = currtime - m_RTPropStamp > m_ullMinRTTWindow;
+   if ((0 == m_iRTProp) || (m_iRTT <= m_iRTProp) || expired)
+   {
+      m_iRTProp = m_iRTT;
+      m_RTPropStamp = currtime;
+      if (expired && (PROBE_RTT != m_Mode))
+      {
+         m_Mode = PROBE_RTT;
+         m_dPacingGain = m_dCWndGain = 1;
+         m_ProbeRTTDone = 0;
+      }
+   }
+
+   // startup ends when the bandwidth has not grown by 25% for three rounds
+   if (roundstart && !m_bFullPipe)
+   {
+      double bw = getBtlBW();
+      if (bw >= m_dFullBW * 1.25)
+      {
+         m_dFullBW = bw;
+         m_iFullBWCount = 0;
+      }
+      else if (++ m_iFullBWCount >= 3)
+         m_bFullPipe = true;
+   }
+}
+
+void CBBRCC::updateMode(uint64_t currtime)
+{
+   switch (m_Mode)
+   {
+   case STARTUP:
+      if (m_bFullPipe)
+      {
+         // drain the queue built during startup
+         m_Mode = DRAIN;
+         m_dPacingGain = 1 / m_dHighGain;
+         m_dCWndGain = m_dHighGain;
+      }
+      break;
+
+   case DRAIN:
+      if (getInflight(m_iLastAck) <= getBDP(1))
+         enterProbeBW(currtime);
+      break;
+
+   case PROBE_BW:
+      // each gain phase lasts one min RTT; the draining phase may end early once the queue is gone
+      if ((currtime - m_CycleStamp > (uint64_t)m_iRTProp) || ((m_dPacingGain < 1) && (getInflight(m_iLastAck) <= getBDP(1))))
+      {
+         m_iCycleIndex = (m_iCycleIndex + 1) % m_iGainCycle;
+         m_CycleStamp = currtime;
+         m_dPacingGain = m_adPacingGain[m_iCycleIndex];
+      }
+      break;
+
+   default:
+      break;
+   }
+}
+
+void CBBRCC::enterProbeBW(uint64_t currtime)
+{
+   m_Mode = PROBE_BW;
+   m_dCWndGain = 2;
+
+   // start at a random phase other than the draining one, so that flows do not probe in sync
+   m_iCycleIndex = rand() % (m_iGainCycle - 1);
+   if (m_iCycleIndex >= 1)
+      ++ m_iCycleIndex;
+   m_dPacingGain = m_adPacingGain[m_iCycleIndex];
+   m_CycleStamp = currtime;
+}
+
+void CBBRCC::setOutput(int acked)
+{
+   double bw = getBtlBW();
+   if (bw > 0)
+      m_dPktSndPeriod = 1000000.0 / (m_dPacingGain * bw);
+
+   if (PROBE_RTT == m_Mode)
+   {
+      m_dCWndSize = 4;
+      return;
+   }
+
+   // before the pipe is full the window grows with every ACK, afterwards it converges to the target
+   double target = getBDP(m_dCWndGain) + 16;
+   if (m_bFullPipe)
+   {
+      m_dCWndSize += acked;
+      if (m_dCWndSize > target)
+         m_dCWndSize = target;
+   }
+   else if ((m_dCWndSize < target) || (0 == bw))
+      m_dCWndSize += acked;
+
+   if (m_dCWndSize < 4)
+      m_dCWndSize = 4;
+}
+
+double CBBRCC::getBtlBW() const
+{
+   double bw = 0;
+   for (int i = 0; i < m_iBWWindow; ++ i)
+   {
+      if (m_adBWSample[i] > bw)
+         bw = m_adBWSample[i];
+   }
+   return bw;
+}
+
+double CBBRCC::getBDP(double gain) const
+{
+   // feedback arrives once per SYN interval, so the pipe must also cover the ACK period
+   return gain * getBtlBW() * (m_iRTProp + m_iSYNInterval) / 1000000.0;
+}
+
+int CBBRCC::getInflight(int32_t ack) const
+{
+   int inflight = CSeqNo::seqoff(ack, m_iSndCurrSeqNo) + 1;
+   return (inflight > 0) ? inflight : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+const double CCubicCC::m_dBeta = 0.7;
+const double CCubicCC::m_dC = 0.4;
+
+CCubicCC::CCubicCC():
+m_iLastAck(),
+m_iLastDecSeq(),
+m_dSSThresh(),
+m_dWMax(),
+m_dWLastMax(),
+m_dOrigin(),
+m_dK(),
+m_dWTCP(),
+m_EpochStart()
+{
+}
+
+void CCubicCC::init()
+{
+   m_iLastAck = m_iSndCurrSeqNo;
+   m_iLastDecSeq = CSeqNo::decseq(m_iLastAck);
+   m_dSSThresh = m_dMaxCWndSize;
+   m_dWMax = 0;
+   m_dWLastMax = 0;
+   m_dOrigin = 0;
+   m_dK = 0;
+   m_dWTCP = 0;
+   m_EpochStart = 0;
+
+   m_dCWndSize = 16;
+
+   // history of the peer: slow start ends at the window the recent connections ended with
+   // 有对端的历史信息时，从最近连接结束时的窗口开始，不再慢启动
+   if (m_dWarmCWndSize > 0)
+      m_dCWndSize = m_dSSThresh = m_dWarmCWndSize;
+
+   setPacing();
+}
+
+/*
+   1. 慢启动阶段：窗口按新确认的包数增长
+   2. 拥塞避免阶段：目标窗口 W(t) = C * (t - K)^3 + Wmax，t为本轮开始以来的时间
+   3. 窗口不低于标准TCP在同样时间内能达到的窗口
+*/
+void CCubicCC::onACK(int32_t ack)
+{
+   int acked = CSeqNo::seqoff(m_iLastAck, ack);
+   if (acked <= 0)
+      return;
+   m_iLastAck = ack;
+
+   if (m_dCWndSize < m_dSSThresh)
+   {
+      m_dCWndSize += acked;
+      setPacing();
+      return;
+   }
+
+   uint64_t currtime = CTimer::getTime();
+   if (0 == m_EpochStart)
+   {
+      m_EpochStart = currtime;
+      if (m_dCWndSize < m_dWMax)
+      {
+         m_dK = pow((m_dWMax - m_dCWndSize) / m_dC, 1.0 / 3);
+         m_dOrigin = m_dWMax;
+      }
+      else
+      {
+         m_dK = 0;
+         m_dOrigin = m_dCWndSize;
+      }
+      m_dWTCP = m_dCWndSize;
+   }
+
+   // look one min RTT ahead, as the window is used for the next round trip
+   double t = (currtime - m_EpochStart + m_iMinRTT) / 1000000.0;
+   double target = m_dOrigin + m_dC * (t - m_dK) * (t - m_dK) * (t - m_dK);
+
+   // TCP-friendly region: the window of AIMD with the same beta
+   m_dWTCP += 3 * (1 - m_dBeta) / (1 + m_dBeta) * acked / m_dCWndSize;
+   if (target < m_dWTCP)
+      target = m_dWTCP;
+
+   if (target > m_dCWndSize)
+      m_dCWndSize += (target - m_dCWndSize) / m_dCWndSize * acked;
+   else
+      m_dCWndSize += 0.01 * acked / m_dCWndSize;
+
+   if (m_dCWndSize > m_dMaxCWndSize)
+      m_dCWndSize = m_dMaxCWndSize;
+
+   setPacing();
+}
+
+void CCubicCC::onLoss(const int32_t* losslist, int)
+{
+   // one decrease per congestion event: ignore losses of packets sent before the last decrease
+   if (CSeqNo::seqcmp(losslist[0] & 0x7FFFFFFF, m_iLastDecSeq) <= 0)
+      return;
+   m_iLastDecSeq = m_iSndCurrSeqNo;
+
+   // fast convergence: release bandwidth for new flows when the window keeps shrinking
+   if (m_dCWndSize < m_dWLastMax)
+      m_dWLastMax = m_dCWndSize * (1 + m_dBeta) / 2;
+   else
+      m_dWLastMax = m_dCWndSize;
+   m_dWMax = m_dWLastMax;
+
+   m_dCWndSize *= m_dBeta;
+   if (m_dCWndSize < 2)
+      m_dCWndSize = 2;
+   m_dSSThresh = m_dCWndSize;
+   m_EpochStart = 0;
+
+   setPacing();
+}
+
+void CCubicCC::onTimeout()
+{
+   m_dSSThresh = m_dCWndSize * m_dBeta;
+   if (m_dSSThresh < 2)
+      m_dSSThresh = 2;
+   m_dWMax = m_dCWndSize;
+   m_dCWndSize = 2;
+   m_EpochStart = 0;
+   m_iLastDecSeq = m_iSndCurrSeqNo;
+
+   setPacing();
+}
+
+void CCubicCC::setPacing()
+{
+   // feedback is clocked by the ACK timer, so a round trip spans RTT + SYN
+   m_dPktSndPeriod = (m_iRTT + m_iSYNInterval) / (1.25 * m_dCWndSize);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CLEDBATCC::CLEDBATCC():
+m_iLastAck(),
+m_iLastDecSeq(),
+m_bSlowStart(),
+m_iBaseIndex(),
+m_BaseStamp()
+{
+   memset(m_aiBaseRTT, 0, sizeof(m_aiBaseRTT));
+}
+
+void CLEDBATCC::init()
+{
+   m_iLastAck = m_iSndCurrSeqNo;
+   m_iLastDecSeq = CSeqNo::decseq(m_iLastAck);
+   m_bSlowStart = true;
+
+   memset(m_aiBaseRTT, 0, sizeof(m_aiBaseRTT));
+   m_iBaseIndex = 0;
+   m_BaseStamp = CTimer::getTime();
+
+   m_dCWndSize = 16;
+
+   // history of the peer: start in congestion avoidance at the window the recent connections ended with
+   if (m_dWarmCWndSize > 0)
+   {
+      m_bSlowStart = false;
+      m_dCWndSize = m_dWarmCWndSize;
+   }
+
+   setPacing();
+}
+
+/*
+   1. 基准时延取最近10分钟内每分钟最小RTT中的最小值
+   2. 排队时延 = 当前RTT - 基准时延
+   3. 窗口变化量与 (目标时延 - 排队时延) / 目标时延 成正比，每个RTT最多增减一个包
+   4. 慢启动在排队时延超过目标值的一半或发生丢包时结束
+*/
+void CLEDBATCC::onACK(int32_t ack)
+{
+   int acked = CSeqNo::seqoff(m_iLastAck, ack);
+   if (acked <= 0)
+      return;
+   m_iLastAck = ack;
+
+   updateBaseRTT(CTimer::getTime());
+
+   int base = 0;
+   for (int i = 0; i < m_iBaseHistory; ++ i)
+   {
+      if ((m_aiBaseRTT[i] > 0) && ((0 == base) || (m_aiBaseRTT[i] < base)))
+         base = m_aiBaseRTT[i];
+   }
+   int queuing = m_iRTT - base;
+
+   if (m_bSlowStart)
+   {
+      if (queuing < m_iTarget / 2)
+      {
+         m_dCWndSize += acked;
+         if (m_dCWndSize > m_dMaxCWndSize)
+            m_dCWndSize = m_dMaxCWndSize;
+         setPacing();
+         return;
+      }
+      m_bSlowStart = false;
+   }
+
+   double offtarget = double(m_iTarget - queuing) / m_iTarget;
+   if (offtarget < -1)
+      offtarget = -1;
+   m_dCWndSize += offtarget * acked / m_dCWndSize;
+
+   if (m_dCWndSize < 2)
+      m_dCWndSize = 2;
+   else if (m_dCWndSize > m_dMaxCWndSize)
+      m_dCWndSize = m_dMaxCWndSize;
+
+   setPacing();
+}
+
+void CLEDBATCC::onLoss(const int32_t* losslist, int)
+{
+   m_bSlowStart = false;
+
+   // halve once per congestion event
+   if (CSeqNo::seqcmp(losslist[0] & 0x7FFFFFFF, m_iLastDecSeq) <= 0)
+      return;
+   m_iLastDecSeq = m_iSndCurrSeqNo;
+
+   m_dCWndSize /= 2;
+   if (m_dCWndSize < 2)
+      m_dCWndSize = 2;
+
+   setPacing();
+}
+
+void CLEDBATCC::onTimeout()
+{
+   m_bSlowStart = false;
+   m_iLastDecSeq = m_iSndCurrSeqNo;
+   m_dCWndSize = 2;
+
+   setPacing();
+}
+
+void CLEDBATCC::updateBaseRTT(uint64_t currtime)
+{
+   // keep one minimum per minute, so that a route change is forgotten after m_iBaseHistory minutes
+   if (currtime - m_BaseStamp > m_ullBaseInterval)
+   {
+      m_iBaseIndex = (m_iBaseIndex + 1) % m_iBaseHistory;
+      m_aiBaseRTT[m_iBaseIndex] = 0;
+      m_BaseStamp = currtime;
+   }
+
+   if ((0 == m_aiBaseRTT[m_iBaseIndex]) || (m_iRTT < m_aiBaseRTT[m_iBaseIndex]))
+      m_aiBaseRTT[m_iBaseIndex] = m_iRTT;
+}
+
+void CLEDBATCC::setPacing()
+{
+   m_dPktSndPeriod = (m_iRTT + m_iSYNInterval) / (1.25 * m_dCWndSize);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CCCVirtualFactory* CCCVirtualFactory::byName(const char* name)
+{
+   if (0 == strcmp(name, "udt"))
+      return new CCCFactory<CUDTCC>;
+   if (0 == strcmp(name, "bbr"))
+      return new CCCFactory<CBBRCC>;
+   if (0 == strcmp(name, "cubic"))
+      return new CCCFactory<CCubicCC>;
+   if (0 == strcmp(name, "ledbat"))
+      return new CCCFactory<CLEDBATCC>;
+
+   return NULL;
+}
@@ -216,6 +216,8 @@ private:
    void setSndCurrSeqNo(int32_t seqno);
    void setRcvRate(int rcvrate);
    void setRTT(int rtt);
+   void setRTTSample(int sample, int rttvar, int minrtt);
+   void setWarmStart(double period, double cwnd);
 
 protected:
    // SYN包间隔,默认为10000 ms
@@ -239,6 +241,13 @@ protected:
    int m_iRcvRate;			// packet arrive rate at receiver side, packets per second
    // 估算的rtt，us
    int m_iRTT;				// current estimated RTT, microsecond
+   // 最新的RTT样本、RTT变化幅度，及10秒窗口内的最小RTT，us
+   int m_iLastRTT;			// latest RTT sample, microsecond, 0 if none yet
+   int m_iRTTVar;			// RTT variance, microsecond
+   int m_iMinRTT;			// minimum RTT sample in the last 10 seconds, microsecond, 0 if none yet
+   // 最近到同一对端的连接结束时的发送间隔和拥塞窗口，0表示没有历史，init()可据此跳过慢启动
+   double m_dWarmPktSndPeriod;		// sending period the recent connections to the peer ended with, 0 if no history
+   double m_dWarmCWndSize;		// their congestion window, in packets, 0 if no history
 
    // 用户自定义参数
    char* m_pcParam;			// user defined parameter
@@ -271,6 +280,16 @@ public:
 
    virtual CCC* create() = 0;
    virtual CCCVirtualFactory* clone() = 0;
+
+public:
+      // Functionality:
+      //    Look up the factory of a congestion control built into the library.
+      // Parameters:
+      //    0) [in] name: "udt", "bbr", "cubic" or "ledbat".
+      // Returned value:
+      //    a new factory, or NULL if the name is unknown.
+
+   static CCCVirtualFactory* byName(const char* name);
 };
 
 template <class T>
@@ -325,4 +344,136 @@ private:
    int m_iDecCount;			// number of decreases in a congestion epoch
 };
 
+// BBR风格的基于模型的拥塞控制：估计瓶颈带宽和最小RTT，按 增益*带宽 进行速率控制
+// model-based congestion control in the style of BBR: the sender estimates the
+// bottleneck bandwidth (windowed max of delivery rate) and the minimum RTT
+// (windowed min), paces at gain * bandwidth and caps the window at gain * BDP.
+// Random loss does not reduce the sending rate.
+class UDT_API CBBRCC: public CCC
+{
+public:
+   CBBRCC();
+
+public:
+   virtual void init();
+   virtual void onACK(int32_t);
+   virtual void onTimeout();
+
+private:
+   // 运行阶段
+   enum Mode {STARTUP, DRAIN, PROBE_BW, PROBE_RTT};
+
+   void updateModel(int32_t ack, uint64_t currtime);
+   void updateMode(uint64_t currtime);
+   void enterProbeBW(uint64_t currtime);
+   void setOutput(int acked);
+   double getBtlBW() const;
+   double getBDP(double gain) const;
+   int getInflight(int32_t ack) const;
+
+private:
+   static const int m_iBWWindow = 10;           // bandwidth filter length, in rounds
+   static const int m_iGainCycle = 8;           // length of the PROBE_BW gain cycle
+   static const double m_dHighGain;             // 2/ln(2), startup gain
+   static const double m_adPacingGain[m_iGainCycle];
+   static const uint64_t m_ullMinRTTWindow = 10000000;  // min RTT filter length, in microseconds
+   static const uint64_t m_ullProbeRTTTime = 200000;    // time spent in PROBE_RTT, in microseconds
+
+   Mode m_Mode;                 // current mode
+   double m_dPacingGain;        // current pacing gain
+   double m_dCWndGain;          // current cwnd gain
+
+   // 瓶颈带宽估计：最近若干轮的最大交付速率
+   double m_adBWSample[m_iBWWindow];    // max delivery rate (pkts/s) seen in each of the last rounds
+   int m_iBWIndex;              // slot of the current round
+   int32_t m_iLastAck;          // last ACKed seq no
+   uint64_t m_LastAckTime;      // time when the last ACK arrived
+
+   // 往返轮次，以序列号划分
+   int64_t m_llRound;           // number of round trips so far
+   int32_t m_iRoundEndSeq;      // a round ends when this seq no is acknowledged
+
+   // 最小RTT估计
+   int m_iRTProp;               // round-trip propagation time: windowed min RTT, in microseconds
+   uint64_t m_RTPropStamp;      // time when m_iRTProp was last refreshed
+
+   // 启动阶段是否已填满管道
+   bool m_bFullPipe;            // if startup has found the bottleneck bandwidth
+   double m_dFullBW;            // bandwidth at the last significant increase
+   int m_iFullBWCount;          // rounds without significant increase
+
+   int m_iCycleIndex;           // position in the gain cycle
+   uint64_t m_CycleStamp;       // time when the current gain phase started
+
+   uint64_t m_ProbeRTTDone;     // time to leave PROBE_RTT, 0 if not yet scheduled
+   int64_t m_llProbeRTTRound;   // round in which PROBE_RTT started
+};
+
+// CUBIC拥塞控制：丢包后窗口按时间的三次函数增长
+// CUBIC (RFC 8312): after a loss the window grows as a cubic function of the
+// time since the loss, centered on the window where the loss happened, and never
+// slower than standard TCP. Sending is paced at 1.25 * cwnd per round trip.
+class UDT_API CCubicCC: public CCC
+{
+public:
+   CCubicCC();
+
+public:
+   virtual void init();
+   virtual void onACK(int32_t);
+   virtual void onLoss(const int32_t*, int);
+   virtual void onTimeout();
+
+private:
+   void setPacing();
+
+private:
+   static const double m_dBeta;         // multiplicative decrease factor
+   static const double m_dC;            // cubic scaling constant, packets/s^3
+
+   int32_t m_iLastAck;                  // last ACKed seq no
+   int32_t m_iLastDecSeq;               // max seq no sent out when the last decrease happened
+   double m_dSSThresh;                  // slow start threshold
+   double m_dWMax;                      // window before the last decrease
+   double m_dWLastMax;                  // m_dWMax of the previous epoch, for fast convergence
+   double m_dOrigin;                    // window the cubic curve converges to
+   double m_dK;                         // seconds from the epoch start to reach m_dOrigin
+   double m_dWTCP;                      // window standard TCP would have
+   uint64_t m_EpochStart;               // start of the current congestion avoidance epoch, 0 if none
+};
+
+// 基于时延的后台拥塞控制：排队时延超过目标值时主动让出带宽
+// LEDBAT-style delay-based control (RFC 6817) for background bulk transfers: the
+// queueing delay is the RTT above the base (minimum) RTT, and the window grows
+// while it is below the target and shrinks above it, so these flows yield to
+// loss-based and latency-sensitive traffic sharing the bottleneck.
+class UDT_API CLEDBATCC: public CCC
+{
+public:
+   CLEDBATCC();
+
+public:
+   virtual void init();
+   virtual void onACK(int32_t);
+   virtual void onLoss(const int32_t*, int);
+   virtual void onTimeout();
+
+private:
+   void updateBaseRTT(uint64_t currtime);
+   void setPacing();
+
+private:
+   static const int m_iTarget = 25000;                  // target queueing delay, in microseconds
+   static const int m_iBaseHistory = 10;                // base RTT history, in minutes
+   static const uint64_t m_ullBaseInterval = 60000000;  // length of one base RTT slot, in microseconds
+
+   int32_t m_iLastAck;                  // last ACKed seq no
+   int32_t m_iLastDecSeq;               // max seq no sent out when the last decrease happened
+   bool m_bSlowStart;                   // if in slow start phase
+
+   int m_aiBaseRTT[m_iBaseHistory];     // min RTT of each of the last minutes, 0 = no sample
+   int m_iBaseIndex;                    // slot of the current minute
+   uint64_t m_BaseStamp;                // start time of the current slot
+};
+
 #endif
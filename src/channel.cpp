@@ -246,31 +246,32 @@ void CChannel::getPeerAddr(sockaddr* addr) const
 
 int CChannel::sendto(const sockaddr* addr, CPacket& packet) const
 {
-   // convert control information into network order
-   // packet.getFlag() ！=0,说明是一个控制报文
-   // 将控制报文转换成网络字节序
-   // 判断是否是一个控制报文，如果是一个控制报文，将其转换成网络字节序
-   if (packet.getFlag()){
-      for (int i = 0, n = packet.getLength() / 4; i < n; ++ i){
-         *((uint32_t *)packet.m_pcData + i) = htonl(*((uint32_t *)packet.m_pcData + i));
-      }
-   }
-   // convert packet header into network order
-   //for (int j = 0; j < 4; ++ j)
-   //   packet.m_nHeader[j] = htonl(packet.m_nHeader[j]);
-   // 将所有报文的包头转换成网络字节序
-   uint32_t* p = packet.m_nHeader;
-   for (int j = 0; j < 4; ++ j)
+   // serialize into network order in separate buffers, the packet itself is never modified
+   // 按网络字节序序列化到单独的缓冲区，不修改报文本身
+   uint32_t header[4];
+   packet.encodeHeader(header);
+
+   iovec vec[2];
+   vec[0].iov_base = (char*)header;
+   vec[0].iov_len = CPacket::m_iPktHdrSize;
+   vec[1] = packet.m_PacketVector[1];
+
+   // control information has to be converted too; data payload goes out as it is
+   // 控制报文的控制信息也需要转换，数据包的负载直接发送
+   char ctrlbuf[m_iCtrlBufSize];
+   char* ctrl = NULL;
+   if (packet.getFlag())
    {
-      *p = htonl(*p);
-      ++ p;
+      ctrl = (packet.getLength() <= m_iCtrlBufSize) ? ctrlbuf : new char[packet.getLength()];
+      packet.encodeControl(ctrl);
+      vec[1].iov_base = ctrl;
    }
 
    #ifndef WIN32
       msghdr mh;
       mh.msg_name = (sockaddr*)addr;
       mh.msg_namelen = m_iSockAddrSize;
-      mh.msg_iov = (iovec*)packet.m_PacketVector;
+      mh.msg_iov = vec;
       mh.msg_iovlen = 2;
       mh.msg_control = NULL;
       mh.msg_controllen = 0;
@@ -281,27 +282,12 @@ int CChannel::sendto(const sockaddr* addr, CPacket& packet) const
    #else
       DWORD size = CPacket::m_iPktHdrSize + packet.getLength();
       int addrsize = m_iSockAddrSize;
-      int res = ::WSASendTo(m_iSocket, (LPWSABUF)packet.m_PacketVector, 2, &size, 0, addr, addrsize, NULL, NULL);
+      int res = ::WSASendTo(m_iSocket, (LPWSABUF)vec, 2, &size, 0, addr, addrsize, NULL, NULL);
       res = (0 == res) ? size : -1;
    #endif
 
-   // convert back into local host order
-   //for (int k = 0; k < 4; ++ k)
-   //   packet.m_nHeader[k] = ntohl(packet.m_nHeader[k]);
-   // 由于传入的参数packet是引用，所以这里需要重新转换成本地字节序，避免破环引用的数据
-   p = packet.m_nHeader;
-   for (int k = 0; k < 4; ++ k)
-   {
-      *p = ntohl(*p);
-       ++ p;
-   }
-
-   // 重新将包头的flag信息转换成本地字节序
-   if (packet.getFlag())
-   {
-      for (int l = 0, n = packet.getLength() / 4; l < n; ++ l)
-         *((uint32_t *)packet.m_pcData + l) = ntohl(*((uint32_t *)packet.m_pcData + l));
-   }
+   if ((NULL != ctrl) && (ctrl != ctrlbuf))
+      delete [] ctrl;
 
    return res;
 }
@@ -348,23 +334,9 @@ int CChannel::recvfrom(sockaddr* addr, CPacket& packet) const
 
    packet.setLength(res - CPacket::m_iPktHdrSize);
 
-   // convert back into local host order
-   //for (int i = 0; i < 4; ++ i)
-   //   packet.m_nHeader[i] = ntohl(packet.m_nHeader[i]);
-   // 将包头转换成本地字节序
-   uint32_t* p = packet.m_nHeader;
-   for (int i = 0; i < 4; ++ i)
-   {
-      *p = ntohl(*p);
-      ++ p;
-   }
-
-   // 将包头中的flag转换成本地字节序
-   if (packet.getFlag())
-   {
-      for (int j = 0, n = packet.getLength() / 4; j < n; ++ j)
-         *((uint32_t *)packet.m_pcData + j) = ntohl(*((uint32_t *)packet.m_pcData + j));
-   }
+   // convert the header, and the control information of control packets, into host order
+   // 将包头及控制报文的控制信息转换成本地字节序
+   packet.decode();
 
    return packet.getLength();
 }
@@ -51,7 +51,7 @@ class CChannel
 public:
    CChannel();
    CChannel(int version);
-   ~CChannel();
+   virtual ~CChannel();
 
       // Functionality:
       //    Open a UDP channel.
@@ -81,7 +81,7 @@ public:
       //    None.
 
    // 直接调用系统API，关闭UDP套接字
-   void close() const;
+   virtual void close() const;
 
       // Functionality:
       //    Get the UDP sending buffer size.
@@ -151,7 +151,7 @@ public:
       //    Actual size of data sent.
 
    // 调用系统API sendmsg, 发送一个packet
-   int sendto(const sockaddr* addr, CPacket& packet) const;
+   virtual int sendto(const sockaddr* addr, CPacket& packet) const;
 
       // Functionality:
       //    Receive a packet from the channel and record the source address.
@@ -168,7 +168,10 @@ private:
    // 设置套接字属性：发送/接收缓冲区大小 及 接收超时时间
    void setUDPSockOpt();
 
-private:
+protected:
+   // 发送控制报文时使用的栈上缓冲区大小，足以容纳默认MSS下最长的NAK列表
+   static const int m_iCtrlBufSize = 1536;     // on-stack wire buffer for control information; larger ones are allocated
+
    // IPv4 or IPv6
    int m_iIPversion;                    // IP version
    // 地址长度，IPv6/IPv6的地址长度不同
@@ -43,6 +43,7 @@ written by
    #include <cstring>
    #include <cerrno>
    #include <unistd.h>
+   #include <fcntl.h>
    #ifdef OSX
       #include <mach/mach_time.h>
    #endif
@@ -442,6 +443,16 @@ m_strMsg()
 {
 }
 
+CUDTException& CUDTException::operator=(const CUDTException& e)
+{
+   // the message is rebuilt by getErrorMessage(), only the codes are copied
+   m_iMajor = e.m_iMajor;
+   m_iMinor = e.m_iMinor;
+   m_iErrno = e.m_iErrno;
+
+   return *this;
+}
+
 CUDTException::~CUDTException()
 {
 }
@@ -787,3 +798,155 @@ void CMD5::compute(const char* input, unsigned char result[16])
    md5_append(&state, (const md5_byte_t *)input, strlen(input));
    md5_finish(&state, result);
 }
+
+//
+#define SIP_ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIP_ROUND(v0, v1, v2, v3) \
+   do { \
+      v0 += v1; v1 = SIP_ROTL(v1, 13); v1 ^= v0; v0 = SIP_ROTL(v0, 32); \
+      v2 += v3; v3 = SIP_ROTL(v3, 16); v3 ^= v2; \
+      v0 += v3; v3 = SIP_ROTL(v3, 21); v3 ^= v0; \
+      v2 += v1; v1 = SIP_ROTL(v1, 17); v1 ^= v2; v2 = SIP_ROTL(v2, 32); \
+   } while (0)
+
+uint64_t CSipHash::compute(const uint64_t key[2], const unsigned char* data, int len)
+{
+   // SipHash-2-4: 2 compression rounds per 8-byte word, 4 finalization rounds
+   uint64_t v0 = 0x736f6d6570736575ULL ^ key[0];
+   uint64_t v1 = 0x646f72616e646f6dULL ^ key[1];
+   uint64_t v2 = 0x6c7967656e657261ULL ^ key[0];
+   uint64_t v3 = 0x7465646279746573ULL ^ key[1];
+
+   // message words are read little endian, whatever the host order is
+   // 按小端读取消息字，与主机字节序无关
+   const unsigned char* end = data + (len & ~7);
+   for (; data != end; data += 8)
+   {
+      uint64_t m = 0;
+      for (int i = 7; i >= 0; -- i)
+         m = (m << 8) | data[i];
+
+      v3 ^= m;
+      SIP_ROUND(v0, v1, v2, v3);
+      SIP_ROUND(v0, v1, v2, v3);
+      v0 ^= m;
+   }
+
+   // the last word holds the remaining bytes and the message length in its top byte
+   uint64_t b = ((uint64_t)len) << 56;
+   for (int i = (len & 7) - 1; i >= 0; -- i)
+      b |= ((uint64_t)data[i]) << (8 * i);
+
+   v3 ^= b;
+   SIP_ROUND(v0, v1, v2, v3);
+   SIP_ROUND(v0, v1, v2, v3);
+   v0 ^= b;
+
+   v2 ^= 0xff;
+   for (int i = 0; i < 4; ++ i)
+      SIP_ROUND(v0, v1, v2, v3);
+
+   return v0 ^ v1 ^ v2 ^ v3;
+}
+
+void CSipHash::genKey(uint64_t key[2])
+{
+   #ifndef WIN32
+      int fd = open("/dev/urandom", O_RDONLY);
+      if (fd >= 0)
+      {
+         int res = read(fd, key, 2 * sizeof(uint64_t));
+         close(fd);
+         if (res == 2 * sizeof(uint64_t))
+            return;
+      }
+   #endif
+
+   // no system random source: mix the clocks, the process random generator and the key address
+   // 没有系统随机源时，混合时钟、rand()和密钥地址生成密钥
+   uint64_t seed[4];
+   CTimer::rdtsc(seed[0]);
+   seed[1] = CTimer::getTime();
+   seed[2] = ((uint64_t)rand() << 32) ^ rand();
+   seed[3] = (uint64_t)(size_t)key;
+
+   const uint64_t mix[2] = {0x0123456789abcdefULL, 0xfedcba9876543210ULL};
+   key[0] = compute(mix, (const unsigned char*)seed, sizeof(seed));
+   seed[0] = ~seed[0];
+   key[1] = compute(mix, (const unsigned char*)seed, sizeof(seed));
+}
+
+//
+CSlab::CSlab(int size, int count):
+m_iSize((size + 15) & ~15),
+m_iCount(count),
+m_pChunks(NULL),
+m_pFree(NULL),
+m_iUsed(0),
+m_iTotal(0),
+m_Lock()
+{
+   CGuard::createMutex(m_Lock);
+}
+
+CSlab::~CSlab()
+{
+   while (NULL != m_pChunks)
+   {
+      char* next = *(char**)m_pChunks;
+      delete [] m_pChunks;
+      m_pChunks = next;
+   }
+
+   CGuard::releaseMutex(m_Lock);
+}
+
+void* CSlab::alloc()
+{
+   CGuard slabguard(m_Lock);
+
+   if (NULL == m_pFree)
+   {
+      // the first 16 bytes of a chunk link it to the next one and keep the objects aligned
+      // 内存块的前16字节用于链接下一个块，同时保持对象对齐
+      char* chunk = new char [16 + m_iSize * m_iCount];
+      *(char**)chunk = m_pChunks;
+      m_pChunks = chunk;
+
+      for (int i = m_iCount - 1; i >= 0; -- i)
+      {
+         CFree* f = (CFree*)(chunk + 16 + i * m_iSize);
+         f->m_pNext = m_pFree;
+         m_pFree = f;
+      }
+      m_iTotal += m_iCount;
+   }
+
+   CFree* f = m_pFree;
+   m_pFree = f->m_pNext;
+   ++ m_iUsed;
+
+   return f;
+}
+
+void CSlab::free(void* p)
+{
+   if (NULL == p)
+      return;
+
+   CGuard slabguard(m_Lock);
+
+   CFree* f = (CFree*)p;
+   f->m_pNext = m_pFree;
+   m_pFree = f;
+   -- m_iUsed;
+}
+
+void CSlab::getStats(int& used, int& total)
+{
+   CGuard slabguard(m_Lock);
+
+   used = m_iUsed;
+   total = m_iTotal;
+}
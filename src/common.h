@@ -351,5 +351,99 @@ struct CMD5
    static void compute(const char* input, unsigned char result[16]);
 };
 
+// SipHash-2-4，带密钥的短消息哈希，用于SYN cookie
+struct CSipHash
+{
+      // Functionality:
+      //    Compute the keyed hash of a short message.
+      // Parameters:
+      //    0) [in] key: 128-bit secret.
+      //    1) [in] data: the message.
+      //    2) [in] len: length of the message, in bytes.
+      // Returned value:
+      //    64-bit hash value.
+
+   static uint64_t compute(const uint64_t key[2], const unsigned char* data, int len);
+
+      // Functionality:
+      //    Generate a random 128-bit secret.
+      // Parameters:
+      //    0) [out] key: the new secret.
+      // Returned value:
+      //    None.
+
+   static void genKey(uint64_t key[2]);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// 定长对象的slab分配器：按块批量申请内存，释放的对象放入空闲链表供下次复用
+// Fixed-size object cache. Memory is taken from the heap in chunks of objects
+// and a freed object goes to a free list for the next allocation, so objects
+// created and destroyed at a high rate neither fragment the heap nor pay for
+// malloc. Chunks are only given back when the slab is destroyed.
+class CSlab
+{
+public:
+   CSlab(int size, int count = 32);
+   ~CSlab();
+
+      // Functionality:
+      //    Take one object from the cache.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    Uninitialized space for one object; throws std::bad_alloc if the heap is exhausted.
+
+   // 分配一个对象的空间
+   void* alloc();
+
+      // Functionality:
+      //    Return an object to the cache.
+      // Parameters:
+      //    0) [in] p: space taken by alloc(), already destroyed.
+      // Returned value:
+      //    None.
+
+   // 归还一个对象的空间
+   void free(void* p);
+
+      // Functionality:
+      //    Read the numbers of objects in use and cached.
+      // Parameters:
+      //    0) [out] used: objects handed out and not returned.
+      //    1) [out] total: objects in all chunks.
+      // Returned value:
+      //    None.
+
+   // 获取已分配的对象数和总对象数
+   void getStats(int& used, int& total);
+
+private:
+   struct CFree
+   {
+      CFree* m_pNext;
+   };
+
+   // 对象大小，按16字节对齐
+   int m_iSize;                         // object size, rounded up to 16 bytes
+   // 每个内存块中的对象数
+   int m_iCount;                        // objects per chunk
+   // 内存块链表，每个块的首部指向下一个块
+   char* m_pChunks;                     // chunks, linked through their first bytes
+   // 空闲对象链表
+   CFree* m_pFree;                      // free objects
+   // 已分配的对象数
+   int m_iUsed;                         // objects handed out
+   // 总对象数
+   int m_iTotal;                        // objects in all chunks
+
+   pthread_mutex_t m_Lock;
+
+private:
+   CSlab(const CSlab&);
+   CSlab& operator=(const CSlab&);
+};
+
 
 #endif
@@ -53,9 +53,11 @@ written by
    #endif
 #endif
 #include <cmath>
-#include <sstream>
+#include <algorithm>
+#include <new>
 #include "queue.h"
 #include "core.h"
+#include "netem.h"
 
 using namespace std;
 
@@ -79,7 +81,23 @@ const int32_t CMsgNo::m_iMaxMsgNo = 0x1FFFFFFF;
 const int CUDT::m_iVersion = 4;
 const int CUDT::m_iSYNInterval = 10000;
 const int CUDT::m_iSelfClockInterval = 64;
-
+const int CUDT::m_iTicketLifetime = 3600;
+const int CUDT::m_iTicketWindow = 10000;
+const int CUDT::m_iWarmStartAge = 600;
+const int CUDT::m_iInfoLifetime = 3600;
+
+
+CConnState::CConnState(int payloadsize, CUnitQueue* queue, int rcvbufsize, int flowwindow, int flightflag, bool msgmode):
+m_SndBuffer(32, payloadsize),
+// after introducing lite ACK, the sndlosslist may not be cleared in time, so it requires twice space.
+m_SndLossList(flowwindow * 2),
+m_SndTimeWindow(),
+m_RcvBuffer(queue, rcvbufsize, msgmode),
+m_RcvLossList(flightflag),
+m_ACKWindow(1024),
+m_RcvTimeWindow(16, 64)
+{
+}
 
 CUDT::CUDT()
 {
@@ -99,8 +117,10 @@ CUDT::CUDT()
    m_pSndQueue = NULL;
    m_pRcvQueue = NULL;
    m_pPeerAddr = NULL;
-   m_pSNode = NULL;
-   m_pRNode = NULL;
+   m_pSNode = &m_SNode;
+   m_pRNode = &m_RNode;
+   m_pConnSlab = NULL;
+   m_pConnState = NULL;
 
    // Initilize mutex and condition variables
    initSynch();
@@ -124,15 +144,30 @@ CUDT::CUDT()
    m_iRcvTimeOut = -1;
    m_bReuseAddr = true;
    m_llMaxBW = -1;
+   memset(&m_NetEmu, 0, sizeof(CNetEmuConfig));
+   m_iPktTraceSize = 0;
+   m_iRateClass = 0;
+   m_iSndWeight = 1;
+   m_iPriority = UDT_PRIORITY_NORMAL;
+   m_bResume = false;
+   m_pSndTrace = NULL;
+   m_pRcvTrace = NULL;
 
    m_pCCFactory = new CCCFactory<CUDTCC>;
+   strcpy(m_acCCName, "udt");
    m_pCC = NULL;
    m_pCache = NULL;
+   m_pTicketCache = NULL;
 
    // Initial status
    m_bOpened = false;
    m_bListening = false;
+   m_llCookieEpoch = -1;
    m_bConnecting = false;
+   m_iConnError = 0;
+   m_pcEarlyData = NULL;
+   m_iEarlyDataLen = 0;
+   m_bEarlyDataTaken = false;
    m_bConnected = false;
    m_bClosing = false;
    m_bShutdown = false;
@@ -154,8 +189,10 @@ CUDT::CUDT(const CUDT& ancestor)
    m_pSndQueue = NULL;
    m_pRcvQueue = NULL;
    m_pPeerAddr = NULL;
-   m_pSNode = NULL;
-   m_pRNode = NULL;
+   m_pSNode = &m_SNode;
+   m_pRNode = &m_RNode;
+   m_pConnSlab = NULL;
+   m_pConnState = NULL;
 
    // Initilize mutex and condition variables
    initSynch();
@@ -177,15 +214,30 @@ CUDT::CUDT(const CUDT& ancestor)
    m_iRcvTimeOut = ancestor.m_iRcvTimeOut;
    m_bReuseAddr = true;	// this must be true, because all accepted sockets shared the same port with the listener
    m_llMaxBW = ancestor.m_llMaxBW;
+   m_NetEmu = ancestor.m_NetEmu;
+   m_iPktTraceSize = ancestor.m_iPktTraceSize;
+   m_iRateClass = ancestor.m_iRateClass;
+   m_iSndWeight = ancestor.m_iSndWeight;
+   m_iPriority = ancestor.m_iPriority;
+   m_bResume = ancestor.m_bResume;
+   m_pSndTrace = NULL;
+   m_pRcvTrace = NULL;
 
    m_pCCFactory = ancestor.m_pCCFactory->clone();
+   strcpy(m_acCCName, ancestor.m_acCCName);
    m_pCC = NULL;
    m_pCache = ancestor.m_pCache;
+   m_pTicketCache = ancestor.m_pTicketCache;
 
    // Initial status
    m_bOpened = false;
    m_bListening = false;
+   m_llCookieEpoch = -1;
    m_bConnecting = false;
+   m_iConnError = 0;
+   m_pcEarlyData = NULL;
+   m_iEarlyDataLen = 0;
+   m_bEarlyDataTaken = false;
    m_bConnected = false;
    m_bClosing = false;
    m_bShutdown = false;
@@ -200,21 +252,44 @@ CUDT::~CUDT()
    destroySynch();
 
    // destroy the data structures
-   delete m_pSndBuffer;
-   delete m_pRcvBuffer;
-   delete m_pSndLossList;
-   delete m_pRcvLossList;
-   delete m_pACKWindow;
-   delete m_pSndTimeWindow;
-   delete m_pRcvTimeWindow;
+   if (NULL != m_pConnState)
+   {
+      m_pConnState->~CConnState();
+      m_pConnSlab->free(m_pConnState);
+   }
    delete m_pCCFactory;
    delete m_pCC;
-   delete m_pPeerAddr;
-   delete m_pSNode;
-   delete m_pRNode;
+   delete m_pSndTrace;
+   delete m_pRcvTrace;
+   delete [] m_pcEarlyData;
 }
 
-void CUDT::setOpt(UDTOpt optName, const void* optval, int)
+void CUDT::newConnState()
+{
+   // the slab belongs to the multiplexer, which outlives the sockets bound to it
+   // slab属于多路复用器，多路复用器在绑定它的所有套接字删除之后才会释放
+   void* p = NULL;
+   try
+   {
+      p = m_pConnSlab->alloc();
+      m_pConnState = new (p) CConnState(m_iPayloadSize, &(m_pRcvQueue->m_UnitQueue), m_iRcvBufSize, m_iFlowWindowSize, m_iFlightFlagSize, UDT_DGRAM == m_iSockType);
+   }
+   catch (...)
+   {
+      m_pConnSlab->free(p);
+      throw CUDTException(3, 2, 0);
+   }
+
+   m_pSndBuffer = &(m_pConnState->m_SndBuffer);
+   m_pSndLossList = &(m_pConnState->m_SndLossList);
+   m_pSndTimeWindow = &(m_pConnState->m_SndTimeWindow);
+   m_pRcvBuffer = &(m_pConnState->m_RcvBuffer);
+   m_pRcvLossList = &(m_pConnState->m_RcvLossList);
+   m_pACKWindow = &(m_pConnState->m_ACKWindow);
+   m_pRcvTimeWindow = &(m_pConnState->m_RcvTimeWindow);
+}
+
+void CUDT::setOpt(UDTOpt optName, const void* optval, int optlen)
 {
    if (m_bBroken || m_bClosing)
       throw CUDTException(2, 1, 0);
@@ -256,7 +331,30 @@ void CUDT::setOpt(UDTOpt optName, const void* optval, int)
       if (NULL != m_pCCFactory)
          delete m_pCCFactory;
       m_pCCFactory = ((CCCVirtualFactory *)optval)->clone();
+      strcpy(m_acCCName, "custom");
+
+      break;
+
+   case UDT_CCNAME:
+      {
+      if (m_bConnecting || m_bConnected)
+         throw CUDTException(5, 1, 0);
+
+      // the name may be passed with or without the terminating zero
+      if ((optlen <= 0) || (optlen >= (int)sizeof(m_acCCName)))
+         throw CUDTException(5, 3, 0);
+      char name[sizeof(m_acCCName)];
+      memcpy(name, optval, optlen);
+      name[optlen] = '\0';
 
+      CCCVirtualFactory* factory = CCCVirtualFactory::byName(name);
+      if (NULL == factory)
+         throw CUDTException(5, 3, 0);
+
+      delete m_pCCFactory;
+      m_pCCFactory = factory;
+      strcpy(m_acCCName, name);
+      }
       break;
 
    case UDT_FC:
@@ -357,6 +455,55 @@ void CUDT::setOpt(UDTOpt optName, const void* optval, int)
    case UDT_MAXBW:
       m_llMaxBW = *(int64_t*)optval;
       break;
+
+   case UDT_NETEM:
+      if (m_bOpened)
+         throw CUDTException(5, 1, 0);
+
+      if (!CEmuChannel::isValid(*(CNetEmuConfig*)optval))
+         throw CUDTException(5, 3, 0);
+
+      m_NetEmu = *(CNetEmuConfig*)optval;
+      break;
+
+   case UDT_PKTTRACE:
+      if (m_bOpened)
+         throw CUDTException(5, 1, 0);
+
+      if (*(int*)optval < 0)
+         throw CUDTException(5, 3, 0);
+
+      m_iPktTraceSize = *(int*)optval;
+      break;
+
+   case UDT_RATECLASS:
+      if ((*(int*)optval < 0) || (*(int*)optval >= UDT_RATECLASS_NUM))
+         throw CUDTException(5, 3, 0);
+
+      // takes effect the next time the socket enters the sending list
+      m_iRateClass = *(int*)optval;
+      break;
+
+   case UDT_SNDWEIGHT:
+      if ((*(int*)optval < 1) || (*(int*)optval > 10000))
+         throw CUDTException(5, 3, 0);
+
+      m_iSndWeight = *(int*)optval;
+      break;
+
+   case UDT_PRIORITY:
+      if ((*(int*)optval < UDT_PRIORITY_HIGH) || (*(int*)optval >= UDT_PRIORITY_NUM))
+         throw CUDTException(5, 3, 0);
+
+      // takes effect the next time the socket enters the sending list
+      m_iPriority = *(int*)optval;
+      break;
+
+   case UDT_RESUME:
+      if (m_bConnecting || m_bConnected)
+         throw CUDTException(5, 1, 0);
+      m_bResume = *(bool *)optval;
+      break;
     
    default:
       throw CUDTException(5, 0, 0);
@@ -452,6 +599,46 @@ void CUDT::getOpt(UDTOpt optName, void* optval, int& optlen)
       optlen = sizeof(int64_t);
       break;
 
+   case UDT_NETEM:
+      *(CNetEmuConfig*)optval = m_NetEmu;
+      optlen = sizeof(CNetEmuConfig);
+      break;
+
+   case UDT_PKTTRACE:
+      *(int*)optval = m_iPktTraceSize;
+      optlen = sizeof(int);
+      break;
+
+   case UDT_RATECLASS:
+      *(int*)optval = m_iRateClass;
+      optlen = sizeof(int);
+      break;
+
+   case UDT_SNDWEIGHT:
+      *(int*)optval = m_iSndWeight;
+      optlen = sizeof(int);
+      break;
+
+   case UDT_PRIORITY:
+      *(int*)optval = m_iPriority;
+      optlen = sizeof(int);
+      break;
+
+   case UDT_RESUME:
+      *(bool *)optval = m_bResume;
+      optlen = sizeof(bool);
+      break;
+
+   case UDT_CCNAME:
+      {
+      int len = strlen(m_acCCName) + 1;
+      if (optlen < len)
+         throw CUDTException(5, 3, 0);
+      memcpy(optval, m_acCCName, len);
+      optlen = len;
+      }
+      break;
+
    case UDT_STATE:
       *(int32_t*)optval = s_UDTUnited.getStatus(m_SocketID);
       optlen = sizeof(int32_t);
@@ -530,15 +717,19 @@ void CUDT::open()
 
    // structures for queue
    // 发送队列
-   if (NULL == m_pSNode)
-      m_pSNode = new CSNode;
    m_pSNode->m_pUDT = this;
    m_pSNode->m_llTimeStamp = 1;
    m_pSNode->m_iHeapLoc = -1;
+   m_pSNode->m_iRateClass = 0;
+   m_pSNode->m_iSndWeight = 0;
+   m_pSNode->m_adVirtualTag[0] = m_pSNode->m_adVirtualTag[1] = 0;
+   m_pSNode->m_aiTagLoc[0] = m_pSNode->m_aiTagLoc[1] = -1;
+   m_pSNode->m_iPriority = UDT_PRIORITY_NORMAL;
+   m_pSNode->m_iDeficit = 0;
+   m_pSNode->m_bReady = false;
+   m_pSNode->m_pPrev = m_pSNode->m_pNext = NULL;
 
    // 接收队列
-   if (NULL == m_pRNode)
-      m_pRNode = new CRNode;
    m_pRNode->m_pUDT = this;
    m_pRNode->m_llTimeStamp = 1;
    m_pRNode->m_pPrev = m_pRNode->m_pNext = NULL;
@@ -546,8 +737,22 @@ void CUDT::open()
 
    m_iRTT = 10 * m_iSYNInterval;
    m_iRTTVar = m_iRTT >> 1;
+   m_iMinRTT = 0;
+   m_RTTMinFilter.reset();
    m_ullCPUFrequency = CTimer::getCPUFrequency();
 
+   m_bRcvTsBaseSet = false;
+   m_iRcvTsBase = 0;
+   m_iRcvMsgFirstNo = -1;
+   m_iRcvMsgFirstTS = 0;
+
+   if ((m_iPktTraceSize > 0) && (NULL == m_pSndTrace))
+   {
+      m_pSndTrace = new CPktTrace(m_iPktTraceSize);
+      m_pRcvTrace = new CPktTrace(m_iPktTraceSize);
+   }
+   m_iTracePeriod = m_iTraceCWnd = -1;
+
    // set up the timers
    m_ullSYNInt = m_iSYNInterval * m_ullCPUFrequency;
   
@@ -577,8 +782,6 @@ void CUDT::open()
 // 只是设置了一个标志位，表明处于listen模式
 void CUDT::listen()
 {
-   std::cout << "CUDT::listen..." << std::endl;
-
    // lock_guard
    CGuard cg(m_ConnectionLock);
 
@@ -593,6 +796,11 @@ void CUDT::listen()
    if (m_bListening)
       return;
 
+   // the tickets are bound to this listener: they become invalid when it is closed
+   // 票据只对本监听套接字有效
+   CSipHash::genKey(m_pullTicketKey);
+   m_iTicketSerial = 0;
+
    // if there is already another socket listening on the same port
    if (m_pRcvQueue->setListener(this) < 0)
       throw CUDTException(5, 11, 0);
@@ -600,7 +808,7 @@ void CUDT::listen()
    m_bListening = true;
 }
 
-void CUDT::connect(const sockaddr* serv_addr)
+void CUDT::connect(const sockaddr* serv_addr, const char* data, int len)
 {
    // lock_guard
    CGuard cg(m_ConnectionLock);
@@ -615,10 +823,24 @@ void CUDT::connect(const sockaddr* serv_addr)
    if (m_bConnecting || m_bConnected)
       throw CUDTException(5, 2, 0);
 
+   // the early data must fit in the handshake packet
+   // 早期数据必须能和握手报文放在同一个包中
+   if ((len < 0) || ((len > 0) && (NULL == data)) || (len > m_iPayloadSize - CHandShake::m_iContentSize - CHandShake::m_iExtSize))
+      throw CUDTException(5, 3, 0);
+
+   delete [] m_pcEarlyData;
+   m_pcEarlyData = NULL;
+   m_iEarlyDataLen = 0;
+   if (len > 0)
+   {
+      m_pcEarlyData = new char[len];
+      memcpy(m_pcEarlyData, data, len);
+      m_iEarlyDataLen = len;
+   }
+
    // record peer/server address
    // 记录对端IP，IPv4/IPv6
-   delete m_pPeerAddr;
-   m_pPeerAddr = (AF_INET == m_iIPversion) ? (sockaddr*)new sockaddr_in : (sockaddr*)new sockaddr_in6;
+   m_pPeerAddr = (sockaddr*)&m_PeerAddrSpace;
    memcpy(m_pPeerAddr, serv_addr, (AF_INET == m_iIPversion) ? sizeof(sockaddr_in) : sizeof(sockaddr_in6));
 
    // register this socket in the rendezvous queue
@@ -640,8 +862,32 @@ void CUDT::connect(const sockaddr* serv_addr)
    m_ConnReq.m_iFlightFlagSize = (m_iRcvBufSize < m_iFlightFlagSize)? m_iRcvBufSize : m_iFlightFlagSize;
    m_ConnReq.m_iReqType = (!m_bRendezvous) ? 1 : 0;
    m_ConnReq.m_iID = m_SocketID;
+   m_ConnReq.m_iCookie = 0;
+   m_ConnReq.m_iExtFlags = 0;
    CIPAddress::ntop(serv_addr, m_ConnReq.m_piPeerIP, m_iIPversion);
 
+   // a ticket from an earlier connection to this listener replaces the cookie round trip
+   // 持有该监听端签发的未过期票据时，跳过cookie交换，直接发送第二次握手
+   if (m_bResume && !m_bRendezvous)
+   {
+      CTicketBlock tb;
+      tb.m_iIPversion = m_iIPversion;
+      CInfoBlock::convert(serv_addr, m_iIPversion, tb.m_piIP);
+      tb.m_iPort = (AF_INET == m_iIPversion) ? ntohs(((sockaddr_in*)serv_addr)->sin_port) : ntohs(((sockaddr_in6*)serv_addr)->sin6_port);
+
+      uint64_t now = CTimer::getTime();
+      if ((m_pTicketCache->lookup(&tb) >= 0) && (now - tb.m_ullTimeStamp < m_iTicketLifetime * 1000000ULL))
+      {
+         m_ConnReq.m_iReqType = -1;
+         m_ConnReq.m_iExtFlags = CHandShake::m_iExtTicket | ((m_iEarlyDataLen > 0) ? CHandShake::m_iExtEarlyData : 0);
+         m_ConnReq.m_iTicketTime = tb.m_iTicketTime;
+         m_ConnReq.m_iTicketSerial = tb.m_iTicketSerial;
+         m_ConnReq.m_iTicketAge = int32_t((now - tb.m_ullTimeStamp) / 1000);
+         m_ConnReq.m_piTicketMAC[0] = tb.m_piTicketMAC[0];
+         m_ConnReq.m_piTicketMAC[1] = tb.m_piTicketMAC[1];
+      }
+   }
+
    // Random Initial Sequence Number
    srand((unsigned int)CTimer::getTime());
    m_iISN = m_ConnReq.m_iISN = (int32_t)(CSeqNo::m_iMaxSeqNo * (double(rand()) / RAND_MAX));
@@ -653,93 +899,70 @@ void CUDT::connect(const sockaddr* serv_addr)
    m_iSndLastAck2 = m_iISN;
    m_ullSndLastAck2Time = CTimer::getTime();
 
-   // Inform the server my configurations.
-   // 握手报文: 告知对端我的配置
-   CPacket request;
-   char* reqdata = new char [m_iPayloadSize];
-   // 0表示是一个握手报文
-   request.pack(0, NULL, reqdata, m_iPayloadSize);
-   // ID = 0, connection request
-   request.m_iID = 0;
-
-   // 握手报文负载数据大小
-   int hs_size = m_iPayloadSize;
-   // 握手报文封包
-   m_ConnReq.serialize(reqdata, hs_size);
-   request.setLength(hs_size);
-   // 调用系统API sendmsg()立即发送
-   m_pSndQueue->sendto(serv_addr, request);
-   // 记录最后一次发送连接请求的时间，用于控制连接请求的发送间隔，每250ms最多发送1个请求
-   m_llLastReqTime = CTimer::getTime();
-
    // 正在建立连接标志位
    m_bConnecting = true;
+   m_iConnError = 0;
 
-   // asynchronous connect, return immediately
+   // Inform the server my configurations.
+   // 握手报文: 告知对端我的配置。调用系统API sendmsg()立即发送，之后的重传由接收工作线程按退避间隔完成
+   // retransmissions, with backoff, and the responses are handled by the receiving worker
+   sendConnReq(serv_addr, 0);
+
+   // asynchronous connect, return immediately; completion is reported by UDT_EPOLL_OUT, failure by UDT_EPOLL_ERR
    // 异步连接，不必阻塞等待，立即返回
    if (!m_bSynRecving)
-   {
-      delete [] reqdata;
       return;
-   }
 
-   // Wait for the negotiated configurations from the peer side.
-   // 等待对端返回协商的配置
-   CPacket response;
-   char* resdata = new char [m_iPayloadSize];
-   response.pack(0, NULL, resdata, m_iPayloadSize);
-
-   CUDTException e(0, 0);
+   // Wait for the receiving worker to complete or abort the handshake.
+   // 等待接收工作线程完成握手，或在超时后放弃
+   #ifndef WIN32
+      timespec deadline;
+      deadline.tv_sec = ttl / 1000000;
+      deadline.tv_nsec = (ttl % 1000000) * 1000;
 
-   while (!m_bClosing)
-   {
-      // avoid sending too many requests, at most 1 request per 250ms
-      // 避免发送太多请求，每250ms最多发送1个请求
-      if (CTimer::getTime() - m_llLastReqTime > 250000)
+      pthread_mutex_lock(&m_ConnectLock);
+      while (m_bConnecting && !m_bClosing)
       {
-         // 握手报文封包
-         m_ConnReq.serialize(reqdata, hs_size);
-         request.setLength(hs_size);
-         if (m_bRendezvous)
-            request.m_iID = m_ConnRes.m_iID;
-
-         // 调用系统API sendmsg()立即发送
-         m_pSndQueue->sendto(serv_addr, request);
-         m_llLastReqTime = CTimer::getTime();
+         if (ETIMEDOUT == pthread_cond_timedwait(&m_ConnectCond, &m_ConnectLock, &deadline))
+            break;
       }
-
-      response.setLength(m_iPayloadSize);
-      // 对端返回的握手报文
-      if (m_pRcvQueue->recvfrom(m_SocketID, response) > 0)
+   #else
+      while (m_bConnecting && !m_bClosing)
       {
-         if (connect(response) <= 0)
+         uint64_t now = CTimer::getTime();
+         if ((now >= ttl) || (WAIT_TIMEOUT == WaitForSingleObject(m_ConnectCond, DWORD((ttl - now) / 1000))))
             break;
-
-         // new request/response should be sent out immediately on receving a response
-         m_llLastReqTime = 0;
       }
+   #endif
 
-      // 连接超时
-      if (CTimer::getTime() > ttl)
-      {
-         // timeout
-         e = CUDTException(1, 1, 0);
-         break;
-      }
-   }
+   // give up the handshake under the lock, so that the worker cannot complete it at the same time
+   // 在锁内放弃握手，避免与接收工作线程同时完成连接
+   bool pending = m_bConnecting;
+   if (pending && !m_bClosing)
+      m_bConnecting = false;
+   #ifndef WIN32
+      pthread_mutex_unlock(&m_ConnectLock);
+   #endif
 
-   delete [] reqdata;
-   delete [] resdata;
+   // the handshake decides the result: the peer may already have shut the new connection down
+   // 以握手结果为准：连接建立后对端可能已经立即关闭了它
+   CUDTException e(0, 0);
 
-   if (e.getErrorCode() == 0)
+   if (pending)
    {
       if (m_bClosing)                                                 // if the socket is closed before connection...
          e = CUDTException(1);
-      else if (1002 == m_ConnRes.m_iReqType)                          // connection request rejected
-         e = CUDTException(1, 2, 0);
-      else if ((!m_bRendezvous) && (m_iISN != m_ConnRes.m_iISN))      // secuity check
-         e = CUDTException(1, 4, 0);
+      else
+      {
+         // the worker has not expired the request yet
+         m_pRcvQueue->removeConnector(m_SocketID);
+         e = CUDTException(1, 1, 0);
+      }
    }
+   else if (0 != m_iConnError)                                        // timeout, rejection or bad response
+      e = CUDTException(1, m_iConnError, 0);
+   else if (!m_bConnected && !m_bBroken)                              // woken up without a connection
+      e = CUDTException(1);
 
    if (e.getErrorCode() != 0)
       throw e;
@@ -770,6 +993,15 @@ int CUDT::connect(const CPacket& response) throw ()
    // 对端返回的握手报文解包
    m_ConnRes.deserialize(response.m_pcData, response.getLength());
 
+   // connection request rejected
+   // 对端拒绝了连接请求
+   if (1002 == m_ConnRes.m_iReqType)
+   {
+      m_pRcvQueue->removeConnector(m_SocketID);
+      connectFailed(2);
+      return -1;
+   }
+
    if (m_bRendezvous)
    {
       // regular connect should NOT communicate with rendezvous connect
@@ -782,8 +1014,7 @@ int CUDT::connect(const CPacket& response) throw ()
       if ((0 == m_ConnReq.m_iReqType) || (0 == m_ConnRes.m_iReqType))
       {
          m_ConnReq.m_iReqType = -1;
-         // the request time must be updated so that the next handshake can be sent out immediately.
-         m_llLastReqTime = 0;
+         // the caller sends the next handshake out immediately
          return 1;
       }
    }
@@ -795,9 +1026,20 @@ int CUDT::connect(const CPacket& response) throw ()
       {
          m_ConnReq.m_iReqType = -1;
          m_ConnReq.m_iCookie = m_ConnRes.m_iCookie;
-         m_llLastReqTime = 0;
+         // a cookie in reply to a ticket means the ticket was refused; the early data is sent once connected
+         // 票据被拒绝时监听端返回cookie，早期数据改为在连接建立后发送
+         m_ConnReq.m_iExtFlags = 0;
          return 1;
       }
+
+      // secuity check
+      // 校验对端确认的初始序列号
+      if (m_iISN != m_ConnRes.m_iISN)
+      {
+         m_pRcvQueue->removeConnector(m_SocketID);
+         connectFailed(4);
+         return -1;
+      }
    }
 
 POST_CONNECT:
@@ -818,61 +1060,132 @@ POST_CONNECT:
 
    // Prepare all data structures
    // 准备所有数据结构
-   try
-   {
-      m_pSndBuffer = new CSndBuffer(32, m_iPayloadSize);
-      m_pRcvBuffer = new CRcvBuffer(&(m_pRcvQueue->m_UnitQueue), m_iRcvBufSize);
-      // after introducing lite ACK, the sndlosslist may not be cleared in time, so it requires twice space.
-      m_pSndLossList = new CSndLossList(m_iFlowWindowSize * 2);
-      m_pRcvLossList = new CRcvLossList(m_iFlightFlagSize);
-      m_pACKWindow = new CACKWindow(1024);
-      m_pRcvTimeWindow = new CPktTimeWindow(16, 64);
-      m_pSndTimeWindow = new CPktTimeWindow();
-   }
-   catch (...)
-   {
-      throw CUDTException(3, 2, 0);
-   }
+   newConnState();
+
+   // keep the ticket the listener issued for the next connection
+   // 保存监听端签发的票据，供下一次连接使用
+   if (m_bResume && !m_bRendezvous && (0 != (m_ConnRes.m_iExtFlags & CHandShake::m_iExtTicket)))
+   {
+      CTicketBlock tb;
+      tb.m_iIPversion = m_iIPversion;
+      CInfoBlock::convert(m_pPeerAddr, m_iIPversion, tb.m_piIP);
+      tb.m_iPort = (AF_INET == m_iIPversion) ? ntohs(((sockaddr_in*)m_pPeerAddr)->sin_port) : ntohs(((sockaddr_in6*)m_pPeerAddr)->sin6_port);
+      tb.m_ullTimeStamp = CTimer::getTime();
+      tb.m_iTicketTime = m_ConnRes.m_iTicketTime;
+      tb.m_iTicketSerial = m_ConnRes.m_iTicketSerial;
+      tb.m_piTicketMAC[0] = m_ConnRes.m_piTicketMAC[0];
+      tb.m_piTicketMAC[1] = m_ConnRes.m_piTicketMAC[1];
+      m_pTicketCache->update(&tb);
+   }
+
+   // The data given to connect() is the first packet of the connection. If the listener took it from the
+   // handshake, it is recorded as sent and stays in the buffer until acknowledged; otherwise it is sent now.
+   // connect()给出的数据是连接的第一个数据包：如果监听端已从握手中接收，记为已发送，等待确认；否则现在发送
+   bool unsent = false;
+   if (m_iEarlyDataLen > 0)
+   {
+      m_pSndBuffer->addBuffer(m_pcEarlyData, m_iEarlyDataLen);
+      if ((0 != (m_ConnReq.m_iExtFlags & CHandShake::m_iExtEarlyData)) && (0 != (m_ConnRes.m_iExtFlags & CHandShake::m_iExtEarlyData)))
+      {
+         char* data;
+         int32_t msgno;
+         uint64_t origintime;
+         m_pSndBuffer->readData(&data, msgno, origintime);
+         m_iSndCurrSeqNo = CSeqNo::incseq(m_iSndCurrSeqNo);
+      }
+      else
+         unsent = true;
 
-   CInfoBlock ib;
-   ib.m_iIPversion = m_iIPversion;
-   CInfoBlock::convert(m_pPeerAddr, m_iIPversion, ib.m_piIP);
-   if (m_pCache->lookup(&ib) >= 0)
-   {
-      m_iRTT = ib.m_iRTT;
-      m_iBandwidth = ib.m_iBandwidth;
+      delete [] m_pcEarlyData;
+      m_pcEarlyData = NULL;
+      m_iEarlyDataLen = 0;
    }
 
-   m_pCC = m_pCCFactory->create();
-   m_pCC->m_UDT = m_SocketID;
-   m_pCC->setMSS(m_iMSS);
-   m_pCC->setMaxCWndSize(m_iFlowWindowSize);
-   m_pCC->setSndCurrSeqNo(m_iSndCurrSeqNo);
-   m_pCC->setRcvRate(m_iDeliveryRate);
-   m_pCC->setRTT(m_iRTT);
-   m_pCC->setBandwidth(m_iBandwidth);
-   m_pCC->init();
-
-   m_ullInterval = (uint64_t)(m_pCC->m_dPktSndPeriod * m_ullCPUFrequency);
-   m_dCongestionWindow = m_pCC->m_dCWndSize;
+   initCC(m_pPeerAddr);
 
    // And, I am connected too.
-   m_bConnecting = false;
    m_bConnected = true;
 
    // register this socket for receiving data packets
    m_pRNode->m_bOnList = true;
    m_pRcvQueue->setNewEntry(this);
 
+   if (unsent)
+      m_pSndQueue->m_pSndUList->update(this, false);
+
    // acknowledge the management module.
    s_UDTUnited.connect_complete(m_SocketID);
 
    // acknowledde any waiting epolls to write
    s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT, true);
 
+   // the handshake is over only now that the socket is CONNECTED: a blocking connect() returns when the flag is cleared
+   // 套接字状态变为CONNECTED之后才清除连接中标志，阻塞的connect()以此为返回条件
+   #ifndef WIN32
+      pthread_mutex_lock(&m_ConnectLock);
+      m_bConnecting = false;
+      pthread_cond_signal(&m_ConnectCond);
+      pthread_mutex_unlock(&m_ConnectLock);
+   #else
+      m_bConnecting = false;
+      SetEvent(m_ConnectCond);
+   #endif
+
    return 0;
 }
 
+void CUDT::connectFailed(int err)
+{
+   m_iConnError = err;
+
+   #ifndef WIN32
+      pthread_mutex_lock(&m_ConnectLock);
+      m_bConnecting = false;
+      pthread_cond_signal(&m_ConnectCond);
+      pthread_mutex_unlock(&m_ConnectLock);
+   #else
+      m_bConnecting = false;
+      SetEvent(m_ConnectCond);
+   #endif
+
+   // a non-blocking connect has no caller to report to: the socket becomes broken and the application learns it from epoll
+   // 非阻塞连接：套接字标记为broken，应用通过epoll得知失败
+   if (!m_bSynRecving)
+   {
+      m_bBroken = true;
+      s_UDTUnited.scheduleGC(m_SocketID, 1000000);
+   }
+
+   s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_ERR, true);
+}
+
+void CUDT::sendConnReq(const sockaddr* addr, int32_t id)
+{
+   CPacket request;
+   char* reqdata = new char [m_iPayloadSize];
+   // 0表示是一个握手报文
+   request.pack(0, NULL, reqdata, m_iPayloadSize);
+   request.m_iID = id;
+
+   // 握手报文封包
+   int hs_size = m_iPayloadSize;
+   m_ConnReq.serialize(reqdata, hs_size);
+
+   // the early data follows the extension; it carries the timestamp a data packet would
+   // 早期数据紧跟在扩展之后，时间戳与数据包一致
+   if (0 != (m_ConnReq.m_iExtFlags & CHandShake::m_iExtEarlyData))
+   {
+      memcpy(reqdata + hs_size, m_pcEarlyData, m_iEarlyDataLen);
+      hs_size += m_iEarlyDataLen;
+      request.m_iTimeStamp = int32_t(CTimer::getTime() - m_StartTime);
+   }
+   request.setLength(hs_size);
+
+   // 握手报文需要通过UDP立即发送到对端,不经过发送缓冲区
+   m_pSndQueue->sendto(addr, request);
+   delete [] reqdata;
+}
+
 void CUDT::connect(const sockaddr* peer, CHandShake* hs)
 {
    // std::cout << "CUDT::connect " << __func__ << " : " << __LINE__ << std::endl;
@@ -925,32 +1238,67 @@ void CUDT::connect(const sockaddr* peer, CHandShake* hs)
    m_iPayloadSize = m_iPktSize - CPacket::m_iPktHdrSize;
 
    // Prepare all structures
-   try
-   {
-      m_pSndBuffer = new CSndBuffer(32, m_iPayloadSize);
-      m_pRcvBuffer = new CRcvBuffer(&(m_pRcvQueue->m_UnitQueue), m_iRcvBufSize);
-      m_pSndLossList = new CSndLossList(m_iFlowWindowSize * 2);
-      m_pRcvLossList = new CRcvLossList(m_iFlightFlagSize);
-      m_pACKWindow = new CACKWindow(1024);
-      m_pRcvTimeWindow = new CPktTimeWindow(16, 64);
-      m_pSndTimeWindow = new CPktTimeWindow();
-   }
-   catch (...)
-   {
-      throw CUDTException(3, 2, 0);
-   }
+   newConnState();
+
+   // 拥塞控制初始参数，使用历史连接性能信息缓存，不用从零开始估算网络性能，减少连接初期的性能波动
+   initCC(peer);
+
+   // 保存对端地址
+   m_pPeerAddr = (sockaddr*)&m_PeerAddrSpace;
+   memcpy(m_pPeerAddr, peer, (AF_INET == m_iIPversion) ? sizeof(sockaddr_in) : sizeof(sockaddr_in6));
+
+   // And of course, it is connected.
+   m_bConnected = true;
 
-   // 获取历史连接性能信息缓存查询，不用从零开始估算网络性能，减少连接初期的性能波动
+   // register this socket for receiving data packets
+   // 注册接收队列
+   m_pRNode->m_bOnList = true;
+   m_pRcvQueue->setNewEntry(this);
+
+   //send the response to the peer, see listen() for more discussions about this
+   // 向对端发送握手响应报文
+   CPacket response;
+   // room for the ticket extension, which is appended only if the listener issues a ticket
+   int size = CHandShake::m_iContentSize + CHandShake::m_iExtSize;
+   char* buffer = new char[size];
+   hs->serialize(buffer, size);
+   response.pack(0, NULL, buffer, size);
+   response.m_iID = m_PeerID;
+   m_pSndQueue->sendto(peer, response);
+   delete [] buffer;
+}
+
+int CUDT::wouldBlock(int minor)
+{
+   // the caller polls, so this path must be cheap: no exception, no allocation
+   s_UDTUnited.setError(CUDTException(6, minor, 0));
+   return ERROR;
+}
+
+void CUDT::initCC(const sockaddr* peer)
+{
+   // 获取历史连接性能信息
    CInfoBlock ib;
    ib.m_iIPversion = m_iIPversion;
    CInfoBlock::convert(peer, m_iIPversion, ib.m_piIP);
+   bool warm = false;
    if (m_pCache->lookup(&ib) >= 0)
    {
       m_iRTT = ib.m_iRTT;
+      m_iRTTVar = ib.m_iRTTVar;
       m_iBandwidth = ib.m_iBandwidth;
+
+      // the NAK interval follows the RTT, as after every ACK
+      // NAK间隔按缓存的RTT设置
+      m_ullNAKInt = (m_iRTT + 4 * m_iRTTVar) * m_ullCPUFrequency;
+      if (m_ullNAKInt < m_ullMinNakInt)
+         m_ullNAKInt = m_ullMinNakInt;
+
+      // the sending rate and window are used only while the history is recent
+      // 发送速率和窗口只在历史信息足够新时使用
+      warm = (ib.m_dCWnd > 0) && (CTimer::getTime() - ib.m_ullTimeStamp < m_iWarmStartAge * 1000000ULL);
    }
 
-   // 拥塞控制初始参数
    m_pCC = m_pCCFactory->create();
    m_pCC->m_UDT = m_SocketID;
    m_pCC->setMSS(m_iMSS);
@@ -959,35 +1307,14 @@ void CUDT::connect(const sockaddr* peer, CHandShake* hs)
    m_pCC->setRcvRate(m_iDeliveryRate);
    m_pCC->setRTT(m_iRTT);
    m_pCC->setBandwidth(m_iBandwidth);
+   if (warm)
+      m_pCC->setWarmStart(ib.m_dInterval, (ib.m_dCWnd < m_iFlowWindowSize) ? ib.m_dCWnd : m_iFlowWindowSize);
    m_pCC->init();
 
    // 发送间隔，用于带宽控制
    m_ullInterval = (uint64_t)(m_pCC->m_dPktSndPeriod * m_ullCPUFrequency);
    // 拥塞窗口大小
    m_dCongestionWindow = m_pCC->m_dCWndSize;
-
-   // 保存对端地址
-   m_pPeerAddr = (AF_INET == m_iIPversion) ? (sockaddr*)new sockaddr_in : (sockaddr*)new sockaddr_in6;
-   memcpy(m_pPeerAddr, peer, (AF_INET == m_iIPversion) ? sizeof(sockaddr_in) : sizeof(sockaddr_in6));
-
-   // And of course, it is connected.
-   m_bConnected = true;
-
-   // register this socket for receiving data packets
-   // 注册接收队列
-   m_pRNode->m_bOnList = true;
-   m_pRcvQueue->setNewEntry(this);
-
-   //send the response to the peer, see listen() for more discussions about this
-   // 向对端发送握手响应报文
-   CPacket response;
-   int size = CHandShake::m_iContentSize;
-   char* buffer = new char[size];
-   hs->serialize(buffer, size);
-   response.pack(0, NULL, buffer, size);
-   response.m_iID = m_PeerID;
-   m_pSndQueue->sendto(peer, response);
-   delete [] buffer;
 }
 
 void CUDT::close()
@@ -1047,6 +1374,15 @@ void CUDT::close()
    // Inform the threads handler to stop.
    m_bClosing = true;
 
+   // a blocking connect() holds m_ConnectionLock while it waits
+   #ifndef WIN32
+      pthread_mutex_lock(&m_ConnectLock);
+      pthread_cond_signal(&m_ConnectCond);
+      pthread_mutex_unlock(&m_ConnectLock);
+   #else
+      SetEvent(m_ConnectCond);
+   #endif
+
    CGuard cg(m_ConnectionLock);
 
    // Signal the sender and recver if they are waiting for data.
@@ -1069,13 +1405,38 @@ void CUDT::close()
 
       m_pCC->close();
 
-      // Store current connection information.
-      CInfoBlock ib;
-      ib.m_iIPversion = m_iIPversion;
-      CInfoBlock::convert(m_pPeerAddr, m_iIPversion, ib.m_piIP);
-      ib.m_iRTT = m_iRTT;
-      ib.m_iBandwidth = m_iBandwidth;
-      m_pCache->update(&ib);
+      // Store current connection information, smoothed with the history of the peer.
+      // A connection without any RTT sample has nothing to tell: the receiver samples RTT on ACK2,
+      // the sender learns it from the ACKs of its data.
+      // 保存本连接的网络信息，与该对端的历史信息做指数平滑；没有RTT样本的连接不保存
+      int acked = CSeqNo::seqoff(m_iISN, m_iSndLastAck);
+      if ((m_iMinRTT > 0) || (acked > 0))
+      {
+         CInfoBlock conn;
+         conn.m_iIPversion = m_iIPversion;
+         CInfoBlock::convert(m_pPeerAddr, m_iIPversion, conn.m_piIP);
+         conn.m_ullTimeStamp = CTimer::getTime();
+         conn.m_iRTT = m_iRTT;
+         conn.m_iRTTVar = m_iRTTVar;
+         conn.m_iBandwidth = m_iBandwidth;
+         if (m_llSentTotal > 0)
+            conn.m_iLossRate = int(m_iSndLossTotal * 10000LL / m_llSentTotal);
+
+         // the congestion state is kept only if the connection got past the initial window
+         // 只有发送超过初始窗口的连接才记录拥塞控制状态
+         if (acked > 16)
+         {
+            conn.m_dCWnd = m_pCC->m_dCWndSize;
+            // a controller still in slow start has no rate yet: one window per RTT
+            conn.m_dInterval = (m_pCC->m_dPktSndPeriod > 1) ? m_pCC->m_dPktSndPeriod : m_iRTT / m_pCC->m_dCWndSize;
+         }
+
+         CInfoBlock ib;
+         ib = conn;
+         if (m_pCache->lookup(&ib) >= 0)
+            ib.merge(conn);
+         m_pCache->update(&ib);
+      }
 
       m_bConnected = false;
    }
@@ -1128,7 +1489,7 @@ int CUDT::send(const char* data, int len)
    {
       // 非阻塞发送
       if (!m_bSynSending)
-         throw CUDTException(6, 1, 0);
+         return wouldBlock(1);
       // 阻塞发送
       else
       {
@@ -1246,9 +1607,9 @@ int CUDT::recv(char* data, int len)
    // 接收缓冲区中无数据，在条件变量上休眠，等待有数据时唤醒
    if (0 == m_pRcvBuffer->getRcvDataSize())
    {
-      // 为什么这里要抛出异常
+      // 非阻塞接收，无数据可读
       if (!m_bSynRecving)
-         throw CUDTException(6, 2, 0);
+         return wouldBlock(2);
       else
       {
 #ifndef WIN32
@@ -1327,10 +1688,36 @@ int CUDT::recv(char* data, int len)
    if ((res <= 0) && (m_iRcvTimeOut >= 0))
       throw CUDTException(6, 3, 0);
 
-   return res;
+   return res;
+}
+
+int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder)
+{
+   if (UDT_STREAM == m_iSockType)
+      throw CUDTException(5, 9, 0);
+
+   // 待发送的数据长度小于0
+   if (len <= 0)
+   {
+      if (m_bBroken || m_bClosing)
+         throw CUDTException(2, 1, 0);
+      else if (!m_bConnected)
+         throw CUDTException(2, 2, 0);
+
+      return 0;
+   }
+
+   // 单条消息的批量发送
+   CMsgVec msg;
+   msg.pcData = const_cast<char*>(data);
+   msg.iLength = len;
+   msg.iReceived = 0;
+   int res = sendmsgBatch(&msg, 1, msttl, inorder);
+
+   return (res > 0) ? len : res;
 }
 
-int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder)
+int CUDT::sendmsgBatch(const CMsgVec* msgs, int num, int msttl, bool inorder)
 {
    if (UDT_STREAM == m_iSockType)
       throw CUDTException(5, 9, 0);
@@ -1342,13 +1729,17 @@ int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder)
    else if (!m_bConnected)
       throw CUDTException(2, 2, 0);
 
-   // 待发送的数据长度小于0
-   if (len <= 0)
+   if (num <= 0)
       return 0;
 
-   // 待发送的数据长度大于发送缓冲区大小
-   if (len > m_iSndBufSize * m_iPayloadSize)
-      throw CUDTException(5, 12, 0);
+   // 消息长度为负或大于发送缓冲区大小，整批都不发送
+   for (int i = 0; i < num; ++ i)
+   {
+      if (msgs[i].iLength < 0)
+         throw CUDTException(5, 3, 0);
+      if (msgs[i].iLength > m_iSndBufSize * m_iPayloadSize)
+         throw CUDTException(5, 12, 0);
+   }
 
    // lock_guard
    CGuard sendguard(m_SendLock);
@@ -1362,83 +1753,76 @@ int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder)
       m_ullLastRspTime = currtime;
    }
 
-   // 发送缓冲区中的可用空间小于待发送的数据长度
-   if ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len)
+   int sent = 0;
+   bool waited = false;
+   while (sent < num)
    {
-      // 非阻塞发送，抛出异常
-      if (!m_bSynSending)
-         throw CUDTException(6, 1, 0);
-      // 阻塞发送
-      else
+      // the messages that fit into the free space of the sender buffer
+      // 发送缓冲区的剩余空间能容纳的消息
+      int avail = m_iSndBufSize - m_pSndBuffer->getCurrBufSize();
+      int n = sent;
+      for (; n < num; ++ n)
       {
-         // wait here during a blocking sending
-#ifndef WIN32
-            pthread_mutex_lock(&m_SendBlockLock);
-            // 一直阻塞，直到条件变量被唤醒
-            if (m_iSndTimeOut < 0)
-            {
-               while (!m_bBroken && m_bConnected && !m_bClosing && ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len))
-                  pthread_cond_wait(&m_SendBlockCond, &m_SendBlockLock);
-            }
-            // 带有超时时间的阻塞
-            else
-            {
-               uint64_t exptime = CTimer::getTime() + m_iSndTimeOut * 1000ULL;
-               timespec locktime;
-
-               locktime.tv_sec = exptime / 1000000;
-               locktime.tv_nsec = (exptime % 1000000) * 1000;
-
-               while (!m_bBroken && m_bConnected && !m_bClosing && ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len) && (CTimer::getTime() < exptime))
-                  pthread_cond_timedwait(&m_SendBlockCond, &m_SendBlockLock, &locktime);
-            }
-            pthread_mutex_unlock(&m_SendBlockLock);
-#else
-            if (m_iSndTimeOut < 0)
-            {
-               while (!m_bBroken && m_bConnected && !m_bClosing && ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len))
-                  WaitForSingleObject(m_SendBlockCond, INFINITE);
-            }
-            else
-            {
-               uint64_t exptime = CTimer::getTime() + m_iSndTimeOut * 1000ULL;
+         int blocks = (msgs[n].iLength > 0) ? (msgs[n].iLength + m_iPayloadSize - 1) / m_iPayloadSize : 0;
+         if (blocks > avail)
+            break;
+         avail -= blocks;
+      }
 
-               while (!m_bBroken && m_bConnected && !m_bClosing && ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len) && (CTimer::getTime() < exptime))
-                  WaitForSingleObject(m_SendBlockCond, DWORD((exptime - CTimer::getTime()) / 1000));
-            }
-#endif
+      if (n > sent)
+      {
+         // record total time used for sending
+         // 记录发送数据一共使用了多长时间
+         if (0 == m_pSndBuffer->getCurrBufSize())
+            m_llSndDurationCounter = CTimer::getTime();
+
+         // insert the user buffers into the sending list
+         // 插入到发送缓冲区
+         m_pSndBuffer->addBuffer(msgs + sent, n - sent, msttl, inorder);
+
+         // insert this socket to the snd list if it is not on the list yet; needed before waiting for more space
+         // 插入UDT实例到发送队列中；在等待更多空间之前必须先让已放入的数据开始发送
+         m_pSndQueue->m_pSndUList->update(this, false);
+
+         sent = n;
+         waited = false;
+         continue;
+      }
 
-         // check the connection status
-         // 检查连接状态
-         if (m_bBroken || m_bClosing)
-            throw CUDTException(2, 1, 0);
-         else if (!m_bConnected)
-            throw CUDTException(2, 2, 0);
+      // 非阻塞发送，缓冲区已满
+      if (!m_bSynSending)
+      {
+         if (sent > 0)
+            break;
+         return wouldBlock(1);
       }
-   }
 
-   // 再次检查发送缓冲区容量是否够用
-   if ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len)
-   {
-      if (m_iSndTimeOut >= 0)
-         throw CUDTException(6, 3, 0);
+      // the send timeout applies to each wait for buffer space
+      // 发送超时作用于每一次等待
+      if (waited)
+      {
+         if (sent > 0)
+            break;
+         if (m_iSndTimeOut >= 0)
+            throw CUDTException(6, 3, 0);
+         return 0;
+      }
 
-      return 0;
+      // messages already queued are reported rather than lost in the exception
+      // 连接中断时，已放入发送缓冲区的消息数优先返回给调用者
+      try
+      {
+         waitSndSpace(msgs[sent].iLength);
+      }
+      catch (CUDTException&)
+      {
+         if (sent > 0)
+            break;
+         throw;
+      }
+      waited = true;
    }
 
-   // record total time used for sending
-   // 记录发送数据一共使用了多长时间
-   if (0 == m_pSndBuffer->getCurrBufSize())
-      m_llSndDurationCounter = CTimer::getTime();
-
-   // insert the user buffer into the sening list
-   // 插入到发送缓冲区
-   m_pSndBuffer->addBuffer(data, len, msttl, inorder);
-
-   // insert this socket to the snd list if it is not on the list yet
-   // 插入UDT实例到发送队列中
-   m_pSndQueue->m_pSndUList->update(this, false);
-
    // 发送缓冲区容量不足，更新次套接字的epoll状态为不可发送
    if (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize())
    {
@@ -1446,7 +1830,54 @@ int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder)
       s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT, false);
    }
 
-   return len;   
+   return sent;
+}
+
+void CUDT::waitSndSpace(int len)
+{
+   // wait here during a blocking sending
+#ifndef WIN32
+      pthread_mutex_lock(&m_SendBlockLock);
+      // 一直阻塞，直到条件变量被唤醒
+      if (m_iSndTimeOut < 0)
+      {
+         while (!m_bBroken && m_bConnected && !m_bClosing && ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len))
+            pthread_cond_wait(&m_SendBlockCond, &m_SendBlockLock);
+      }
+      // 带有超时时间的阻塞
+      else
+      {
+         uint64_t exptime = CTimer::getTime() + m_iSndTimeOut * 1000ULL;
+         timespec locktime;
+
+         locktime.tv_sec = exptime / 1000000;
+         locktime.tv_nsec = (exptime % 1000000) * 1000;
+
+         while (!m_bBroken && m_bConnected && !m_bClosing && ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len) && (CTimer::getTime() < exptime))
+            pthread_cond_timedwait(&m_SendBlockCond, &m_SendBlockLock, &locktime);
+      }
+      pthread_mutex_unlock(&m_SendBlockLock);
+#else
+      if (m_iSndTimeOut < 0)
+      {
+         while (!m_bBroken && m_bConnected && !m_bClosing && ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len))
+            WaitForSingleObject(m_SendBlockCond, INFINITE);
+      }
+      else
+      {
+         uint64_t exptime = CTimer::getTime() + m_iSndTimeOut * 1000ULL;
+
+         while (!m_bBroken && m_bConnected && !m_bClosing && ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len) && (CTimer::getTime() < exptime))
+            WaitForSingleObject(m_SendBlockCond, DWORD((exptime - CTimer::getTime()) / 1000));
+      }
+#endif
+
+   // check the connection status
+   // 检查连接状态
+   if (m_bBroken || m_bClosing)
+      throw CUDTException(2, 1, 0);
+   else if (!m_bConnected)
+      throw CUDTException(2, 2, 0);
 }
 
 int CUDT::recvmsg(char* data, int len)
@@ -1461,11 +1892,41 @@ int CUDT::recvmsg(char* data, int len)
    if (len <= 0)
       return 0;
 
+   // 单条消息的批量接收
+   CMsgVec msg;
+   msg.pcData = data;
+   msg.iLength = len;
+   msg.iReceived = 0;
+   int res = recvmsgBatch(&msg, 1);
+
+   return (res > 0) ? msg.iReceived : res;
+}
+
+int CUDT::recvmsgBatch(CMsgVec* msgs, int num)
+{
+   if (UDT_STREAM == m_iSockType)
+      throw CUDTException(5, 9, 0);
+
+   // throw an exception if not connected
+   if (!m_bConnected)
+      throw CUDTException(2, 2, 0);
+
+   if (num <= 0)
+      return 0;
+
+   // readMsg() would drop a message into an empty buffer
+   // 空的接收缓冲区会使消息被读出并丢弃
+   for (int i = 0; i < num; ++ i)
+   {
+      if (msgs[i].iLength <= 0)
+         throw CUDTException(5, 3, 0);
+   }
+
    CGuard recvguard(m_RecvLock);
 
    if (m_bBroken || m_bClosing)
    {
-      int res = m_pRcvBuffer->readMsg(data, len);
+      int res = readMsgs(msgs, num);
 
       if (m_pRcvBuffer->getRcvMsgNum() <= 0)
       {
@@ -1481,9 +1942,9 @@ int CUDT::recvmsg(char* data, int len)
 
    if (!m_bSynRecving)
    {
-      int res = m_pRcvBuffer->readMsg(data, len);
+      int res = readMsgs(msgs, num);
       if (0 == res)
-         throw CUDTException(6, 2, 0);
+         return wouldBlock(2);
       else
          return res;
    }
@@ -1498,7 +1959,7 @@ int CUDT::recvmsg(char* data, int len)
 
          if (m_iRcvTimeOut < 0)
          {
-            while (!m_bBroken && m_bConnected && !m_bClosing && (0 == (res = m_pRcvBuffer->readMsg(data, len))))
+            while (!m_bBroken && m_bConnected && !m_bClosing && (0 == (res = readMsgs(msgs, num))))
                pthread_cond_wait(&m_RecvDataCond, &m_RecvDataLock);
          }
          else
@@ -1512,13 +1973,13 @@ int CUDT::recvmsg(char* data, int len)
             if (pthread_cond_timedwait(&m_RecvDataCond, &m_RecvDataLock, &locktime) == ETIMEDOUT)
                timeout = true;
 
-            res = m_pRcvBuffer->readMsg(data, len);           
+            res = readMsgs(msgs, num);
          }
          pthread_mutex_unlock(&m_RecvDataLock);
       #else
          if (m_iRcvTimeOut < 0)
          {
-            while (!m_bBroken && m_bConnected && !m_bClosing && (0 == (res = m_pRcvBuffer->readMsg(data, len))))
+            while (!m_bBroken && m_bConnected && !m_bClosing && (0 == (res = readMsgs(msgs, num))))
                WaitForSingleObject(m_RecvDataCond, INFINITE);
          }
          else
@@ -1526,7 +1987,7 @@ int CUDT::recvmsg(char* data, int len)
             if (WaitForSingleObject(m_RecvDataCond, DWORD(m_iRcvTimeOut)) == WAIT_TIMEOUT)
                timeout = true;
 
-            res = m_pRcvBuffer->readMsg(data, len);
+            res = readMsgs(msgs, num);
          }
       #endif
 
@@ -1548,6 +2009,15 @@ int CUDT::recvmsg(char* data, int len)
    return res;
 }
 
+int CUDT::readMsgs(CMsgVec* msgs, int num)
+{
+   int n = 0;
+   while ((n < num) && ((msgs[n].iReceived = m_pRcvBuffer->readMsg(msgs[n].pcData, msgs[n].iLength)) > 0))
+      ++ n;
+
+   return n;
+}
+
 int64_t CUDT::sendfile(fstream& ifs, int64_t& offset, int64_t size, int block)
 {
    if (UDT_DGRAM == m_iSockType)
@@ -1805,6 +2275,56 @@ void CUDT::sample(CPerfMon* perf, bool clear)
    }
 }
 
+void CUDT::sample(CPerfMon2* perf, bool clear)
+{
+   sample(&perf->perf, clear);
+
+   m_RTTHist.read(perf->histRTT);
+   m_MsgLatencyHist.read(perf->histMsgLatency);
+   m_SndQueueDelayHist.read(perf->histSndQueueDelay);
+
+   if (clear)
+   {
+      m_RTTHist.clear();
+      m_MsgLatencyHist.clear();
+      m_SndQueueDelayHist.clear();
+   }
+}
+
+void CUDT::dumpTrace(const char* path)
+{
+   if ((NULL == m_pSndTrace) || (NULL == m_pRcvTrace))
+      throw CUDTException(5, 3, 0);
+
+   // merge the two rings by time; each of them is already in time order
+   // 按时间合并两个环形缓冲区，每个缓冲区内部已按时间排序
+   vector<CPktTraceRecord> snd, rcv;
+   int64_t overwritten = m_pSndTrace->read(snd) + m_pRcvTrace->read(rcv);
+   vector<CPktTraceRecord> records(snd.size() + rcv.size());
+   merge(snd.begin(), snd.end(), rcv.begin(), rcv.end(), records.begin(), CPktTrace::earlier);
+
+   CPktTraceHeader header;
+   memset(&header, 0, sizeof(CPktTraceHeader));
+   memcpy(header.acMagic, "UDTTRACE", 8);
+   header.iVersion = 1;
+   header.iRecordSize = sizeof(CPktTraceRecord);
+   header.iSocketID = m_SocketID;
+   header.iPeerID = m_PeerID;
+   header.usStartTime = m_StartTime;
+   header.llRecords = records.size();
+   header.llOverwritten = overwritten;
+
+   fstream ofs(path, ios::out | ios::binary | ios::trunc);
+   if (ofs.fail())
+      throw CUDTException(4, 4, 0);
+
+   ofs.write((char*)&header, sizeof(CPktTraceHeader));
+   if (!records.empty())
+      ofs.write((char*)&records[0], sizeof(CPktTraceRecord) * records.size());
+   if (ofs.fail())
+      throw CUDTException(4, 4, 0);
+}
+
 // 更新拥塞控制信息
 void CUDT::CCUpdate()
 {
@@ -1813,6 +2333,18 @@ void CUDT::CCUpdate()
    // 更新拥塞窗口
    m_dCongestionWindow = m_pCC->m_dCWndSize;
 
+   if (NULL != m_pRcvTrace)
+   {
+      int period = int(m_pCC->m_dPktSndPeriod * 1000);
+      int cwnd = int(m_pCC->m_dCWndSize);
+      if ((period != m_iTracePeriod) || (cwnd != m_iTraceCWnd))
+      {
+         m_iTracePeriod = period;
+         m_iTraceCWnd = cwnd;
+         m_pRcvTrace->record(CTimer::getTime() - m_StartTime, UDT_TRACE_RATE, 0, m_iSndCurrSeqNo, period, cwnd);
+      }
+   }
+
    // 带宽限制
    if (m_llMaxBW <= 0)
       return;
@@ -1834,6 +2366,8 @@ void CUDT::initSynch()
       pthread_mutex_init(&m_RecvLock, NULL);
       pthread_mutex_init(&m_AckLock, NULL);
       pthread_mutex_init(&m_ConnectionLock, NULL);
+      pthread_mutex_init(&m_ConnectLock, NULL);
+      pthread_cond_init(&m_ConnectCond, NULL);
    #else
       m_SendBlockLock = CreateMutex(NULL, false, NULL);
       m_SendBlockCond = CreateEvent(NULL, false, false, NULL);
@@ -1843,6 +2377,8 @@ void CUDT::initSynch()
       m_RecvLock = CreateMutex(NULL, false, NULL);
       m_AckLock = CreateMutex(NULL, false, NULL);
       m_ConnectionLock = CreateMutex(NULL, false, NULL);
+      m_ConnectLock = CreateMutex(NULL, false, NULL);
+      m_ConnectCond = CreateEvent(NULL, false, false, NULL);
    #endif
 }
 
@@ -1857,6 +2393,8 @@ void CUDT::destroySynch()
       pthread_mutex_destroy(&m_RecvLock);
       pthread_mutex_destroy(&m_AckLock);
       pthread_mutex_destroy(&m_ConnectionLock);
+      pthread_mutex_destroy(&m_ConnectLock);
+      pthread_cond_destroy(&m_ConnectCond);
    #else
       CloseHandle(m_SendBlockLock);
       CloseHandle(m_SendBlockCond);
@@ -1866,6 +2404,8 @@ void CUDT::destroySynch()
       CloseHandle(m_RecvLock);
       CloseHandle(m_AckLock);
       CloseHandle(m_ConnectionLock);
+      CloseHandle(m_ConnectLock);
+      CloseHandle(m_ConnectCond);
    #endif
 }
 
@@ -2169,9 +2709,13 @@ void CUDT::processCtrl(CPacket& ctrlpkt)
          //this should not happen: attack or bug
          m_bBroken = true;
          m_iBrokenCounter = 0;
+         s_UDTUnited.scheduleGC(m_SocketID, 1000000);
          break;
       }
 
+      if (NULL != m_pRcvTrace)
+         m_pRcvTrace->record(now - m_StartTime, UDT_TRACE_ACK_RECV, 0, ack, *((int32_t *)ctrlpkt.m_pcData + 1), ctrlpkt.getAckSeqNo());
+
       if (CSeqNo::seqcmp(ack, m_iSndLastAck) >= 0)
       {
          // Update Flow Window Size, must update before and together with m_iSndLastAck
@@ -2228,6 +2772,8 @@ void CUDT::processCtrl(CPacket& ctrlpkt)
       m_iRTT = (m_iRTT * 7 + rtt) >> 3;
 
       m_pCC->setRTT(m_iRTT);
+      if (rtt > 0)
+         m_pCC->setRTTSample(rtt, m_iRTTVar, m_RTTMinFilter.update(rtt, CTimer::getTime()));
 
       if (ctrlpkt.getLength() > 16)
       {
@@ -2264,11 +2810,18 @@ void CUDT::processCtrl(CPacket& ctrlpkt)
       //if increasing delay detected...
       //   sendCtrl(4);
 
+      m_RTTHist.record(rtt);
+      if (NULL != m_pRcvTrace)
+         m_pRcvTrace->record(CTimer::getTime() - m_StartTime, UDT_TRACE_ACK2_RECV, 0, ack, rtt, ctrlpkt.getAckSeqNo());
+      if ((0 == m_iMinRTT) || (rtt < m_iMinRTT))
+         m_iMinRTT = rtt;
+
       // RTT EWMA
       m_iRTTVar = (m_iRTTVar * 3 + abs(rtt - m_iRTT)) >> 2;
       m_iRTT = (m_iRTT * 7 + rtt) >> 3;
 
       m_pCC->setRTT(m_iRTT);
+      m_pCC->setRTTSample(rtt, m_iRTTVar, m_RTTMinFilter.update(rtt, CTimer::getTime()));
 
       // update last ACK that has been received by the sender
       if (CSeqNo::seqcmp(ack, m_iRcvLastAckAck) > 0)
@@ -2284,6 +2837,25 @@ void CUDT::processCtrl(CPacket& ctrlpkt)
       m_pCC->onLoss(losslist, ctrlpkt.getLength() / 4);
       CCUpdate();
 
+      if (NULL != m_pRcvTrace)
+      {
+         // count the lost packets the same way the sender loss list does
+         // 统计本次报告的丢包数
+         int lost = 0;
+         for (int i = 0, n = ctrlpkt.getLength() / 4; i < n; ++ i)
+         {
+            if (0 != (losslist[i] & 0x80000000))
+            {
+               if (i + 1 < n)
+                  lost += CSeqNo::seqlen(losslist[i] & 0x7FFFFFFF, losslist[i + 1]);
+               ++ i;
+            }
+            else
+               ++ lost;
+         }
+         m_pRcvTrace->record(CTimer::getTime() - m_StartTime, UDT_TRACE_NAK_RECV, 0, losslist[0] & 0x7FFFFFFF, lost, 0);
+      }
+
       bool secure = true;
 
       // decode loss list message and insert loss into the sender loss list
@@ -2330,6 +2902,7 @@ void CUDT::processCtrl(CPacket& ctrlpkt)
          //this should not happen: attack or bug
          m_bBroken = true;
          m_iBrokenCounter = 0;
+         s_UDTUnited.scheduleGC(m_SocketID, 1000000);
          break;
       }
 
@@ -2386,6 +2959,7 @@ void CUDT::processCtrl(CPacket& ctrlpkt)
       m_bClosing = true;
       m_bBroken = true;
       m_iBrokenCounter = 60;
+      s_UDTUnited.scheduleGC(m_SocketID, 1000000);
 
       // Signal the sender and recver if they are waiting for data.
       releaseSynch();
@@ -2442,6 +3016,8 @@ int CUDT::packData(CPacket& packet, uint64_t& ts)
    int payload = 0;
    // 带宽探测标志位
    bool probe = false;
+   // 是否为重传包
+   int retrans = 0;
 
    // 当前时间
    uint64_t entertime;
@@ -2495,6 +3071,7 @@ int CUDT::packData(CPacket& packet, uint64_t& ts)
 
       ++ m_iTraceRetrans;
       ++ m_iRetransTotal;
+      retrans = 1;
    }
    // 重传队列为空，则从发送缓冲区中读取正常的数据
    else
@@ -2508,8 +3085,14 @@ int CUDT::packData(CPacket& packet, uint64_t& ts)
       if (cwnd >= CSeqNo::seqlen(m_iSndLastAck, CSeqNo::incseq(m_iSndCurrSeqNo)))
       {
          // 从发送缓冲区中读取数据
-         if (0 != (payload = m_pSndBuffer->readData(&(packet.m_pcData), packet.m_iMsgNo)))
+         uint64_t origintime;
+         if (0 != (payload = m_pSndBuffer->readData(&(packet.m_pcData), packet.m_iMsgNo, origintime)))
          {
+            // the first packet of a message leaves the buffer: record how long the message has been queued
+            // 消息的第一个包首次发送，记录该消息在发送缓冲区中的排队时间
+            if (0 != (packet.getMsgBoundary() & 2))
+               m_SndQueueDelayHist.record(int64_t(CTimer::getTime() - origintime));
+
             // 更新当前发送序列号
             m_iSndCurrSeqNo = CSeqNo::incseq(m_iSndCurrSeqNo);
             // 更新拥塞控制模块中的当前发送序列号
@@ -2543,7 +3126,11 @@ int CUDT::packData(CPacket& packet, uint64_t& ts)
    }
 
    // 更新UDT报文的时间戳，当前时间 - UDT实例启动时间
-   packet.m_iTimeStamp = int(CTimer::getTime() - m_StartTime);
+   uint64_t reltime = CTimer::getTime() - m_StartTime;
+   packet.m_iTimeStamp = int(reltime);
+
+   if (NULL != m_pSndTrace)
+      m_pSndTrace->record(reltime, UDT_TRACE_DATA_SENT, retrans, packet.m_iSeqNo, payload, packet.m_iMsgNo);
    // 更新UDT报文的目标ID，使UDP复用器能够找到指定的UDT流
    packet.m_iID = m_PeerID;
    // 更新UDT报文的负载数据大小
@@ -2643,6 +3230,11 @@ int CUDT::processData(CUnit* unit)
    if (m_pRcvBuffer->addData(unit, offset) < 0)
       return -1;
 
+   recordMsgLatency(packet);
+
+   if (NULL != m_pRcvTrace)
+      m_pRcvTrace->record(CTimer::getTime() - m_StartTime, UDT_TRACE_DATA_RECV, (CSeqNo::seqcmp(packet.m_iSeqNo, m_iRcvCurrSeqNo) <= 0) ? 1 : 0, packet.m_iSeqNo, packet.getLength(), packet.m_iMsgNo);
+
    // Loss detection.
    // 丢包检测与处理，当前序列号大于期望序列号，说明有丢包
    if (CSeqNo::seqcmp(packet.m_iSeqNo, CSeqNo::incseq(m_iRcvCurrSeqNo)) > 0)
@@ -2689,60 +3281,161 @@ int CUDT::processData(CUnit* unit)
    return 0;
 }
 
+void CUDT::recordMsgLatency(const CPacket& packet)
+{
+   // The timestamp carried by a DATA packet is the peer's sending time relative to its own start time.
+   // The smallest (arrival - timestamp) seen so far is taken as the clock offset plus the shortest one way
+   // delay, which is then approximated by half of the minimum RTT.
+   // 数据包的时间戳是对端相对其启动时间的发送时间；以(到达时间 - 时间戳)的最小值作为时钟偏差加最小单向时延，
+   // 最小单向时延取最小RTT的一半
+   int32_t offset = int32_t(uint32_t(CTimer::getTime() - m_StartTime) - uint32_t(packet.m_iTimeStamp));
+   if (!m_bRcvTsBaseSet || (offset - m_iRcvTsBase < 0))
+   {
+      m_iRcvTsBase = offset;
+      m_bRcvTsBaseSet = true;
+   }
+
+   int32_t msgno = packet.getMsgSeq();
+   int boundary = packet.getMsgBoundary();
+
+   // remember when the first packet of the message was sent
+   // 记录消息第一个包的发送时间
+   if (0 != (boundary & 2))
+   {
+      m_iRcvMsgFirstNo = msgno;
+      m_iRcvMsgFirstTS = packet.m_iTimeStamp;
+   }
+
+   // the last packet of the message: measure from the first packet if it was seen, otherwise from this one
+   // 消息的最后一个包：如果收到过第一个包，从第一个包的发送时间开始计算，否则从本包的发送时间开始计算
+   if (0 != (boundary & 1))
+   {
+      int32_t ts = (msgno == m_iRcvMsgFirstNo) ? m_iRcvMsgFirstTS : packet.m_iTimeStamp;
+      int32_t delay = int32_t(uint32_t(offset) + uint32_t(packet.m_iTimeStamp) - uint32_t(ts)) - m_iRcvTsBase;
+      m_MsgLatencyHist.record(int64_t(delay) + m_iMinRTT / 2);
+   }
+}
+
 // 处理连接请求
-int CUDT::listen(sockaddr* addr, CPacket& packet)
+int CUDT::listen(sockaddr* addr, CUnit* unit)
 {
+   CPacket& packet = unit->m_Packet;
+
    // 如果UDT实例正在关闭，返回错误码
    if (m_bClosing)
       return 1002;
 
-   // 握手报文的长度固定为48byte，如果长度不正常，返回错误码
-   if (packet.getLength() != CHandShake::m_iContentSize)
+   // 握手报文至少48byte，出示票据的请求后跟扩展和早期数据；如果长度不正常，返回错误码
+   if (packet.getLength() < CHandShake::m_iContentSize)
       return 1004;
 
    // 握手报文解包
    CHandShake hs;
    hs.deserialize(packet.m_pcData, packet.getLength());
 
-   // SYN cookie, cookie用于连接认证
-   char clienthost[NI_MAXHOST];
-   char clientport[NI_MAXSERV];
+   // SYN cookie, keyed by a secret that changes every minute; the previous one is kept so that
+   // a cookie issued just before the change is still accepted
+   // SYN cookie，cookie用于连接认证。密钥每分钟更换一次，并保留上一分钟的密钥
+   int64_t epoch = (CTimer::getTime() - m_StartTime) / 60000000;
+   if (epoch != m_llCookieEpoch)
+   {
+      if (epoch == m_llCookieEpoch + 1)
+      {
+         m_pullCookieKey[1][0] = m_pullCookieKey[0][0];
+         m_pullCookieKey[1][1] = m_pullCookieKey[0][1];
+      }
+      else
+         CSipHash::genKey(m_pullCookieKey[1]);
+      CSipHash::genKey(m_pullCookieKey[0]);
+      m_llCookieEpoch = epoch;
+   }
+
+   int32_t cookie = makeCookie(addr, m_pullCookieKey[0]);
 
-   // 获取客户端的IP地址和端口号
-   getnameinfo(addr, (AF_INET == m_iVersion) ? sizeof(sockaddr_in) : sizeof(sockaddr_in6), clienthost, sizeof(clienthost), clientport, sizeof(clientport), NI_NUMERICHOST|NI_NUMERICSERV);
-   // 计算时间戳，每分钟变化一次
-   int64_t timestamp = (CTimer::getTime() - m_StartTime) / 60000000; // secret changes every one minute
-   // 根据拼接的字符串生成MD5值,相同的四元组和时间戳，生成的cookie相同
-   stringstream cookiestr;
-   cookiestr << clienthost << ":" << clientport << ":" << timestamp;
-   unsigned char cookie[16];
-   CMD5::compute(cookiestr.str().c_str(), cookie);
+   // size of the early data taken from a resumed request, 0 if none
+   // 从恢复请求中接收的早期数据大小
+   int earlylen = 0;
 
    // 普通连接请求，即第一次握手
    if (1 == hs.m_iReqType)
    {
       // 第一次握手，发送cookie到客户端
-      hs.m_iCookie = *(int*)cookie;
+      hs.m_iCookie = cookie;
       packet.m_iID = hs.m_iID;
-      int size = packet.getLength();
+      int size = CHandShake::m_iContentSize;
       hs.serialize(packet.m_pcData, size);
+      packet.setLength(size);
       m_pSndQueue->sendto(addr, packet);
       return 0;
    }
    // 第二次握手，验证cookie
    else
    {
-      // 如果cookie不匹配，重新计算cookie
-      if (hs.m_iCookie != *(int*)cookie)
+      // 如果cookie不匹配，尝试使用前一分钟的密钥重新验证
+      if ((hs.m_iCookie != cookie) && (hs.m_iCookie != makeCookie(addr, m_pullCookieKey[1])))
       {
-         // 时间戳减1，重新计算cookie，即尝试使用前一分钟的时间戳重新验证
-         timestamp --;
-         cookiestr << clienthost << ":" << clientport << ":" << timestamp;
-         CMD5::compute(cookiestr.str().c_str(), cookie);
-
-         // 如果重新计算的cookie仍然不匹配，返回错误码，连接失败
-         if (hs.m_iCookie != *(int*)cookie)
+         // without a valid cookie, only a ticket can let the request in
+         // cookie无效时，只有出示了票据的请求可以继续
+         if (0 == (hs.m_iExtFlags & CHandShake::m_iExtTicket))
             return -1;
+
+         // The ticket must be authentic and unexpired, and the age the client reports must agree with the
+         // issue time within m_iTicketWindow: a request replayed later than that is refused.
+         // 票据必须通过认证且未过期，并且客户端报告的票据年龄与签发时间相符（误差在m_iTicketWindow以内），
+         // 超出这个时间窗口的重放请求会被拒绝
+         bool valid = false;
+         if (m_bResume)
+         {
+            uint64_t now = CTimer::getTime();
+            int64_t issue = uint32_t(hs.m_iTicketTime);
+            int64_t nowsec = now / 1000000;
+            int64_t skew = int64_t(now / 1000) - (issue * 1000 + hs.m_iTicketAge);
+            uint64_t mac = makeTicket(addr, hs.m_iTicketTime, hs.m_iTicketSerial);
+
+            valid = (hs.m_piTicketMAC[0] == uint32_t(mac)) && (hs.m_piTicketMAC[1] == uint32_t(mac >> 32))
+                    && (issue <= nowsec) && (nowsec - issue <= m_iTicketLifetime)
+                    && (hs.m_iTicketAge >= 0) && (skew > -m_iTicketWindow) && (skew < m_iTicketWindow);
+         }
+
+         if (!valid)
+         {
+            // refused: answer as to a first request, the client falls back to the cookie
+            // 票据无效：按第一次握手回复cookie，客户端退回到普通握手
+            hs.m_iReqType = 1;
+            hs.m_iCookie = cookie;
+            hs.m_iExtFlags = 0;
+            packet.m_iID = hs.m_iID;
+            int size = CHandShake::m_iContentSize;
+            hs.serialize(packet.m_pcData, size);
+            packet.setLength(size);
+            m_pSndQueue->sendto(addr, packet);
+            return 0;
+         }
+
+         // Early data is taken once per ticket. The fingerprint covers only what the MAC covers, since the
+         // client chooses the other fields freely; it is kept until the ticket can no longer be valid. A later
+         // request with the same ticket (a retransmission or a replay) may still connect, but its data is not
+         // delivered again.
+         // 每张票据只接收一次早期数据：指纹只取MAC覆盖的字段，其余字段由客户端任意选择；指纹保留到票据过期为止。
+         // 之后使用同一票据的请求（重传或重放）仍可建立连接，但数据不再交付
+         if (0 != (hs.m_iExtFlags & CHandShake::m_iExtEarlyData))
+         {
+            uint64_t now = CTimer::getTime();
+            while (!m_qTicketSeen.empty() && (now - m_qTicketSeen.front().first > (m_iTicketLifetime * 1000ULL + m_iTicketWindow) * 1000ULL))
+            {
+               m_sTicketSeen.erase(m_qTicketSeen.front().second);
+               m_qTicketSeen.pop();
+            }
+
+            int32_t fp[4] = {int32_t(hs.m_piTicketMAC[0]), int32_t(hs.m_piTicketMAC[1]), hs.m_iTicketTime, hs.m_iTicketSerial};
+            uint64_t fingerprint = CSipHash::compute(m_pullTicketKey, (const unsigned char*)fp, sizeof(fp));
+
+            earlylen = packet.getLength() - CHandShake::m_iContentSize - CHandShake::m_iExtSize;
+            if ((earlylen <= 0) || (hs.m_iMSS > m_iMSS) || !m_sTicketSeen.insert(fingerprint).second)
+               earlylen = 0;
+            else
+               m_qTicketSeen.push(std::make_pair(now, fingerprint));
+         }
       }
    }
 
@@ -2762,12 +3455,29 @@ int CUDT::listen(sockaddr* addr, CPacket& packet)
          hs.m_iReqType = 1002;
          int size = CHandShake::m_iContentSize;
          hs.serialize(packet.m_pcData, size);
+         packet.setLength(size);
          packet.m_iID = id;
          m_pSndQueue->sendto(addr, packet);
       }
       // 验证通过，开始建立新的连接
       else
       {  
+         // issue a ticket with the response, see connect(peer, hs)
+         // 在握手响应中签发新的票据
+         hs.m_iExtFlags = 0;
+         if (m_bResume)
+         {
+            int32_t t = int32_t(CTimer::getTime() / 1000000);
+            int32_t serial = ++ m_iTicketSerial;
+            uint64_t mac = makeTicket(addr, t, serial);
+            hs.m_iExtFlags = CHandShake::m_iExtTicket | ((earlylen > 0) ? CHandShake::m_iExtEarlyData : 0);
+            hs.m_iTicketTime = t;
+            hs.m_iTicketSerial = serial;
+            hs.m_iTicketAge = 0;
+            hs.m_piTicketMAC[0] = uint32_t(mac);
+            hs.m_piTicketMAC[1] = uint32_t(mac >> 32);
+         }
+
          // 建立新的连接
          int result = s_UDTUnited.newConnection(m_SocketID, addr, &hs);
          if (result == -1)
@@ -2779,7 +3489,28 @@ int CUDT::listen(sockaddr* addr, CPacket& packet)
          if (result != 1)
          {
             int size = CHandShake::m_iContentSize;
+
+            // a repeated request gets the ticket too, and learns whether the existing connection took its early data
+            // 重复的请求同样带回票据，并告知已存在的连接是否接收了早期数据
+            if ((0 == result) && (0 != hs.m_iExtFlags))
+            {
+               CUDT* u = NULL;
+               try
+               {
+                  u = s_UDTUnited.lookup(hs.m_iID);
+               }
+               catch (...)
+               {
+               }
+
+               hs.m_iExtFlags &= ~CHandShake::m_iExtEarlyData;
+               if ((NULL != u) && u->m_bEarlyDataTaken)
+                  hs.m_iExtFlags |= CHandShake::m_iExtEarlyData;
+               size += CHandShake::m_iExtSize;
+            }
+
             hs.serialize(packet.m_pcData, size);
+            packet.setLength(size);
             packet.m_iID = id;
             m_pSndQueue->sendto(addr, packet);
          }
@@ -2788,6 +3519,32 @@ int CUDT::listen(sockaddr* addr, CPacket& packet)
          {
             // a new connection has been created, enable epoll for write 
             s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT, true);
+
+            // the unit holding the request becomes the first data packet of the new connection
+            // 握手报文所在的数据单元原地转换为新连接的第一个数据包
+            if (earlylen > 0)
+            {
+               CUDT* u = NULL;
+               try
+               {
+                  u = s_UDTUnited.lookup(hs.m_iID);
+               }
+               catch (...)
+               {
+               }
+
+               if ((NULL != u) && u->m_bConnected && !u->m_bBroken && !u->m_bClosing)
+               {
+                  memmove(packet.m_pcData, packet.m_pcData + CHandShake::m_iContentSize + CHandShake::m_iExtSize, earlylen);
+                  packet.setLength(earlylen);
+                  packet.m_iSeqNo = u->m_iPeerISN;
+                  packet.m_iMsgNo = 0xC0000001;
+                  packet.m_iID = u->m_SocketID;
+                  u->m_bEarlyDataTaken = true;
+                  u->processData(unit);
+                  u->checkTimers();
+               }
+            }
          }
       }
    }
@@ -2795,6 +3552,52 @@ int CUDT::listen(sockaddr* addr, CPacket& packet)
    return hs.m_iReqType;
 }
 
+int32_t CUDT::makeCookie(const sockaddr* addr, const uint64_t key[2]) const
+{
+   // hash the binary address and port
+   // 对二进制的IP地址和端口计算哈希
+   unsigned char data[18];
+   int len;
+   if (AF_INET == m_iIPversion)
+   {
+      const sockaddr_in* a = (const sockaddr_in*)addr;
+      memcpy(data, &a->sin_addr, 4);
+      memcpy(data + 4, &a->sin_port, 2);
+      len = 6;
+   }
+   else
+   {
+      const sockaddr_in6* a = (const sockaddr_in6*)addr;
+      memcpy(data, &a->sin6_addr, 16);
+      memcpy(data + 16, &a->sin6_port, 2);
+      len = 18;
+   }
+
+   return (int32_t)CSipHash::compute(key, data, len);
+}
+
+uint64_t CUDT::makeTicket(const sockaddr* addr, int32_t time, int32_t serial) const
+{
+   // the client's port changes from one connection to the next, only its address is bound
+   // 客户端端口每次连接都会变化，只绑定IP地址
+   unsigned char data[24];
+   int len;
+   if (AF_INET == m_iIPversion)
+   {
+      memcpy(data, &((const sockaddr_in*)addr)->sin_addr, 4);
+      len = 4;
+   }
+   else
+   {
+      memcpy(data, &((const sockaddr_in6*)addr)->sin6_addr, 16);
+      len = 16;
+   }
+   memcpy(data + len, &time, 4);
+   memcpy(data + len + 4, &serial, 4);
+
+   return CSipHash::compute(m_pullTicketKey, data, len + 8);
+}
+
 /*
    定时器检查
       1. 更新拥塞控制参数
@@ -2864,21 +3667,7 @@ void CUDT::checkTimers()
    //}
 
    // 重传超时检查
-   uint64_t next_exp_time;
-   // 用户自定义了重传超时时间RTO
-   if (m_pCC->m_bUserDefinedRTO)
-   {
-      // 下次超时时间 = 上次响应时间 + 用户自定义的RTO * CPU频率
-      next_exp_time = m_ullLastRspTime + m_pCC->m_iRTO * m_ullCPUFrequency;
-   }
-   // 用户没有自定义RTO，使用默认的RTO计算方法
-   else
-   {
-      uint64_t exp_int = (m_iEXPCount * (m_iRTT + 4 * m_iRTTVar) + m_iSYNInterval) * m_ullCPUFrequency;
-      if (exp_int < m_iEXPCount * m_ullMinExpInt)
-         exp_int = m_iEXPCount * m_ullMinExpInt;
-      next_exp_time = m_ullLastRspTime + exp_int;
-   }
+   uint64_t next_exp_time = getNextEXPTime();
 
    // 需要进行重传超时检测
    if (currtime > next_exp_time)
@@ -2896,8 +3685,9 @@ void CUDT::checkTimers()
          // 连接断开，设置关闭标志，并设置断开标志
          m_bClosing = true;
          m_bBroken = true;
-         // 让GC线程能够检测到连接断开
+         // 让GC线程能够检测到连接断开：GC线程1秒后检查，接收缓冲区有数据时最多再等30秒
          m_iBrokenCounter = 30;
+         s_UDTUnited.scheduleGC(m_SocketID, 1000000);
 
          // update snd U list to remove this socket
          // 更新发送队列，移除该UDT实例
@@ -2945,6 +3735,12 @@ void CUDT::checkTimers()
       else
       {
          sendCtrl(1);
+
+         // the connection is idle: give back the space grown for past bursts
+         // 连接空闲，释放突发时扩展的丢包列表和ACK窗口空间
+         m_pSndLossList->shrink();
+         m_pRcvLossList->shrink();
+         m_pACKWindow->shrink();
       }
 
       ++ m_iEXPCount;
@@ -2954,6 +3750,43 @@ void CUDT::checkTimers()
    }
 }
 
+uint64_t CUDT::getNextEXPTime()
+{
+   // 用户自定义了重传超时时间RTO
+   if (m_pCC->m_bUserDefinedRTO)
+   {
+      // 下次超时时间 = 上次响应时间 + 用户自定义的RTO * CPU频率
+      return m_ullLastRspTime + m_pCC->m_iRTO * m_ullCPUFrequency;
+   }
+
+   // 用户没有自定义RTO，使用默认的RTO计算方法
+   uint64_t exp_int = (m_iEXPCount * (m_iRTT + 4 * m_iRTTVar) + m_iSYNInterval) * m_ullCPUFrequency;
+   if (exp_int < m_iEXPCount * m_ullMinExpInt)
+      exp_int = m_iEXPCount * m_ullMinExpInt;
+   return m_ullLastRspTime + exp_int;
+}
+
+uint64_t CUDT::getNextTimerTime()
+{
+   // checkTimers() fires the timers once the current time is past them
+   uint64_t next = getNextEXPTime() + 1;
+
+   // the ACK timer only matters while the peer has not confirmed the latest ACK (see sendCtrl)
+   // 只有存在对端尚未确认的ACK时，才需要ACK定时器
+   int32_t ack = (0 == m_pRcvLossList->getLossLength()) ? CSeqNo::incseq(m_iRcvCurrSeqNo) : m_pRcvLossList->getFirstLostSeq();
+   if ((ack != m_iRcvLastAckAck) && (m_ullNextACKTime + 1 < next))
+      next = m_ullNextACKTime + 1;
+
+   // sockets closed by the application are noticed by the timer check, so look at every socket at least once a second
+   // 应用关闭的套接字需要由定时器检查发现，因此每个套接字至少每秒检查一次
+   uint64_t currtime;
+   CTimer::rdtsc(currtime);
+   if (next > currtime + 1000000 * m_ullCPUFrequency)
+      next = currtime + 1000000 * m_ullCPUFrequency;
+
+   return next;
+}
+
 void CUDT::addEPoll(const int eid)
 {
    CGuard::enterCS(s_UDTUnited.m_EPoll.m_EPollLock);
@@ -53,12 +53,31 @@ written by
 #include "ccc.h"
 #include "cache.h"
 #include "queue.h"
+#include "trace.h"
 
 enum UDTSockType {UDT_STREAM = 1, UDT_DGRAM};
 
+// 连接建立时创建的收发缓冲区、丢包列表和时间窗口，整块从多路复用器的slab中分配
+// Per-connection state created when the connection is set up. It is taken in
+// one piece from the slab of the connection's multiplexer, so the structures
+// of a connection sit together and their space is recycled by later connections.
+struct CConnState
+{
+   CConnState(int payloadsize, CUnitQueue* queue, int rcvbufsize, int flowwindow, int flightflag, bool msgmode);
+
+   CSndBuffer m_SndBuffer;                      // Sender buffer
+   CSndLossList m_SndLossList;                  // Sender loss list
+   CPktTimeWindow m_SndTimeWindow;              // Packet sending time window
+   CRcvBuffer m_RcvBuffer;                      // Receiver buffer
+   CRcvLossList m_RcvLossList;                  // Receiver loss list
+   CACKWindow m_ACKWindow;                      // ACK history window
+   CPktTimeWindow m_RcvTimeWindow;              // Packet arrival time window
+};
+
 class CUDT
 {
 friend class CUDTSocket;
+friend struct CSocketBlock;
 friend class CUDTUnited;
 friend class CCC;
 friend struct CUDTComp;
@@ -67,7 +86,7 @@ friend class CRendezvousQueue;
 friend class CSndQueue;
 friend class CRcvQueue;
 friend class CSndUList;
-friend class CRcvUList;
+friend class CTimerWheel;
 
 private: // constructor and desctructor
    CUDT();
@@ -87,8 +106,12 @@ public: //API
    static int listen(UDTSOCKET u, int backlog);
    // 接受连接
    static UDTSOCKET accept(UDTSOCKET u, sockaddr* addr, int* addrlen);
+   // 批量接受连接
+   static int accept_batch(UDTSOCKET u, UDTSOCKET* sockets, int max);
    // 连接
    static int connect(UDTSOCKET u, const sockaddr* name, int namelen);
+   // 连接，持有票据时数据随握手一起发送
+   static int connect_data(UDTSOCKET u, const sockaddr* name, int namelen, const char* buf, int len);
    // 关闭一个UDT socket
    static int close(UDTSOCKET u);
    // 获取对端地址
@@ -107,6 +130,10 @@ public: //API
    static int sendmsg(UDTSOCKET u, const char* buf, int len, int ttl = -1, bool inorder = false);
    // 和recvmsg搭配使用
    static int recvmsg(UDTSOCKET u, char* buf, int len);
+   // 批量发送消息
+   static int sendmsg_batch(UDTSOCKET u, const CMsgVec* msgs, int num, int ttl = -1, bool inorder = false);
+   // 批量接收消息
+   static int recvmsg_batch(UDTSOCKET u, CMsgVec* msgs, int num);
    // 发送文件，按块发送
    static int64_t sendfile(UDTSOCKET u, std::fstream& ifs, int64_t& offset, int64_t size, int block = 364000);
    // 接收文件
@@ -126,8 +153,15 @@ public: //API
    static CUDTException& getlasterror();
    // 性能监控
    static int perfmon(UDTSOCKET u, CPerfMon* perf, bool clear = true);
+   static int perfmon2(UDTSOCKET u, CPerfMon2* perf, bool clear = true);
+   static int dumptrace(UDTSOCKET u, const char* path);
    // 套接字状态
    static UDTSTATUS getsockstate(UDTSOCKET u);
+   static int getmuxstats(int port, CMuxStats* stats);
+   static int setmuxtrace(int port, int size);
+   static int getmuxtrace(int port, CMuxEvent* events, int len);
+   static int setmuxrate(int port, int cls, int64_t bandwidth);
+   static int getmuxrate(int port, int cls, int64_t* bandwidth);
 
 public: // internal API
    // 根据UDT socket获取CUDT实例
@@ -157,11 +191,13 @@ private:
       //    Connect to a UDT entity listening at address "peer".
       // Parameters:
       //    0) [in] peer: The address of the listening UDT entity.
+      //    1) [in] data: data to send with the handshake when a resumption ticket is held, or NULL.
+      //    2) [in] len: size of "data", at most one packet less the handshake.
       // Returned value:
       //    None.
 
-   // 连接指定的地址
-   void connect(const sockaddr* peer);
+   // 连接指定的地址，data为随握手发送的首个数据包
+   void connect(const sockaddr* peer, const char* data, int len);
 
       // Functionality:
       //    Process the response handshake packet.
@@ -183,6 +219,60 @@ private:
 
    void connect(const sockaddr* peer, CHandShake* hs);
 
+      // Functionality:
+      //    Abort a connection setup in progress and notify the application.
+      // Parameters:
+      //    0) [in] err: minor code of the setup failure (major code 1): 1 timeout, 2 rejected, 4 bad response.
+      // Returned value:
+      //    None.
+
+   // 连接建立失败：通知等待的connect()和epoll
+   void connectFailed(int err);
+
+      // Functionality:
+      //    Report that a non-blocking call cannot proceed, without throwing.
+      // Parameters:
+      //    0) [in] minor: minor code of the error (major code 6): 1 no buffer to send, 2 no data or connection available.
+      // Returned value:
+      //    ERROR.
+
+   // 非阻塞调用无法立即完成是常态：记录错误码并返回ERROR，不抛出异常
+   static int wouldBlock(int minor);
+
+      // Functionality:
+      //    Block a sending call until the sender buffer has room for "len" bytes, the send timeout expires or the connection breaks.
+      // Parameters:
+      //    0) [in] len: bytes the caller needs to put into the buffer.
+      // Returned value:
+      //    None.
+
+   // 阻塞发送时等待发送缓冲区有足够的空间
+   void waitSndSpace(int len);
+
+   // 从接收缓冲区中读取尽可能多的消息，不等待
+   int readMsgs(CMsgVec* msgs, int num);
+
+      // Functionality:
+      //    Create the congestion control of a new connection, warm started from the network information cache.
+      // Parameters:
+      //    0) [in] peer: address of the peer.
+      // Returned value:
+      //    None.
+
+   // 创建拥塞控制，使用对端的历史网络信息
+   void initCC(const sockaddr* peer);
+
+      // Functionality:
+      //    Send the connection request, followed by the early data if the request presents a ticket for it.
+      // Parameters:
+      //    0) [in] addr: address of the listener or the rendezvous peer.
+      //    1) [in] id: destination socket ID, 0 for a listener.
+      // Returned value:
+      //    None.
+
+   // 发送连接请求
+   void sendConnReq(const sockaddr* addr, int32_t id);
+
       // Functionality:
       //    Close the opened UDT entity.
       // Parameters:
@@ -238,6 +328,30 @@ private:
    // 从接收缓冲区中读取数据
    int recvmsg(char* data, int len);
 
+      // Functionality:
+      //    Send an array of messages under one lock and one sending list update.
+      // Parameters:
+      //    0) [in] msgs: the messages.
+      //    1) [in] num: number of messages.
+      //    2) [in] ttl: the time-to-live of every message.
+      //    3) [in] inorder: if the messages should be delivered in order.
+      // Returned value:
+      //    Number of messages put into the sender buffer, in the order given.
+
+   // 批量发送消息；阻塞模式下等待直到全部放入发送缓冲区或超时
+   int sendmsgBatch(const CMsgVec* msgs, int num, int ttl, bool inorder);
+
+      // Functionality:
+      //    Receive up to "num" messages; a blocking call waits for the first one only.
+      // Parameters:
+      //    0) [in, out] msgs: receive buffers; iReceived is set for each message received.
+      //    1) [in] num: number of buffers.
+      // Returned value:
+      //    Number of messages received.
+
+   // 批量接收消息
+   int recvmsgBatch(CMsgVec* msgs, int num);
+
       // Functionality:
       //    Request UDT to send out a file described as "fd", starting from "offset", with size of "size".
       // Parameters:
@@ -299,6 +413,27 @@ private:
    // 传输状态，性能监测
    void sample(CPerfMon* perf, bool clear = true);
 
+      // Functionality:
+      //    read the performance data and the latency histograms since last sample() call.
+      // Parameters:
+      //    0) [in, out] perf: pointer to a CPerfMon2 structure to record the performance data.
+      //    1) [in] clear: flag to decide if the local performance trace and the histograms should be cleared.
+      // Returned value:
+      //    None.
+
+   // 传输状态及延迟分布
+   void sample(CPerfMon2* perf, bool clear = true);
+
+      // Functionality:
+      //    write the packet trace into a binary file, see CPktTraceHeader.
+      // Parameters:
+      //    0) [in] path: the file to be written.
+      // Returned value:
+      //    None.
+
+   // 将数据包跟踪写入文件
+   void dumpTrace(const char* path);
+
 private:
    static CUDTUnited s_UDTUnited;               // UDT global management base
 
@@ -345,18 +480,41 @@ private: // Options
    // 端口复用
    bool m_bReuseAddr;				// reuse an exiting port or not, for UDP multiplexer
    int64_t m_llMaxBW;				// maximum data transfer rate (threshold)
+   // 网络仿真参数，仅用于测试
+   CNetEmuConfig m_NetEmu;			// link impairment emulation on the multiplexer channel
+   // 数据包跟踪记录数，0表示关闭
+   int m_iPktTraceSize;				// number of packet trace records kept per direction, 0 = off
+   // 多路复用器限速类别及权重
+   int m_iRateClass;				// rate class of the multiplexer rate limit
+   int m_iSndWeight;				// share of a saturated multiplexer rate limit and of the sending list
+   // 发送列表中的优先级
+   int m_iPriority;				// priority class on the multiplexer's sending list
+   // 会话恢复
+   bool m_bResume;				// issue (listener) or keep and present (client) resumption tickets
 
 private: // congestion control
    // 拥塞控制工厂类
    CCCVirtualFactory* m_pCCFactory;             // Factory class to create a specific CC instance
+   // 内置拥塞控制算法名称
+   char m_acCCName[16];                         // name of the built-in CC in use, "custom" after UDT_CC
    // 拥塞控制类
    CCC* m_pCC;                                  // congestion control class
    // 网络状态缓存
    CCache<CInfoBlock>* m_pCache;		// network information cache
+   // 会话恢复票据缓存
+   CCache<CTicketBlock>* m_pTicketCache;	// resumption tickets received from listeners
 
 private: // Status
    // 是否处于listening状态
    volatile bool m_bListening;                  // If the UDT entit is listening to connection
+   // SYN cookie的密钥，每分钟轮换一次，保留上一分钟的密钥用于验证
+   uint64_t m_pullCookieKey[2][2];              // current and previous secret of the SYN cookies
+   int64_t m_llCookieEpoch;                     // minute the current cookie secret was generated in, -1 if none yet
+   // 会话恢复票据的密钥，以及已用于早期数据的票据，每张票据在有效期内只能携带一次早期数据
+   uint64_t m_pullTicketKey[2];                 // secret of the resumption tickets
+   int32_t m_iTicketSerial;                     // serial number of the last ticket issued
+   std::set<uint64_t> m_sTicketSeen;            // fingerprints of the tickets whose early data was taken, kept while they may be valid
+   std::queue<std::pair<uint64_t, uint64_t> > m_qTicketSeen;   // (arrival time, fingerprint), in arrival order
    // 正在连接，尚未完成
    volatile bool m_bConnecting;			// The short phase when connect() is called but not yet completed
    // 连接成功
@@ -378,6 +536,10 @@ private: // Status
    int m_iRTT;                                  // RTT, in microseconds
    // RTT变化幅度
    int m_iRTTVar;                               // RTT variance
+   // 最小RTT
+   int m_iMinRTT;                               // smallest RTT sample, in microseconds, 0 if none yet
+   // 10秒窗口内的最小RTT，提供给拥塞控制
+   CMinFilter m_RTTMinFilter;                   // minimum RTT over the last 10 seconds, for congestion control
    // 数据包接收速率-单位时间内接收的数据包数量
    int m_iDeliveryRate;				// Packet arrival rate at the receiver side
 
@@ -388,8 +550,13 @@ private: // Status
    CHandShake m_ConnReq;			// connection request
    // 对端返回的握手报文
    CHandShake m_ConnRes;			// connection response
-   // 用于控制连接请求的发送间隔，避免频繁发送，每250ms最多发送1个请求
-   int64_t m_llLastReqTime;			// last time when a connection request is sent
+   // 连接建立失败的原因，0表示没有失败
+   int m_iConnError;				// minor code of the last connection setup failure, 0 if none
+   // 随握手发送的早期数据
+   char* m_pcEarlyData;				// data given to connect(), sent with the handshake if a ticket is held
+   int m_iEarlyDataLen;				// size of m_pcEarlyData
+   // 监听端：本连接的握手携带的早期数据已交付
+   bool m_bEarlyDataTaken;			// accepted connection whose handshake's early data was delivered
 
 private: // Sending related data
    // 发送缓冲区
@@ -447,6 +614,10 @@ private: // synchronization: mutexes and conditions
    // 连接参数保护
    pthread_mutex_t m_ConnectionLock;            // used to synchronize connection operation
 
+   // 阻塞模式的connect()等待握手完成
+   pthread_cond_t m_ConnectCond;                // used to block "connect" until the handshake completes or fails
+   pthread_mutex_t m_ConnectLock;               // lock associated to m_ConnectCond
+
    pthread_cond_t m_SendBlockCond;              // used to block "send" call
    // 发送数据时保护临界区
    pthread_mutex_t m_SendBlockLock;             // lock associated to m_SendBlockCond
@@ -469,7 +640,31 @@ private: // Generation and processing of packets
    void processCtrl(CPacket& ctrlpkt);
    int packData(CPacket& packet, uint64_t& ts);
    int processData(CUnit* unit);
-   int listen(sockaddr* addr, CPacket& packet);
+   int listen(sockaddr* addr, CUnit* unit);
+
+      // Functionality:
+      //    Compute the SYN cookie of a peer address.
+      // Parameters:
+      //    0) [in] addr: peer address.
+      //    1) [in] key: secret the cookie is made with.
+      // Returned value:
+      //    the cookie.
+
+   // 根据对端地址和密钥计算SYN cookie
+   int32_t makeCookie(const sockaddr* addr, const uint64_t key[2]) const;
+
+      // Functionality:
+      //    Compute the authenticator of a resumption ticket.
+      // Parameters:
+      //    0) [in] addr: address of the client the ticket is issued to; the port is not included.
+      //    1) [in] time: issue time, in seconds.
+      //    2) [in] serial: serial number of the ticket on the listener.
+      // Returned value:
+      //    the 64-bit authenticator.
+
+   // 计算会话恢复票据的认证码
+   uint64_t makeTicket(const sockaddr* addr, int32_t time, int32_t serial) const;
+   void recordMsgLatency(const CPacket& packet);
 
 private: // Trace
    // 一个UDT实例启动时的时间戳
@@ -509,6 +704,22 @@ private: // Trace
    // 记录发送数据用了多长时间
    int64_t m_llSndDurationCounter;		// timers to record the sending duration
 
+   // 延迟分布
+   CHistogram m_RTTHist;                        // RTT samples from ACK/ACK2 pairs
+   CHistogram m_MsgLatencyHist;                 // message latency at the receiver side
+   CHistogram m_SndQueueDelayHist;              // time messages wait in the sender buffer before being sent
+   // 对端时间戳与本地到达时间之差的最小值，用于估算消息延迟
+   bool m_bRcvTsBaseSet;                        // if m_iRcvTsBase holds a sample
+   int32_t m_iRcvTsBase;                        // smallest (local arrival time - peer timestamp) seen so far
+   int32_t m_iRcvMsgFirstNo;                    // message number of the last first-of-message packet received
+   int32_t m_iRcvMsgFirstTS;                    // peer timestamp of that packet
+
+   // 数据包跟踪，发送和接收各一个环形缓冲区，分别只由发送和接收工作线程写入
+   CPktTrace* m_pSndTrace;                      // packet trace written by the sending worker
+   CPktTrace* m_pRcvTrace;                      // packet trace written by the receiving worker
+   int m_iTracePeriod;                          // last traced packet sending period, in nanoseconds
+   int m_iTraceCWnd;                            // last traced congestion window
+
 private: // Timers
    // CPU时钟频率，单位KHz
    uint64_t m_ullCPUFrequency;                  // CPU clock frequency, used for Timer, ticks per microsecond
@@ -516,6 +727,13 @@ private: // Timers
    // 用于速率控制
    static const int m_iSYNInterval;             // Periodical Rate Control Interval, 10000 microsecond
    static const int m_iSelfClockInterval;       // ACK interval for self-clocking
+   // 会话恢复票据有效期，以及票据年龄检查的容差
+   static const int m_iTicketLifetime;          // lifetime of a resumption ticket, in seconds
+   static const int m_iTicketWindow;            // tolerance of the ticket age check, in milliseconds
+   // 历史拥塞控制状态的有效期
+   static const int m_iWarmStartAge;            // age up to which cached congestion state is used for a warm start, in seconds
+   // 缓存的网络信息的有效期
+   static const int m_iInfoLifetime;            // lifetime of cached network information, in seconds
 
    // 下一次发送ACK的时间
    uint64_t m_ullNextACKTime;			// Next ACK time, in CPU clock cycles, same below
@@ -545,6 +763,18 @@ private: // Timers
 
    void checkTimers();
 
+      // Functionality:
+      //    Find when checkTimers() has something to do next.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    CPU time of the next ACK or EXP timer to expire.
+
+   // 下一个ACK或EXP定时器的到期时间
+   uint64_t getNextTimerTime();
+   // EXP定时器的到期时间
+   uint64_t getNextEXPTime();
+
 private: // for UDP multiplexer
    // 发送队列
    CSndQueue* m_pSndQueue;			// packet sending queue
@@ -558,6 +788,18 @@ private: // for UDP multiplexer
    CSNode* m_pSNode;				// node information for UDT list used in snd queue
    // 接收队列节点指针
    CRNode* m_pRNode;                            // node information for UDT list used in rcv queue
+   // 多路复用器的连接状态slab
+   CSlab* m_pConnSlab;                          // slab of the multiplexer that m_pConnState is taken from
+   // 连接状态，其中的结构由上面的各个指针引用
+   CConnState* m_pConnState;                    // buffers, loss lists and windows of the connection, NULL until connected
+
+   // 队列节点和对端地址内嵌在CUDT中，无需单独分配
+   CSNode m_SNode;                              // space of *m_pSNode
+   CRNode m_RNode;                              // space of *m_pRNode
+   sockaddr_in6 m_PeerAddrSpace;                // space of *m_pPeerAddr, large enough for both IP versions
+
+   // 从slab中创建连接状态
+   void newConnState();
 
 private: // for epoll
    std::set<int> m_sPollID;                     // set of epoll ID to trigger
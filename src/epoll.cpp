@@ -116,6 +116,9 @@ int CEPoll::add_usock(const int eid, const UDTSOCKET& u, const int* events)
    // 插入到等待可写时间的队列中
    if (!events || (*events & UDT_EPOLL_OUT))
       p->second.m_sUDTSocksOut.insert(u);
+   // 插入到等待异常事件的队列中，例如非阻塞connect失败
+   if (!events || (*events & UDT_EPOLL_ERR))
+      p->second.m_sUDTSocksEx.insert(u);
 
    return 0;
 }
@@ -172,6 +175,10 @@ int CEPoll::remove_usock(const int eid, const UDTSOCKET& u)
    p->second.m_sUDTSocksIn.erase(u);
    p->second.m_sUDTSocksOut.erase(u);
    p->second.m_sUDTSocksEx.erase(u);
+   // 以及已就绪的事件
+   p->second.m_sUDTReads.erase(u);
+   p->second.m_sUDTWrites.erase(u);
+   p->second.m_sUDTExcepts.erase(u);
 
    return 0;
 }
@@ -339,9 +346,9 @@ int CEPoll::wait(const int eid, set<UDTSOCKET>* readfds, set<UDTSOCKET>* writefd
       if (total > 0)
          return total;
 
-      // 超时，抛出异常
+      // 超时；轮询(msTimeOut == 0)时这是常态，不抛出异常
       if ((msTimeOut >= 0) && (int64_t(CTimer::getTime() - entertime) >= msTimeOut * 1000LL))
-         throw CUDTException(6, 3, 0);
+         return -1;
 
       // 阻塞等待，最多等待10ms
       CTimer::waitForEvent();
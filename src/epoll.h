@@ -148,9 +148,9 @@ public: // for CUDTUnited API
       //    4) [out] lrfds: system file descriptors for reading.
       //    5) [out] lwfds: system file descriptors for writing.
       // Returned value:
-      //    number of sockets available for IO.
+      //    number of sockets available for IO, or -1 if timed out.
 
-   // 等待epoll事件或超时；
+   // 等待epoll事件或超时；超时返回-1，由调用者记录错误，不抛出异常；
    int wait(const int eid, std::set<UDTSOCKET>* readfds, std::set<UDTSOCKET>* writefds, int64_t msTimeOut, std::set<SYSSOCKET>* lrfds, std::set<SYSSOCKET>* lwfds);
 
       // Functionality:
@@ -46,8 +46,10 @@ m_piData2(NULL),
 m_piNext(NULL),
 m_iHead(-1),
 m_iLength(0),
-m_iSize(size),
+m_iSize((size < m_iInitSize) ? size : m_iInitSize),
+m_iMaxSize(size),
 m_iLastInsertPos(-1),
+m_iLastSeqNo(-1),
 m_ListLock()
 {
    m_piData1 = new int32_t [m_iSize];
@@ -56,7 +58,7 @@ m_ListLock()
 
    // -1 means there is no data in the node
    // 初始化数组，-1表示没有数据
-   for (int i = 0; i < size; ++ i)
+   for (int i = 0; i < m_iSize; ++ i)
    {
       m_piData1[i] = -1;
       m_piData2[i] = -1;
@@ -98,6 +100,15 @@ int CSndLossList::insert(int32_t seqno1, int32_t seqno2)
    // lock_guard
    CGuard listguard(m_ListLock);
 
+   // the array must cover the seq. no. range of the list after the insertion
+   // 数组需要覆盖插入后列表的整个序列号范围，不够时扩展
+   if ((0 == m_iLength) || (CSeqNo::seqcmp(seqno2, m_iLastSeqNo) > 0))
+      m_iLastSeqNo = seqno2;
+   if ((0 == m_iLength) || (CSeqNo::seqcmp(seqno1, m_piData1[m_iHead]) < 0))
+      reserve(CSeqNo::seqlen(seqno1, m_iLastSeqNo));
+   else
+      reserve(CSeqNo::seqlen(m_piData1[m_iHead], m_iLastSeqNo));
+
    // 0 == m_iLength 说明此时重传列表为空
    if (0 == m_iLength)
    {
@@ -548,6 +559,74 @@ int32_t CSndLossList::getLostSeq()
    return seqno;
 }
 
+void CSndLossList::shrink()
+{
+   CGuard listguard(m_ListLock);
+
+   int size = (m_iMaxSize < m_iInitSize) ? m_iMaxSize : m_iInitSize;
+   if ((0 == m_iLength) && (m_iSize > size))
+      resize(size);
+}
+
+void CSndLossList::reserve(int span)
+{
+   if ((span <= m_iSize) || (m_iSize >= m_iMaxSize))
+      return;
+
+   // grow geometrically so that a burst costs a few copies at most
+   // 按倍数扩展，一次突发丢包最多引起几次拷贝
+   int size = m_iSize;
+   while ((size < span) && (size < m_iMaxSize))
+      size *= 2;
+
+   resize((size < m_iMaxSize) ? size : m_iMaxSize);
+}
+
+void CSndLossList::resize(int size)
+{
+   int32_t* data1 = new int32_t [size];
+   int32_t* data2 = new int32_t [size];
+   int* next = new int [size];
+
+   for (int i = 0; i < size; ++ i)
+   {
+      data1[i] = -1;
+      data2[i] = -1;
+   }
+
+   // a node lives at the offset of its first seq. no. from the head's, so the head moves to 0
+   // 节点位置由其起始序列号相对头节点的偏移决定，重新排布后头节点位于0
+   int head = -1;
+   int last = -1;
+   for (int i = m_iHead, prior = -1; (m_iLength > 0) && (-1 != i); i = m_piNext[i])
+   {
+      int loc = CSeqNo::seqoff(m_piData1[m_iHead], m_piData1[i]);
+      data1[loc] = m_piData1[i];
+      data2[loc] = m_piData2[i];
+      next[loc] = -1;
+
+      if (-1 == prior)
+         head = loc;
+      else
+         next[prior] = loc;
+      prior = loc;
+
+      if (m_iLastInsertPos == i)
+         last = loc;
+   }
+
+   delete [] m_piData1;
+   delete [] m_piData2;
+   delete [] m_piNext;
+
+   m_piData1 = data1;
+   m_piData2 = data2;
+   m_piNext = next;
+   m_iHead = head;
+   m_iLastInsertPos = last;
+   m_iSize = size;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 CRcvLossList::CRcvLossList(int size):
@@ -558,7 +637,8 @@ m_piPrior(NULL),
 m_iHead(-1),
 m_iTail(-1),
 m_iLength(0),
-m_iSize(size)
+m_iSize((size < m_iInitSize) ? size : m_iInitSize),
+m_iMaxSize(size)
 {
    m_piData1 = new int32_t [m_iSize];
    m_piData2 = new int32_t [m_iSize];
@@ -566,7 +646,7 @@ m_iSize(size)
    m_piPrior = new int [m_iSize];
 
    // -1 means there is no data in the node
-   for (int i = 0; i < size; ++ i)
+   for (int i = 0; i < m_iSize; ++ i)
    {
       m_piData1[i] = -1;
       m_piData2[i] = -1;
@@ -586,6 +666,10 @@ void CRcvLossList::insert(int32_t seqno1, int32_t seqno2)
    // Data to be inserted must be larger than all those in the list
    // guaranteed by the UDT receiver
 
+   // the array must cover the seq. no. range of the list after the insertion
+   // 数组需要覆盖插入后列表的整个序列号范围，不够时扩展
+   reserve(CSeqNo::seqlen((0 == m_iLength) ? seqno1 : m_piData1[m_iHead], seqno2));
+
    if (0 == m_iLength)
    {
       // insert data into an empty list
@@ -832,3 +916,70 @@ void CRcvLossList::getLossArray(int32_t* array, int& len, int limit)
       i = m_piNext[i];
    }
 }
+
+void CRcvLossList::shrink()
+{
+   int size = (m_iMaxSize < m_iInitSize) ? m_iMaxSize : m_iInitSize;
+   if ((0 == m_iLength) && (m_iSize > size))
+      resize(size);
+}
+
+void CRcvLossList::reserve(int span)
+{
+   if ((span <= m_iSize) || (m_iSize >= m_iMaxSize))
+      return;
+
+   // grow geometrically so that a burst costs a few copies at most
+   // 按倍数扩展，一次突发丢包最多引起几次拷贝
+   int size = m_iSize;
+   while ((size < span) && (size < m_iMaxSize))
+      size *= 2;
+
+   resize((size < m_iMaxSize) ? size : m_iMaxSize);
+}
+
+void CRcvLossList::resize(int size)
+{
+   int32_t* data1 = new int32_t [size];
+   int32_t* data2 = new int32_t [size];
+   int* next = new int [size];
+   int* prior = new int [size];
+
+   for (int i = 0; i < size; ++ i)
+   {
+      data1[i] = -1;
+      data2[i] = -1;
+   }
+
+   // a node lives at the offset of its first seq. no. from the head's, so the head moves to 0
+   // 节点位置由其起始序列号相对头节点的偏移决定，重新排布后头节点位于0
+   int head = -1;
+   int tail = -1;
+   for (int i = m_iHead; (m_iLength > 0) && (-1 != i); i = m_piNext[i])
+   {
+      int loc = CSeqNo::seqoff(m_piData1[m_iHead], m_piData1[i]);
+      data1[loc] = m_piData1[i];
+      data2[loc] = m_piData2[i];
+      next[loc] = -1;
+      prior[loc] = tail;
+
+      if (-1 == tail)
+         head = loc;
+      else
+         next[tail] = loc;
+      tail = loc;
+   }
+
+   delete [] m_piData1;
+   delete [] m_piData2;
+   delete [] m_piNext;
+   delete [] m_piPrior;
+
+   m_piData1 = data1;
+   m_piData2 = data2;
+   m_piNext = next;
+   m_piPrior = prior;
+   m_iHead = head;
+   m_iTail = tail;
+   m_iSize = size;
+}
@@ -95,6 +95,22 @@ public:
    // 获取最小序列号，并从重传列表中删除该序列号
    int32_t getLostSeq();
 
+      // Functionality:
+      //    Release the space grown for a past burst of losses if the list is empty.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   // 丢包列表为空时，释放突发丢包时扩展的数组空间
+   void shrink();
+
+private:
+   // 扩展数组，使其能够容纳跨度为span的序列号范围
+   void reserve(int span);
+   // 按新的大小重新排布数组中的节点
+   void resize(int size);
+
 private:
    // 数组，记录起始序列号
    int32_t* m_piData1;                  // sequence number starts
@@ -107,10 +123,17 @@ private:
    int m_iHead;                         // first node
    // 丢了多少个包，按序列号进行统计
    int m_iLength;                       // loss length
-   // 静态数组的大小
-   int m_iSize;                         // size of the static array
+   // 数组的当前大小，按需扩展
+   int m_iSize;                         // current size of the array, grown on demand
+   // 数组大小的上限
+   int m_iMaxSize;                      // largest size the array may grow to
    // 最新一次插入的位置
    int m_iLastInsertPos;                // position of last insert node
+   // 列表中最大的序列号
+   int32_t m_iLastSeqNo;                // largest seq. no. in the list, valid if the list is not empty
+
+   // 数组的初始大小，空闲时收缩回这个大小
+   static const int m_iInitSize = 64;   // size allocated at first and kept while there is no loss
 
    pthread_mutex_t m_ListLock;          // used to synchronize list operation
 
@@ -203,6 +226,22 @@ public:
    // 获取丢包数组
    void getLossArray(int32_t* array, int& len, int limit);
 
+      // Functionality:
+      //    Release the space grown for a past burst of losses if the list is empty.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   // 丢包列表为空时，释放突发丢包时扩展的数组空间
+   void shrink();
+
+private:
+   // 扩展数组，使其能够容纳跨度为span的序列号范围
+   void reserve(int span);
+   // 按新的大小重新排布数组中的节点
+   void resize(int size);
+
 private:
    // 数组，记录起始序列号
    int32_t* m_piData1;                  // sequence number starts
@@ -219,8 +258,13 @@ private:
    int m_iTail;                         // last node in the list;
    // 丢包数量
    int m_iLength;                       // loss length
-   // 静态数组的大小
-   int m_iSize;                         // size of the static array
+   // 数组的当前大小，按需扩展
+   int m_iSize;                         // current size of the array, grown on demand
+   // 数组大小的上限
+   int m_iMaxSize;                      // largest size the array may grow to
+
+   // 数组的初始大小，空闲时收缩回这个大小
+   static const int m_iInitSize = 64;   // size allocated at first and kept while there is no loss
 
 private:
    CRcvLossList(const CRcvLossList&);
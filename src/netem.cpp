@@ -0,0 +1,303 @@
+/*****************************************************************************
+Copyright (c) 2001 - 2011, The Board of Trustees of the University of Illinois.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above
+  copyright notice, this list of conditions and the
+  following disclaimer.
+
+* Redistributions in binary form must reproduce the
+  above copyright notice, this list of conditions
+  and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the University of Illinois
+  nor the names of its contributors may be used to
+  endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#ifndef WIN32
+   #include <arpa/inet.h>
+   #include <cstring>
+#else
+   #include <winsock2.h>
+   #include <ws2tcpip.h>
+   #ifdef LEGACY_WIN32
+      #include <wspiapi.h>
+   #endif
+#endif
+#include "netem.h"
+#include "packet.h"
+
+using namespace std;
+
+CEmuChannel::CEmuChannel(int version, const CNetEmuConfig& config):
+CChannel(version),
+m_Config(config),
+m_WorkerThread(),
+m_QueueLock(),
+m_QueueCond(),
+m_Queue(),
+m_ullRandState(),
+m_bBadState(false),
+m_dLinkFreeTime(0),
+m_ullLastDelivery(0),
+m_bClosing(false)
+{
+   // xorshift must not start from zero
+   m_ullRandState = 0x9E3779B97F4A7C15ULL ^ m_Config.uiSeed;
+
+   CGuard::createMutex(m_QueueLock);
+   CGuard::createCond(m_QueueCond);
+}
+
+CEmuChannel::~CEmuChannel()
+{
+   for (multimap<uint64_t, CEmuPacket>::iterator i = m_Queue.begin(); i != m_Queue.end(); ++ i)
+      delete [] i->second.m_pcData;
+
+   CGuard::releaseCond(m_QueueCond);
+   CGuard::releaseMutex(m_QueueLock);
+}
+
+bool CEmuChannel::isEnabled(const CNetEmuConfig& config)
+{
+   return (config.usDelay > 0) || (config.usJitter > 0) || (config.dLossRate > 0) || (config.dGEGoodToBad > 0)
+       || (config.dReorderRate > 0) || (config.byteRate > 0);
+}
+
+bool CEmuChannel::isValid(const CNetEmuConfig& config)
+{
+   if ((config.usDelay < 0) || (config.usJitter < 0) || (config.usReorderDelay < 0) || (config.byteRate < 0) || (config.byteQueueLimit < 0))
+      return false;
+
+   const double p[5] = {config.dLossRate, config.dGEGoodToBad, config.dGEBadToGood, config.dGELossBad, config.dReorderRate};
+   for (int i = 0; i < 5; ++ i)
+   {
+      if ((p[i] < 0) || (p[i] > 1))
+         return false;
+   }
+
+   return true;
+}
+
+void CEmuChannel::start()
+{
+   #ifndef WIN32
+      if (0 != pthread_create(&m_WorkerThread, NULL, CEmuChannel::worker, this))
+      {
+         m_WorkerThread = 0;
+         throw CUDTException(3, 1);
+      }
+   #else
+      DWORD threadID;
+      m_WorkerThread = CreateThread(NULL, 0, CEmuChannel::worker, this, 0, &threadID);
+      if (NULL == m_WorkerThread)
+         throw CUDTException(3, 1);
+   #endif
+}
+
+void CEmuChannel::close() const
+{
+   // packets still on the emulated link are lost, as on a real link that goes down
+   CGuard::enterCS(m_QueueLock);
+   bool running = !m_bClosing;
+   m_bClosing = true;
+   #ifndef WIN32
+      pthread_cond_signal(&m_QueueCond);
+   #else
+      SetEvent(m_QueueCond);
+   #endif
+   CGuard::leaveCS(m_QueueLock);
+
+   if (running)
+   {
+      #ifndef WIN32
+         if (0 != m_WorkerThread)
+            pthread_join(m_WorkerThread, NULL);
+      #else
+         if (NULL != m_WorkerThread)
+         {
+            WaitForSingleObject(m_WorkerThread, INFINITE);
+            CloseHandle(m_WorkerThread);
+         }
+      #endif
+   }
+
+   CChannel::close();
+}
+
+int CEmuChannel::sendto(const sockaddr* addr, CPacket& packet) const
+{
+   int size = CPacket::m_iPktHdrSize + packet.getLength();
+
+   CGuard queueguard(m_QueueLock);
+
+   if (m_bClosing)
+      return -1;
+
+   // dropped packets are reported as sent, the sender cannot tell the difference
+   if (lose())
+      return size;
+
+   uint64_t currtime = CTimer::getTime();
+
+   // serialization on the bottleneck link, with tail drop when its queue is full
+   double departure = double(currtime);
+   if (m_Config.byteRate > 0)
+   {
+      if (m_dLinkFreeTime > departure)
+         departure = m_dLinkFreeTime;
+
+      if ((m_Config.byteQueueLimit > 0) && ((departure - currtime) * m_Config.byteRate / 1000000.0 > m_Config.byteQueueLimit))
+         return size;
+
+      departure += size * 1000000.0 / m_Config.byteRate;
+      m_dLinkFreeTime = departure;
+   }
+
+   uint64_t delivery = uint64_t(departure) + m_Config.usDelay;
+   if (m_Config.usJitter > 0)
+      delivery += uint64_t(random() * m_Config.usJitter);
+
+   if ((m_Config.dReorderRate > 0) && (random() < m_Config.dReorderRate))
+   {
+      // hold this one back; packets behind it overtake it
+      delivery += m_Config.usReorderDelay;
+   }
+   else
+   {
+      // jitter alone does not reorder packets
+      if (delivery < m_ullLastDelivery)
+         delivery = m_ullLastDelivery;
+      m_ullLastDelivery = delivery;
+   }
+
+   // convert into network order in a private copy, the caller's packet is left untouched
+   CEmuPacket p;
+   p.m_iLength = size;
+   p.m_pcData = new char[size];
+   packet.encodeHeader((uint32_t*)p.m_pcData);
+   if (packet.getFlag())
+      packet.encodeControl(p.m_pcData + CPacket::m_iPktHdrSize);
+   else
+      memcpy(p.m_pcData + CPacket::m_iPktHdrSize, packet.m_pcData, packet.getLength());
+   memcpy(&p.m_Addr, addr, m_iSockAddrSize);
+
+   m_Queue.insert(pair<uint64_t, CEmuPacket>(delivery, p));
+
+   #ifndef WIN32
+      pthread_cond_signal(&m_QueueCond);
+   #else
+      SetEvent(m_QueueCond);
+   #endif
+
+   return size;
+}
+
+bool CEmuChannel::lose() const
+{
+   if (m_Config.dGEGoodToBad > 0)
+   {
+      // two-state Markov chain for bursty loss
+      if (m_bBadState)
+      {
+         if (random() < m_Config.dGEBadToGood)
+            m_bBadState = false;
+      }
+      else if (random() < m_Config.dGEGoodToBad)
+         m_bBadState = true;
+
+      return random() < (m_bBadState ? m_Config.dGELossBad : m_Config.dLossRate);
+   }
+
+   return (m_Config.dLossRate > 0) && (random() < m_Config.dLossRate);
+}
+
+double CEmuChannel::random() const
+{
+   // xorshift64*, private to this channel so that runs with the same seed are repeatable
+   m_ullRandState ^= m_ullRandState >> 12;
+   m_ullRandState ^= m_ullRandState << 25;
+   m_ullRandState ^= m_ullRandState >> 27;
+   return double((m_ullRandState * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+}
+
+#ifndef WIN32
+   void* CEmuChannel::worker(void* param)
+#else
+   DWORD WINAPI CEmuChannel::worker(LPVOID param)
+#endif
+{
+   CEmuChannel* self = (CEmuChannel*)param;
+
+   CGuard::enterCS(self->m_QueueLock);
+
+   while (!self->m_bClosing)
+   {
+      if (self->m_Queue.empty())
+      {
+         #ifndef WIN32
+            pthread_cond_wait(&self->m_QueueCond, &self->m_QueueLock);
+         #else
+            CGuard::leaveCS(self->m_QueueLock);
+            WaitForSingleObject(self->m_QueueCond, INFINITE);
+            CGuard::enterCS(self->m_QueueLock);
+         #endif
+         continue;
+      }
+
+      uint64_t currtime = CTimer::getTime();
+      multimap<uint64_t, CEmuPacket>::iterator i = self->m_Queue.begin();
+
+      if (i->first > currtime)
+      {
+         // wait until the head is due, or a new packet arrives
+         #ifndef WIN32
+            timespec timeout;
+            timeout.tv_sec = i->first / 1000000;
+            timeout.tv_nsec = (i->first % 1000000) * 1000;
+            pthread_cond_timedwait(&self->m_QueueCond, &self->m_QueueLock, &timeout);
+         #else
+            DWORD wait = DWORD((i->first - currtime) / 1000);
+            CGuard::leaveCS(self->m_QueueLock);
+            WaitForSingleObject(self->m_QueueCond, wait);
+            CGuard::enterCS(self->m_QueueLock);
+         #endif
+         continue;
+      }
+
+      CEmuPacket p = i->second;
+      self->m_Queue.erase(i);
+
+      CGuard::leaveCS(self->m_QueueLock);
+      ::sendto(self->m_iSocket, p.m_pcData, p.m_iLength, 0, (sockaddr*)&p.m_Addr, self->m_iSockAddrSize);
+      delete [] p.m_pcData;
+      CGuard::enterCS(self->m_QueueLock);
+   }
+
+   CGuard::leaveCS(self->m_QueueLock);
+
+   #ifndef WIN32
+      return NULL;
+   #else
+      return 0;
+   #endif
+}
@@ -0,0 +1,145 @@
+/*****************************************************************************
+Copyright (c) 2001 - 2011, The Board of Trustees of the University of Illinois.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above
+  copyright notice, this list of conditions and the
+  following disclaimer.
+
+* Redistributions in binary form must reproduce the
+  above copyright notice, this list of conditions
+  and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the University of Illinois
+  nor the names of its contributors may be used to
+  endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#ifndef __UDT_NETEM_H__
+#define __UDT_NETEM_H__
+
+
+#include <map>
+#include "udt.h"
+#include "common.h"
+#include "channel.h"
+
+// 网络仿真通道：装饰CChannel的发送路径，在发送端注入时延、抖动、丢包、乱序和带宽限制
+// Impairments are applied on egress only; each direction of a loopback test is
+// shaped by the multiplexer that sends it.
+class CEmuChannel: public CChannel
+{
+public:
+   CEmuChannel(int version, const CNetEmuConfig& config);
+   virtual ~CEmuChannel();
+
+      // Functionality:
+      //    Check if a configuration asks for any impairment at all.
+      // Parameters:
+      //    0) [in] config: the emulation parameters.
+      // Returned value:
+      //    true if at least one impairment is enabled, otherwise false.
+
+   // 是否开启了任何一种网络仿真
+   static bool isEnabled(const CNetEmuConfig& config);
+
+      // Functionality:
+      //    Validate the emulation parameters.
+      // Parameters:
+      //    0) [in] config: the emulation parameters.
+      // Returned value:
+      //    true if all values are in range, otherwise false.
+
+   // 检查仿真参数是否合法
+   static bool isValid(const CNetEmuConfig& config);
+
+      // Functionality:
+      //    Start the delivery thread of the emulated link.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   // 创建发送线程，UDP通道打开后调用
+   void start();
+
+      // Functionality:
+      //    Stop the delivery thread, discard the queued packets and close the UDP entity.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   // 停止发送线程并关闭UDP套接字
+   virtual void close() const;
+
+      // Functionality:
+      //    Pass a packet through the emulated link towards the given address.
+      // Parameters:
+      //    0) [in] addr: pointer to the destination address.
+      //    1) [in] packet: reference to a CPacket entity, it is not modified.
+      // Returned value:
+      //    Size of the packet, as if it had been sent, or -1 if the channel is closed.
+
+   // 数据包进入仿真链路，由发送线程在到期后真正发出
+   virtual int sendto(const sockaddr* addr, CPacket& packet) const;
+
+private:
+   struct CEmuPacket
+   {
+      char* m_pcData;                   // packet in network order, header included
+      int m_iLength;                    // size of m_pcData
+      sockaddr_in6 m_Addr;              // destination address, large enough for both IPv4 and IPv6
+   };
+
+   // 根据Bernoulli或Gilbert-Elliott模型决定是否丢弃当前包
+   bool lose() const;
+   // 生成[0, 1)之间的伪随机数
+   double random() const;
+
+   #ifndef WIN32
+      static void* worker(void* param);
+   #else
+      static DWORD WINAPI worker(LPVOID param);
+   #endif
+
+private:
+   CNetEmuConfig m_Config;              // emulation parameters
+
+   pthread_t m_WorkerThread;            // delivery thread
+   mutable pthread_mutex_t m_QueueLock; // protects the fields below
+   mutable pthread_cond_t m_QueueCond;  // signaled on new packets and on close
+
+   // 按投递时间排序的待发送队列，时间相同则保持先进先出
+   mutable std::multimap<uint64_t, CEmuPacket> m_Queue;   // packets on the emulated link, keyed by delivery time (us)
+   mutable uint64_t m_ullRandState;     // state of the xorshift random generator
+   mutable bool m_bBadState;            // current state of the Gilbert-Elliott model
+   mutable double m_dLinkFreeTime;      // time the bottleneck finishes serializing the last packet (us)
+   mutable uint64_t m_ullLastDelivery;  // latest in-order delivery time, keeps jitter from reordering packets
+   mutable volatile bool m_bClosing;    // if the channel is being closed
+
+private:
+   CEmuChannel(const CEmuChannel&);
+   CEmuChannel& operator=(const CEmuChannel&);
+};
+
+
+#endif
@@ -143,13 +143,25 @@ written by
 //      the original sequence numbers in the field.
 
 
+#ifndef WIN32
+   #include <arpa/inet.h>
+#else
+   #include <winsock2.h>
+#endif
 #include <cstring>
+#if defined(__SSSE3__)
+   #include <tmmintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+   #include <emmintrin.h>
+   #define UDT_SSE2_SWAP
+#endif
 #include "packet.h"
 
 
 const int CPacket::m_iPktHdrSize = 16;
 // 握手报文固定大小
 const int CHandShake::m_iContentSize = 48;
+const int CHandShake::m_iExtSize = 24;
 
 
 // Set up the aliases in the constructure
@@ -393,6 +405,58 @@ CPacket* CPacket::clone() const
    return pkt;
 }
 
+void CPacket::swapWords(uint32_t* dst, const uint32_t* src, int n)
+{
+   int i = 0;
+
+   // x86 is little endian, so every word needs its bytes reversed; do four at a time
+   // x86为小端序，每个字都需要反转字节序，一次处理4个字
+   #if defined(__SSSE3__)
+      const __m128i mask = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+      for (; i + 4 <= n; i += 4)
+      {
+         __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+         _mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(v, mask));
+      }
+   #elif defined(UDT_SSE2_SWAP)
+      for (; i + 4 <= n; i += 4)
+      {
+         __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+         // swap the bytes of each 16-bit half, then swap the two halves
+         v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+         v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+         _mm_storeu_si128((__m128i*)(dst + i), v);
+      }
+   #endif
+
+   for (; i < n; ++ i)
+      dst[i] = htonl(src[i]);
+}
+
+void CPacket::encodeHeader(uint32_t* wire) const
+{
+   swapWords(wire, m_nHeader, 4);
+}
+
+void CPacket::encodeControl(char* wire) const
+{
+   int len = getLength();
+   swapWords((uint32_t*)wire, (const uint32_t*)m_pcData, len / 4);
+
+   // a trailing partial word is sent as it is
+   // 不足一个字的尾部按原样发送
+   if (0 != (len & 3))
+      memcpy(wire + (len & ~3), m_pcData + (len & ~3), len & 3);
+}
+
+void CPacket::decode()
+{
+   swapWords(m_nHeader, m_nHeader, 4);
+
+   if (getFlag())
+      swapWords((uint32_t*)m_pcData, (const uint32_t*)m_pcData, getLength() / 4);
+}
+
 CHandShake::CHandShake():
 m_iVersion(0),
 m_iType(0),
@@ -401,10 +465,15 @@ m_iMSS(0),
 m_iFlightFlagSize(0),
 m_iReqType(0),
 m_iID(0),
-m_iCookie(0)
+m_iCookie(0),
+m_iExtFlags(0),
+m_iTicketTime(0),
+m_iTicketSerial(0),
+m_iTicketAge(0)
 {
    for (int i = 0; i < 4; ++ i)
       m_piPeerIP[i] = 0;
+   m_piTicketMAC[0] = m_piTicketMAC[1] = 0;
 }
 
 // 握手报文封包
@@ -413,6 +482,8 @@ int CHandShake::serialize(char* buf, int& size)
    if (size < m_iContentSize)
       return -1;
 
+   int size_in = size;
+
    int32_t* p = (int32_t*)buf;
    *p++ = m_iVersion;
    *p++ = m_iType;
@@ -427,6 +498,17 @@ int CHandShake::serialize(char* buf, int& size)
 
    size = m_iContentSize;
 
+   if ((0 != m_iExtFlags) && (size + m_iExtSize <= size_in))
+   {
+      *p++ = m_iExtFlags;
+      *p++ = m_iTicketTime;
+      *p++ = m_iTicketSerial;
+      *p++ = m_iTicketAge;
+      *p++ = m_piTicketMAC[0];
+      *p++ = m_piTicketMAC[1];
+      size += m_iExtSize;
+   }
+
    return 0;
 }
 
@@ -447,5 +529,19 @@ int CHandShake::deserialize(const char* buf, int size)
    for (int i = 0; i < 4; ++ i)
       m_piPeerIP[i] = *p++;
 
+   // peers without resumption send the 48 bytes only
+   // 不支持会话恢复的对端只发送48byte
+   if (size >= m_iContentSize + m_iExtSize)
+   {
+      m_iExtFlags = *p++;
+      m_iTicketTime = *p++;
+      m_iTicketSerial = *p++;
+      m_iTicketAge = *p++;
+      m_piTicketMAC[0] = *p++;
+      m_piTicketMAC[1] = *p++;
+   }
+   else
+      m_iExtFlags = 0;
+
    return 0;
 }
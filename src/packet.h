@@ -57,6 +57,7 @@ class CChannel;
 class CPacket
 {
 friend class CChannel;
+friend class CEmuChannel;
 friend class CSndQueue;
 friend class CRcvQueue;
 
@@ -202,6 +203,48 @@ public:
    // 复制报文，包含包头和负载
    CPacket* clone() const;
 
+      // Functionality:
+      //    Convert 32-bit words between host and network order; the conversion is its own inverse.
+      // Parameters:
+      //    0) [out] dst: converted words, may be the same as src.
+      //    1) [in] src: words to be converted.
+      //    2) [in] n: number of words.
+      // Returned value:
+      //    None.
+
+   // 主机字节序与网络字节序互转，使用SIMD一次转换多个字
+   static void swapWords(uint32_t* dst, const uint32_t* src, int n);
+
+      // Functionality:
+      //    Serialize the packet header into network order in a separate buffer.
+      // Parameters:
+      //    0) [out] wire: buffer of m_iPktHdrSize bytes.
+      // Returned value:
+      //    None.
+
+   // 将包头按网络字节序写入单独的缓冲区，不修改报文本身
+   void encodeHeader(uint32_t* wire) const;
+
+      // Functionality:
+      //    Serialize the control information of a control packet into network order in a separate buffer.
+      // Parameters:
+      //    0) [out] wire: buffer of getLength() bytes.
+      // Returned value:
+      //    None.
+
+   // 将控制报文的控制信息按网络字节序写入单独的缓冲区
+   void encodeControl(char* wire) const;
+
+      // Functionality:
+      //    Convert a packet just received from network order into host order, in place.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   // 将刚收到的报文就地转换为主机字节序
+   void decode();
+
 protected:
    // 128bit的自定义包头
    uint32_t m_nHeader[4];               // The 128-bit header field
@@ -218,20 +261,26 @@ protected:
 
 ////////////////////////////////////////////////////////////////////////////////
 
-// 握手报文，固定大小：48byte
+// 握手报文，固定大小：48byte；启用会话恢复时后跟20byte的扩展
 class CHandShake
 {
 public:
    CHandShake();
 
-   // 按固定格式封包
+   // 按固定格式封包，扩展标志非0时追加扩展
    int serialize(char* buf, int& size);
-   // 解包
+   // 解包，报文足够长时读取扩展
    int deserialize(const char* buf, int size);
 
 public:
    // 握手报文固定大小48byte
    static const int m_iContentSize;	// Size of hand shake data
+   // 会话恢复扩展大小20byte
+   static const int m_iExtSize;		// Size of the resumption extension following the hand shake data
+
+   // 扩展标志
+   static const int32_t m_iExtTicket = 1;	// request: a ticket is presented; response: a new ticket is issued
+   static const int32_t m_iExtEarlyData = 2;	// request: early data follows the extension; response: the early data was accepted
 
 public:
    // UDT版本号，共有四个版本
@@ -252,6 +301,17 @@ public:
    int32_t m_iCookie;		// cookie
    // 对端IP地址
    uint32_t m_piPeerIP[4];	// The IP address that the peer's UDP port is bound to
+
+   // 会话恢复扩展，0表示没有扩展
+   int32_t m_iExtFlags;		// resumption extension flags, 0 if the extension is absent
+   // 票据签发时间，监听端时钟，单位秒
+   int32_t m_iTicketTime;	// ticket issue time, in seconds on the listener's clock
+   // 票据序号，使同一秒内签发给同一地址的票据互不相同
+   int32_t m_iTicketSerial;	// serial number of the ticket on the listener, makes every ticket unique
+   // 客户端收到票据后经过的时间，单位毫秒
+   int32_t m_iTicketAge;		// request only: milliseconds since the client received the ticket
+   // 票据认证码
+   uint32_t m_piTicketMAC[2];	// ticket authenticator
 };
 
 
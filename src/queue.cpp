@@ -263,16 +263,250 @@ CUnit* CUnitQueue::getNextAvailUnit()
 }
 
 
+CSndRateLimiter::CSndRateLimiter():
+m_Total(),
+m_bEnabled(false)
+{
+   memset(m_aClass, 0, sizeof(m_aClass));
+}
+
+CSndRateLimiter::~CSndRateLimiter()
+{
+   delete [] m_Total.m_pTagHeap;
+   for (int i = 0; i < UDT_RATECLASS_NUM; ++ i)
+      delete [] m_aClass[i].m_pTagHeap;
+}
+
+void CSndRateLimiter::setRate(int cls, int64_t bandwidth)
+{
+   CBucket& b = (UDT_RATECLASS_ALL == cls) ? m_Total : m_aClass[cls];
+
+   b.m_llRate = (bandwidth > 0) ? bandwidth : 0;
+   // the sending worker may oversleep by up to 10ms (see CTimer::sleepto), so the
+   // bucket holds 20ms worth of data to keep the rate through a late wakeup
+   b.m_dBurst = b.m_llRate / 50.0;
+   if (b.m_dBurst < 65536)
+      b.m_dBurst = 65536;
+   b.m_dTokens = b.m_dBurst;
+   b.m_bSaturated = false;
+   CTimer::rdtsc(b.m_LastRefill);
+
+   m_bEnabled = (m_Total.m_llRate > 0);
+   for (int i = 0; i < UDT_RATECLASS_NUM; ++ i)
+      m_bEnabled = m_bEnabled || (m_aClass[i].m_llRate > 0);
+}
+
+int64_t CSndRateLimiter::getRate(int cls) const
+{
+   return (UDT_RATECLASS_ALL == cls) ? m_Total.m_llRate : m_aClass[cls].m_llRate;
+}
+
+uint64_t CSndRateLimiter::check(const CSNode* n, uint64_t currtime, bool& ahead)
+{
+   CBucket& c = m_aClass[n->m_iRateClass];
+   refill(m_Total, currtime);
+   refill(c, currtime);
+
+   bool aheadtotal = false, aheadlocal = false;
+   uint64_t total = getWait(m_Total, n->m_adVirtualTag[0], n->m_iSndWeight, currtime, aheadtotal);
+   uint64_t local = getWait(c, n->m_adVirtualTag[1], n->m_iSndWeight, currtime, aheadlocal);
+   ahead = (aheadtotal || aheadlocal) && ((0 == total) || aheadtotal) && ((0 == local) || aheadlocal);
+   return (total > local) ? total : local;
+}
+
+void CSndRateLimiter::sync(const CSNode* n)
+{
+   // the smallest tags waiting are on top of the tag heaps; n itself has just left them
+   // 等待中的最小标签位于标签堆顶；n刚从堆中取出，也参与比较
+   double total = n->m_adVirtualTag[0];
+   if ((m_Total.m_iTagCount > 0) && (m_Total.m_pTagHeap[0]->m_adVirtualTag[0] < total))
+      total = m_Total.m_pTagHeap[0]->m_adVirtualTag[0];
+   CBucket& c = m_aClass[n->m_iRateClass];
+   double local = n->m_adVirtualTag[1];
+   if ((c.m_iTagCount > 0) && (c.m_pTagHeap[0]->m_adVirtualTag[1] < local))
+      local = c.m_pTagHeap[0]->m_adVirtualTag[1];
+
+   // the virtual time never goes back
+   if (total > m_Total.m_dVirtualTime)
+      m_Total.m_dVirtualTime = total;
+   if (local > c.m_dVirtualTime)
+      c.m_dVirtualTime = local;
+}
+
+void CSndRateLimiter::charge(CSNode* n, int size)
+{
+   charge(m_Total, n->m_adVirtualTag[0], n->m_iSndWeight, size);
+   charge(m_aClass[n->m_iRateClass], n->m_adVirtualTag[1], n->m_iSndWeight, size);
+}
+
+void CSndRateLimiter::join(CSNode* n)
+{
+   m_Total.m_llWeight += n->m_iSndWeight;
+   m_aClass[n->m_iRateClass].m_llWeight += n->m_iSndWeight;
+
+   // the tags of a socket only change while it is off the list (see charge()), so the heaps stay ordered
+   tagPush(m_Total, n, 0);
+   tagPush(m_aClass[n->m_iRateClass], n, 1);
+}
+
+void CSndRateLimiter::leave(CSNode* n)
+{
+   m_Total.m_llWeight -= n->m_iSndWeight;
+   m_aClass[n->m_iRateClass].m_llWeight -= n->m_iSndWeight;
+
+   tagRemove(m_Total, n, 0);
+   tagRemove(m_aClass[n->m_iRateClass], n, 1);
+}
+
+void CSndRateLimiter::refill(CBucket& b, uint64_t currtime)
+{
+   if ((0 == b.m_llRate) || (currtime <= b.m_LastRefill))
+      return;
+
+   b.m_dTokens += (currtime - b.m_LastRefill) / double(CTimer::getCPUFrequency()) * b.m_llRate / 1000000.0;
+   if (b.m_dTokens >= b.m_dBurst)
+   {
+      // demand is below the rate: no need to share
+      b.m_dTokens = b.m_dBurst;
+      b.m_bSaturated = false;
+   }
+   b.m_LastRefill = currtime;
+}
+
+uint64_t CSndRateLimiter::getWait(const CBucket& b, double tag, int weight, uint64_t currtime, bool& ahead) const
+{
+   if (0 == b.m_llRate)
+      return 0;
+
+   // the socket is off the list, so its own weight is not in m_llWeight
+   double us = 0;
+   if (b.m_dTokens < 0)
+      us = -b.m_dTokens * 1000000.0 / b.m_llRate;
+   else if (b.m_bSaturated && (tag - b.m_dVirtualTime > m_iQuantum))
+   {
+      us = (tag - b.m_dVirtualTime - m_iQuantum) * (b.m_llWeight + weight) * 1000000.0 / b.m_llRate;
+      ahead = true;
+   }
+   else
+      return 0;
+
+   return currtime + uint64_t(us * CTimer::getCPUFrequency()) + 1;
+}
+
+void CSndRateLimiter::charge(CBucket& b, double& tag, int weight, int size)
+{
+   if (0 == b.m_llRate)
+      return;
+
+   b.m_dTokens -= size;
+   if (b.m_dTokens <= 0)
+      b.m_bSaturated = true;
+
+   // a socket that has been idle starts from the current virtual time
+   if (tag < b.m_dVirtualTime)
+      tag = b.m_dVirtualTime;
+   tag += double(size) / weight;
+}
+
+void CSndRateLimiter::tagPush(CBucket& b, CSNode* n, int k)
+{
+   // 标签堆已满，成倍增加
+   if (b.m_iTagCount == b.m_iTagSize)
+   {
+      int size = (b.m_iTagSize > 0) ? b.m_iTagSize * 2 : 64;
+      CSNode** temp = NULL;
+
+      try
+      {
+         temp = new CSNode*[size];
+      }
+      catch(...)
+      {
+         // not tracked: the virtual time may only lag behind this socket's tag
+         n->m_aiTagLoc[k] = -1;
+         return;
+      }
+
+      if (b.m_iTagCount > 0)
+         memcpy(temp, b.m_pTagHeap, sizeof(CSNode*) * b.m_iTagCount);
+      delete [] b.m_pTagHeap;
+      b.m_pTagHeap = temp;
+      b.m_iTagSize = size;
+   }
+
+   int q = b.m_iTagCount ++;
+   while (q != 0)
+   {
+      int p = (q - 1) >> 1;
+      if (b.m_pTagHeap[p]->m_adVirtualTag[k] <= n->m_adVirtualTag[k])
+         break;
+
+      b.m_pTagHeap[q] = b.m_pTagHeap[p];
+      b.m_pTagHeap[q]->m_aiTagLoc[k] = q;
+      q = p;
+   }
+
+   b.m_pTagHeap[q] = n;
+   n->m_aiTagLoc[k] = q;
+}
+
+void CSndRateLimiter::tagRemove(CBucket& b, CSNode* n, int k)
+{
+   int q = n->m_aiTagLoc[k];
+   if (q < 0)
+      return;
+   n->m_aiTagLoc[k] = -1;
+
+   // move the last entry into the hole, then up or down
+   // 用最后一个节点填补空位，再上移或下移
+   CSNode* last = b.m_pTagHeap[-- b.m_iTagCount];
+   if (q == b.m_iTagCount)
+      return;
+
+   double tag = last->m_adVirtualTag[k];
+   while ((q != 0) && (b.m_pTagHeap[(q - 1) >> 1]->m_adVirtualTag[k] > tag))
+   {
+      int p = (q - 1) >> 1;
+      b.m_pTagHeap[q] = b.m_pTagHeap[p];
+      b.m_pTagHeap[q]->m_aiTagLoc[k] = q;
+      q = p;
+   }
+
+   int p = q * 2 + 1;
+   while (p < b.m_iTagCount)
+   {
+      if ((p + 1 < b.m_iTagCount) && (b.m_pTagHeap[p]->m_adVirtualTag[k] > b.m_pTagHeap[p + 1]->m_adVirtualTag[k]))
+         p ++;
+
+      if (tag <= b.m_pTagHeap[p]->m_adVirtualTag[k])
+         break;
+
+      b.m_pTagHeap[q] = b.m_pTagHeap[p];
+      b.m_pTagHeap[q]->m_aiTagLoc[k] = q;
+      q = p;
+      p = q * 2 + 1;
+   }
+
+   b.m_pTagHeap[q] = last;
+   last->m_aiTagLoc[k] = q;
+}
+
+
 CSndUList::CSndUList():
 m_pHeap(NULL),
 m_iArrayLength(4096),
 m_iLastEntry(-1),
+m_iReadyCount(0),
+m_Limiter(),
+m_llThrottled(0),
 m_ListLock(),
 m_pWindowLock(NULL),
 m_pWindowCond(NULL),
 m_pTimer(NULL)
 {
    m_pHeap = new CSNode*[m_iArrayLength];
+   for (int i = 0; i < UDT_PRIORITY_NUM; ++ i)
+      m_apReady[i] = NULL;
 
    #ifndef WIN32
       pthread_mutex_init(&m_ListLock, NULL);
@@ -332,6 +566,10 @@ void CSndUList::update(const CUDT* u, bool reschedule)
    // 获取UDT实例中的待发送数据
    CSNode* n = u->m_pSNode;
 
+   // 已在就绪环中，会尽快被发送
+   if (n->m_bReady)
+      return;
+
    // n->m_iHeapLoc >= 0说明该UDT实例的待发送数据已经存在于堆中
    if (n->m_iHeapLoc >= 0)
    {
@@ -362,40 +600,109 @@ int CSndUList::pop(sockaddr*& addr, CPacket& pkt)
    // lock_guard
    CGuard listguard(m_ListLock);
 
-   // 堆中没有数据，直接返回
-   if (-1 == m_iLastEntry)
-      return -1;
-
-   // no pop until the next schedulled time
    // 获取当前时间戳
    uint64_t ts;
    CTimer::rdtsc(ts);
-   // 如果当前时间戳比发送数据的时间戳小，说明尚未到待发送数据规划的调度时间，直接返回
-   if (ts < m_pHeap[0]->m_llTimeStamp){
+
+   // move the sockets that are due from the heap to the ready rings
+   // 将已到发送时间的套接字移入所属优先级的就绪环
+   while ((m_iLastEntry >= 0) && (m_pHeap[0]->m_llTimeStamp <= ts))
+   {
+      CSNode* n = m_pHeap[0];
+      heapRemove_(n);
+      n->m_llTimeStamp = ts;
+      ringPush_(n, false);
+   }
+
+   // no pop until the next schedulled time
+   // 没有到期的套接字，直接返回
+   if (0 == m_iReadyCount)
       return -1;
+
+   // serve the highest priority class, round robin by deficit within the class
+   // 服务最高优先级的就绪环，同一优先级内按差额轮询
+   int prio = 0;
+   while (NULL == m_apReady[prio])
+      ++ prio;
+
+   // a lower class that has waited too long is served once, so it is never starved completely
+   // 低优先级等待过久时服务一次，避免完全饿死
+   uint64_t starved = m_iStarveTime * CTimer::getCPUFrequency();
+   for (int i = UDT_PRIORITY_NUM - 1; i > prio; -- i)
+   {
+      if ((NULL != m_apReady[i]) && (ts > m_apReady[i]->m_llTimeStamp + starved))
+      {
+         prio = i;
+         break;
+      }
    }
 
-   // 获取堆顶元素对应的UDT实例
-   CUDT* u = m_pHeap[0]->m_pUDT;
-   // 删除堆顶元素
-   remove_(u);
+   CSNode* n = m_apReady[prio];
+   while (n->m_iDeficit <= 0)
+   {
+      n->m_iDeficit += n->m_pUDT->m_iMSS * n->m_iSndWeight;
+      n = m_apReady[prio] = n->m_pNext;
+   }
+
+   // 将选中的套接字从就绪环中取出
+   CUDT* u = n->m_pUDT;
+   ringRemove_(n);
+   m_Limiter.leave(n);
 
    // 如果连接异常，说明无法发送数据，直接返回
    if (!u->m_bConnected || u->m_bBroken)
       return -1;
 
+   // hold the socket back while its rate limit buckets are in debt
+   // 限速令牌不足或超出加权份额时推迟发送
+   if (m_Limiter.isEnabled())
+   {
+      bool ahead = false;
+      uint64_t wait = m_Limiter.check(n, ts, ahead);
+      if (ahead)
+      {
+         // the virtual time may be stale: catch it up with the sockets still waiting and check again
+         m_Limiter.sync(n);
+         wait = m_Limiter.check(n, ts, ahead);
+      }
+      if (wait > 0)
+      {
+         ++ m_llThrottled;
+         insert_(wait, u);
+         return -1;
+      }
+   }
+
    // pack a packet from the socket
    // 数据打包，并计算下一次调度的时间
    if (u->packData(pkt, ts) <= 0)
       return -1;
 
+   int size = pkt.getLength() + CPacket::m_iPktHdrSize;
+   n->m_iDeficit -= size;
+   if (m_Limiter.isEnabled())
+      m_Limiter.charge(n, size);
+
    // 取出UDT实例对应的对端地址
    addr = u->m_pPeerAddr;
 
    // insert a new entry, ts is the next processing time
-   // 如果计算得到的 ts 大于 0，表示还有剩余时间，根据下一次调度时间，重新将数据放入堆中
+   // 如果计算得到的 ts 大于 0，表示还有剩余时间，根据下一次调度时间，重新将数据放入列表中
    if (ts > 0)
-      insert_(ts, u);
+   {
+      uint64_t currtime;
+      CTimer::rdtsc(currtime);
+      if (ts <= currtime)
+      {
+         // still due: keep the turn while the deficit lasts, otherwise go to the back of the ring
+         // 仍然就绪：差额未用完时继续本轮发送，否则排到就绪环末尾
+         n->m_llTimeStamp = ts;
+         m_Limiter.join(n);
+         ringPush_(n, n->m_iDeficit > 0);
+      }
+      else
+         insert_(ts, u);
+   }
 
    return 1;
 }
@@ -408,12 +715,30 @@ void CSndUList::remove(const CUDT* u)
    remove_(u);
 }
 
+void CSndUList::setRate(int cls, int64_t bandwidth)
+{
+   CGuard listguard(m_ListLock);
+
+   m_Limiter.setRate(cls, bandwidth);
+}
+
+int64_t CSndUList::getRate(int cls)
+{
+   CGuard listguard(m_ListLock);
+
+   return m_Limiter.getRate(cls);
+}
+
 // 下一次调度时间，即堆顶元素的发送时间戳
 uint64_t CSndUList::getNextProcTime()
 {
    // lock_guard
    CGuard listguard(m_ListLock);
-   
+
+   // 有就绪的套接字，立即处理
+   if (m_iReadyCount > 0)
+      return 1;
+
    // 堆为空，直接返回
    if (-1 == m_iLastEntry)
       return 0;
@@ -424,51 +749,35 @@ uint64_t CSndUList::getNextProcTime()
 
 void CSndUList::insert_(int64_t ts, const CUDT* u)
 {
-   // std::cout << "insert_ : ts : " << ts << std::endl;
-
    // 取出UDT实例中的待发送数据
    CSNode* n = u->m_pSNode;
 
    // do not insert repeated node
-   // 如果待发送数据已经存在于堆中，则直接返回
-   if (n->m_iHeapLoc >= 0)
+   // 如果待发送数据已经存在于列表中，则直接返回
+   if ((n->m_iHeapLoc >= 0) || n->m_bReady)
       return;
 
-   // 插入数据到堆中
-   m_iLastEntry ++;
-   m_pHeap[m_iLastEntry] = n;
-   n->m_llTimeStamp = ts;
+   bool empty = (-1 == m_iLastEntry) && (0 == m_iReadyCount);
 
-   // 堆排序，按时间戳进行小根堆排序,堆顶节点一定是时间戳最小的节点
-   int q = m_iLastEntry;
-   int p = q;
-   while (p != 0)
-   {
-      p = (q - 1) >> 1;
-      if (m_pHeap[p]->m_llTimeStamp > m_pHeap[q]->m_llTimeStamp)
-      {
-         CSNode* t = m_pHeap[p];
-         m_pHeap[p] = m_pHeap[q];
-         m_pHeap[q] = t;
-         t->m_iHeapLoc = q;
-         q = p;
-      }
-      else
-         break;
-   }
+   // count the socket in the weighted share of its rate class; class, weight and priority
+   // take effect when the socket enters the list
+   n->m_iRateClass = u->m_iRateClass;
+   n->m_iSndWeight = u->m_iSndWeight;
+   n->m_iPriority = u->m_iPriority;
+   n->m_iDeficit = 0;
+   m_Limiter.join(n);
 
-   // 更新堆索引
-   n->m_iHeapLoc = q;
+   // 插入数据到堆中
+   heapPush_(n, ts);
 
    // an earlier event has been inserted, wake up sending worker
    // 新插入的数据比堆顶的时间戳都要早，需要立即发送
-   if (n->m_iHeapLoc == 0){
+   if (n->m_iHeapLoc == 0)
       m_pTimer->interrupt();
-   }
 
    // first entry, activate the sending queue
-   // 当堆中没有数据时，唤醒发送线程，执行退出操作
-   if (0 == m_iLastEntry)
+   // 列表原本为空时，唤醒等待中的发送线程
+   if (empty)
    {
       #ifndef WIN32
          pthread_mutex_lock(m_pWindowLock);
@@ -485,41 +794,15 @@ void CSndUList::remove_(const CUDT* u)
    // 获取UDT实例待发送数据
    CSNode* n = u->m_pSNode;
 
-   // UDT实例中的待发送数据仍然在堆中
+   // UDT实例中的待发送数据仍然在堆或就绪环中
    if (n->m_iHeapLoc >= 0)
-   {
-      // remove the node from heap
-      // 从堆中删除该节点
-      m_pHeap[n->m_iHeapLoc] = m_pHeap[m_iLastEntry];
-      m_iLastEntry --;
-      m_pHeap[n->m_iHeapLoc]->m_iHeapLoc = n->m_iHeapLoc;
-
-      // 删除元素后重新调整堆结构
-      int q = n->m_iHeapLoc;
-      int p = q * 2 + 1;
-      while (p <= m_iLastEntry)
-      {
-         if ((p + 1 <= m_iLastEntry) && (m_pHeap[p]->m_llTimeStamp > m_pHeap[p + 1]->m_llTimeStamp))
-            p ++;
-
-         if (m_pHeap[q]->m_llTimeStamp > m_pHeap[p]->m_llTimeStamp)
-         {
-            CSNode* t = m_pHeap[p];
-            m_pHeap[p] = m_pHeap[q];
-            m_pHeap[p]->m_iHeapLoc = p;
-            m_pHeap[q] = t;
-            m_pHeap[q]->m_iHeapLoc = q;
-
-            q = p;
-            p = q * 2 + 1;
-         }
-         else
-            break;
-      }
+      heapRemove_(n);
+   else if (n->m_bReady)
+      ringRemove_(n);
+   else
+      return;
 
-      // 更新待发送数据在堆中的位置，-1表示不在堆中
-      n->m_iHeapLoc = -1;
-   }
+   m_Limiter.leave(n);
 
    // the only event has been deleted, wake up immediately
    // 堆中数据为空？？？
@@ -527,12 +810,216 @@ void CSndUList::remove_(const CUDT* u)
       m_pTimer->interrupt();
 }
 
+void CSndUList::heapPush_(CSNode* n, uint64_t ts)
+{
+   m_iLastEntry ++;
+   m_pHeap[m_iLastEntry] = n;
+   n->m_llTimeStamp = ts;
+
+   // 堆排序，按时间戳进行小根堆排序,堆顶节点一定是时间戳最小的节点
+   int q = m_iLastEntry;
+   while (q != 0)
+   {
+      int p = (q - 1) >> 1;
+      if (m_pHeap[p]->m_llTimeStamp <= m_pHeap[q]->m_llTimeStamp)
+         break;
+
+      CSNode* t = m_pHeap[p];
+      m_pHeap[p] = m_pHeap[q];
+      m_pHeap[q] = t;
+      t->m_iHeapLoc = q;
+      q = p;
+   }
+
+   // 更新堆索引
+   n->m_iHeapLoc = q;
+}
+
+void CSndUList::heapRemove_(CSNode* n)
+{
+   // remove the node from heap: move the last entry into its place
+   // 从堆中删除该节点，用最后一个节点填补其位置
+   int q = n->m_iHeapLoc;
+   m_pHeap[q] = m_pHeap[m_iLastEntry];
+   m_iLastEntry --;
+   n->m_iHeapLoc = -1;
+   if (q > m_iLastEntry)
+      return;
+   m_pHeap[q]->m_iHeapLoc = q;
+
+   // the moved entry may need to go either up or down
+   // 删除元素后重新调整堆结构，被移动的节点可能需要上移或下移
+   while ((q != 0) && (m_pHeap[(q - 1) >> 1]->m_llTimeStamp > m_pHeap[q]->m_llTimeStamp))
+   {
+      int p = (q - 1) >> 1;
+      CSNode* t = m_pHeap[p];
+      m_pHeap[p] = m_pHeap[q];
+      m_pHeap[p]->m_iHeapLoc = p;
+      m_pHeap[q] = t;
+      m_pHeap[q]->m_iHeapLoc = q;
+      q = p;
+   }
+
+   int p = q * 2 + 1;
+   while (p <= m_iLastEntry)
+   {
+      if ((p + 1 <= m_iLastEntry) && (m_pHeap[p]->m_llTimeStamp > m_pHeap[p + 1]->m_llTimeStamp))
+         p ++;
+
+      if (m_pHeap[q]->m_llTimeStamp <= m_pHeap[p]->m_llTimeStamp)
+         break;
+
+      CSNode* t = m_pHeap[p];
+      m_pHeap[p] = m_pHeap[q];
+      m_pHeap[p]->m_iHeapLoc = p;
+      m_pHeap[q] = t;
+      m_pHeap[q]->m_iHeapLoc = q;
+
+      q = p;
+      p = q * 2 + 1;
+   }
+}
+
+void CSndUList::ringPush_(CSNode* n, bool front)
+{
+   CSNode*& head = m_apReady[n->m_iPriority];
+   if (NULL == head)
+   {
+      n->m_pPrev = n->m_pNext = n;
+      head = n;
+   }
+   else
+   {
+      // the tail of the ring is right before its head
+      n->m_pNext = head;
+      n->m_pPrev = head->m_pPrev;
+      head->m_pPrev->m_pNext = n;
+      head->m_pPrev = n;
+      if (front)
+         head = n;
+   }
+
+   n->m_bReady = true;
+   ++ m_iReadyCount;
+}
+
+void CSndUList::ringRemove_(CSNode* n)
+{
+   CSNode*& head = m_apReady[n->m_iPriority];
+   if (n->m_pNext == n)
+      head = NULL;
+   else
+   {
+      n->m_pPrev->m_pNext = n->m_pNext;
+      n->m_pNext->m_pPrev = n->m_pPrev;
+      if (head == n)
+         head = n->m_pNext;
+   }
+
+   n->m_pPrev = n->m_pNext = NULL;
+   n->m_bReady = false;
+   -- m_iReadyCount;
+}
+
+
+
+//
+CMuxTrace::CMuxTrace():
+m_Lock(),
+m_pEvents(NULL),
+m_iSize(0),
+m_iHead(0),
+m_iCount(0),
+m_bEnabled(false)
+{
+   #ifndef WIN32
+      pthread_mutex_init(&m_Lock, NULL);
+   #else
+      m_Lock = CreateMutex(NULL, false, NULL);
+   #endif
+}
+
+CMuxTrace::~CMuxTrace()
+{
+   #ifndef WIN32
+      pthread_mutex_destroy(&m_Lock);
+   #else
+      CloseHandle(m_Lock);
+   #endif
+
+   delete [] m_pEvents;
+}
+
+void CMuxTrace::setSize(int size)
+{
+   CGuard traceguard(m_Lock);
+
+   m_bEnabled = false;
+   delete [] m_pEvents;
+   m_pEvents = NULL;
+   m_iSize = m_iHead = m_iCount = 0;
+
+   if (size > 0)
+   {
+      m_pEvents = new CMuxEvent[size];
+      m_iSize = size;
+      m_bEnabled = true;
+   }
+}
+
+void CMuxTrace::record_(int type, int64_t value)
+{
+   CGuard traceguard(m_Lock);
+
+   // the trace may have been disabled after the unlocked check
+   // 加锁前的检查不可靠，这里再检查一次
+   if (0 == m_iSize)
+      return;
+
+   // overwrite the oldest event when the ring is full
+   // 写满后覆盖最早的事件
+   int pos = (m_iHead + m_iCount) % m_iSize;
+   if (m_iCount == m_iSize)
+      m_iHead = (m_iHead + 1) % m_iSize;
+   else
+      ++ m_iCount;
+
+   m_pEvents[pos].usTimeStamp = CTimer::getTime();
+   m_pEvents[pos].iType = type;
+   m_pEvents[pos].llValue = value;
+}
+
+int CMuxTrace::read(CMuxEvent* events, int len)
+{
+   CGuard traceguard(m_Lock);
+
+   int n = (len < m_iCount) ? len : m_iCount;
+   for (int i = 0; i < n; ++ i)
+      events[i] = m_pEvents[(m_iHead + i) % m_iSize];
+
+   if (n > 0)
+   {
+      m_iHead = (m_iHead + n) % m_iSize;
+      m_iCount -= n;
+   }
+
+   return n;
+}
+
 //
 CSndQueue::CSndQueue():
 m_WorkerThread(),
 m_pSndUList(NULL),
 m_pChannel(NULL),
 m_pTimer(NULL),
+m_pTrace(NULL),
+m_llSent(0),
+m_llSentDirect(0),
+m_llSendFailed(0),
+m_llIdleWaits(0),
+m_llSleeps(0),
+m_llOversleepTotal(0),
+m_llOversleepMax(0),
 m_WindowLock(),
 m_WindowCond(),
 m_bClosing(false),
@@ -574,12 +1061,14 @@ CSndQueue::~CSndQueue()
 }
 
 // 初始化，创建了一个发送数据的工作线程
-void CSndQueue::init(CChannel* c, CTimer* t)
+void CSndQueue::init(CChannel* c, CTimer* t, CMuxTrace* trace)
 {
    // 关联UDP通道
    m_pChannel = c;
    // 关联定时器
    m_pTimer = t;
+   // 关联事件跟踪
+   m_pTrace = trace;
    // 创建发送列表
    m_pSndUList = new CSndUList;
    m_pSndUList->m_pWindowLock = &m_WindowLock;
@@ -625,8 +1114,24 @@ void CSndQueue::init(CChannel* c, CTimer* t)
          uint64_t currtime;
          CTimer::rdtsc(currtime);
          if (currtime < ts)
+         {
             self->m_pTimer->sleepto(ts);  // 休眠
 
+            // measure how late the worker woke up
+            // 统计实际唤醒时间比计划时间晚了多少
+            ++ self->m_llSleeps;
+            CTimer::rdtsc(currtime);
+            if (currtime > ts)
+            {
+               int64_t late = int64_t((currtime - ts) / CTimer::getCPUFrequency());
+               self->m_llOversleepTotal += late;
+               if (late > self->m_llOversleepMax)
+                  self->m_llOversleepMax = late;
+               if (late > 0)
+                  self->m_pTrace->record(UDT_MUX_SND_OVERSLEEP, late);
+            }
+         }
+
          // 发送数据
          // it is time to send the next pkt
          sockaddr* addr;
@@ -636,7 +1141,12 @@ void CSndQueue::init(CChannel* c, CTimer* t)
             continue;
 
          // 通过UDP通道发送数据
-         self->m_pChannel->sendto(addr, pkt);
+         if (self->m_pChannel->sendto(addr, pkt) < 0)
+         {
+            ++ self->m_llSendFailed;
+            self->m_pTrace->record(UDT_MUX_SND_FAIL, pkt.m_iID);
+         }
+         ++ self->m_llSent;
       }
       // 没有数据需要发送，休眠
       else
@@ -645,10 +1155,16 @@ void CSndQueue::init(CChannel* c, CTimer* t)
          // 等待条件变量m_WindowCond
          #ifndef WIN32
             pthread_mutex_lock(&self->m_WindowLock);
-            if (!self->m_bClosing && (self->m_pSndUList->m_iLastEntry < 0))
+            if (!self->m_bClosing && (self->m_pSndUList->m_iLastEntry < 0) && (0 == self->m_pSndUList->m_iReadyCount))
+            {
+               ++ self->m_llIdleWaits;
+               self->m_pTrace->record(UDT_MUX_SND_IDLE, 0);
                pthread_cond_wait(&self->m_WindowCond, &self->m_WindowLock);
+            }
             pthread_mutex_unlock(&self->m_WindowLock);
          #else
+            ++ self->m_llIdleWaits;
+            self->m_pTrace->record(UDT_MUX_SND_IDLE, 0);
             WaitForSingleObject(self->m_WindowCond, INFINITE);
          #endif
       }
@@ -666,112 +1182,177 @@ void CSndQueue::init(CChannel* c, CTimer* t)
 int CSndQueue::sendto(const sockaddr* addr, CPacket& packet)
 {
    // send out the packet immediately (high priority), this is a control packet
-   m_pChannel->sendto(addr, packet);
+   if (m_pChannel->sendto(addr, packet) < 0)
+   {
+      ++ m_llSendFailed;
+      m_pTrace->record(UDT_MUX_SND_FAIL, packet.m_iID);
+   }
+   ++ m_llSentDirect;
    return packet.getLength();
 }
 
+void CSndQueue::getStats(CMuxStats& stats) const
+{
+   stats.pktSent = m_llSent;
+   stats.pktSentDirect = m_llSentDirect;
+   stats.pktSendFailed = m_llSendFailed;
+   stats.sndIdleWaits = m_llIdleWaits;
+   stats.sndTimerSleeps = m_llSleeps;
+   stats.usSndOversleepTotal = m_llOversleepTotal;
+   stats.usSndOversleepMax = m_llOversleepMax;
+   stats.sndListSize = m_pSndUList->m_iLastEntry + 1 + m_pSndUList->m_iReadyCount;
+   stats.sndListCapacity = m_pSndUList->m_iArrayLength;
+   stats.sndThrottled = m_pSndUList->m_llThrottled;
+}
+
 
 //
-CRcvUList::CRcvUList():
-m_pUList(NULL),
-m_pLast(NULL)
+CTimerWheel::CTimerWheel():
+m_Expired(),
+m_ullCurrTick(0),
+m_ullTickCycles(1000 * CTimer::getCPUFrequency())
 {
+   for (int i = 0; i < m_iSlots0; ++ i)
+      m_aSlot0[i].m_pPrev = m_aSlot0[i].m_pNext = &m_aSlot0[i];
+   for (int l = 0; l < m_iLevels - 1; ++ l)
+      for (int i = 0; i < m_iSlots1; ++ i)
+         m_aSlot[l][i].m_pPrev = m_aSlot[l][i].m_pNext = &m_aSlot[l][i];
+   m_Expired.m_pPrev = m_Expired.m_pNext = &m_Expired;
+
+   uint64_t currtime;
+   CTimer::rdtsc(currtime);
+   m_ullCurrTick = currtime / m_ullTickCycles;
 }
 
-CRcvUList::~CRcvUList()
+CTimerWheel::~CTimerWheel()
 {
 }
 
-void CRcvUList::insert(const CUDT* u)
+void CTimerWheel::schedule(const CUDT* u, uint64_t ts)
 {
    CRNode* n = u->m_pRNode;
-   CTimer::rdtsc(n->m_llTimeStamp);
+   if (NULL != n->m_pNext)
+      unlink_(n);
+
+   // round up, so that a timer is never checked before it expires, and never
+   // expire again within the current tick, so that pop() always comes to an end
+   n->m_llTimeStamp = (ts + m_ullTickCycles - 1) / m_ullTickCycles;
+   if (n->m_llTimeStamp <= m_ullCurrTick)
+      n->m_llTimeStamp = m_ullCurrTick + 1;
+   place_(n);
+}
 
-   if (NULL == m_pUList)
+void CTimerWheel::remove(const CUDT* u)
+{
+   CRNode* n = u->m_pRNode;
+   if (NULL != n->m_pNext)
+      unlink_(n);
+}
+
+CRNode* CTimerWheel::pop(uint64_t currtime)
+{
+   // 推进时间轮，将到期槽位中的节点移到到期链表
+   uint64_t tick = currtime / m_ullTickCycles;
+   while (m_ullCurrTick < tick)
    {
-      // empty list, insert as the single node
-      n->m_pPrev = n->m_pNext = NULL;
-      m_pLast = m_pUList = n;
+      ++ m_ullCurrTick;
 
-      return;
+      // a lower level has wrapped around: bring the entries of the next turn down
+      // 低一层转完一圈，将高层对应槽位中的节点下移
+      uint64_t t = m_ullCurrTick / m_iSlots0;
+      for (int l = 0; (l < m_iLevels - 1) && (0 == m_ullCurrTick % (m_iSlots0 * (uint64_t(1) << (6 * l)))); ++ l, t /= m_iSlots1)
+         cascade_(&m_aSlot[l][t % m_iSlots1]);
+
+      CRNode* slot = &m_aSlot0[m_ullCurrTick % m_iSlots0];
+      while (slot->m_pNext != slot)
+      {
+         CRNode* n = slot->m_pNext;
+         unlink_(n);
+         link_(&m_Expired, n);
+      }
    }
 
-   // always insert at the end for RcvUList
-   n->m_pPrev = m_pLast;
-   n->m_pNext = NULL;
-   m_pLast->m_pNext = n;
-   m_pLast = n;
+   if (m_Expired.m_pNext == &m_Expired)
+      return NULL;
+
+   CRNode* n = m_Expired.m_pNext;
+   unlink_(n);
+   return n;
 }
 
-void CRcvUList::remove(const CUDT* u)
+void CTimerWheel::place_(CRNode* n)
 {
-   CRNode* n = u->m_pRNode;
+   uint64_t t = n->m_llTimeStamp;
+   if (t <= m_ullCurrTick)
+   {
+      link_(&m_Expired, n);
+      return;
+   }
 
-   if (!n->m_bOnList)
+   uint64_t delta = t - m_ullCurrTick;
+   if (delta < uint64_t(m_iSlots0))
+   {
+      link_(&m_aSlot0[t % m_iSlots0], n);
       return;
+   }
 
-   if (NULL == n->m_pPrev)
+   // find the level whose turn covers the deadline; farther ones wait in the last slot reachable
+   uint64_t span = m_iSlots0;
+   int l = 0;
+   while ((l < m_iLevels - 2) && (delta >= span * m_iSlots1))
    {
-      // n is the first node
-      m_pUList = n->m_pNext;
-      if (NULL == m_pUList)
-         m_pLast = NULL;
-      else
-         m_pUList->m_pPrev = NULL;
+      span *= m_iSlots1;
+      ++ l;
    }
-   else
+   if (delta >= span * m_iSlots1)
    {
-      n->m_pPrev->m_pNext = n->m_pNext;
-      if (NULL == n->m_pNext)
-      {
-         // n is the last node
-         m_pLast = n->m_pPrev;
-      }
-      else
-         n->m_pNext->m_pPrev = n->m_pPrev;
+      t = m_ullCurrTick + span * m_iSlots1 - 1;
+      n->m_llTimeStamp = t;
    }
 
-   n->m_pNext = n->m_pPrev = NULL;
+   link_(&m_aSlot[l][(t / span) % m_iSlots1], n);
 }
 
-// 更新一个UDT实例，将其调整到链表的末尾
-void CRcvUList::update(const CUDT* u)
+void CTimerWheel::cascade_(CRNode* slot)
 {
-   CRNode* n = u->m_pRNode;
-
-   if (!n->m_bOnList)
-      return;
-
-   CTimer::rdtsc(n->m_llTimeStamp);
-
-   // if n is the last node, do not need to change
-   // 已经是最后一个节点了，不必进行调整
-   if (NULL == n->m_pNext)
+   // detach the slot first, as an entry may go back into the same slot
+   CRNode list;
+   if (slot->m_pNext == slot)
       return;
+   list.m_pNext = slot->m_pNext;
+   list.m_pPrev = slot->m_pPrev;
+   list.m_pNext->m_pPrev = list.m_pPrev->m_pNext = &list;
+   slot->m_pPrev = slot->m_pNext = slot;
 
-   // 当前节点是第一个节点的情况
-   if (NULL == n->m_pPrev)
-   {
-      m_pUList = n->m_pNext;
-      m_pUList->m_pPrev = NULL;
-   }
-   // 当前节点是中间节点的情况
-   else
+   while (list.m_pNext != &list)
    {
-      n->m_pPrev->m_pNext = n->m_pNext;
-      n->m_pNext->m_pPrev = n->m_pPrev;
+      CRNode* n = list.m_pNext;
+      unlink_(n);
+      place_(n);
    }
+}
+
+void CTimerWheel::link_(CRNode* slot, CRNode* n)
+{
+   // append to the tail of the ring
+   n->m_pNext = slot;
+   n->m_pPrev = slot->m_pPrev;
+   slot->m_pPrev->m_pNext = n;
+   slot->m_pPrev = n;
+}
 
-   n->m_pPrev = m_pLast;
-   n->m_pNext = NULL;
-   m_pLast->m_pNext = n;
-   m_pLast = n;
+void CTimerWheel::unlink_(CRNode* n)
+{
+   n->m_pPrev->m_pNext = n->m_pNext;
+   n->m_pNext->m_pPrev = n->m_pPrev;
+   n->m_pNext = n->m_pPrev = NULL;
 }
 
 //
 CHash::CHash():
 m_pBucket(NULL),
-m_iHashSize(0)
+m_iHashSize(0),
+m_iCount(0)
 {
 }
 
@@ -826,6 +1407,7 @@ void CHash::insert(int32_t id, CUDT* u)
    n->m_pNext = b;
 
    m_pBucket[id % m_iHashSize] = n;
+   ++ m_iCount;
 }
 
 void CHash::remove(int32_t id)
@@ -843,6 +1425,7 @@ void CHash::remove(int32_t id)
             p->m_pNext = b->m_pNext;
 
          delete b;
+         -- m_iCount;
 
          return;
       }
@@ -852,10 +1435,17 @@ void CHash::remove(int32_t id)
    }
 }
 
+void CHash::getStats(int& size, int& count) const
+{
+   size = m_iHashSize;
+   count = m_iCount;
+}
+
 
 // 会合模式
 CRendezvousQueue::CRendezvousQueue():
-m_lRendezvousID(),
+m_mConnectors(),
+m_mTimers(),
 m_RIDVectorLock()
 {
    #ifndef WIN32
@@ -873,15 +1463,8 @@ CRendezvousQueue::~CRendezvousQueue()
       CloseHandle(m_RIDVectorLock);
    #endif
 
-   for (list<CRL>::iterator i = m_lRendezvousID.begin(); i != m_lRendezvousID.end(); ++ i)
-   {
-      if (AF_INET == i->m_iIPversion)
-         delete (sockaddr_in*)i->m_pPeerAddr;
-      else
-         delete (sockaddr_in6*)i->m_pPeerAddr;
-   }
-
-   m_lRendezvousID.clear();
+   m_mConnectors.clear();
+   m_mTimers.clear();
 }
 
 void CRendezvousQueue::insert(const UDTSOCKET& id, CUDT* u, int ipv, const sockaddr* addr, uint64_t ttl)
@@ -889,104 +1472,145 @@ void CRendezvousQueue::insert(const UDTSOCKET& id, CUDT* u, int ipv, const socka
    // lock_gaurd
    CGuard vg(m_RIDVectorLock);
 
-   // 向list中插入一个UDT实例
-   CRL r;
+   map<UDTSOCKET, CRL>::iterator i = m_mConnectors.find(id);
+   if (i != m_mConnectors.end())
+   {
+      m_mTimers.erase(i->second.m_Timer);
+      m_mConnectors.erase(i);
+   }
+
+   // 插入一个UDT实例，第一次重传在250ms之后
+   CRL& r = m_mConnectors[id];
    r.m_iID = id;
    r.m_pUDT = u;
    r.m_iIPversion = ipv;
-   r.m_pPeerAddr = (AF_INET == ipv) ? (sockaddr*)new sockaddr_in : (sockaddr*)new sockaddr_in6;
-   memcpy(r.m_pPeerAddr, addr, (AF_INET == ipv) ? sizeof(sockaddr_in) : sizeof(sockaddr_in6));
+   memcpy(&r.m_PeerAddr, addr, (AF_INET == ipv) ? sizeof(sockaddr_in) : sizeof(sockaddr_in6));
    r.m_ullTTL = ttl;
+   r.m_ullInterval = m_ullMinInterval;
+   r.m_Timer = m_mTimers.end();
 
-   m_lRendezvousID.push_back(r);
+   schedule(r, CTimer::getTime() + m_ullMinInterval);
 }
 
 void CRendezvousQueue::remove(const UDTSOCKET& id)
 {
    CGuard vg(m_RIDVectorLock);
 
-   for (list<CRL>::iterator i = m_lRendezvousID.begin(); i != m_lRendezvousID.end(); ++ i)
-   {
-      if (i->m_iID == id)
-      {
-         if (AF_INET == i->m_iIPversion)
-            delete (sockaddr_in*)i->m_pPeerAddr;
-         else
-            delete (sockaddr_in6*)i->m_pPeerAddr;
-
-         m_lRendezvousID.erase(i);
+   map<UDTSOCKET, CRL>::iterator i = m_mConnectors.find(id);
+   if (i == m_mConnectors.end())
+      return;
 
-         return;
-      }
-   }
+   m_mTimers.erase(i->second.m_Timer);
+   m_mConnectors.erase(i);
 }
 
 CUDT* CRendezvousQueue::retrieve(const sockaddr* addr, UDTSOCKET& id)
 {
    CGuard vg(m_RIDVectorLock);
 
-   // TODO: optimize search
-   for (list<CRL>::iterator i = m_lRendezvousID.begin(); i != m_lRendezvousID.end(); ++ i)
+   // a response carries the ID of the connecting socket
+   // 响应报文携带了发起连接的套接字ID，直接查找
+   if (0 != id)
+   {
+      map<UDTSOCKET, CRL>::iterator i = m_mConnectors.find(id);
+      if ((i != m_mConnectors.end()) && CIPAddress::ipcmp(addr, (const sockaddr*)&i->second.m_PeerAddr, i->second.m_iIPversion))
+         return i->second.m_pUDT;
+
+      return NULL;
+   }
+
+   // the first rendezvous request from the peer only has its address
+   // 会合模式下对端的第一个请求只能按地址匹配
+   for (map<UDTSOCKET, CRL>::iterator i = m_mConnectors.begin(); i != m_mConnectors.end(); ++ i)
    {
-      if (CIPAddress::ipcmp(addr, i->m_pPeerAddr, i->m_iIPversion) && ((0 == id) || (id == i->m_iID)))
+      if (CIPAddress::ipcmp(addr, (const sockaddr*)&i->second.m_PeerAddr, i->second.m_iIPversion))
       {
-         id = i->m_iID;
-         return i->m_pUDT;
+         id = i->first;
+         return i->second.m_pUDT;
       }
    }
 
    return NULL;
 }
 
+void CRendezvousQueue::expedite(const UDTSOCKET& id)
+{
+   CGuard vg(m_RIDVectorLock);
+
+   map<UDTSOCKET, CRL>::iterator i = m_mConnectors.find(id);
+   if (i == m_mConnectors.end())
+      return;
+
+   i->second.m_ullInterval = m_ullMinInterval;
+   schedule(i->second, 0);
+}
+
 void CRendezvousQueue::updateConnStatus()
 {
-   if (m_lRendezvousID.empty())
+   if (m_mTimers.empty())
       return;
 
    CGuard vg(m_RIDVectorLock);
 
-   for (list<CRL>::iterator i = m_lRendezvousID.begin(); i != m_lRendezvousID.end(); ++ i)
+   uint64_t now = CTimer::getTime();
+
+   while (!m_mTimers.empty() && (m_mTimers.begin()->first <= now))
    {
-      // avoid sending too many requests, at most 1 request per 250ms
-      // 避免发送太多连接请求，每250ms最多发送1个请求
-      if (CTimer::getTime() - i->m_pUDT->m_llLastReqTime > 250000)
+      map<UDTSOCKET, CRL>::iterator i = m_mConnectors.find(m_mTimers.begin()->second);
+      if (i == m_mConnectors.end())
       {
-         // 已达到ttl时间
-         if (CTimer::getTime() >= i->m_ullTTL)
-         {
-            // connection timer expired, acknowledge app via epoll
-            // 更新连接状态，以及epoll中该套接字的状态
-            i->m_pUDT->m_bConnecting = false;
-            CUDT::s_UDTUnited.m_EPoll.update_events(i->m_iID, i->m_pUDT->m_sPollID, UDT_EPOLL_ERR, true);
-            continue;
-         }
+         m_mTimers.erase(m_mTimers.begin());
+         continue;
+      }
+      CRL& r = i->second;
 
-         // 创建连接请求数据包
-         CPacket request;
-         char* reqdata = new char [i->m_pUDT->m_iPayloadSize];
-         // 握手报文封包
-         request.pack(0, NULL, reqdata, i->m_pUDT->m_iPayloadSize);
-         // ID = 0, connection request
-         request.m_iID = !i->m_pUDT->m_bRendezvous ? 0 : i->m_pUDT->m_ConnRes.m_iID;
-         int hs_size = i->m_pUDT->m_iPayloadSize;
-         // 握手报文序列化，即按固定格式封包
-         i->m_pUDT->m_ConnReq.serialize(reqdata, hs_size);
-         request.setLength(hs_size);
-         // 握手报文需要通过UDP立即发送到对端,不经过发送缓冲区
-         i->m_pUDT->m_pSndQueue->sendto(i->m_pPeerAddr, request);
-         i->m_pUDT->m_llLastReqTime = CTimer::getTime();
-         delete [] reqdata;
+      // 已达到ttl时间
+      if (now >= r.m_ullTTL)
+      {
+         // connection timer expired, acknowledge app via epoll or the waiting connect()
+         // 连接超时，通知应用
+         CUDT* u = r.m_pUDT;
+         m_mTimers.erase(r.m_Timer);
+         m_mConnectors.erase(i);
+         u->connectFailed(1);
+         continue;
       }
+
+      // 重发连接请求，会合连接发往对端套接字，否则ID为0
+      r.m_pUDT->sendConnReq((const sockaddr*)&r.m_PeerAddr, !r.m_pUDT->m_bRendezvous ? 0 : r.m_pUDT->m_ConnRes.m_iID);
+
+      // exponential backoff, but the request is always checked again when it expires
+      // 指数退避，过期时间点一定会再检查一次
+      uint64_t next = now + r.m_ullInterval;
+      if (next > r.m_ullTTL)
+         next = r.m_ullTTL;
+      r.m_ullInterval *= 2;
+      if (r.m_ullInterval > m_ullMaxInterval)
+         r.m_ullInterval = m_ullMaxInterval;
+      schedule(r, next);
    }
 }
 
+void CRendezvousQueue::schedule(CRL& r, uint64_t next)
+{
+   if (r.m_Timer != m_mTimers.end())
+      m_mTimers.erase(r.m_Timer);
+   r.m_Timer = m_mTimers.insert(make_pair(next, r.m_iID));
+}
+
 CRcvQueue::CRcvQueue():
 m_WorkerThread(),
 m_UnitQueue(),
-m_pRcvUList(NULL),
+m_pTimerWheel(NULL),
 m_pHash(NULL),
 m_pChannel(NULL),
 m_pTimer(NULL),
+m_pTrace(NULL),
+m_llRecvCalls(0),
+m_llRecv(0),
+m_llDropped(0),
+m_llNoSocket(0),
+m_llTimerChecks(0),
 m_iPayloadSize(),
 m_bClosing(false),
 m_ExitCond(),
@@ -994,19 +1618,12 @@ m_LSLock(),
 m_pListener(NULL),
 m_pRendezvousQueue(NULL),
 m_vNewEntry(),
-m_IDLock(),
-m_mBuffer(),
-m_PassLock(),
-m_PassCond()
+m_IDLock()
 {
    #ifndef WIN32
-      pthread_mutex_init(&m_PassLock, NULL);
-      pthread_cond_init(&m_PassCond, NULL);
       pthread_mutex_init(&m_LSLock, NULL);
       pthread_mutex_init(&m_IDLock, NULL);
    #else
-      m_PassLock = CreateMutex(NULL, false, NULL);
-      m_PassCond = CreateEvent(NULL, false, false, NULL);
       m_LSLock = CreateMutex(NULL, false, NULL);
       m_IDLock = CreateMutex(NULL, false, NULL);
       m_ExitCond = CreateEvent(NULL, false, false, NULL);
@@ -1020,36 +1637,20 @@ CRcvQueue::~CRcvQueue()
    #ifndef WIN32
       if (0 != m_WorkerThread)
          pthread_join(m_WorkerThread, NULL);
-      pthread_mutex_destroy(&m_PassLock);
-      pthread_cond_destroy(&m_PassCond);
       pthread_mutex_destroy(&m_LSLock);
       pthread_mutex_destroy(&m_IDLock);
    #else
       if (NULL != m_WorkerThread)
          WaitForSingleObject(m_ExitCond, INFINITE);
       CloseHandle(m_WorkerThread);
-      CloseHandle(m_PassLock);
-      CloseHandle(m_PassCond);
       CloseHandle(m_LSLock);
       CloseHandle(m_IDLock);
       CloseHandle(m_ExitCond);
    #endif
 
-   delete m_pRcvUList;
+   delete m_pTimerWheel;
    delete m_pHash;
    delete m_pRendezvousQueue;
-
-   // remove all queued messages
-   for (map<int32_t, std::queue<CPacket*> >::iterator i = m_mBuffer.begin(); i != m_mBuffer.end(); ++ i)
-   {
-      while (!i->second.empty())
-      {
-         CPacket* pkt = i->second.front();
-         delete [] pkt->m_pcData;
-         delete pkt;
-         i->second.pop();
-      }
-   }
 }
 
 /*
@@ -1062,8 +1663,11 @@ CRcvQueue::~CRcvQueue()
    6. 初始化会合连接模式
    7. 创建接收数据的工作线程
  */
-void CRcvQueue::init(int qsize, int payload, int version, int hsize, CChannel* cc, CTimer* t)
+void CRcvQueue::init(int qsize, int payload, int version, int hsize, CChannel* cc, CTimer* t, CMuxTrace* trace)
 {
+   // 关联事件跟踪
+   m_pTrace = trace;
+
    // 数据包负载大小
    m_iPayloadSize = payload;
 
@@ -1079,7 +1683,7 @@ void CRcvQueue::init(int qsize, int payload, int version, int hsize, CChannel* c
    // 关联定时器
    m_pTimer = t;
    // UDT接收实例列表初始化
-   m_pRcvUList = new CRcvUList;
+   m_pTimerWheel = new CTimerWheel;
    // 会合连接模式
    m_pRendezvousQueue = new CRendezvousQueue;
 
@@ -1133,8 +1737,8 @@ void CRcvQueue::init(int qsize, int payload, int version, int hsize, CChannel* c
          CUDT* ne = self->getNewEntry();
          if (NULL != ne)
          {
-            // 插入到UDT接收实例列表
-            self->m_pRcvUList->insert(ne);
+            // 调度其定时器
+            self->m_pTimerWheel->schedule(ne, ne->getNextTimerTime());
             // 插入到哈希表
             self->m_pHash->insert(ne->m_SocketID, ne);
          }
@@ -1142,7 +1746,10 @@ void CRcvQueue::init(int qsize, int payload, int version, int hsize, CChannel* c
 
       // find next available slot for incoming packet
       // 从m_UnitQueue中获取一个空闲的数据单元
+      int unitqsize = self->m_UnitQueue.m_iSize;
       CUnit* unit = self->m_UnitQueue.getNextAvailUnit();
+      if (self->m_UnitQueue.m_iSize != unitqsize)
+         self->m_pTrace->record(UDT_MUX_RCV_GROW, self->m_UnitQueue.m_iSize);
       // 接收缓冲区已满，则跳过这个数据包
       if (NULL == unit)
       {
@@ -1150,7 +1757,12 @@ void CRcvQueue::init(int qsize, int payload, int version, int hsize, CChannel* c
          CPacket temp;
          temp.m_pcData = new char[self->m_iPayloadSize];
          temp.setLength(self->m_iPayloadSize);
-         self->m_pChannel->recvfrom(addr, temp);
+         ++ self->m_llRecvCalls;
+         if (self->m_pChannel->recvfrom(addr, temp) >= 0)
+         {
+            ++ self->m_llDropped;
+            self->m_pTrace->record(UDT_MUX_RCV_DROP, self->m_UnitQueue.m_iSize);
+         }
          delete [] temp.m_pcData;
          goto TIMER_CHECK;
       }
@@ -1161,8 +1773,10 @@ void CRcvQueue::init(int qsize, int payload, int version, int hsize, CChannel* c
 
       // reading next incoming packet, recvfrom returns -1 is nothing has been received
       // 接收出错
+      ++ self->m_llRecvCalls;
       if (self->m_pChannel->recvfrom(addr, unit->m_Packet) < 0)
          goto TIMER_CHECK;
+      ++ self->m_llRecv;
 
       // 获取数据包的id
       id = unit->m_Packet.m_iID;
@@ -1174,21 +1788,15 @@ void CRcvQueue::init(int qsize, int payload, int version, int hsize, CChannel* c
          // 监听模式，调用listen，创建新的UDT连接
          if (NULL != self->m_pListener){
             // std::cout << __func__ << " : " << __LINE__ << std::endl;
-            self->m_pListener->listen(addr, unit->m_Packet);
+            self->m_pListener->listen(addr, unit);
          }
          // 会合连接模式
          else if (NULL != (u = self->m_pRendezvousQueue->retrieve(addr, id)))
          {
-            // asynchronous connect: call connect here
-            // otherwise wait for the UDT socket to retrieve this packet
-            if (!u->m_bSynRecving){
-               // std::cout << __func__ << " : " << __LINE__ << std::endl;
-               u->connect(unit->m_Packet);
-            }
-            else{
-               // std::cout << __func__ << " : " << __LINE__ << std::endl;
-               self->storePkt(id, unit->m_Packet.clone());
-            }
+            // the handshake is driven here for both blocking and non-blocking connect
+            // 握手由工作线程处理，阻塞的connect()只等待结果；需要继续握手时立即发送下一个请求
+            if (u->connect(unit->m_Packet) > 0)
+               self->m_pRendezvousQueue->expedite(id);
          }
       }
       // id > 0, 说明这是一个数据包
@@ -1213,18 +1821,21 @@ void CRcvQueue::init(int qsize, int payload, int version, int hsize, CChannel* c
                   }
 
                   u->checkTimers();
-                  // 更新m_pRcvUList
-                  self->m_pRcvUList->update(u);
+                  // 重新调度其定时器
+                  self->m_pTimerWheel->schedule(u, u->getNextTimerTime());
                }
             }
          }
          // 会合连接模式
          else if (NULL != (u = self->m_pRendezvousQueue->retrieve(addr, id)))
          {
-            if (!u->m_bSynRecving)
-               u->connect(unit->m_Packet);
-            else
-               self->storePkt(id, unit->m_Packet.clone());
+            if (u->connect(unit->m_Packet) > 0)
+               self->m_pRendezvousQueue->expedite(id);
+         }
+         else
+         {
+            ++ self->m_llNoSocket;
+            self->m_pTrace->record(UDT_MUX_RCV_NOSOCKET, id);
          }
       }
 
@@ -1235,38 +1846,27 @@ TIMER_CHECK:
       uint64_t currtime;
       CTimer::rdtsc(currtime);
 
-      CRNode* ul = self->m_pRcvUList->m_pUList;
-      // 100ms的时间窗口
-      uint64_t ctime = currtime - 100000 * CTimer::getCPUFrequency();
-      // ul->m_llTimeStamp < ctime 说明这个UDT实例已经超过100ms没有更新了，需要进行检查
-      while ((NULL != ul) && (ul->m_llTimeStamp < ctime))
+      // only the sockets whose ACK or EXP timer has expired are checked
+      // 只处理定时器已到期的UDT实例
+      CRNode* ul;
+      while (NULL != (ul = self->m_pTimerWheel->pop(currtime)))
       {
          CUDT* u = ul->m_pUDT;
 
-         /*
-            检查连接状态
-            1. 连接正常，调用update()将当前节点移动到列表m_pRcvUList末尾
-            2. 连接异常，调用remove()从哈希表和m_pRcvUList列表中移除
-            3. 由于重新调整了m_pRcvUList，故需要重新获取m_pRcvUList的头节点
-         */
-
-         // 连接正常
+         // 连接正常，检查定时器并重新调度
          if (u->m_bConnected && !u->m_bBroken && !u->m_bClosing)
          {
+            ++ self->m_llTimerChecks;
             u->checkTimers();
-            self->m_pRcvUList->update(u);
+            self->m_pTimerWheel->schedule(u, u->getNextTimerTime());
          }
-         // 连接异常，则从哈希表和UDT接收实例列表中移除
+         // 连接异常，则从哈希表和时间轮中移除
          else
          {
-            // the socket must be removed from Hash table first, then RcvUList
+            // the socket must be removed from Hash table first, then the timer wheel
             self->m_pHash->remove(u->m_SocketID);
-            self->m_pRcvUList->remove(u);
             u->m_pRNode->m_bOnList = false;
          }
-
-         // 由于重新调整了m_pRcvUList，故需要重新获取m_pRcvUList的头节点
-         ul = self->m_pRcvUList->m_pUList;
       }
 
       // Check connection requests status for all sockets in the RendezvousQueue.
@@ -1288,86 +1888,20 @@ TIMER_CHECK:
    #endif
 }
 
-/*
-   从接收缓冲区中读取指定UDT套接字的packet
-   1. 先根据UDTSOCKET找到对应的packet队列
-   2. 从packet队列中获取最早的packet
-   3. 释放空间，返回数据包长度
-*/
-int CRcvQueue::recvfrom(int32_t id, CPacket& packet)
+void CRcvQueue::getStats(CMuxStats& stats) const
 {
-   CGuard bufferlock(m_PassLock);
-
-   // 从缓冲区中查找指定ID的packet队列
-   map<int32_t, std::queue<CPacket*> >::iterator i = m_mBuffer.find(id);
-
-   // 没有找到packet,在条件变量m_PassCond上休眠等待，最多等待大约1秒
-   if (i == m_mBuffer.end())
-   {
-      // 最多等待大约1秒
-      #ifndef WIN32
-         uint64_t now = CTimer::getTime();
-         timespec timeout;
-
-         timeout.tv_sec = now / 1000000 + 1;
-         timeout.tv_nsec = (now % 1000000) * 1000;
-
-         // 在条件变量m_PassCond上休眠等待，最多等待大约1秒
-         pthread_cond_timedwait(&m_PassCond, &m_PassLock, &timeout);
-      #else
-         ReleaseMutex(m_PassLock);
-         WaitForSingleObject(m_PassCond, 1000);
-         WaitForSingleObject(m_PassLock, INFINITE);
-      #endif
-
-      // 再次检查缓冲区中是否存在指定ID的packet
-      i = m_mBuffer.find(id);
-      // 不存在，返回-1
-      if (i == m_mBuffer.end())
-      {
-         packet.setLength(-1);
-         return -1;
-      }
-   }
-
-   // 到这一步，说明找到了对应的packet队列
-
-   // retrieve the earliest packet
-   // 获取最早的packet
-   CPacket* newpkt = i->second.front();
-
-   // 检查数据包长度，确保packet的容量足够大
-   if (packet.getLength() < newpkt->getLength())
-   {
-      packet.setLength(-1);
-      return -1;
-   }
-
-   // copy packet content
-   // 拷贝数据包
-   memcpy(packet.m_nHeader, newpkt->m_nHeader, CPacket::m_iPktHdrSize);
-   memcpy(packet.m_pcData, newpkt->m_pcData, newpkt->getLength());
-   packet.setLength(newpkt->getLength());
-
-   // 释放空间
-   delete [] newpkt->m_pcData;
-   delete newpkt;
-
-   // remove this message from queue, 
-   // if no more messages left for this socket, release its data structure
-   // 从packet队列中删除这个packet
-   i->second.pop();
-   // 如果这个packet队列中没有更多的packet，则删除这个packet队列
-   if (i->second.empty())
-      m_mBuffer.erase(i);
-
-   // 返回数据包长度
-   return packet.getLength();
+   stats.sysRecvCalls = m_llRecvCalls;
+   stats.pktRecv = m_llRecv;
+   stats.pktRecvDropped = m_llDropped;
+   stats.pktRecvNoSocket = m_llNoSocket;
+   stats.rcvTimerChecks = m_llTimerChecks;
+   stats.unitQueueSize = m_UnitQueue.m_iSize;
+   stats.unitQueueUsed = m_UnitQueue.m_iCount;
+   m_pHash->getStats(stats.hashSize, stats.hashEntries);
 }
 
 int CRcvQueue::setListener(CUDT* u)
 {
-   std::cout << "CRecvQueue::setListener()..." << std::endl;
    CGuard lslock(m_LSLock);
 
    if (NULL != m_pListener)
@@ -1393,20 +1927,6 @@ void CRcvQueue::registerConnector(const UDTSOCKET& id, CUDT* u, int ipv, const s
 void CRcvQueue::removeConnector(const UDTSOCKET& id)
 {
    m_pRendezvousQueue->remove(id);
-
-   CGuard bufferlock(m_PassLock);
-
-   map<int32_t, std::queue<CPacket*> >::iterator i = m_mBuffer.find(id);
-   if (i != m_mBuffer.end())
-   {
-      while (!i->second.empty())
-      {
-         delete [] i->second.front()->m_pcData;
-         delete i->second.front();
-         i->second.pop();
-      }
-      m_mBuffer.erase(i);
-   }
 }
 
 void CRcvQueue::setNewEntry(CUDT* u)
@@ -1437,37 +1957,3 @@ CUDT* CRcvQueue::getNewEntry()
    return u;
 }
 
-// 保存握手阶段的控制报文
-void CRcvQueue::storePkt(int32_t id, CPacket* pkt)
-{
-   // lock_guard
-   CGuard bufferlock(m_PassLock);   
-
-   // 查找指定的UDTSOCKET
-   map<int32_t, std::queue<CPacket*> >::iterator i = m_mBuffer.find(id);
-
-   // UDTSOCKET不存在，则创建一个新的队列
-   if (i == m_mBuffer.end())
-   {
-      m_mBuffer[id].push(pkt);
-
-      // 唤醒CRcvQueue::recvfrom，从接收缓冲区中取数据
-      #ifndef WIN32
-         pthread_cond_signal(&m_PassCond);
-      #else
-         SetEvent(m_PassCond);
-      #endif
-   }
-   // UDTSOCKET存在，向队尾添加packet
-   else
-   {
-      //avoid storing too many packets, in case of malfunction or attack
-      // 避免存储太多的packet，最多存储16个packets
-      // 队列m_mBuffer存储的是握手阶段的控制包，而不是数据包
-      // 限制为16可以避免对端短时间内快速创建多个连接，防止握手阶段的Dos攻击
-      if (i->second.size() > 16)
-         return;
-
-      i->second.push(pkt);
-   }
-}
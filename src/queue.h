@@ -159,8 +159,141 @@ struct CSNode
 
    // 堆节点索引
    int m_iHeapLoc;		// location on the heap, -1 means not on the heap
+
+   // 入堆时记录的限速类别和权重
+   int m_iRateClass;            // rate class charged while on the heap
+   int m_iSndWeight;            // sending weight counted while on the heap
+   // 加权公平调度的虚拟时间标签
+   double m_adVirtualTag[2];    // virtual finish tags in the aggregate and class rate limits
+   // 在限速器标签堆中的位置
+   int m_aiTagLoc[2];           // location on the tag heaps of the aggregate and class buckets, -1 if not on them
+
+   // 入堆时记录的优先级
+   int m_iPriority;             // priority class while on the list
+   // 就绪环中的差额轮询计数
+   int m_iDeficit;              // deficit round robin counter, in bytes
+   // 是否在就绪环中
+   bool m_bReady;               // if the node is on a ready ring
+   // 就绪环中的前后节点
+   CSNode* m_pPrev;             // previous node on the ready ring
+   CSNode* m_pNext;             // next node on the ready ring
+};
+
+// 多路复用器发送限速：所有套接字共享一个总令牌桶，每个类别另有一个令牌桶
+// Token buckets shared by all sockets of a multiplexer: one for the aggregate
+// and one per rate class. A bucket may go into debt by one packet; sockets are
+// held back until it is paid off. While a bucket is saturated, it is shared by
+// start-time fair queueing: every socket carries a virtual finish tag that
+// advances by size / weight, the bucket's virtual time is the smallest tag of
+// the sockets waiting to send, and a socket more than one quantum ahead of it
+// waits for the others.
+// All calls are made under the lock of the owning sending list; check() and
+// charge() are only called for a socket that has just been taken off the list.
+
+class CSndRateLimiter
+{
+public:
+   CSndRateLimiter();
+   ~CSndRateLimiter();
+
+public:
+
+      // Functionality:
+      //    Set the rate of a bucket.
+      // Parameters:
+      //    0) [in] cls: rate class, or UDT_RATECLASS_ALL for the aggregate.
+      //    1) [in] bandwidth: bytes per second, <= 0 for unlimited.
+      // Returned value:
+      //    None.
+
+   void setRate(int cls, int64_t bandwidth);
+   int64_t getRate(int cls) const;
+
+      // Functionality:
+      //    Check if a socket may send now.
+      // Parameters:
+      //    0) [in] n: the socket's node, holding its class, weight and tags.
+      //    1) [in] currtime: current CPU time.
+      //    2) [out] ahead: if the socket is held back only for being ahead of its share.
+      // Returned value:
+      //    0 if it may send, otherwise the CPU time to try again.
+
+   uint64_t check(const CSNode* n, uint64_t currtime, bool& ahead);
+
+      // Functionality:
+      //    Move the virtual time of the buckets of a socket up to the smallest tag waiting to send.
+      // Parameters:
+      //    0) [in] n: the socket's node.
+      // Returned value:
+      //    None.
+
+   void sync(const CSNode* n);
+
+      // Functionality:
+      //    Charge a sent packet to the buckets of a socket.
+      // Parameters:
+      //    0) [in, out] n: the socket's node; its virtual tags are advanced.
+      //    1) [in] size: bytes sent.
+      // Returned value:
+      //    None.
+
+   void charge(CSNode* n, int size);
+
+      // Functionality:
+      //    Count a socket in or out of the weighted share of its class.
+      // Parameters:
+      //    0) [in] n: the socket's node.
+      // Returned value:
+      //    None.
+
+   void join(CSNode* n);
+   void leave(CSNode* n);
+
+   bool isEnabled() const {return m_bEnabled;}
+
+private:
+   struct CBucket
+   {
+      int64_t m_llRate;         // bytes per second, 0 = unlimited
+      double m_dTokens;         // bytes available, negative when in debt
+      double m_dBurst;          // maximum tokens
+      uint64_t m_LastRefill;    // CPU time of the last refill
+      bool m_bSaturated;        // went into debt since the bucket was last full
+      int64_t m_llWeight;       // total weight of the sockets on the sending list
+      double m_dVirtualTime;    // smallest tag of the waiting sockets, in bytes per unit of weight
+      CSNode** m_pTagHeap;      // min-heap of the waiting sockets keyed by their tag in this bucket
+      int m_iTagCount;          // number of sockets on m_pTagHeap
+      int m_iTagSize;           // physical length of m_pTagHeap
+   };
+
+   void refill(CBucket& b, uint64_t currtime);
+   uint64_t getWait(const CBucket& b, double tag, int weight, uint64_t currtime, bool& ahead) const;
+   void charge(CBucket& b, double& tag, int weight, int size);
+
+   // 标签堆操作，k为标签下标：0为总限速，1为类别限速
+   void tagPush(CBucket& b, CSNode* n, int k);
+   void tagRemove(CBucket& b, CSNode* n, int k);
+
+private:
+   static const int m_iQuantum = 1500;          // bytes per unit of weight a socket may run ahead
+
+   CBucket m_Total;                             // aggregate bucket
+   CBucket m_aClass[UDT_RATECLASS_NUM];         // per-class buckets
+   bool m_bEnabled;                             // if any bucket has a rate
+
+private:
+   CSndRateLimiter(const CSndRateLimiter&);
+   CSndRateLimiter& operator=(const CSndRateLimiter&);
 };
 
+// 发送列表：尚未到发送时间的套接字放在按时间戳排序的小根堆中，到期后移入所属优先级的就绪环；
+// 总是先服务最高优先级的就绪环，同一优先级内按发送权重进行差额轮询（DRR）
+// Sockets not yet due wait on a min-heap keyed by their next sending time. Once
+// due they move to the ready ring of their priority class. pop() serves the
+// highest non-empty ring, and sockets of the same class share it by deficit
+// round robin with a quantum of one MSS per unit of UDT_SNDWEIGHT. A ring whose
+// head has been due for m_iStarveTime is served once ahead of higher classes.
+
 // 使用一个小根堆来存储待发送的数据，堆中的节点安装时间戳进行排序，堆顶节点一定是时间戳最小的节点
 // 小根堆的大小可以动态增大，调整方式是成倍增加
 class CSndUList
@@ -215,6 +348,17 @@ public:
    // 删除UDT实例
    void remove(const CUDT* u);
 
+      // Functionality:
+      //    Set or read the rate limit of a class (UDT_RATECLASS_ALL for the aggregate).
+      // Parameters:
+      //    0) [in] cls: rate class.
+      //    1) [in] bandwidth: bytes per second, <= 0 for unlimited.
+      // Returned value:
+      //    None / the limit, 0 if unlimited.
+
+   void setRate(int cls, int64_t bandwidth);
+   int64_t getRate(int cls);
+
       // Functionality:
       //    Retrieve the next scheduled processing time.
       // Parameters:
@@ -231,6 +375,13 @@ private:
    // 从堆中删除数据
    void remove_(const CUDT* u);
 
+   // 堆操作
+   void heapPush_(CSNode* n, uint64_t ts);
+   void heapRemove_(CSNode* n);
+   // 就绪环操作
+   void ringPush_(CSNode* n, bool front);
+   void ringRemove_(CSNode* n);
+
 private:
    // 待发送数据，使用一个小根堆来实现
    CSNode** m_pHeap;			// The heap array
@@ -239,6 +390,17 @@ private:
    // 最新一个节点的位置
    int m_iLastEntry;			// position of last entry on the heap array
 
+   // 各优先级的就绪环
+   CSNode* m_apReady[UDT_PRIORITY_NUM];	// head of the ready ring of each priority class
+   // 就绪环中的节点个数
+   int m_iReadyCount;			// number of nodes on the ready rings
+   // 低优先级最长等待时间，微秒
+   static const int m_iStarveTime = 100000;	// microseconds a lower class may wait behind a higher one
+
+   // 发送限速
+   CSndRateLimiter m_Limiter;		// multiplexer rate limit
+   int64_t m_llThrottled;		// times a socket was held back by m_Limiter
+
    // 同步访问保护
    pthread_mutex_t m_ListLock;
 
@@ -259,37 +421,47 @@ struct CRNode
 {
    // UDT接收实例
    CUDT* m_pUDT;                // Pointer to the instance of CUDT socket
-   // 时间戳
-   uint64_t m_llTimeStamp;      // Time Stamp
+   // 定时器到期时刻，单位为时间轮的刻度
+   uint64_t m_llTimeStamp;      // tick of the timer wheel the socket's next timer expires at
 
-   // 链表结构
-   CRNode* m_pPrev;             // previous link
-   CRNode* m_pNext;             // next link
+   // 时间轮槽位中的双向链表
+   CRNode* m_pPrev;             // previous link in the wheel slot
+   CRNode* m_pNext;             // next link in the wheel slot, NULL if not scheduled
 
-   // 当前节点是否已经在链表中
-   bool m_bOnList;              // if the node is already on the list
+   // 当前节点是否已经注册到接收队列
+   bool m_bOnList;              // if the socket is registered with the receiving queue
 };
 
-class CRcvUList
+// 接收队列的分层时间轮：按每个套接字下一个ACK/EXP定时器的到期时间调度，只处理到期的套接字
+// Hierarchical timer wheel of the receiving queue. Every registered socket is
+// scheduled at the deadline of its next ACK or EXP timer, so the receiving
+// worker only calls checkTimers() on the sockets whose timers have expired.
+// The first level has m_iSlots0 slots of one millisecond, each further level
+// has m_iSlots1 slots covering a whole turn of the level below; entries are
+// cascaded down one level each time the level below wraps around.
+// Only the receiving worker thread uses the wheel, so it needs no lock.
+
+class CTimerWheel
 {
 public:
-   CRcvUList();
-   ~CRcvUList();
+   CTimerWheel();
+   ~CTimerWheel();
 
 public:
 
       // Functionality:
-      //    Insert a new UDT instance to the list.
+      //    Schedule the timers of a UDT instance, moving it if it is already scheduled.
       // Parameters:
       //    1) [in] u: pointer to the UDT instance
+      //    2) [in] ts: CPU time of the next timer to expire
       // Returned value:
       //    None.
 
-   // 插入一个UDT实例
-   void insert(const CUDT* u);
+   // 调度一个UDT实例
+   void schedule(const CUDT* u, uint64_t ts);
 
       // Functionality:
-      //    Remove the UDT instance from the list.
+      //    Remove the UDT instance from the wheel.
       // Parameters:
       //    1) [in] u: pointer to the UDT instance
       // Returned value:
@@ -299,27 +471,39 @@ public:
    void remove(const CUDT* u);
 
       // Functionality:
-      //    Move the UDT instance to the end of the list, if it already exists; otherwise, do nothing.
+      //    Advance the wheel to the current time and take one UDT instance whose timer has expired.
       // Parameters:
-      //    1) [in] u: pointer to the UDT instance
+      //    1) [in] currtime: current CPU time
       // Returned value:
-      //    None.
+      //    The node of the expired instance, which is no longer scheduled, or NULL if none.
 
-   // 更新一个UDT实例，将其调整到链表的末尾
-   void update(const CUDT* u);
+   // 取出一个定时器已到期的UDT实例
+   CRNode* pop(uint64_t currtime);
 
-public:
-   // 接收队列的头节点
-   CRNode* m_pUList;		// the head node
+private:
+   void place_(CRNode* n);
+   void cascade_(CRNode* slot);
+   static void link_(CRNode* slot, CRNode* n);
+   static void unlink_(CRNode* n);
 
 private:
-   // 接收队列的尾节点
-   CRNode* m_pLast;		// the last node
+   static const int m_iSlots0 = 256;			// slots of the first level
+   static const int m_iSlots1 = 64;			// slots of each further level
+   static const int m_iLevels = 3;			// number of levels, one is the first level
+
+   // 每一层的槽位，每个槽位是一个带哨兵节点的环形链表
+   CRNode m_aSlot0[m_iSlots0];			// first level, one tick per slot
+   CRNode m_aSlot[m_iLevels - 1][m_iSlots1];	// further levels
+   // 已到期的节点
+   CRNode m_Expired;				// nodes whose timers have expired
+
+   // 当前刻度，及每个刻度对应的CPU时钟周期数
+   uint64_t m_ullCurrTick;			// the wheel has expired all entries up to this tick
+   uint64_t m_ullTickCycles;			// CPU cycles per tick
 
 private:
-   // 禁用拷贝构造和赋值运算符
-   CRcvUList(const CRcvUList&);
-   CRcvUList& operator=(const CRcvUList&);
+   CTimerWheel(const CTimerWheel&);
+   CTimerWheel& operator=(const CTimerWheel&);
 };
 
 class CHash
@@ -367,6 +551,16 @@ public:
 
    void remove(int32_t id);
 
+      // Functionality:
+      //    Read the size and occupancy of the hash table.
+      // Parameters:
+      //    1) [out] size: number of buckets
+      //    2) [out] count: number of entries
+      // Returned value:
+      //    None.
+
+   void getStats(int& size, int& count) const;
+
 private:
    struct CBucket
    {
@@ -377,6 +571,7 @@ private:
    } **m_pBucket;		// list of buckets (the hash table)
 
    int m_iHashSize;		// size of hash table
+   int m_iCount;		// number of entries in the table
 
 private:
    CHash(const CHash&);
@@ -398,6 +593,24 @@ public:
    // 检索一个UDT实例
    CUDT* retrieve(const sockaddr* addr, UDTSOCKET& id);
 
+      // Functionality:
+      //    Send the next handshake of a connector at the next update and restart its backoff.
+      // Parameters:
+      //    0) [in] id: UDT socket ID of the connector.
+      // Returned value:
+      //    None.
+
+   // 对端有响应：立即发送下一个握手报文，并重置退避间隔
+   void expedite(const UDTSOCKET& id);
+
+      // Functionality:
+      //    Retransmit the handshakes that are due and abort the requests that have expired.
+      //    Only the connectors whose timer has fired are visited.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
    // 更新连接状态
    void updateConnStatus();
 
@@ -411,14 +624,81 @@ private:
       // IPv4/IPv6
       int m_iIPversion;                 // IP version
       // 对端地址
-      sockaddr* m_pPeerAddr;		// UDT sonnection peer address
+      sockaddr_in6 m_PeerAddr;		// UDT sonnection peer address
       // 请求过期时间
       uint64_t m_ullTTL;			// the time that this request expires
+      // 当前重传间隔
+      uint64_t m_ullInterval;		// current handshake retransmission interval, doubled after each retransmission
+      // 在定时器表中的位置
+      std::multimap<uint64_t, UDTSOCKET>::iterator m_Timer;	// entry in m_mTimers
    };
-   // 处于rendezvous模式的UDT实例list
-   std::list<CRL> m_lRendezvousID;      // The sockets currently in rendezvous mode
+   // 正在建立连接的UDT实例，按套接字ID索引
+   std::map<UDTSOCKET, CRL> m_mConnectors;      // The sockets currently connecting, normal or rendezvous
+   // 下一次重传或过期的时间
+   std::multimap<uint64_t, UDTSOCKET> m_mTimers;        // next retransmission or expiration time of each connector
+
+   // 握手重传间隔：从250ms开始倍增，最大1s
+   static const uint64_t m_ullMinInterval = 250000;     // first retransmission interval, in microseconds
+   static const uint64_t m_ullMaxInterval = 1000000;    // largest retransmission interval, in microseconds
 
    pthread_mutex_t m_RIDVectorLock;
+
+private:
+   void schedule(CRL& r, uint64_t next);
+};
+
+// 多路复用器工作线程的事件环形缓冲区，默认关闭，写满后覆盖最早的事件
+class CMuxTrace
+{
+public:
+   CMuxTrace();
+   ~CMuxTrace();
+
+public:
+
+      // Functionality:
+      //    Enable, resize or disable the trace buffer. Events already recorded are dropped.
+      // Parameters:
+      //    1) [in] size: capacity in number of events, 0 disables the trace
+      // Returned value:
+      //    None.
+
+   void setSize(int size);
+
+      // Functionality:
+      //    Record an event if tracing is enabled.
+      // Parameters:
+      //    1) [in] type: event type, one of UDTMuxEvent
+      //    2) [in] value: event specific value
+      // Returned value:
+      //    None.
+
+   void record(int type, int64_t value) {if (m_bEnabled) record_(type, value);}
+
+      // Functionality:
+      //    Move the recorded events, oldest first, out of the buffer.
+      // Parameters:
+      //    1) [out] events: array to receive the events
+      //    2) [in] len: length of the array
+      // Returned value:
+      //    Number of events read.
+
+   int read(CMuxEvent* events, int len);
+
+private:
+   void record_(int type, int64_t value);
+
+private:
+   pthread_mutex_t m_Lock;
+   CMuxEvent* m_pEvents;		// the ring
+   int m_iSize;				// capacity of the ring
+   int m_iHead;				// position of the oldest event
+   int m_iCount;			// number of events in the ring
+   volatile bool m_bEnabled;		// if events are being recorded
+
+private:
+   CMuxTrace(const CMuxTrace&);
+   CMuxTrace& operator=(const CMuxTrace&);
 };
 
 class CSndQueue
@@ -437,11 +717,12 @@ public:
       // Parameters:
       //    1) [in] c: UDP channel to be associated to the queue
       //    2) [in] t: Timer
+      //    3) [in] trace: event trace of the multiplexer
       // Returned value:
       //    None.
 
    // 初始化，创建了一个发送数据的工作线程
-   void init(CChannel* c, CTimer* t);
+   void init(CChannel* c, CTimer* t, CMuxTrace* trace);
 
       // Functionality:
       //    Send out a packet to a given address.
@@ -454,6 +735,15 @@ public:
    // 将数据立即通过UDP通道发送到对端，不经过发送缓冲机制
    int sendto(const sockaddr* addr, CPacket& packet);
 
+      // Functionality:
+      //    Fill in the sending side of the multiplexer statistics.
+      // Parameters:
+      //    1) [out] stats: the statistics
+      // Returned value:
+      //    None.
+
+   void getStats(CMuxStats& stats) const;
+
 private:
 #ifndef WIN32
    // 用于发送数据的工作线程
@@ -471,6 +761,17 @@ private:
    CChannel* m_pChannel;                // The UDP channel for data sending
    // 定时器
    CTimer* m_pTimer;			// Timing facility
+   // 事件跟踪
+   CMuxTrace* m_pTrace;			// event trace of the multiplexer
+
+   // 统计，只由工作线程更新（m_llSentDirect除外），读取时不加锁
+   int64_t m_llSent;			// DATA packets sent by the worker
+   volatile int64_t m_llSentDirect;	// packets sent through sendto(), approximate since it is called from several threads
+   int64_t m_llSendFailed;		// failed UDP sends
+   int64_t m_llIdleWaits;		// times the worker waited for data
+   int64_t m_llSleeps;			// times the worker slept until the next scheduled packet
+   int64_t m_llOversleepTotal;		// total oversleep, in microseconds
+   int64_t m_llOversleepMax;		// largest oversleep, in microseconds
 
    // 等待m_pSndUList中有数据的条件变量
    pthread_mutex_t m_WindowLock;
@@ -508,22 +809,21 @@ public:
       //    4) [in] hsize: hash table size
       //    5) [in] c: UDP channel to be associated to the queue
       //    6) [in] t: timer
+      //    7) [in] trace: event trace of the multiplexer
       // Returned value:
       //    None.
 
    // 初始化接收队列的大小、负载大小、IP版本、哈希表大小、UDP通道、定时器
-   void init(int size, int payload, int version, int hsize, CChannel* c, CTimer* t);
+   void init(int size, int payload, int version, int hsize, CChannel* c, CTimer* t, CMuxTrace* trace);
 
       // Functionality:
-      //    Read a packet for a specific UDT socket id.
+      //    Fill in the receiving side of the multiplexer statistics.
       // Parameters:
-      //    1) [in] id: Socket ID
-      //    2) [out] packet: received packet
+      //    1) [out] stats: the statistics
       // Returned value:
-      //    Data size of the packet
+      //    None.
 
-   // 取握手阶段的控制报文
-   int recvfrom(int32_t id, CPacket& packet);
+   void getStats(CMuxStats& stats) const;
 
 private:
 #ifndef WIN32
@@ -541,13 +841,22 @@ private:
    CUnitQueue m_UnitQueue;		// The received packet queue
 
    // UDT实例列表，将从这些UDT实例中读取数据包
-   CRcvUList* m_pRcvUList;		// List of UDT instances that will read packets from the queue
+   CTimerWheel* m_pTimerWheel;		// timers of the UDT instances that will read packets from the queue
    // 哈希表，用于查找UDT套接字
    CHash* m_pHash;			// Hash table for UDT socket looking up
    // 关联的UDP通道
    CChannel* m_pChannel;		// UDP channel for receving packets
    // 定时器
    CTimer* m_pTimer;			// shared timer with the snd queue
+   // 事件跟踪
+   CMuxTrace* m_pTrace;			// event trace of the multiplexer
+
+   // 统计，只由工作线程更新，读取时不加锁
+   int64_t m_llRecvCalls;		// UDP recvfrom calls
+   int64_t m_llRecv;			// packets received
+   int64_t m_llDropped;			// packets dropped because the unit queue was full
+   int64_t m_llNoSocket;		// packets for unknown socket IDs
+   int64_t m_llTimerChecks;		// timer checks made because a socket's timer expired
 
    // 数据包负载大小
    int m_iPayloadSize;                  // packet payload size
@@ -571,9 +880,6 @@ private:
    bool ifNewEntry();
    CUDT* getNewEntry();
 
-   // 保存握手阶段的控制报文到m_mBuffer中
-   void storePkt(int32_t id, CPacket* pkt);
-
 private:
    // 同步访问，临界区保护
    pthread_mutex_t m_LSLock;
@@ -586,12 +892,6 @@ private:
    std::vector<CUDT*> m_vNewEntry;                      // newly added entries, to be inserted
    pthread_mutex_t m_IDLock;
 
-   // 存储握手阶段的控制报文
-   std::map<int32_t, std::queue<CPacket*> > m_mBuffer;	// temporary buffer for rendezvous connection request
-   pthread_mutex_t m_PassLock;
-   // 用于在没有数据包时等待
-   pthread_cond_t m_PassCond;
-
 private:
    // 禁用拷贝构造函数和赋值运算符
    CRcvQueue(const CRcvQueue&);
@@ -611,6 +911,10 @@ struct CMultiplexer
    CChannel* m_pChannel;	// The UDP channel for sending and receiving
    // 定时器
    CTimer* m_pTimer;		// The timer
+   // 工作线程事件跟踪
+   CMuxTrace* m_pTrace;		// worker event trace
+   // 连接状态分配器
+   CSlab* m_pConnSlab;		// slab for the per-connection state of the sockets on this multiplexer
 
    // UDP端口号
    int m_iPort;			// The UDP port number of this multiplexer
@@ -0,0 +1,121 @@
+/*****************************************************************************
+Copyright (c) 2001 - 2011, The Board of Trustees of the University of Illinois.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above
+  copyright notice, this list of conditions and the
+  following disclaimer.
+
+* Redistributions in binary form must reproduce the
+  above copyright notice, this list of conditions
+  and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the University of Illinois
+  nor the names of its contributors may be used to
+  endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#ifdef WIN32
+   #include <windows.h>
+#endif
+#include <cstring>
+#include "trace.h"
+
+using namespace std;
+
+// The head counter publishes the records to readers on other threads: it is stored with release and
+// loaded with acquire semantics, and accessed atomically so that it does not tear on 32-bit targets.
+// 头计数器向其他线程发布记录：写入用release语义，读取用acquire语义，原子访问避免32位平台上的撕裂读写
+#ifndef WIN32
+   #define TRACE_LOAD(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+   #define TRACE_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+   #define TRACE_FENCE(order) __atomic_thread_fence(order)
+#else
+   #define TRACE_LOAD(x) InterlockedCompareExchange64((LONGLONG volatile*)&(x), 0, 0)
+   #define TRACE_STORE(x, v) InterlockedExchange64((LONGLONG volatile*)&(x), (v))
+   #define TRACE_FENCE(order) MemoryBarrier()
+#endif
+
+CPktTrace::CPktTrace(int size):
+m_pRecords(NULL),
+m_iSize(1),
+m_llHead(0)
+{
+   // round up to a power of 2 so that the position is a mask away from the counter
+   // 向上取整为2的幂，位置可以直接通过掩码得到
+   while (m_iSize < size)
+      m_iSize <<= 1;
+
+   m_pRecords = new CPktTraceRecord[m_iSize];
+   memset(m_pRecords, 0, sizeof(CPktTraceRecord) * m_iSize);
+}
+
+CPktTrace::~CPktTrace()
+{
+   delete [] m_pRecords;
+}
+
+void CPktTrace::record(uint64_t ts, int type, int flags, int32_t seq, int32_t value1, int32_t value2)
+{
+   // only this thread writes the head; the fence keeps the previous record's publication ahead of
+   // the stores below, which overwrite the oldest record a reader may still be copying
+   // 只有本线程写头计数器；屏障保证上一条记录先于下面覆盖最旧记录的写入发布
+   int64_t head = TRACE_LOAD(m_llHead);
+   TRACE_FENCE(__ATOMIC_RELEASE);
+   CPktTraceRecord* r = m_pRecords + (head & (m_iSize - 1));
+
+   r->usTimeStamp = ts;
+   r->iSeqNo = seq;
+   r->iValue1 = value1;
+   r->iValue2 = value2;
+   r->iType = (unsigned char)type;
+   r->iFlags = (unsigned char)flags;
+   r->iReserved = 0;
+
+   TRACE_STORE(m_llHead, head + 1);
+}
+
+int64_t CPktTrace::read(vector<CPktTraceRecord>& records) const
+{
+   int64_t end = TRACE_LOAD(m_llHead);
+   int64_t begin = (end > m_iSize) ? end - m_iSize : 0;
+
+   size_t base = records.size();
+   for (int64_t i = begin; i < end; ++ i)
+      records.push_back(m_pRecords[i & (m_iSize - 1)]);
+
+   // the copies above must complete before the head is read again
+   // 再次读取头计数器之前必须完成上面的复制
+   TRACE_FENCE(__ATOMIC_ACQUIRE);
+
+   // the writer may have wrapped around while we were copying; the slot of the record being written
+   // now is the one of record (head - size), so everything up to and including it is unreliable
+   // 复制期间写入方可能已经绕回，序号不大于(head - size)的记录可能已被覆盖
+   int64_t valid = TRACE_LOAD(m_llHead) - m_iSize + 1;
+   if (valid > begin)
+   {
+      int64_t skip = (valid < end) ? valid - begin : end - begin;
+      records.erase(records.begin() + base, records.begin() + base + size_t(skip));
+      begin += skip;
+   }
+
+   return begin;
+}
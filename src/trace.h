@@ -0,0 +1,100 @@
+/*****************************************************************************
+Copyright (c) 2001 - 2011, The Board of Trustees of the University of Illinois.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above
+  copyright notice, this list of conditions and the
+  following disclaimer.
+
+* Redistributions in binary form must reproduce the
+  above copyright notice, this list of conditions
+  and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the University of Illinois
+  nor the names of its contributors may be used to
+  endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#ifndef __UDT_TRACE_H__
+#define __UDT_TRACE_H__
+
+
+#include <vector>
+#include "udt.h"
+
+
+// 单生产者的数据包跟踪环形缓冲区，写入不加锁，写满后覆盖最早的记录
+class CPktTrace
+{
+public:
+   CPktTrace(int size);
+   ~CPktTrace();
+
+public:
+
+      // Functionality:
+      //    Append a record. Only one thread may record into the same ring.
+      // Parameters:
+      //    0) [in] ts: time stamp, in microseconds.
+      //    1) [in] type: event type, one of UDTTraceEvent.
+      //    2) [in] flags: event flags.
+      //    3) [in] seq: sequence number.
+      //    4) [in] value1: event specific value.
+      //    5) [in] value2: event specific value.
+      // Returned value:
+      //    None.
+
+   // 写入一条记录
+   void record(uint64_t ts, int type, int flags, int32_t seq, int32_t value1, int32_t value2);
+
+      // Functionality:
+      //    Copy the records currently held by the ring, oldest first. Safe against a concurrent writer:
+      //    records that may have been overwritten during the copy are discarded.
+      // Parameters:
+      //    0) [out] records: the records are appended to this vector.
+      // Returned value:
+      //    Number of records ever written but no longer available.
+
+   // 读取当前所有记录
+   int64_t read(std::vector<CPktTraceRecord>& records) const;
+
+      // Functionality:
+      //    Order two records by time.
+      // Parameters:
+      //    0) [in] a: a record.
+      //    1) [in] b: another record.
+      // Returned value:
+      //    true if a happened before b.
+
+   static bool earlier(const CPktTraceRecord& a, const CPktTraceRecord& b) {return a.usTimeStamp < b.usTimeStamp;}
+
+private:
+   CPktTraceRecord* m_pRecords;         // the ring
+   int m_iSize;                         // capacity of the ring, a power of 2
+   volatile int64_t m_llHead;           // number of records ever written
+
+private:
+   CPktTrace(const CPktTrace&);
+   CPktTrace& operator=(const CPktTrace&);
+};
+
+
+#endif
@@ -191,7 +191,37 @@ enum UDTOpt
    // 发送缓冲区中的数据大小
    UDT_SNDDATA,		   // 发送缓冲区中的数据大小，size of data in the sending buffer
    // 接收缓冲区的数据大小
-   UDT_RCVDATA		      // 接收缓冲区的数据大小，size of data available for recv
+   UDT_RCVDATA,		   // 接收缓冲区的数据大小，size of data available for recv
+   // 网络仿真参数，仅用于测试
+   UDT_NETEM,		      // 网络仿真参数，link impairment emulation on the UDP channel, see CNetEmuConfig
+   // 数据包跟踪环形缓冲区大小，0表示关闭
+   UDT_PKTTRACE,	      // 数据包跟踪，number of packet trace records kept per direction, 0 = off, see dumptrace()
+   // 按名称选择内置拥塞控制算法
+   UDT_CCNAME,		      // 内置拥塞控制算法名称，built-in congestion control by name: "udt", "bbr", "cubic" or "ledbat"
+   // 多路复用器限速类别
+   UDT_RATECLASS,	      // 限速类别，class of the multiplexer rate limit the socket is charged to, 0 ~ UDT_RATECLASS_NUM - 1
+   // 共享带宽时的权重
+   UDT_SNDWEIGHT,	      // 发送权重，share of a saturated multiplexer rate limit and of the sending list, relative to the other sockets, 1 ~ 10000
+   // 发送调度优先级
+   UDT_PRIORITY,	      // 发送优先级，priority class on the multiplexer's sending list, see UDTPriority
+   // 会话恢复票据
+   UDT_RESUME		      // 会话恢复，listener: issue and accept resumption tickets; client: keep and present them, see connect_data()
+};
+
+// 多路复用器限速类别
+enum UDTRateClass
+{
+   UDT_RATECLASS_ALL = -1,              // the aggregate limit over all classes
+   UDT_RATECLASS_NUM = 8                // number of classes with their own limit
+};
+
+// 发送调度优先级：就绪的高优先级套接字总是先于低优先级的套接字发送
+enum UDTPriority
+{
+   UDT_PRIORITY_HIGH = 0,               // interactive / control traffic
+   UDT_PRIORITY_NORMAL = 1,             // default
+   UDT_PRIORITY_LOW = 2,                // background bulk transfer
+   UDT_PRIORITY_NUM = 3                 // number of priority classes
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -267,6 +297,204 @@ struct CPerfMon
    int byteAvailRcvBuf;                 // available UDT receiver buffer size
 };
 
+// 对数-线性直方图，每个2的幂区间分为16个子桶，相对误差不超过1/16
+struct CPerfHist
+{
+   static const int m_iSubBuckets = 16;         // number of linear sub-buckets per power of two
+   static const int m_iBuckets = 512;           // total number of buckets; values beyond the last one are clamped
+
+   // 样本数量
+   int64_t count;                       // number of samples recorded
+   // 最小值、最大值、平均值，单位为微秒
+   int64_t usMin;                       // smallest sample, in microseconds
+   int64_t usMax;                       // largest sample, in microseconds
+   double usMean;                       // average of all samples, in microseconds
+   // 百分位数，取所在桶的上界
+   int64_t usP50;                       // 50th percentile (upper edge of the bucket), in microseconds
+   int64_t usP90;                       // 90th percentile
+   int64_t usP99;                       // 99th percentile
+   int64_t usP999;                      // 99.9th percentile
+   // 各个桶的样本数
+   int64_t bucket[m_iBuckets];          // raw bucket counters, see bucketLow()/bucketHigh() for the ranges
+
+   // 根据数值计算桶下标
+   static int bucketOf(int64_t value)
+   {
+      if (value < m_iSubBuckets)
+         return (value < 0) ? 0 : int(value);
+
+      int shift = 0;
+      while (value >= 2 * m_iSubBuckets)
+      {
+         value >>= 1;
+         ++ shift;
+      }
+
+      int index = (shift + 1) * m_iSubBuckets + int(value - m_iSubBuckets);
+      return (index < m_iBuckets) ? index : m_iBuckets - 1;
+   }
+
+   // 桶所覆盖的最小值
+   static int64_t bucketLow(int index)
+   {
+      if (index < m_iSubBuckets)
+         return index;
+      return int64_t(m_iSubBuckets + index % m_iSubBuckets) << (index / m_iSubBuckets - 1);
+   }
+
+   // 桶所覆盖的最大值
+   static int64_t bucketHigh(int index)
+   {
+      if (index < m_iSubBuckets)
+         return index;
+      return bucketLow(index) + (int64_t(1) << (index / m_iSubBuckets - 1)) - 1;
+   }
+};
+
+// 扩展的性能统计，在CPerfMon的基础上增加延迟分布，CPerfMon本身的布局保持不变
+struct CPerfMon2
+{
+   CPerfMon perf;                       // the same counters as returned by perfmon()
+   // ACK/ACK2测得的RTT样本
+   CPerfHist histRTT;                   // RTT samples taken from ACK/ACK2 pairs
+   // 接收端：消息第一个包从对端发出到最后一个包到达本地的时间，对端时钟按最小单向时延对齐
+   CPerfHist histMsgLatency;            // receiver side: time from the first packet of a message leaving the peer to its last packet arriving here; the peer clock is aligned using half of the minimum RTT
+   // 发送端：消息在发送缓冲区中等待首次发送的时间
+   CPerfHist histSndQueueDelay;         // sender side: time a message waits in the sender buffer before its first packet is sent
+};
+
+// UDP多路复用器（即一个UDP端口）的统计信息，由所有共享该端口的UDT套接字共同产生
+struct CMuxStats
+{
+   int iPort;                           // UDP port of the multiplexer
+   int iIPversion;                      // AF_INET or AF_INET6
+   int iSockets;                        // number of UDT sockets sharing the multiplexer
+
+   // 发送工作线程
+   int64_t pktSent;                     // DATA packets sent by the sending worker
+   int64_t pktSentDirect;               // packets sent immediately, bypassing the sending list (control, handshake)
+   int64_t pktSendFailed;               // UDP sendto calls that failed
+   int64_t sndIdleWaits;                // times the sending worker blocked because no socket had data
+   int64_t sndTimerSleeps;              // times the sending worker slept until the next scheduled packet
+   int64_t usSndOversleepTotal;         // total time the sending worker woke up later than scheduled, in microseconds
+   int64_t usSndOversleepMax;           // largest single oversleep, in microseconds
+   int sndListSize;                     // sockets currently on the sending list (heap)
+   int sndListCapacity;                 // allocated length of the sending list
+   int64_t sndThrottled;                // times a socket was held back by the multiplexer rate limit
+
+   // 接收工作线程
+   int64_t sysRecvCalls;                // UDP recvfrom calls, including the ones that timed out
+   int64_t pktRecv;                     // packets received
+   int64_t pktRecvDropped;              // packets discarded because the unit queue was full
+   int64_t pktRecvNoSocket;             // packets addressed to a socket ID unknown to this multiplexer
+   int unitQueueSize;                   // receiver unit queue size, in packets
+   int unitQueueUsed;                   // units currently holding packets
+   int hashSize;                        // number of buckets in the socket ID hash table
+   int hashEntries;                     // number of sockets in the hash table
+   int64_t rcvTimerChecks;              // checkTimers() calls made because a socket's ACK or EXP timer expired
+
+   // 连接状态slab
+   int connSlabUsed;                    // per-connection state blocks in use
+   int connSlabTotal;                   // per-connection state blocks allocated from the heap
+};
+
+// 多路复用器工作线程的跟踪事件类型
+enum UDTMuxEvent
+{
+   UDT_MUX_SND_IDLE = 1,                // sending worker blocked waiting for data; value: 0
+   UDT_MUX_SND_OVERSLEEP,               // sending worker woke up late; value: delay in microseconds
+   UDT_MUX_SND_FAIL,                    // UDP sendto failed; value: destination socket ID
+   UDT_MUX_RCV_DROP,                    // packet discarded, unit queue full; value: unit queue size
+   UDT_MUX_RCV_NOSOCKET,                // packet for an unknown socket ID; value: the socket ID
+   UDT_MUX_RCV_GROW                     // unit queue enlarged; value: new size in packets
+};
+
+// 数据包跟踪事件类型
+enum UDTTraceEvent
+{
+   UDT_TRACE_DATA_SENT = 1,             // seq: sequence number; value1: payload size; value2: message number; flag 1: retransmission
+   UDT_TRACE_DATA_RECV,                 // seq: sequence number; value1: payload size; value2: message number; flag 1: fills a gap
+   UDT_TRACE_ACK_RECV,                  // seq: acknowledged sequence number; value1: RTT reported by the peer, in microseconds; value2: ACK number
+   UDT_TRACE_ACK2_RECV,                 // seq: acknowledged sequence number; value1: RTT sample, in microseconds; value2: ACK number
+   UDT_TRACE_NAK_RECV,                  // seq: first lost sequence number; value1: number of lost packets reported
+   UDT_TRACE_RATE                       // seq: current sending sequence number; value1: packet sending period, in nanoseconds; value2: congestion window
+};
+
+// 数据包跟踪记录，24字节，按本机字节序写入跟踪文件
+struct CPktTraceRecord
+{
+   uint64_t usTimeStamp;                // time since the socket was started, in microseconds
+   int32_t iSeqNo;                      // see UDTTraceEvent
+   int32_t iValue1;
+   int32_t iValue2;
+   unsigned char iType;                 // one of UDTTraceEvent
+   unsigned char iFlags;                // see UDTTraceEvent
+   unsigned short iReserved;
+};
+
+// 跟踪文件头，其后是按时间排序的记录
+struct CPktTraceHeader
+{
+   char acMagic[8];                     // "UDTTRACE"
+   int32_t iVersion;                    // file format version, currently 1
+   int32_t iRecordSize;                 // sizeof(CPktTraceRecord), also used to detect a byte order mismatch
+   int32_t iSocketID;                   // local socket ID
+   int32_t iPeerID;                     // peer socket ID
+   uint64_t usStartTime;                // absolute start time of the socket, in microseconds since the epoch
+   int64_t llRecords;                   // number of records following the header
+   int64_t llOverwritten;               // records lost because the ring wrapped
+};
+
+// 多路复用器工作线程的跟踪事件
+struct CMuxEvent
+{
+   int64_t usTimeStamp;                 // time of the event, in microseconds (same clock as CTimer::getTime)
+   int iType;                           // one of UDTMuxEvent
+   int64_t llValue;                     // event specific value
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// 网络仿真参数：在UDP通道的发送端注入时延、抖动、丢包、乱序和带宽限制，用于在本机上进行可重复的测试
+// All fields zero means no emulation. Must be set before the socket is bound.
+struct CNetEmuConfig
+{
+   // 单向固定时延，us
+   int usDelay;                         // one-way base delay, in microseconds
+   // 随机抖动的最大值，us
+   int usJitter;                        // maximum random jitter added to the delay, in microseconds
+   // 随机丢包率；Gilbert-Elliott模型中为Good状态下的丢包率
+   double dLossRate;                    // random loss probability, or loss in the GOOD state of the Gilbert-Elliott model
+   // Good -> Bad 状态转移概率，为0时不使用Gilbert-Elliott模型
+   double dGEGoodToBad;                 // Gilbert-Elliott: probability of GOOD -> BAD per packet, 0 disables the model
+   // Bad -> Good 状态转移概率
+   double dGEBadToGood;                 // Gilbert-Elliott: probability of BAD -> GOOD per packet
+   // Bad状态下的丢包率
+   double dGELossBad;                   // Gilbert-Elliott: loss probability in the BAD state
+   // 乱序概率
+   double dReorderRate;                 // probability that a packet is held back and delivered out of order
+   // 乱序包的额外时延，us
+   int usReorderDelay;                  // extra delay of a reordered packet, in microseconds
+   // 瓶颈带宽，bytes/s，0表示不限速
+   int64_t byteRate;                    // bottleneck rate in bytes per second, 0 means unlimited
+   // 瓶颈队列长度，bytes，超出后尾部丢包，0表示不限制
+   int byteQueueLimit;                  // bottleneck queue size in bytes (tail drop), 0 means unlimited
+   // 随机数种子，相同的种子产生相同的丢包序列
+   unsigned int uiSeed;                 // random seed, the same seed gives the same impairment pattern
+};
+
+// sendmsg_batch/recvmsg_batch的一条消息
+// One message of sendmsg_batch() or recvmsg_batch().
+struct CMsgVec
+{
+   // 消息数据(发送)或接收缓冲区(接收)
+   char* pcData;                        // message data (send) or receive buffer (receive)
+   // 消息长度(发送)或接收缓冲区大小(接收)
+   int iLength;                         // message length (send) or size of the receive buffer (receive)
+   // 接收到的字节数，只由recvmsg_batch填写
+   int iReceived;                       // bytes received into the buffer, set by recvmsg_batch() only
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 
 class UDT_API CUDTException
@@ -274,6 +502,7 @@ class UDT_API CUDTException
 public:
    CUDTException(int major = 0, int minor = 0, int err = -1);
    CUDTException(const CUDTException& e);
+   CUDTException& operator=(const CUDTException& e);
    virtual ~CUDTException();
 
       // Functionality:
@@ -374,7 +603,14 @@ namespace UDT
 typedef CUDTException ERRORINFO;
 typedef UDTOpt SOCKOPT;
 typedef CPerfMon TRACEINFO;
+typedef CPerfMon2 TRACEINFO2;
 typedef ud_set UDSET;
+typedef CNetEmuConfig NETEMUCONFIG;
+typedef CMsgVec MSGVEC;
+typedef CMuxStats MUXSTATS;
+typedef CMuxEvent MUXEVENT;
+typedef CPktTraceRecord TRACERECORD;
+typedef CPktTraceHeader TRACEHEADER;
 
 UDT_API extern const UDTSOCKET INVALID_SOCK;
 #undef ERROR
@@ -391,8 +627,12 @@ UDT_API int bind2(UDTSOCKET u, UDPSOCKET udpsock);
 UDT_API int listen(UDTSOCKET u, int backlog);
 // 接受UDT socket连接
 UDT_API UDTSOCKET accept(UDTSOCKET u, struct sockaddr* addr, int* addrlen);
+// 批量接受UDT socket连接，返回取到的连接数
+UDT_API int accept_batch(UDTSOCKET u, UDTSOCKET* sockets, int max);
 // UDT socket连接
 UDT_API int connect(UDTSOCKET u, const struct sockaddr* name, int namelen);
+// UDT socket连接，持有票据时数据随握手一起发送
+UDT_API int connect_data(UDTSOCKET u, const struct sockaddr* name, int namelen, const char* buf, int len);
 // 关闭UDT socket
 UDT_API int close(UDTSOCKET u);
 // 获取对端地址
@@ -408,6 +648,10 @@ UDT_API int send(UDTSOCKET u, const char* buf, int len, int flags);
 UDT_API int recv(UDTSOCKET u, char* buf, int len, int flags);
 UDT_API int sendmsg(UDTSOCKET u, const char* buf, int len, int ttl = -1, bool inorder = false);
 UDT_API int recvmsg(UDTSOCKET u, char* buf, int len);
+// 批量发送消息，所有消息使用相同的ttl和inorder，返回放入发送缓冲区的消息数
+UDT_API int sendmsg_batch(UDTSOCKET u, const MSGVEC* msgs, int num, int ttl = -1, bool inorder = false);
+// 批量接收消息，阻塞模式下只等待第一条消息，返回接收到的消息数
+UDT_API int recvmsg_batch(UDTSOCKET u, MSGVEC* msgs, int num);
 UDT_API int64_t sendfile(UDTSOCKET u, std::fstream& ifs, int64_t& offset, int64_t size, int block = 364000);
 UDT_API int64_t recvfile(UDTSOCKET u, std::fstream& ofs, int64_t& offset, int64_t size, int block = 7280000);
 UDT_API int64_t sendfile2(UDTSOCKET u, const char* path, int64_t* offset, int64_t size, int block = 364000);
@@ -432,7 +676,16 @@ UDT_API ERRORINFO& getlasterror();
 UDT_API int getlasterror_code();
 UDT_API const char* getlasterror_desc();
 UDT_API int perfmon(UDTSOCKET u, TRACEINFO* perf, bool clear = true);
+UDT_API int perfmon2(UDTSOCKET u, TRACEINFO2* perf, bool clear = true);
+UDT_API int dumptrace(UDTSOCKET u, const char* path);
 UDT_API UDTSTATUS getsockstate(UDTSOCKET u);
+// 多路复用器统计及事件跟踪，port为本地UDP端口
+UDT_API int getmuxstats(int port, MUXSTATS* stats);
+UDT_API int setmuxtrace(int port, int size);
+UDT_API int getmuxtrace(int port, MUXEVENT* events, int len);
+// 多路复用器限速，cls为UDT_RATECLASS_ALL时设置总带宽，bandwidth单位为字节/秒，<= 0表示不限速
+UDT_API int setmuxrate(int port, int cls, int64_t bandwidth);
+UDT_API int getmuxrate(int port, int cls, int64_t* bandwidth);
 
 }  // namespace UDT
 
@@ -39,6 +39,7 @@ written by
 *****************************************************************************/
 
 #include <cmath>
+#include <cstring>
 #include "common.h"
 #include "window.h"
 #include <algorithm>
@@ -49,9 +50,9 @@ CACKWindow::CACKWindow(int size):
 m_piACKSeqNo(NULL),
 m_piACK(NULL),
 m_pTimeStamp(NULL),
-m_iSize(size),
-m_iHead(0),
-m_iTail(0)
+m_iSize((size < m_iInitSize) ? size : m_iInitSize),
+m_iMaxSize(size),
+m_iLastAck2(-1)
 {
    // 记录窗口中包的序列号
    m_piACKSeqNo = new int32_t[m_iSize];
@@ -60,7 +61,8 @@ m_iTail(0)
    // 每个ACK包的发送时间戳
    m_pTimeStamp = new uint64_t[m_iSize];
 
-   m_piACKSeqNo[0] = -1;
+   for (int i = 0; i < m_iSize; ++ i)
+      m_piACKSeqNo[i] = -1;
 }
 
 CACKWindow::~CACKWindow()
@@ -72,132 +74,491 @@ CACKWindow::~CACKWindow()
 
 void CACKWindow::store(int32_t seq, int32_t ack)
 {
+   // ACK seq. no. are consecutive, so each one has its own slot until it is
+   // overwritten by the one m_iSize later, which is not likely to be acknowledged
+   // ACK序列号是连续的，直接按序列号定位槽位；被覆盖的旧记录已不太可能被确认
+   int i = seq % m_iSize;
+
+   // the slot still holds an ACK waiting for its ACK-2, so more ACKs are in flight than the window holds
+   // 槽位中的ACK仍在等待ACK-2，说明在途的ACK多于窗口大小，扩展窗口
+   if ((m_iSize < m_iMaxSize) && (-1 != m_piACKSeqNo[i]) && ((-1 == m_iLastAck2) || (CSeqNo::seqcmp(m_piACKSeqNo[i], m_iLastAck2) > 0)))
+   {
+      resize((m_iSize * 2 < m_iMaxSize) ? m_iSize * 2 : m_iMaxSize);
+      i = seq % m_iSize;
+   }
+
    // 记录序列号
-   m_piACKSeqNo[m_iHead] = seq;
+   m_piACKSeqNo[i] = seq;
    // 记录ACK
-   m_piACK[m_iHead] = ack;
+   m_piACK[i] = ack;
    // 记录时间戳
-   m_pTimeStamp[m_iHead] = CTimer::getTime();
+   m_pTimeStamp[i] = CTimer::getTime();
+}
+
+int CACKWindow::acknowledge(int32_t seq, int32_t& ack)
+{
+   // 序列号不匹配，说明记录已被覆盖或不存在
+   int i = seq % m_iSize;
+   if ((seq < 0) || (seq != m_piACKSeqNo[i]))
+   {
+      // Bad input, the ACK node has been overwritten
+      return -1;
+   }
+
+   // an ACK-2 older than the latest one is stale, just like its ACK
+   // 比最近一次ACK-2更早的ACK-2已经过时
+   if ((-1 != m_iLastAck2) && (CSeqNo::seqcmp(seq, m_iLastAck2) <= 0))
+      return -1;
 
-   // 更新头指针
-   m_iHead = (m_iHead + 1) % m_iSize;
+   // return the Data ACK it carried
+   // 将找到的数据包序列号赋值给ack
+   ack = m_piACK[i];
+   m_piACKSeqNo[i] = -1;
+   m_iLastAck2 = seq;
 
-   // overwrite the oldest ACK since it is not likely to be acknowledged
-   // 覆盖最早的ACK，因为它已经不太可能被确认
-   if (m_iHead == m_iTail)
-      m_iTail = (m_iTail + 1) % m_iSize;
+   // calculate RTT
+   // 计算RTT
+   return int(CTimer::getTime() - m_pTimeStamp[i]);
 }
 
-int CACKWindow::acknowledge(int32_t seq, int32_t& ack)
+void CACKWindow::shrink()
+{
+   int size = (m_iMaxSize < m_iInitSize) ? m_iMaxSize : m_iInitSize;
+   if (m_iSize > size)
+      resize(size);
+}
+
+void CACKWindow::resize(int size)
+{
+   int32_t* seqno = new int32_t[size];
+   int32_t* ack = new int32_t[size];
+   uint64_t* timestamp = new uint64_t[size];
+
+   for (int i = 0; i < size; ++ i)
+      seqno[i] = -1;
+
+   // only the records still waiting for their ACK-2 are worth keeping; when they collide the newer one wins
+   // 只保留仍在等待ACK-2的记录，槽位冲突时保留较新的记录
+   for (int i = 0; i < m_iSize; ++ i)
+   {
+      if ((-1 == m_piACKSeqNo[i]) || ((-1 != m_iLastAck2) && (CSeqNo::seqcmp(m_piACKSeqNo[i], m_iLastAck2) <= 0)))
+         continue;
+
+      int j = m_piACKSeqNo[i] % size;
+      if ((-1 != seqno[j]) && (CSeqNo::seqcmp(seqno[j], m_piACKSeqNo[i]) > 0))
+         continue;
+
+      seqno[j] = m_piACKSeqNo[i];
+      ack[j] = m_piACK[i];
+      timestamp[j] = m_pTimeStamp[i];
+   }
+
+   delete [] m_piACKSeqNo;
+   delete [] m_piACK;
+   delete [] m_pTimeStamp;
+
+   m_piACKSeqNo = seqno;
+   m_piACK = ack;
+   m_pTimeStamp = timestamp;
+   m_iSize = size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CMinFilter::CMinFilter(uint64_t window):
+m_ullWindow(window)
+{
+   reset();
+}
+
+void CMinFilter::reset()
+{
+   for (int i = 0; i < 3; ++ i)
+   {
+      m_aSample[i].m_iValue = 0;
+      m_aSample[i].m_ullTime = 0;
+   }
+}
+
+int CMinFilter::update(int value, uint64_t time)
 {
-   // 窗口中有数据
-   if (m_iHead >= m_iTail)
+   CSample s;
+   s.m_iValue = value;
+   s.m_ullTime = time;
+
+   // a new minimum, or nothing in the window at all: start over
+   // 新的最小值，或窗口内已无样本，重新开始
+   if ((0 == m_aSample[0].m_iValue) || (value <= m_aSample[0].m_iValue) || (time - m_aSample[2].m_ullTime > m_ullWindow))
    {
-      // Head has not exceeded the physical boundary of the window
-      // 头部未超出窗口的物理边界
+      m_aSample[0] = m_aSample[1] = m_aSample[2] = s;
+      return value;
+   }
+
+   if (value <= m_aSample[1].m_iValue)
+      m_aSample[1] = m_aSample[2] = s;
+   else if (value <= m_aSample[2].m_iValue)
+      m_aSample[2] = s;
 
-      // 遍历窗口
-      for (int i = m_iTail, n = m_iHead; i < n; ++ i)
+   // the best sample has left the window: the second and third best take over
+   // 最好的样本已离开窗口，由次好和第三好的样本接替
+   uint64_t dt = time - m_aSample[0].m_ullTime;
+   if (dt > m_ullWindow)
+   {
+      m_aSample[0] = m_aSample[1];
+      m_aSample[1] = m_aSample[2];
+      m_aSample[2] = s;
+      if (time - m_aSample[0].m_ullTime > m_ullWindow)
       {
-         // looking for indentical ACK Seq. No.
-         // 找到匹配的序列号
-         if (seq == m_piACKSeqNo[i])
-         {
-            // return the Data ACK it carried
-            // 将找到的数据包序列号赋值给ack
-            ack = m_piACK[i];
-
-            // calculate RTT
-            // 计算RTT
-            int rtt = int(CTimer::getTime() - m_pTimeStamp[i]);
-
-            // 更新尾指针，尾指针追上了头指针，说明窗口中没有数据
-            if (i + 1 == m_iHead)
-            {
-               m_iTail = m_iHead = 0;
-               m_piACKSeqNo[0] = -1;
-            }
-            else
-               m_iTail = (i + 1) % m_iSize;
-
-            return rtt;
-         }
+         m_aSample[0] = m_aSample[1];
+         m_aSample[1] = m_aSample[2];
+         m_aSample[2] = s;
       }
+   }
+   // keep the second and third best from different quarters and halves of the window
+   // 保证次好和第三好的样本分别来自窗口的不同阶段
+   else if ((m_aSample[1].m_ullTime == m_aSample[0].m_ullTime) && (dt > m_ullWindow / 4))
+      m_aSample[1] = m_aSample[2] = s;
+   else if ((m_aSample[2].m_ullTime == m_aSample[1].m_ullTime) && (dt > m_ullWindow / 2))
+      m_aSample[2] = s;
+
+   return m_aSample[0].m_iValue;
+}
 
-      // Bad input, the ACK node has been overwritten
-      // 如果没有找到匹配的序列号，返回 -1
-      return -1;
+////////////////////////////////////////////////////////////////////////////////
+
+CMedianWindow::CMedianWindow(int size, int init):
+m_iSize(size),
+m_iMaxLevel(1),
+m_iPtr(0),
+m_iPending(0),
+m_bOrdered(false),
+m_piSample(NULL),
+m_piValue(NULL),
+m_piLevel(NULL),
+m_piLink(NULL),
+m_pLink(NULL),
+m_pllScratch(NULL)
+{
+   // 头节点的层数足以覆盖整个窗口
+   while ((1 << m_iMaxLevel) <= m_iSize)
+      ++ m_iMaxLevel;
+
+   m_piSample = new int[m_iSize];
+   m_piValue = new int[m_iSize + 2];
+   m_piLevel = new int[m_iSize + 2];
+   m_piLink = new int[m_iSize + 2];
+   m_pllScratch = new int64_t[m_iSize];
+
+   // node i gets 1 + (trailing zeros of i + 1) levels, which gives the usual geometric
+   // distribution without a random generator; the levels stay with the slot when its sample is replaced
+   // 节点层数按槽位固定分配：槽位i的层数为1加上(i + 1)末尾0的个数，正好是跳表需要的几何分布
+   int links = 0;
+   for (int i = 0; i < m_iSize; ++ i)
+   {
+      int level = 1;
+      while ((level < m_iMaxLevel) && (0 == ((i + 1) & ((1 << level) - 1))))
+         ++ level;
+      m_piLevel[i] = level;
+      m_piLink[i] = links;
+      links += level;
+   }
+   m_piLevel[m_iSize] = m_iMaxLevel;
+   m_piLink[m_iSize] = links;
+   links += m_iMaxLevel;
+   m_piLevel[m_iSize + 1] = 0;
+   m_piLink[m_iSize + 1] = links;
+
+   m_pLink = new CLink[links];
+
+   for (int i = 0; i < m_iSize; ++ i)
+      m_piSample[i] = init;
+}
+
+CMedianWindow::~CMedianWindow()
+{
+   delete [] m_piSample;
+   delete [] m_piValue;
+   delete [] m_piLevel;
+   delete [] m_piLink;
+   delete [] m_pLink;
+   delete [] m_pllScratch;
+}
+
+void CMedianWindow::push(int value)
+{
+   m_piSample[m_iPtr] = value;
+
+   // the window is logically circular
+   // 环形缓冲区
+   if (++ m_iPtr == m_iSize)
+      m_iPtr = 0;
+
+   if (m_iPending < m_iSize)
+      ++ m_iPending;
+}
+
+int CMedianWindow::median()
+{
+   if (!sync())
+   {
+      // select the median, but cannot change the original value order in the window
+      // 不维护有序表时，复制样本并用选择算法取中值
+      for (int i = 0; i < m_iSize; ++ i)
+         m_pllScratch[i] = m_piSample[i];
+      std::nth_element(m_pllScratch, m_pllScratch + m_iSize / 2, m_pllScratch + m_iSize);
+      return int(m_pllScratch[m_iSize / 2]);
    }
 
-   // Head has exceeded the physical window boundary, so it is behind tail
-   // 头指针超出了窗口边界，环形缓冲区
-   for (int j = m_iTail, n = m_iHead + m_iSize; j < n; ++ j)
+   // walk down to the node of rank size/2 (0-based)
+   // 按宽度向下查找排名为size/2的节点
+   int node = m_iSize;
+   int remain = m_iSize / 2 + 1;
+   for (int l = m_iMaxLevel - 1; l >= 0; -- l)
    {
-      // looking for indentical ACK seq. no.
-      // 查找匹配的序列号
-      if (seq == m_piACKSeqNo[j % m_iSize])
+      const CLink* k = m_pLink + m_piLink[node] + l;
+      while ((k->m_iNext != m_iSize + 1) && (k->m_iWidth <= remain))
       {
-         // return Data ACK
-         // 将找到的数据包序列号赋值给ack
-         j %= m_iSize;
-         ack = m_piACK[j];
+         remain -= k->m_iWidth;
+         node = k->m_iNext;
+         k = m_pLink + m_piLink[node] + l;
+      }
+   }
 
-         // calculate RTT
-         // 计算RTT
-         int rtt = int(CTimer::getTime() - m_pTimeStamp[j]);
+   return m_piValue[node];
+}
 
-         // 更新尾指针
-         if (j == m_iHead)
+int CMedianWindow::range(int lower, int upper, int64_t& sum)
+{
+   sum = 0;
+   if (upper <= lower + 1)
+      return 0;
+
+   if (!sync())
+   {
+      // 不维护有序表时，直接扫描整个窗口
+      int count = 0;
+      for (int i = 0; i < m_iSize; ++ i)
+      {
+         if ((m_piSample[i] > lower) && (m_piSample[i] < upper))
          {
-            m_iTail = m_iHead = 0;
-            m_piACKSeqNo[0] = -1;
+            ++ count;
+            sum += m_piSample[i];
          }
-         else
-            m_iTail = (j + 1) % m_iSize;
+      }
+      return count;
+   }
+
+   int64_t lowsum;
+   int lowcount = below(lower + 1, lowsum);
+   int count = below(upper, sum);
+   sum -= lowsum;
 
-         return rtt;
+   return count - lowcount;
+}
+
+bool CMedianWindow::sync()
+{
+   // an update of the list costs two searches, several times the cost of scanning a few samples,
+   // so the list is only kept when few samples arrive between two reads
+   // 两次读取之间到达的样本很少时才维护有序跳表，否则直接扫描窗口更快
+   if (0 == m_iPending)
+      return m_bOrdered;
+
+   bool few = (m_iPending * 32 <= m_iSize);
+
+   if (!few)
+      m_bOrdered = false;
+   else if (!m_bOrdered)
+   {
+      for (int i = 0; i < m_iSize; ++ i)
+         m_piValue[i] = m_piSample[i];
+      rebuild();
+      m_bOrdered = true;
+   }
+   else
+   {
+      for (int i = m_iPtr - m_iPending; i < m_iPtr; ++ i)
+      {
+         int node = (i < 0) ? i + m_iSize : i;
+         if (m_piSample[node] != m_piValue[node])
+         {
+            remove(node);
+            m_piValue[node] = m_piSample[node];
+            insert(node);
+         }
       }
    }
 
-   // bad input, the ACK node has been overwritten
-   return -1;
+   m_iPending = 0;
+   return m_bOrdered;
+}
+
+void CMedianWindow::rebuild()
+{
+   // sort the slots by sample then by slot, both packed in one key
+   // 按(样本, 槽位)排序，二者合成一个64位键
+   for (int i = 0; i < m_iSize; ++ i)
+      m_pllScratch[i] = int64_t(m_piValue[i]) * 0x100000000LL + i;
+   std::sort(m_pllScratch, m_pllScratch + m_iSize);
+
+   // link the nodes in ascending order, remembering the last node on every level with its rank
+   // and the sum of the samples up to it
+   // 按升序链接所有节点，记录每一层最后一个节点的排名和到它为止的样本总和
+   int last[32];
+   int rank[32];
+   int64_t prefix[32];
+   for (int l = 0; l < m_iMaxLevel; ++ l)
+   {
+      last[l] = m_iSize;
+      rank[l] = 0;
+      prefix[l] = 0;
+   }
+
+   int r = 0;
+   int64_t ps = 0;
+   for (int i = 0; i < m_iSize; ++ i)
+   {
+      int node = int(m_pllScratch[i] & 0xFFFFFFFFLL);
+      ++ r;
+      ps += m_piValue[node];
+      for (int l = 0; l < m_piLevel[node]; ++ l)
+      {
+         CLink& k = m_pLink[m_piLink[last[l]] + l];
+         k.m_iNext = node;
+         k.m_iWidth = r - rank[l];
+         k.m_llSum = ps - prefix[l];
+         last[l] = node;
+         rank[l] = r;
+         prefix[l] = ps;
+      }
+   }
+
+   for (int l = 0; l < m_iMaxLevel; ++ l)
+   {
+      CLink& k = m_pLink[m_piLink[last[l]] + l];
+      k.m_iNext = m_iSize + 1;
+      k.m_iWidth = m_iSize + 1 - rank[l];
+      k.m_llSum = ps - prefix[l];
+   }
+}
+
+int CMedianWindow::below(int bound, int64_t& sum) const
+{
+   // count and sum of the samples smaller than bound
+   // 统计小于bound的样本个数和总和
+   int node = m_iSize;
+   int count = 0;
+   sum = 0;
+   for (int l = m_iMaxLevel - 1; l >= 0; -- l)
+   {
+      const CLink* k = m_pLink + m_piLink[node] + l;
+      while ((k->m_iNext != m_iSize + 1) && (m_piValue[k->m_iNext] < bound))
+      {
+         count += k->m_iWidth;
+         sum += k->m_llSum;
+         node = k->m_iNext;
+         k = m_pLink + m_piLink[node] + l;
+      }
+   }
+
+   return count;
+}
+
+void CMedianWindow::insert(int node)
+{
+   // find the predecessor on every level, with its rank and the sum of the samples up to it
+   // 逐层查找前驱节点，并记录前驱的排名和到前驱为止的样本总和
+   int prev[32];
+   int rank[32];
+   int64_t prefix[32];
+
+   int x = m_iSize;
+   int r = 0;
+   int64_t ps = 0;
+   for (int l = m_iMaxLevel - 1; l >= 0; -- l)
+   {
+      const CLink* k = m_pLink + m_piLink[x] + l;
+      while ((k->m_iNext != m_iSize + 1) && less(k->m_iNext, node))
+      {
+         r += k->m_iWidth;
+         ps += k->m_llSum;
+         x = k->m_iNext;
+         k = m_pLink + m_piLink[x] + l;
+      }
+      prev[l] = x;
+      rank[l] = r;
+      prefix[l] = ps;
+   }
+
+   int value = m_piValue[node];
+   for (int l = 0; l < m_iMaxLevel; ++ l)
+   {
+      CLink& p = m_pLink[m_piLink[prev[l]] + l];
+      if (l < m_piLevel[node])
+      {
+         // split the predecessor's link at the new node
+         CLink& k = m_pLink[m_piLink[node] + l];
+         k.m_iNext = p.m_iNext;
+         k.m_iWidth = p.m_iWidth - (r - rank[l]);
+         k.m_llSum = p.m_llSum - (ps - prefix[l]);
+         p.m_iNext = node;
+         p.m_iWidth = r - rank[l] + 1;
+         p.m_llSum = ps - prefix[l] + value;
+      }
+      else
+      {
+         // the link now spans one more node
+         ++ p.m_iWidth;
+         p.m_llSum += value;
+      }
+   }
+}
+
+void CMedianWindow::remove(int node)
+{
+   int x = m_iSize;
+   int value = m_piValue[node];
+   for (int l = m_iMaxLevel - 1; l >= 0; -- l)
+   {
+      CLink* k = m_pLink + m_piLink[x] + l;
+      while ((k->m_iNext != m_iSize + 1) && less(k->m_iNext, node))
+      {
+         x = k->m_iNext;
+         k = m_pLink + m_piLink[x] + l;
+      }
+
+      if (l < m_piLevel[node])
+      {
+         // merge the node's link into its predecessor's
+         const CLink& n = m_pLink[m_piLink[node] + l];
+         k->m_iNext = n.m_iNext;
+         k->m_iWidth += n.m_iWidth - 1;
+         k->m_llSum += n.m_llSum - value;
+      }
+      else
+      {
+         -- k->m_iWidth;
+         k->m_llSum -= value;
+      }
+   }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
 CPktTimeWindow::CPktTimeWindow(int asize, int psize):
-m_iAWSize(asize),
-m_piPktWindow(NULL),
-m_iPktWindowPtr(0),
-m_iPWSize(psize),
-m_piProbeWindow(NULL),
-m_iProbeWindowPtr(0),
+m_PktWindow(asize, 1000000),
+m_ProbeWindow(psize, 1000),
 m_iLastSentTime(0),
 m_iMinPktSndInt(1000000),
 m_LastArrTime(),
 m_CurrArrTime(),
 m_ProbeTime()
 {
-   m_piPktWindow = new int[m_iAWSize];
-   m_piPktReplica = new int[m_iAWSize];
-   m_piProbeWindow = new int[m_iPWSize];
-   m_piProbeReplica = new int[m_iPWSize];
-
    m_LastArrTime = CTimer::getTime();
-
-   for (int i = 0; i < m_iAWSize; ++ i)
-      m_piPktWindow[i] = 1000000;
-
-   for (int k = 0; k < m_iPWSize; ++ k)
-      m_piProbeWindow[k] = 1000;
 }
 
 CPktTimeWindow::~CPktTimeWindow()
 {
-   delete [] m_piPktWindow;
-   delete [] m_piPktReplica;
-   delete [] m_piProbeWindow;
-   delete [] m_piProbeReplica;
 }
 
 int CPktTimeWindow::getMinPktSndInt() const
@@ -207,37 +568,17 @@ int CPktTimeWindow::getMinPktSndInt() const
 
 int CPktTimeWindow::getPktRcvSpeed() const
 {
-   // get median value, but cannot change the original value order in the window
-   // 从 m_piPktWindow 数组复制数据到 m_piPktReplica 数组，不改变原数组的值顺序
-   std::copy(m_piPktWindow, m_piPktWindow + m_iAWSize - 1, m_piPktReplica);
-   // 排序获取中值
-   std::nth_element(m_piPktReplica, m_piPktReplica + (m_iAWSize / 2), m_piPktReplica + m_iAWSize - 1);
-   int median = m_piPktReplica[m_iAWSize / 2];
-
-   int count = 0;
-   int sum = 0;
-   // 上限值，中值乘以8
-   int upper = median << 3;
-   // 下限值，中值除以8
-   int lower = median >> 3;
+   // 中值
+   int median = m_PktWindow.median();
 
    // median filtering
-   // 中值滤波，去除过大或过小的值，降低因网络抖动或突发延迟对极端结果的影响
-   int* p = m_piPktWindow;
-   for (int i = 0, n = m_iAWSize; i < n; ++ i)
-   {
-      // 当前元素在上限和下限之间（有效值）
-      if ((*p < upper) && (*p > lower))
-      {
-         ++ count;
-         sum += *p;
-      }
-      ++ p;
-   }
+   // 中值滤波，只统计中值的1/8到8倍之间的值，降低因网络抖动或突发延迟对极端结果的影响
+   int64_t sum;
+   int count = m_PktWindow.range(median >> 3, median << 3, sum);
 
    // claculate speed, or return 0 if not enough valid value
    // 计算接收速度，如果有效值计数器大于数组大小的一半（即有效值足够多）
-   if (count > (m_iAWSize >> 1)){
+   if (count > (m_PktWindow.size() >> 1)){
       // 小数向上圆整成整数,每秒接收到多少个包
       return (int)ceil(1000000.0 / (sum / count));
    }
@@ -248,30 +589,14 @@ int CPktTimeWindow::getPktRcvSpeed() const
 
 int CPktTimeWindow::getBandwidth() const
 {
-   // get median value, but cannot change the original value order in the window
-   // 排序获取中值
-   std::copy(m_piProbeWindow, m_piProbeWindow + m_iPWSize - 1, m_piProbeReplica);
-   std::nth_element(m_piProbeReplica, m_piProbeReplica + (m_iPWSize / 2), m_piProbeReplica + m_iPWSize - 1);
-   int median = m_piProbeReplica[m_iPWSize / 2];
-
-   int count = 1;
-   int sum = median;
-   // 有效值的上下限
-   int upper = median << 3;
-   int lower = median >> 3;
+   // 中值
+   int median = m_ProbeWindow.median();
 
    // median filtering
-   // 中值滤波
-   int* p = m_piProbeWindow;
-   for (int i = 0, n = m_iPWSize; i < n; ++ i)
-   {
-      if ((*p < upper) && (*p > lower))
-      {
-         ++ count;
-         sum += *p;
-      }
-      ++ p;
-   }
+   // 中值滤波，中值本身额外计入一次
+   int64_t sum;
+   int count = m_ProbeWindow.range(median >> 3, median << 3, sum) + 1;
+   sum += median;
 
    // 每秒传输多少个数据包
    return (int)ceil(1000000.0 / (double(sum) / double(count)));
@@ -295,13 +620,7 @@ void CPktTimeWindow::onPktArrival()
 
    // record the packet interval between the current and the last one
    // 记录两个报文间的接收时间间隔,用于统计接收速度
-   *(m_piPktWindow + m_iPktWindowPtr) = int(m_CurrArrTime - m_LastArrTime);
-
-   // the window is logically circular
-   // 环形缓冲区
-   ++ m_iPktWindowPtr;
-   if (m_iPktWindowPtr == m_iAWSize)
-      m_iPktWindowPtr = 0;
+   m_PktWindow.push(int(m_CurrArrTime - m_LastArrTime));
 
    // remember last packet arrival time
    // 记录最后一个报文到达的时间
@@ -319,10 +638,128 @@ void CPktTimeWindow::probe2Arrival()
 
    // record the probing packets interval
    // 记录探测报文的包间隔
-   *(m_piProbeWindow + m_iProbeWindowPtr) = int(m_CurrArrTime - m_ProbeTime);
-   // the window is logically circular
-   // 环形缓冲区
-   ++ m_iProbeWindowPtr;
-   if (m_iProbeWindowPtr == m_iPWSize)
-      m_iProbeWindowPtr = 0;
+   m_ProbeWindow.push(int(m_CurrArrTime - m_ProbeTime));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHistogram::CHistogram():
+m_piBucket(NULL)
+{
+   clear();
+}
+
+CHistogram::~CHistogram()
+{
+   delete [] m_piBucket;
+}
+
+void CHistogram::record(int64_t value)
+{
+   if (value < 0)
+      value = 0;
+
+   // each histogram is recorded by a single worker thread, which is the only one allocating its buckets
+   // 每个直方图只由一个工作线程记录，也只由它分配桶数组
+   int64_t* bucket = m_piBucket;
+   if (NULL == bucket)
+   {
+      try
+      {
+         bucket = new int64_t[CPerfHist::m_iBuckets];
+      }
+      catch (...)
+      {
+         return;
+      }
+      memset(bucket, 0, sizeof(int64_t) * CPerfHist::m_iBuckets);
+
+      // publish the zeroed buckets before the pointer, perfmon2 reads it from another thread
+      // 先发布清零后的数组，再发布指针
+      #ifndef WIN32
+         __sync_synchronize();
+      #else
+         MemoryBarrier();
+      #endif
+      m_piBucket = bucket;
+   }
+
+   ++ bucket[CPerfHist::bucketOf(value)];
+
+   if ((0 == m_llCount) || (value < m_llMin))
+      m_llMin = value;
+   if (value > m_llMax)
+      m_llMax = value;
+   m_llSum += value;
+   ++ m_llCount;
+}
+
+void CHistogram::read(CPerfHist& hist) const
+{
+   const int64_t* bucket = buckets();
+   if (NULL != bucket)
+      memcpy(hist.bucket, bucket, sizeof(int64_t) * CPerfHist::m_iBuckets);
+   else
+      memset(hist.bucket, 0, sizeof(int64_t) * CPerfHist::m_iBuckets);
+   hist.count = m_llCount;
+   hist.usMin = m_llMin;
+   hist.usMax = m_llMax;
+   hist.usMean = (m_llCount > 0) ? double(m_llSum) / m_llCount : 0;
+   hist.usP50 = percentile(bucket, 0.5);
+   hist.usP90 = percentile(bucket, 0.9);
+   hist.usP99 = percentile(bucket, 0.99);
+   hist.usP999 = percentile(bucket, 0.999);
+}
+
+void CHistogram::clear()
+{
+   int64_t* bucket = (int64_t*)buckets();
+   if (NULL != bucket)
+      memset(bucket, 0, sizeof(int64_t) * CPerfHist::m_iBuckets);
+   m_llCount = 0;
+   m_llSum = 0;
+   m_llMin = 0;
+   m_llMax = 0;
+}
+
+const int64_t* CHistogram::buckets() const
+{
+   const int64_t* bucket = m_piBucket;
+
+   // pairs with the barrier in record(): the buckets are seen zeroed, never as raw memory
+   // 与record()中的屏障配对
+   #ifndef WIN32
+      __sync_synchronize();
+   #else
+      MemoryBarrier();
+   #endif
+
+   return bucket;
+}
+
+int64_t CHistogram::percentile(const int64_t* bucket, double ratio) const
+{
+   if ((NULL == bucket) || (0 == m_llCount))
+      return 0;
+
+   // the rank of the sample we are looking for, 1-based
+   // 目标样本的序号
+   int64_t rank = int64_t(ceil(ratio * m_llCount));
+   if (rank < 1)
+      rank = 1;
+
+   int64_t seen = 0;
+   for (int i = 0; i < CPerfHist::m_iBuckets; ++ i)
+   {
+      seen += bucket[i];
+      if (seen >= rank)
+      {
+         // report the upper edge of the bucket, but never beyond what was actually seen
+         // 取桶的上界，但不超过实际的最大值
+         int64_t high = CPerfHist::bucketHigh(i);
+         return (high < m_llMax) ? high : m_llMax;
+      }
+   }
+
+   return m_llMax;
 }
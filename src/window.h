@@ -78,20 +78,37 @@ public:
    // 在窗口中查找指定的 ACK-2 序列号，并计算往返时间 (RTT)
    int acknowledge(int32_t seq, int32_t& ack);
 
+      // Functionality:
+      //    Release the space grown for a past burst of outstanding ACKs.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   // 释放ACK突发时扩展的窗口空间
+   void shrink();
+
+private:
+   // 按新的大小重新排布仍在等待ACK-2的记录
+   void resize(int size);
+
 private:
-   // 记录序列号的数组
-   int32_t* m_piACKSeqNo;       // Seq. No. for the ACK packet
+   // 记录序列号的数组，以ACK序列号对窗口大小取模作为下标
+   int32_t* m_piACKSeqNo;       // Seq. No. for the ACK packet, indexed by the seq. no. modulo the window size; -1 if empty
    // 记录ACK的数组
    int32_t* m_piACK;            // Data Seq. No. carried by the ACK packet
    // 记录发送时间戳，用来计算RTT
    uint64_t* m_pTimeStamp;      // The timestamp when the ACK was sent
 
-   // 窗口大小
-   int m_iSize;                 // Size of the ACK history window
-   // 指向最新的包
-   int m_iHead;                 // Pointer to the lastest ACK record
-   // 指向最旧的包
-   int m_iTail;                 // Pointer to the oldest ACK record
+   // 窗口的当前大小，按需扩展
+   int m_iSize;                 // Current size of the ACK history window, grown on demand
+   // 窗口大小的上限
+   int m_iMaxSize;              // Largest size the window may grow to
+   // 最近一次被确认的ACK序列号，不再接受更早的ACK-2
+   int32_t m_iLastAck2;         // ACK seq. no. of the latest ACK-2; older ACK-2s are ignored, -1 if none
+
+   // 窗口的初始大小，空闲时收缩回这个大小
+   static const int m_iInitSize = 16;   // size allocated at first and kept while few ACKs are outstanding
 
 private:
    // 仅声明未实现，相当于禁用拷贝构造
@@ -102,6 +119,129 @@ private:
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// 滑动时间窗口内的最小值，只保存窗口内最好的三个样本（Kathleen Nichols算法），每次更新O(1)
+// Running minimum over a sliding time window (Kathleen Nichols' algorithm, as
+// used for BBR's and TCP's min-RTT): it keeps the best, second best and third
+// best samples of successive sub-windows, so an update is O(1).
+
+class CMinFilter
+{
+public:
+   CMinFilter(uint64_t window = 10000000);
+
+      // Functionality:
+      //    Add a sample.
+      // Parameters:
+      //    0) [in] value: the sample, must be positive.
+      //    1) [in] time: time of the sample, in microseconds.
+      // Returned value:
+      //    The minimum over the window.
+
+   // 加入一个样本
+   int update(int value, uint64_t time);
+
+   // 窗口内的最小值，0表示没有样本
+   int get() const {return m_aSample[0].m_iValue;}
+
+   void reset();
+
+private:
+   struct CSample
+   {
+      int m_iValue;
+      uint64_t m_ullTime;
+   };
+
+   CSample m_aSample[3];        // best, second best and third best samples
+   uint64_t m_ullWindow;        // window length, in microseconds
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// 固定长度的滑动窗口，新样本替换最老的样本，支持取中值和统计某个区间内样本的个数与总和
+// Sliding window of the last N samples, for the median and the count/sum of
+// the samples within a value range. Adding a sample is only a ring write. When
+// few samples arrive between two reads, the samples are kept ordered in an
+// indexable skip list whose links also carry the sum of the samples they skip,
+// so a read costs O(log n) per new sample. When most of the window is new
+// anyway, a read selects the median and scans the window in O(n) instead,
+// which is cheaper than maintaining the order.
+
+class CMedianWindow
+{
+public:
+   CMedianWindow(int size, int init);
+   ~CMedianWindow();
+
+      // Functionality:
+      //    Replace the oldest sample with a new one.
+      // Parameters:
+      //    0) [in] value: the new sample.
+      // Returned value:
+      //    None.
+
+   // 用新样本替换最老的样本，O(1)
+   void push(int value);
+
+      // Functionality:
+      //    Read the median of the window.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    the sample ranked size/2 in ascending order.
+
+   // 窗口内的中值
+   int median();
+
+      // Functionality:
+      //    Count the samples strictly between two bounds.
+      // Parameters:
+      //    0) [in] lower: lower bound, excluded.
+      //    1) [in] upper: upper bound, excluded.
+      //    2) [out] sum: sum of these samples.
+      // Returned value:
+      //    number of samples in (lower, upper).
+
+   // 统计(lower, upper)区间内样本的个数和总和
+   int range(int lower, int upper, int64_t& sum);
+
+   int size() const {return m_iSize;}
+
+private:
+   struct CLink
+   {
+      int m_iNext;              // next node on this level
+      int m_iWidth;             // rank distance to the next node
+      int64_t m_llSum;          // sum of the samples after this node, up to and including the next one
+   };
+
+   bool less(int a, int b) const {return (m_piValue[a] < m_piValue[b]) || ((m_piValue[a] == m_piValue[b]) && (a < b));}
+   bool sync();
+   void rebuild();
+   int below(int bound, int64_t& sum) const;
+   void insert(int node);
+   void remove(int node);
+
+private:
+   int m_iSize;                 // number of samples; node m_iSize is the head and m_iSize + 1 the tail
+   int m_iMaxLevel;             // number of levels of the head
+   int m_iPtr;                  // slot of the oldest sample
+   int m_iPending;              // number of samples pushed since the last read
+   bool m_bOrdered;             // if the list is up to date but for the last m_iPending samples
+   int* m_piSample;             // latest sample of each slot
+   int* m_piValue;              // sample of each slot as ordered in the list
+   int* m_piLevel;              // number of levels of each node
+   int* m_piLink;               // index of the first link of each node in m_pLink
+   CLink* m_pLink;              // links of all nodes, lowest level first
+   int64_t* m_pllScratch;       // scratch space to sort or select the samples
+
+private:
+   CMedianWindow(const CMedianWindow&);
+   CMedianWindow& operator=(const CMedianWindow&);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
 // 用于记录和估计数据包发送和接收时间信息的类。它提供了计算最小发送间隔、接收速度和带宽的功能
 class CPktTimeWindow
 {
@@ -180,23 +320,11 @@ public:
    void probe2Arrival();
 
 private:
-   // 接收速率统计窗口
-   int m_iAWSize;               // size of the packet arrival history window
-   // 指向一个int数组，记录两个报文间的接收时间间隔，以微秒为单位，用于计算接收速度和估算带宽
-   int* m_piPktWindow;          // packet information window
-   // m_piPktWindow的副本，避免直接操作m_piPktWindow
-   int* m_piPktReplica;
-   // 指向当前存储位置
-   int m_iPktWindowPtr;         // position pointer of the packet info. window.
-
-   // 探测报文窗口
-   int m_iPWSize;               // size of probe history window size
-   // 记录探测报文的包间隔
-   int* m_piProbeWindow;        // record inter-packet time for probing packet pairs
-   // m_piProbeWindow的副本，避免直接操作m_piProbeWindow
-   int* m_piProbeReplica;
-   // 指向当前存储位置
-   int m_iProbeWindowPtr;       // position pointer to the probing window
+   // 接收速率统计窗口，记录两个报文间的接收时间间隔，以微秒为单位，用于计算接收速度；读取时才排序，因此为mutable
+   mutable CMedianWindow m_PktWindow;   // packet arrival interval window, ordered when read
+
+   // 探测报文窗口，记录探测报文的包间隔，用于估算带宽
+   mutable CMedianWindow m_ProbeWindow; // inter-packet time of probing packet pairs, ordered when read
 
    // 最后一个数据包的发送时间
    int m_iLastSentTime;         // last packet sending time
@@ -215,4 +343,60 @@ private:
 };
 
 
+
+// 延迟直方图，记录样本并生成CPerfHist快照
+// 桶数组在第一个样本到来时才分配，空闲连接不占用这部分内存
+// The bucket array is allocated by the first record(), so idle sockets do not pay for it.
+class CHistogram
+{
+public:
+   CHistogram();
+   ~CHistogram();
+
+      // Functionality:
+      //    Record one sample. The sample is dropped if the buckets cannot be allocated.
+      // Parameters:
+      //    0) [in] value: sample value, in microseconds; negative values are counted as 0.
+      // Returned value:
+      //    None.
+
+   // 记录一个样本
+   void record(int64_t value);
+
+      // Functionality:
+      //    Export the histogram together with its summary statistics.
+      // Parameters:
+      //    0) [out] hist: the snapshot.
+      // Returned value:
+      //    None.
+
+   // 导出直方图及其统计值
+   void read(CPerfHist& hist) const;
+
+      // Functionality:
+      //    Drop all samples.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   // 清空所有样本
+   void clear();
+
+private:
+   int64_t percentile(const int64_t* bucket, double ratio) const;
+   const int64_t* buckets() const;
+
+private:
+   int64_t* volatile m_piBucket;                // sample counter of each bucket, NULL until the first sample
+   int64_t m_llCount;                           // number of samples
+   int64_t m_llSum;                             // sum of all samples
+   int64_t m_llMin;                             // smallest sample
+   int64_t m_llMax;                             // largest sample
+
+private:
+   CHistogram(const CHistogram&);
+   CHistogram& operator=(const CHistogram&);
+};
+
 #endif